@@ -248,20 +248,18 @@ static void print_operand(char *prefix, pka_operand_t *operand, char *suffix)
 }
 #endif
 
-static void pka_wait_for_results(pka_handle_t handle, pka_results_t *results)
+static int pka_wait_for_results(pka_handle_t handle, pka_results_t *results)
 {
-    // *TBD*
-    // This is weak! We should define a timer here, so that we don't
-    // get stuck indefinitely when the test fails to retrieve a result.
-    while (true)
-    {
-        if (!pka_get_result(handle, results))
-            break;
+    int ret;
 
-        // Wait for a short while (~50 cycles) between attempts to get
-        // the result
-        pka_wait();
-    }
+    // Let the library spin, yield and then sleep on the completion fd of
+    // the handle, so that we don't get stuck indefinitely when we fail to
+    // retrieve a result.
+    ret = pka_wait_result(handle, results, PKA_ENGINE_WAIT_TIMEOUT_US, NULL);
+    if (ret)
+        PKA_ERROR(PKA_TESTS, "pka_wait_result failed, error=%d\n", ret);
+
+    return ret;
 }
 
 static void init_results_operand(pka_results_t *results,
@@ -307,7 +305,9 @@ static pka_operand_t *results_to_operand(pka_handle_t handle)
     memset(&results, 0, sizeof(pka_results_t));
     init_results_operand(&results, 1, res1, MAX_BYTE_LEN, NULL, 0);
 
-    pka_wait_for_results(handle, &results);
+    if (pka_wait_for_results(handle, &results))
+        return NULL;
+
     if (results.status != RC_NO_ERROR)
     {
         PKA_ERROR(PKA_TESTS, "pka_get_result status=0x%x\n", results.status);
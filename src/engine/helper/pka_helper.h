@@ -63,6 +63,8 @@ extern "C" {
 #define PKA_ENGINE_QUEUE_CNT        4
 #define PKA_ENGINE_RING_CNT         8
 
+#define PKA_ENGINE_WAIT_TIMEOUT_US  (5 * 1000 * 1000) // 5 seconds.
+
 #define PKA_ENGINE_INSTANCE_NAME    "SSL engine"
 
 #define PKA_MAX_OBJS                 32       // 32  objs
@@ -158,6 +158,26 @@ static inline void pka_atomic64_init(pka_atomic64_t *atom, uint64_t val)
 #endif
 }
 
+// Load value of atomic uint64 variable. Return Value of the variable
+static inline uint64_t pka_atomic64_load(pka_atomic64_t *atom)
+{
+#if __GCC_ATOMIC_LLONG_LOCK_FREE < 2
+    return ATOMIC_OP(atom, (void)0);
+#else
+    return __atomic_load_n(&atom->v, __ATOMIC_RELAXED);
+#endif
+}
+
+// Store value of atomic uint64 variable
+static inline void pka_atomic64_store(pka_atomic64_t *atom, uint64_t val)
+{
+#if __GCC_ATOMIC_LLONG_LOCK_FREE < 2
+    (void)ATOMIC_OP(atom, atom->v = val);
+#else
+    __atomic_store_n(&atom->v, val, __ATOMIC_RELAXED);
+#endif
+}
+
 // Atomic fetch and add of 64-bit atomic variable. Return Value of the atomic
 // variable before the addition
 static inline uint64_t _pka_atomic64_fetch_add_relaxed(pka_atomic64_t *atom,
@@ -222,6 +242,18 @@ static inline void pka_atomic64_dec(pka_atomic64_t *atom)
 
 // 32-bit operations in non-RELAXED memory ordering
 
+// Load value of atomic uint32 variable using ACQUIRE memory ordering
+static inline uint32_t pka_atomic32_load_acq(pka_atomic32_t *atom)
+{
+    return __atomic_load_n(&atom->v, __ATOMIC_ACQUIRE);
+}
+
+// Store value of atomic uint32 variable using RELEASE memory ordering
+static inline void pka_atomic32_store_rel(pka_atomic32_t *atom, uint32_t val)
+{
+    __atomic_store_n(&atom->v, val, __ATOMIC_RELEASE);
+}
+
 // Compare and swap atomic uint32 variable using ACQUIRE-and-RELEASE memory
 // ordering
 static inline int pka_atomic32_cas_acq_rel(pka_atomic32_t *atom,
@@ -234,6 +266,21 @@ static inline int pka_atomic32_cas_acq_rel(pka_atomic32_t *atom,
                        __ATOMIC_RELAXED);
 }
 
+// Try to take a spin lock held in an atomic uint32 variable. Returns 1 if the
+// lock was taken, 0 if it is held by someone else.
+static inline int pka_spin_trylock(pka_atomic32_t *lock)
+{
+    uint32_t unlocked = 0;
+
+    return pka_atomic32_cas_acq_rel(lock, &unlocked, 1);
+}
+
+// Release a spin lock held in an atomic uint32 variable.
+static inline void pka_spin_unlock(pka_atomic32_t *lock)
+{
+    pka_atomic32_store_rel(lock, 0);
+}
+
 // Compare and swap atomic uint64 variable using ACQUIRE-and-RELEASE memory
 // ordering
 static inline int pka_atomic64_cas_acq_rel(pka_atomic64_t *atom,
@@ -261,7 +308,8 @@ typedef enum
     LOCK_BIT_SET      =  0,
 } pka_lock_t;
 
-// Functions below are implemented in the assembler file (pka_lock.S)
+// Functions below are implemented in the assembler file (pka_lock.S). Other
+// architectures get an equivalent implementation based on compiler builtins.
 
 // The following function will try to acquire the lock by atomically setting the
 // bottom byte of the "lock" to its thread number "num + 1" (allowing for the
@@ -282,7 +330,32 @@ typedef enum
 // return 0 if the lock was NOT acquired but the thread bit was set (which
 // implies "set_bit" is TRUE).  Finally it will return -1 if the lock was NOT
 // acquired AND the thread bit was not set because "set_bit" was FALSE.
+#ifdef __aarch64__
 int pka_try_acquire_lock(uint64_t *lock_v, uint32_t num, bool set_bit);
+#else
+static inline int pka_try_acquire_lock(uint64_t *lock_v,
+                                       uint32_t  num,
+                                       bool      set_bit)
+{
+    uint64_t old_v, new_v;
+
+    old_v = __atomic_load_n(lock_v, __ATOMIC_RELAXED);
+    do
+    {
+        if ((old_v & 0xFF) == 0)
+            new_v = old_v | (num + 1);
+        else
+            new_v = old_v | ((uint64_t) set_bit << (num + 8));
+    } while (!__atomic_compare_exchange_n(lock_v, &old_v, new_v, true,
+                                          __ATOMIC_ACQ_REL,
+                                          __ATOMIC_RELAXED));
+
+    if ((old_v & 0xFF) == 0)
+        return 1;
+
+    return (int) set_bit - 1;
+}
+#endif
 
 // The following function will try to release the lock by atomically setting
 // the bottom byte of the lock_word to 0. However this will fail if any of the
@@ -291,6 +364,58 @@ int pka_try_acquire_lock(uint64_t *lock_v, uint32_t num, bool set_bit);
 //
 // Return -1 if the lock was released.  Otherwise return the thread_num
 // corresponding to ONE of the set request bits and clr this bit.
+#ifdef __aarch64__
 int pka_try_release_lock(uint64_t *lock_v, uint32_t num);
+#else
+static inline int pka_try_release_lock(uint64_t *lock_v, uint32_t num)
+{
+    uint64_t old_v, new_v, req_bits;
+    int      bit;
+
+    old_v = __atomic_load_n(lock_v, __ATOMIC_RELAXED);
+    do
+    {
+        req_bits = old_v & ~((uint64_t) 0xFF);
+        if (req_bits == 0)
+        {
+            bit   = -1;
+            new_v = 0;
+        }
+        else
+        {
+            bit   = 63 - __builtin_clzll(req_bits);
+            new_v = old_v & ~((uint64_t) 1 << bit);
+        }
+    } while (!__atomic_compare_exchange_n(lock_v, &old_v, new_v, true,
+                                          __ATOMIC_ACQ_REL,
+                                          __ATOMIC_RELAXED));
+
+    return (bit < 0) ? -1 : bit - 8;
+}
+#endif
+
+// The following function releases the lock whether or not any of the
+// dedicated "request" bits are set, by atomically clearing the bottom byte
+// of the lock_word along with the request bits of the thread numbers which
+// are not in "keep_mask". It is meant for a lock owner which leaves the
+// pending requests to other threads; the request bits kept are seen by the
+// next owner, which serves them before it releases the lock.
+//
+// Return the bitmask of the thread numbers whose request bit was cleared.
+static inline uint64_t pka_force_release_lock(uint64_t *lock_v,
+                                              uint64_t  keep_mask)
+{
+    uint64_t old_v, new_v;
+
+    old_v = __atomic_load_n(lock_v, __ATOMIC_RELAXED);
+    do
+    {
+        new_v = old_v & (keep_mask << 8);
+    } while (!__atomic_compare_exchange_n(lock_v, &old_v, new_v, true,
+                                          __ATOMIC_ACQ_REL,
+                                          __ATOMIC_RELAXED));
+
+    return (old_v >> 8) & ~keep_mask;
+}
 
 #endif // __PKA_ATOMIC_H__
@@ -36,9 +36,14 @@
 
 #include "pka_atomic.h"
 
+#ifdef __aarch64__
 // ARMv8 Assembler code to implement memory barrier:
 
 #define dmb(opt)  ({ asm volatile("dmb " #opt : : : "memory"); })
+#else
+// Other architectures fall back to a full (sequentially consistent) fence.
+#define dmb(opt)  __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
 
 // General memory barrier. Guarantees that the LOAD and STORE operations
 // generated before the barrier occur before the LOAD and STORE operations
@@ -69,9 +74,20 @@ static inline void pka_mb_full(void)
     __atomic_thread_fence(__ATOMIC_SEQ_CST);
 }
 
+#ifdef __aarch64__
 // CPU pause -i.e. wait for few CPU cycles. This function is implemented in the
 // assembler file (pka_lock.S)
 void pka_wait();
+#else
+// CPU pause -i.e. wait for few CPU cycles.
+static inline void pka_wait(void)
+{
+    volatile uint32_t cnt;
+
+    for (cnt = 50; cnt > 0; cnt--)
+        ;
+}
+#endif
 
 // PKA thread synchronization barrier
 typedef struct
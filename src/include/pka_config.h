@@ -68,19 +68,41 @@
 
 // PKA Window RAM parameters.
 // Define whether to split or not Window RAM during PKA device creation phase.
+// When split, each ring gets its own window RAM region of PKA_RING_MEM_1_SIZE
+// bytes, PKA_RING_MEM_1_SPACING apart; otherwise rings share the contiguous
+// window RAM, each with PKA_RING_MEM_0_SIZE bytes. The mode may be selected
+// at build time, e.g. -DPKA_SPLIT_WINDOW_RAM_MODE=1.
 #define SPLIT_WINDOW_RAM_MODE_ENABLED        1
 #define SPLIT_WINDOW_RAM_MODE_DISABLED       0
+#ifndef PKA_SPLIT_WINDOW_RAM_MODE
 #define PKA_SPLIT_WINDOW_RAM_MODE            SPLIT_WINDOW_RAM_MODE_DISABLED
-// Defines for Window RAM partition. It is valid for 16K memory.
+#endif
+// Defines for Window RAM partition. It is valid for 16K memory. This is the
+// default partition; the data memory size may be chosen per ring at setup
+// time, the descriptor rings getting the remaining memory. The data memory
+// size must be a multiple of the partition alignment, and hold at least the
+// operands of the largest command.
 #define PKA_WINDOW_RAM_RING_MEM_SIZE         0x0800 //  2KB
 #define PKA_WINDOW_RAM_DATA_MEM_SIZE         0x3800 // 14KB
+#define PKA_WINDOW_RAM_DATA_MEM_MIN_SIZE     0x1000 //  4KB
+#define PKA_WINDOW_RAM_PARTITION_ALIGN       0x0100 // 256B
+
+// Depth of the command and result descriptor rings, i.e. the number of
+// commands a ring can keep in flight. The depth is chosen when a ring is
+// initialized; both descriptor rings must fit in the ring memory and the HW
+// does not support more than 64K descriptors per ring.
+#define PKA_RING_NUM_CMD_DESC_MIN            1
+#define PKA_RING_NUM_CMD_DESC_MAX            0x10000
+#define PKA_RING_NUM_CMD_DESC                16
 
 // Macro for mapping PKA Ring address into Window RAM address. It converts the
 // ring address, either physical address or virtual address, to valid address
-// into the Window RAM. This is done assuming the Window RAM base and size.
+// into the Window RAM. This is done assuming the Window RAM base and the size
+// of the ring region: split regions are PKA_RING_MEM_1_SPACING (64KB) apart,
+// and the region index selects the 'size' bytes slot of the ring.
 #define PKA_RING_MEM_ADDR(addr, size) \
     (PKA_WINDOW_RAM_BASE | (((addr) & 0xffff) | \
-        ((((addr) & ~((size) - 1)) & 0xf0000) >> 2)))
+        (((((addr) & ~((size) - 1)) & 0xf0000) >> 16) * (size))))
 
 // PKA Master Sequencer Control/Status Register
 //  Write '1' to bit [31] puts the Master controller Sequencer in a reset
@@ -130,7 +152,12 @@
 #define PKA_FIXED_PRIORITY                      0x1
 #define PKA_RING_0_HAS_THE_HIGHEST_PRIORITY     0x2
 #define PKA_RESERVED                            0x3
+// Build with PKA_RING_OPTIONS_PRIORITY=PKA_RING_0_HAS_THE_HIGHEST_PRIORITY
+// to have the ring reserved for high priority commands - PKA_F_PRIORITY_RING
+// - served first by its EIP-154.
+#ifndef PKA_RING_OPTIONS_PRIORITY
 #define PKA_RING_OPTIONS_PRIORITY               PKA_FULL_ROTATING_PRIORITY
+#endif
 
 // 'Signature' byte used because the ring options are transferred through RAM
 // which does not have a defined reset value.  The EIP-154  master controller
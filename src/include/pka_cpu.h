@@ -46,7 +46,9 @@
 
 #include "pka_common.h"
 
+#ifdef __aarch64__
 #define PKA_AARCH_64
+#endif
 #define MAX_CPU_NUMBER 16      // BlueField specific
 
 #define MEGA 1000000
@@ -64,12 +66,19 @@
 //#define CPU_HZ_MAX      (2 * GIGA) // Cortex A72 : 2 GHz max -> 2.5 GHz max
 #define CPU_HZ_MAX        (1255 * MEGA) // CPU Freq for High/Bin Chip
 
+#ifdef PKA_AARCH_64
 // YIELD hints the CPU to switch to another thread if possible
 // and executes as a NOP otherwise.
 #define pka_cpu_yield() ({ asm volatile("yield" : : : "memory"); })
 // ISB flushes the pipeline, then restarts. This is guaranteed to
 // stall the CPU a number of cycles.
 #define pka_cpu_relax() ({ asm volatile("isb" : : : "memory"); })
+#else
+// Non-ARM hosts (e.g. when running over simulated rings) only get a
+// compiler barrier.
+#define pka_cpu_yield() ({ asm volatile("" : : : "memory"); })
+#define pka_cpu_relax() ({ asm volatile("" : : : "memory"); })
+#endif
 
 #ifdef __KERNEL__
 // Processor speed in hertz; used in routines which might be called very
@@ -98,6 +107,7 @@ static inline uint64_t pka_cpu_hz_max(void)
     return pka_cpu_hz_max_id(0);
 }
 
+#ifdef PKA_AARCH_64
 /// Read the system counter frequency
 static inline uint64_t pka_cpu_rdfrq(void)
 {
@@ -115,6 +125,7 @@ static inline uint64_t pka_cpu_rdvct(void)
     asm volatile("mrs %0, cntvct_el0" : "=r" (vct));
     return vct;
 }
+#endif
 
 /// Return current CPU cycle count. Cycle count may not be reset at PKA init
 /// and thus may wrap back to zero between two calls. Use pka_cpu_cycles_max()
@@ -31,6 +31,8 @@
 //   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //
 
+#define _GNU_SOURCE
+
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/mman.h>
@@ -44,6 +46,11 @@
 #include <errno.h>
 #include <pthread.h>
 #include <sys/wait.h>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <sched.h>
+#include <time.h>
 
 #include "pka_internal.h"
 #include "pka_utils.h"
@@ -52,10 +59,20 @@
 
 #define PKA_INVALID_OPERANDS    0x0
 
+// Serializes the routing of the ring interrupts - see pka_get_result_fd().
+static pthread_mutex_t pka_irq_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int  pka_progress_start(pka_global_info_t *gbl_info);
+static void pka_progress_stop(pka_global_info_t *gbl_info);
+static void pka_drain_lane(pka_global_info_t *gbl_info, pka_worker_t *worker);
+static void pka_rslt_queue_lock(pka_worker_t *worker);
+static void pka_rslt_queue_unlock(pka_worker_t *worker);
+static uint32_t pka_flush_cmd_queues(pka_local_info_t *local_info);
 
 // Start statistics counters. Returns the command number associated with
-// a statistic entry.
-static __pka_inline uint32_t pka_stats_start_cycles_cnt(uint32_t queue_num)
+// a statistic entry. The entries of a shared handle are taken atomically.
+static __pka_inline uint32_t pka_stats_start_cycles_cnt(uint32_t queue_num,
+                                                        bool     shared)
 {
     pka_cmd_stats_db_t *stats_db;
     pka_cmd_stats_t    *stats_entry;
@@ -63,7 +80,10 @@ static __pka_inline uint32_t pka_stats_start_cycles_cnt(uint32_t queue_num)
 
     stats_db    = &pka_cmd_stats_db[queue_num];
 
-    cmd_num     =  stats_db->index++;
+    if (shared)
+        cmd_num = __atomic_fetch_add(&stats_db->index, 1, __ATOMIC_RELAXED);
+    else
+        cmd_num = stats_db->index++;
     stats_entry = &stats_db->cmd_stats[cmd_num];
 
     stats_entry->start_cycles = pka_cpu_cycles();
@@ -140,6 +160,32 @@ static __pka_inline void pka_stats_processing_cycles_cnt(uint8_t queue_num,
     }
 }
 
+// Record the cost of a command, in work units.
+static __pka_inline void pka_stats_cost_units(uint8_t  queue_num,
+                                              uint32_t cmd_num,
+                                              uint64_t cost_units)
+{
+    pka_cmd_stats_db_t *stats_db;
+    pka_cmd_stats_t    *stats_entry;
+
+    stats_db    = &pka_cmd_stats_db[queue_num];
+    stats_entry = &stats_db->cmd_stats[cmd_num];
+
+    stats_entry->cost_units = cost_units;
+}
+
+// Set the dispatch information of a command about to be appended to a HW
+// ring, which is carried by the ring tag - see pka_ring_push_tag().
+static __pka_inline void pka_stats_ring_cost(pka_global_info_t    *gbl_info,
+                                             pka_queue_cmd_desc_t *cmd_desc,
+                                             pka_ring_cost_t      *cost)
+{
+    cost->enqueue_time = pka_cpu_cycles();
+    cost->cost_units   = cmd_desc->cost_units;
+    cost->hw_cost      = pka_dispatch_hw_cost(&gbl_info->dispatch,
+                                              cmd_desc->cost_units);
+}
+
 // Return Rings byte order, whether BE(1) or LE(0).
 uint8_t pka_get_rings_byte_order(pka_handle_t handle)
 {
@@ -199,18 +245,21 @@ static uint8_t *pka_mmap_shmem(int shmem_fd, size_t size)
     if (shmem_ptr == MAP_FAILED)
         return NULL;
 
-    memset(shmem_ptr, 0, size);
-
+    // The object is new - see pka_open_shmem() - hence reads as zeros. The
+    // memory of the queues of a worker is only touched once its slot is used
+    // for the first time, see pka_alloc_slot().
     return shmem_ptr;
 }
 
 // Determine the size of memory shared object.
 static uint32_t pka_get_memsize(uint8_t cnt, uint32_t cmd_queue_size,
+                                    uint32_t small_queue_size,
                                     uint32_t result_queue_size)
 {
     uint32_t mem_size;
 
     mem_size  = cmd_queue_size;
+    mem_size += 2 * small_queue_size;
     mem_size += result_queue_size;
     mem_size *= cnt;
     mem_size += sizeof(pka_global_info_t);
@@ -219,56 +268,292 @@ static uint32_t pka_get_memsize(uint8_t cnt, uint32_t cmd_queue_size,
     return mem_size;
 }
 
-// Initialize worker.
-static void pka_init_worker_queues(pka_global_info_t *info, uint32_t queues_cnt)
+// Split the rings into lanes, one per worker, in lane mode - see
+// PKA_F_LANE_MODE. The lanes take the last rings, and consecutive rings
+// of a lane mostly belong to the same EIP-154. The first 'pool_rings_cnt'
+// rings remain shared under the lock.
+static void pka_reserve_lanes(pka_global_info_t *info)
+{
+    uint32_t lanes_cnt, lane_rings_cnt;
+
+    info->pool_rings_cnt = info->rings_cnt;
+    info->lane_rings_cnt = 0;
+    info->lanes_cnt      = 0;
+
+    if (!(info->flags & PKA_F_LANE_MODE)          ||
+            (info->flags & PKA_F_SYNC_MODE_DISABLE) ||
+            (info->flags & PKA_F_PROGRESS_THREAD)   ||
+            (info->flags & PKA_F_SHARED_HANDLES)    ||
+            !info->queues_cnt || info->rings_cnt < 2)
+        return;
+
+    if (info->rings_cnt >= info->queues_cnt)
+    {
+        lanes_cnt      = info->queues_cnt;
+        lane_rings_cnt = info->rings_cnt / info->queues_cnt;
+    }
+    else
+    {
+        lanes_cnt      = info->rings_cnt - 1;
+        lane_rings_cnt = 1;
+    }
+
+    info->pool_rings_cnt = info->rings_cnt - lanes_cnt * lane_rings_cnt;
+    info->lane_rings_cnt = lane_rings_cnt;
+    info->lanes_cnt      = lanes_cnt;
+
+    PKA_DEBUG(PKA_USER, "%u lanes of %u rings, %d rings shared\n", lanes_cnt,
+                    lane_rings_cnt, info->pool_rings_cnt);
+}
+
+// Reserve a ring for high priority commands, if requested and if there are
+// other rings left for the commands of normal priority. The first ring of an
+// EIP-154 is preferred, since the EIP-154 may serve it first. The reserved
+// ring is moved to the last index of the shared rings, so that the ring
+// selection policies only have to look at the first 'shared_rings_cnt' rings.
+static void pka_reserve_prio_ring(pka_global_info_t *info)
+{
+    pka_ring_info_t ring;
+    uint8_t         ring_idx, last_idx;
+
+    info->shared_rings_cnt = info->pool_rings_cnt;
+    info->prio_ring        = PKA_PRIORITY_RING_NONE;
+
+    if (!(info->flags & PKA_F_PRIORITY_RING) || info->pool_rings_cnt < 2)
+        return;
+
+    last_idx = info->pool_rings_cnt - 1;
+    for (ring_idx = 0; ring_idx < last_idx; ring_idx++)
+    {
+        if (info->rings[ring_idx].ring_id % PKA_MAX_NUM_IO_BLOCK_RINGS == 0)
+            break;
+    }
+
+    if (ring_idx != last_idx)
+    {
+        ring                      = info->rings[ring_idx];
+        info->rings[ring_idx]     = info->rings[last_idx];
+        info->rings[last_idx]     = ring;
+        info->rings[ring_idx].idx = ring_idx;
+        info->rings[last_idx].idx = last_idx;
+    }
+
+    info->shared_rings_cnt = last_idx;
+    info->prio_ring        = last_idx;
+
+    PKA_DEBUG(PKA_USER, "ring %d reserved for high priority commands\n",
+                    info->rings[last_idx].ring_id);
+}
+
+// Size the credits of the instance from the descriptors of its rings - see
+// pka_acquire_credits().
+static void pka_init_credits(pka_global_info_t *info)
+{
+    uint32_t descs_cnt;
+    uint8_t  ring_idx;
+
+    descs_cnt = 0;
+    for (ring_idx = 0; ring_idx < info->rings_cnt; ring_idx++)
+        descs_cnt += info->rings[ring_idx].ring_desc.num_descs;
+
+    info->credits_max = descs_cnt * PKA_CREDITS_PER_DESC;
+    pka_atomic32_init(&info->credits, info->credits_max);
+}
+
+// Initialize the owner of the lock of the instance. Its work is unbounded
+// until pka_set_owner_budget() is called.
+static void pka_init_owner(pka_global_info_t *info)
+{
+    pka_owner_t *owner;
+    uint32_t     bucket;
+
+    owner            = &info->owner;
+    owner->max_cmds  = 0;
+    owner->max_ticks = 0;
+    owner->acquired  = 0;
+    pka_atomic64_init(&owner->holds, 0);
+    pka_atomic64_init(&owner->handoffs, 0);
+    for (bucket = 0; bucket < PKA_HOLD_HIST_BUCKETS; bucket++)
+        pka_atomic64_init(&owner->hold_hist[bucket], 0);
+}
+
+// Initialize the worker of a slot, the first time the slot is used.
+static void pka_init_worker(pka_global_info_t *info, uint8_t worker_idx)
 {
     pka_worker_t *worker;
-    uint32_t      cmd_queue_size, rslt_queue_size;
-    uint8_t       worker_idx;
+    uint32_t      cmd_queue_size, small_queue_size, rslt_queue_size;
+    uint32_t      cmd_queue_flags, cmd_queues_size;
     uint8_t      *mem_ptr;
 
     // Create FIFO queues to append command descriptors and get result
     // descriptors. These queues aims to handle hardware rings overflow.
     cmd_queue_size     = info->cmd_queue_size;
+    small_queue_size   = info->small_queue_size;
     rslt_queue_size    = info->rslt_queue_size;
-
-    mem_ptr = info->mem_ptr;
-
+    cmd_queues_size    = cmd_queue_size + 2 * small_queue_size;
 
     // Instead of allocating contiguous command and result queues, we opt
     // for a first pool with all command queues, and a second pool with the
     // result queues.
+    mem_ptr = info->mem_ptr + worker_idx * cmd_queues_size;
+
+    // The threads sharing a handle enqueue their commands concurrently.
+    cmd_queue_flags = PKA_QUEUE_TYPE_CMD;
+    if (info->flags & PKA_F_SHARED_HANDLES)
+        cmd_queue_flags |= PKA_QUEUE_F_MP;
+
+    worker = &info->workers[worker_idx];
+
+    // Create command SW queues, one per class.
+    worker->cmd_queues[PKA_CMD_CLASS_LARGE] =
+            pka_queue_create(cmd_queue_size, cmd_queue_flags, mem_ptr);
+    mem_ptr += cmd_queue_size;
+
+    worker->cmd_queues[PKA_CMD_CLASS_SMALL] =
+            pka_queue_create(small_queue_size, cmd_queue_flags, mem_ptr);
+    mem_ptr += small_queue_size;
+
+    worker->cmd_queues[PKA_CMD_CLASS_HIGH] =
+            pka_queue_create(small_queue_size, cmd_queue_flags, mem_ptr);
+
+    // Create result SW queue.
+    mem_ptr = info->mem_ptr + info->queues_cnt * cmd_queues_size +
+                    worker_idx * rslt_queue_size;
+    worker->rslt_queue = pka_queue_create(rslt_queue_size,
+                                            PKA_QUEUE_TYPE_RSLT, mem_ptr);
+
+    // Give the worker its lane of rings, if any.
+    worker->lane_idx = 0;
+    worker->lane_cnt = 0;
+    if (worker_idx < info->lanes_cnt)
+    {
+        worker->lane_idx = info->pool_rings_cnt +
+                                worker_idx * info->lane_rings_cnt;
+        worker->lane_cnt = info->lane_rings_cnt;
+    }
+    pka_atomic32_init(&worker->rslt_lock, 0);
+    pka_atomic32_init(&worker->lane_lock, 0);
+}
 
-    // Create contiguous command queues.
-    for (worker_idx = 0; worker_idx < queues_cnt; worker_idx++)
+// Reset the state of the worker of a slot, before a handle takes the slot.
+// The queues and the lane of the slot are kept.
+static void pka_reset_worker(pka_worker_t *worker)
+{
+    worker->weight       = 1;
+    worker->deficit      = 0;
+    worker->drr_turn     = false;
+    worker->served_cmds  = 0;
+    worker->served_bytes = 0;
+    worker->delay        = 0;
+    worker->max_delay    = 0;
+    worker->stolen_cmds  = 0;
+    worker->stolen_delay = 0;
+    worker->orphans      = 0;
+    pka_atomic32_init(&worker->stolen, 0);
+    pka_atomic32_init(&worker->rslt_fd, (uint32_t) -1);
+}
+
+// Drop the results which arrived for the slots released with results pending,
+// and give back those which have none left. The results of the lane of such
+// a slot are moved first, no other handle does it. The caller holds the lock
+// of the slots.
+static void pka_reclaim_slots(pka_global_info_t *gbl_info)
+{
+    pka_worker_t *worker;
+    uint64_t      orphans_mask;
+    uint8_t       worker_idx;
+
+    orphans_mask = gbl_info->orphans_mask;
+    while (orphans_mask)
     {
-        worker = &info->workers[worker_idx];
+        worker_idx    = __builtin_ctzll(orphans_mask);
+        orphans_mask &= orphans_mask - 1;
+        worker        = &gbl_info->workers[worker_idx];
+
+        if (worker->lane_cnt)
+            pka_drain_lane(gbl_info, worker);
 
-        // Create command SW queue.
-        worker->cmd_queue  = pka_queue_create(cmd_queue_size,
-                                                PKA_QUEUE_TYPE_CMD, mem_ptr);
+        while (worker->orphans &&
+                    !pka_queue_rslt_discard(worker->rslt_queue))
+            worker->orphans -= 1;
 
-        // increment memory pointer.
-        mem_ptr      += cmd_queue_size;
+        if (!worker->orphans)
+        {
+            gbl_info->orphans_mask &= ~((uint64_t) 1 << worker_idx);
+            gbl_info->slots_mask   &= ~((uint64_t) 1 << worker_idx);
+        }
     }
+}
+
+// Allocate the lowest worker slot free, and create its queues if it is used
+// for the first time. The slots of the terminated handles are reused once
+// the results of their commands in flight are dropped. Returns the slot, or
+// -1 if all are in use.
+static int pka_alloc_slot(pka_global_info_t *gbl_info)
+{
+    uint64_t free_mask;
+    int      worker_idx;
+
+    while (!pka_spin_trylock(&gbl_info->slots_lock))
+        pka_cpu_relax();
 
-    // Create contiguous result queues.
-    for (worker_idx = 0; worker_idx < queues_cnt; worker_idx++)
+    pka_reclaim_slots(gbl_info);
+
+    free_mask  = ~gbl_info->slots_mask;
+    free_mask &= ((uint64_t) 1 << gbl_info->queues_cnt) - 1;
+    worker_idx = -1;
+    if (free_mask)
     {
-        worker = &info->workers[worker_idx];
+        worker_idx            = __builtin_ctzll(free_mask);
+        gbl_info->slots_mask |= (uint64_t) 1 << worker_idx;
 
-        // Create result SW queue.
-        worker->rslt_queue = pka_queue_create(rslt_queue_size,
-                                                PKA_QUEUE_TYPE_RSLT, mem_ptr);
+        // The slots below the lowest free one are all in use, so the slots
+        // whose queues are created remain contiguous.
+        pka_reset_worker(&gbl_info->workers[worker_idx]);
+        if (worker_idx == (int) pka_atomic32_load(&gbl_info->slots_cnt))
+        {
+            pka_init_worker(gbl_info, worker_idx);
+            pka_atomic32_store_rel(&gbl_info->slots_cnt, worker_idx + 1);
+        }
 
-        // increment memory pointer.
-        mem_ptr      += rslt_queue_size;
+        pka_atomic32_inc(&gbl_info->workers_cnt);
     }
+
+    pka_spin_unlock(&gbl_info->slots_lock);
+    return worker_idx;
+}
+
+// Release the worker slot of a handle. Its commands left in the SW command
+// queues are dropped, so that they do not reach the rings, and so are its
+// results left in the SW result queue; if commands are still in flight, the
+// slot is only reused once their results are dropped as well - see
+// pka_reclaim_slots().
+static void pka_free_slot(pka_local_info_t *local_info)
+{
+    pka_global_info_t *gbl_info;
+    pka_worker_t      *worker;
+    uint32_t           pending, dropped;
+
+    gbl_info = local_info->gbl_info;
+    worker   = &gbl_info->workers[local_info->id];
+
+    dropped  = pka_flush_cmd_queues(local_info);
+    pending  = local_info->req_num - MIN(dropped, local_info->req_num);
+
+    while (!pka_spin_trylock(&gbl_info->slots_lock))
+        pka_cpu_relax();
+
+    worker->orphans         = pending;
+    gbl_info->orphans_mask |= (uint64_t) 1 << local_info->id;
+    pka_reclaim_slots(gbl_info);
+
+    pka_atomic32_dec(&gbl_info->workers_cnt);
+    pka_spin_unlock(&gbl_info->slots_lock);
 }
 
 // Global PKA initialization.
 pka_instance_t pka_init_global(const char *name,
-                               uint8_t     flags,
+                               uint32_t    flags,
                                uint32_t    ring_cnt,
                                uint32_t    queue_cnt,
                                uint32_t    cmd_queue_size,
@@ -278,13 +563,18 @@ pka_instance_t pka_init_global(const char *name,
     uint32_t        shmem_size;
     uint8_t        *shmem_ptr;
     char            shmem_name[PKA_SHMEM_NAME_SIZE];
+    uint32_t        small_queue_size;
     int             shmem_fd;
     int             ret;
 
     if ((!flags) || (cmd_queue_size > PKA_QUEUE_MASK_SIZE)  ||
             (result_queue_size > PKA_QUEUE_MASK_SIZE)  ||
             (ring_cnt          > PKA_MAX_NUM_RINGS)    ||
-            (queue_cnt         > PKA_MAX_QUEUES_NUM))
+            (queue_cnt         > PKA_MAX_QUEUES_NUM)   ||
+            ((flags & PKA_F_PROGRESS_THREAD) &&
+                (flags & PKA_F_PROCESS_MODE_MULTI))    ||
+            ((flags & PKA_F_RING_POLICY_MASK) >
+                PKA_F_RING_POLICY_SHIM_LOCAL))
     {
         PKA_DEBUG(PKA_USER, "invalid PK context arguments\n");
         errno = EINVAL;
@@ -307,10 +597,16 @@ pka_instance_t pka_init_global(const char *name,
     if (!pka_is_power_of_2(result_queue_size))
         result_queue_size += pka_align32pow2(result_queue_size);
 
+    // The queues of small and high priority commands hold at least a few
+    // small commands.
+    small_queue_size = MAX(cmd_queue_size >> PKA_CMD_SMALL_QUEUE_SHIFT,
+                           4 * PKA_CMD_SMALL_LEN);
+
     cmd_queue_size    = pka_queue_get_memsize(cmd_queue_size);
+    small_queue_size  = pka_queue_get_memsize(small_queue_size);
     result_queue_size = pka_queue_get_memsize(result_queue_size);
     // Determine the memory required for PK context.
-    shmem_size = pka_get_memsize(queue_cnt, cmd_queue_size,
+    shmem_size = pka_get_memsize(queue_cnt, cmd_queue_size, small_queue_size,
                                     result_queue_size);
 
     // Open shared memory object
@@ -352,27 +648,63 @@ pka_instance_t pka_init_global(const char *name,
     if (ret)
     {
         PKA_DEBUG(PKA_USER, "failed to retrieve free rings\n");
-        errno = EBUSY;
-        goto exit_shmem_munmap;
+        if (!(flags & PKA_F_SOFT_FALLBACK))
+        {
+            errno = EBUSY;
+            goto exit_shmem_munmap;
+        }
+
+        // Keep going without rings, commands are processed in software.
+        PKA_DEBUG(PKA_USER, "PK commands will be processed in software\n");
+        pka_gbl_info->rings_mask = 0;
+        pka_gbl_info->rings_cnt  = 0;
     }
 
+    // Calibrate the cost model used to dispatch commands to the HW rings
+    // or to the CPU.
+    pka_dispatch_init(&pka_gbl_info->dispatch);
+
     // Initialize PK context info
     pka_atomic64_init(&pka_gbl_info->lock, 0);
+    pka_init_owner(pka_gbl_info);
     pka_atomic32_init(&pka_gbl_info->workers_cnt, 0);
-    pka_gbl_info->flags           = flags;
-    pka_gbl_info->queues_cnt      = queue_cnt;
-    pka_gbl_info->cmd_queue_size  = cmd_queue_size;
-    pka_gbl_info->rslt_queue_size = result_queue_size;
-    // Init memory pointer.
+    pka_atomic32_init(&pka_gbl_info->slots_cnt, 0);
+    pka_atomic32_init(&pka_gbl_info->slots_lock, 0);
+    pka_gbl_info->slots_mask       = 0;
+    pka_gbl_info->orphans_mask     = 0;
+    pka_gbl_info->flags            = flags;
+    pka_gbl_info->queues_cnt       = queue_cnt;
+    pka_gbl_info->cmd_queue_size   = cmd_queue_size;
+    pka_gbl_info->small_queue_size = small_queue_size;
+    pka_gbl_info->rslt_queue_size  = result_queue_size;
+    pka_gbl_info->ring_rr          = 0;
+    pka_gbl_info->drr_next         = 0;
+    memset(pka_gbl_info->ring_affinity, PKA_RING_AFFINITY_NONE,
+           sizeof(pka_gbl_info->ring_affinity));
+    pka_reserve_lanes(pka_gbl_info);
+    pka_reserve_prio_ring(pka_gbl_info);
+    pka_init_credits(pka_gbl_info);
+    // Init memory pointer. The worker queues are created on demand, see
+    // pka_init_local().
     pka_gbl_info->mem_ptr = (uint8_t *) pka_gbl_info->mem;
 
-    // Create worker queues
-    pka_init_worker_queues(pka_gbl_info, queue_cnt);
-
     // Get process identifier for the PK instance
     pka_gbl_info->main_pid     = getpid();
     pka_gbl_info->requests_cnt = 0;
 
+    if (flags & PKA_F_PROGRESS_THREAD)
+    {
+        ret = pka_progress_start(pka_gbl_info);
+        if (ret)
+        {
+            PKA_DEBUG(PKA_USER, "failed to start the progress thread\n");
+            pka_ring_free(pka_gbl_info->rings, &pka_gbl_info->rings_mask,
+                            &pka_gbl_info->rings_cnt);
+            errno = -ret;
+            goto exit_shmem_munmap;
+        }
+    }
+
     PKA_DEBUG(PKA_USER, "PKA instance %s created successfully\n", name);
     return (pka_instance_t) pka_gbl_info->main_pid;
 
@@ -401,6 +733,12 @@ void pka_term_global(pka_instance_t instance)
             PKA_DEBUG(PKA_USER, "warning: non-released PK handles are no "
                                         "longer usable\n");
 
+        if (pka_gbl_info->flags & PKA_F_PROGRESS_THREAD)
+        {
+            PKA_DEBUG(PKA_USER, "stop the progress thread\n");
+            pka_progress_stop(pka_gbl_info);
+        }
+
         PKA_DEBUG(PKA_USER, "release PKA rings\n");
         pka_ring_free(pka_gbl_info->rings, &pka_gbl_info->rings_mask,
                         &pka_gbl_info->rings_cnt);
@@ -423,7 +761,7 @@ void pka_term_global(pka_instance_t instance)
 pka_handle_t pka_init_local(pka_instance_t instance)
 {
     pka_local_info_t *local_info;
-    uint8_t           worker_id;
+    int               worker_id;
 
     if (instance != (pka_instance_t) pka_gbl_info->main_pid)
     {
@@ -432,26 +770,32 @@ pka_handle_t pka_init_local(pka_instance_t instance)
         return PKA_HANDLE_INVALID;
     }
 
-    // load and increment the number workers.
-    worker_id = pka_atomic32_fetch_inc_relaxed(&pka_gbl_info->workers_cnt);
-    if (worker_id > pka_gbl_info->queues_cnt - 1)
+    local_info = calloc(1, sizeof(*local_info));
+    if (!local_info)
     {
-        PKA_DEBUG(PKA_USER, "handle cnt exceeded\n");
-        errno = EINVAL;
+        errno = ENXIO;
         return PKA_HANDLE_INVALID;
     }
 
-    local_info = calloc(sizeof(*local_info), 0);
-    if (!local_info)
+    // Take a free worker slot, the slot of a terminated handle perhaps.
+    worker_id = pka_alloc_slot(pka_gbl_info);
+    if (worker_id < 0)
     {
-        pka_atomic32_dec(&pka_gbl_info->workers_cnt);
-        errno = ENXIO;
+        PKA_DEBUG(PKA_USER, "handle cnt exceeded\n");
+        free(local_info);
+        errno = EINVAL;
         return PKA_HANDLE_INVALID;
     }
     // Init PK handle
-    local_info->id       = worker_id;
-    local_info->gbl_info = pka_gbl_info;
-    local_info->req_num  = 0;
+    local_info->id        = worker_id;
+    local_info->gbl_info  = pka_gbl_info;
+    local_info->req_num   = 0;
+    local_info->req_units = 0;
+    local_info->priority  = PKA_PRIORITY_NORMAL;
+    local_info->timeout   = 0;
+    local_info->credits   = 0;
+    local_info->credited  = 0;
+    local_info->event_fd  = -1;
 
     PKA_DEBUG(PKA_USER, "PKA handle %d initialized successfully\n",
                     worker_id);
@@ -463,11 +807,38 @@ pka_handle_t pka_init_local(pka_instance_t instance)
 void pka_term_local(pka_handle_t handle)
 {
     pka_local_info_t *local_info;
+    pka_worker_t     *worker;
+    int               rslt_fd;
 
     local_info = (pka_local_info_t *) handle;
     if (local_info)
     {
-        pka_atomic32_dec(&local_info->gbl_info->workers_cnt);
+        // Give back the room of a command reserved but not committed.
+        if (local_info->resv.cmd_queue)
+            pka_abort_cmd(handle);
+
+        if (local_info->event_fd >= 0)
+        {
+            // Stop the notifications before closing the fd. A worker moving
+            // our results might have read the fd already, but it signals it
+            // under the lock of our SW result queue - see
+            // pka_notify_workers().
+            worker  = &local_info->gbl_info->workers[local_info->id];
+            pka_rslt_queue_lock(worker);
+            rslt_fd = (int) pka_atomic32_load(&worker->rslt_fd);
+            pka_atomic32_store_rel(&worker->rslt_fd, (uint32_t) -1);
+            pka_rslt_queue_unlock(worker);
+            close(rslt_fd);
+            close(local_info->event_fd);
+        }
+
+        // Give back the credits of the handle, including those of the
+        // requests whose result was not returned.
+        _pka_atomic32_fetch_add_relaxed(&local_info->gbl_info->credits,
+                                        local_info->credits +
+                                            local_info->credited);
+
+        pka_free_slot(local_info);
         free(local_info);
     }
 }
@@ -488,591 +859,3227 @@ uint32_t pka_get_rings_bitmask(pka_instance_t instance)
     return 0;
 }
 
-static pka_ring_info_t* pka_has_available_ring(pka_ring_info_t rings_info[],
-                                               uint8_t         rings_cnt,
-                                               uint32_t        vectors_size,
-                                               uint32_t       *avail_descs_cnt)
+int pka_set_progress_cpu(pka_instance_t instance, uint32_t cpu)
 {
-    pka_ring_info_t *ring_info;
-    bool             found;
-    uint32_t         best_ring_idx, cnt;
-    uint8_t          ring_idx;
-
-    best_ring_idx    = 0;
-    *avail_descs_cnt = 0;
-    cnt              = 0;
-    found            = false;
+    cpu_set_t cpu_set;
 
-    for (ring_idx = 0; ring_idx < rings_cnt; ring_idx++)
-    {
-        ring_info = &rings_info[ring_idx];
+    if (instance != (pka_instance_t) pka_gbl_info->main_pid ||
+            cpu >= CPU_SETSIZE)
+        return -EINVAL;
 
-        cnt = pka_ring_has_available_room(ring_info);
-        if (!cnt)
-            continue;
+    if (!(pka_gbl_info->flags & PKA_F_PROGRESS_THREAD))
+        return -EPERM;
 
-        if (pka_mem_is_full(ring_info->ring_id, vectors_size))
-            continue;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    return -pthread_setaffinity_np(pka_gbl_info->progress.thread,
+                                   sizeof(cpu_set_t), &cpu_set);
+}
 
-        if (cnt > *avail_descs_cnt)
-        {
-            best_ring_idx    = ring_idx;
-            *avail_descs_cnt = cnt;
-            found            = true;
-        }
-    }
+int pka_set_owner_budget(pka_instance_t instance,
+                         uint32_t       max_cmds,
+                         uint32_t       max_us)
+{
+    if (instance != (pka_instance_t) pka_gbl_info->main_pid)
+        return -EINVAL;
 
-    return (found == true) ? &rings_info[best_ring_idx] : NULL;
+    pka_gbl_info->owner.max_cmds  = max_cmds;
+    pka_gbl_info->owner.max_ticks = (uint64_t) max_us *
+                                        pka_gbl_info->dispatch.ticks_per_us;
+    return 0;
 }
 
-// Check if there is an available descriptor across rings. This function should
-// return as soon as possible.
-static bool pka_has_avail_descs(pka_global_info_t *gbl_info)
+int pka_get_dispatch_params(pka_instance_t         instance,
+                            pka_dispatch_params_t *params)
 {
-    pka_ring_info_t *ring;
-    bool             has_avail_desc;
-    uint8_t          ring_idx, rings_cnt;
+    if (instance != (pka_instance_t) pka_gbl_info->main_pid || !params)
+        return -EINVAL;
 
-    rings_cnt       = gbl_info->rings_cnt;
-    has_avail_desc  = false;
+    pka_dispatch_get_params(&pka_gbl_info->dispatch, params);
+    return 0;
+}
 
-    for (ring_idx = 0; ring_idx < rings_cnt; ring_idx++)
-    {
-        ring = &gbl_info->rings[ring_idx];
-        if (pka_ring_has_available_room(ring))
-        {
-            has_avail_desc = true;
-            break;
-        }
-    }
+int pka_set_dispatch_params(pka_instance_t         instance,
+                            pka_dispatch_params_t *params)
+{
+    if (instance != (pka_instance_t) pka_gbl_info->main_pid || !params)
+        return -EINVAL;
 
-    return has_avail_desc;
+    pka_dispatch_set_params(&pka_gbl_info->dispatch, params);
+    return 0;
 }
 
-// Determine the number of available descriptors.
-uint32_t pka_avail_desc_count(pka_global_info_t *gbl_info)
+int pka_get_dispatch_stats(pka_instance_t        instance,
+                           pka_dispatch_stats_t *stats)
 {
-    pka_ring_info_t *ring;
-    uint32_t         avail_descs_cnt;
-    uint8_t          ring_idx, rings_cnt;
+    pka_dispatch_stats_t *worker_stats;
+    uint32_t              queue_idx;
 
-    rings_cnt       = gbl_info->rings_cnt;
-    avail_descs_cnt = 0;
+    if (instance != (pka_instance_t) pka_gbl_info->main_pid || !stats)
+        return -EINVAL;
 
-    for (ring_idx = 0; ring_idx < rings_cnt; ring_idx++)
+    memset(stats, 0, sizeof(pka_dispatch_stats_t));
+    for (queue_idx = 0; queue_idx < PKA_MAX_QUEUES_NUM; queue_idx++)
     {
-        ring             = &gbl_info->rings[ring_idx];
-        avail_descs_cnt += pka_ring_has_available_room(ring);
+        worker_stats         = &pka_gbl_info->dispatch_stats[queue_idx];
+        stats->hw_cmds      += worker_stats->hw_cmds;
+        stats->cpu_cmds     += worker_stats->cpu_cmds;
+        stats->spilled_cmds += worker_stats->spilled_cmds;
+        stats->blocked_cmds += worker_stats->blocked_cmds;
+        stats->bypass_cmds  += worker_stats->bypass_cmds;
+        stats->high_cmds    += worker_stats->high_cmds;
+        stats->expired_cmds  += worker_stats->expired_cmds;
+        stats->canceled_cmds += worker_stats->canceled_cmds;
     }
 
-    return avail_descs_cnt;
+    return 0;
 }
 
-// Set HW ring command descriptor to enqueue.
-static int pka_set_cmd_desc(pka_global_info_t      *gbl_info,
-                            uint8_t                 worker_id,
-                            pka_queue_cmd_desc_t   *cmd_desc,
-                            pka_ring_hw_cmd_desc_t *ring_desc,
-                            pka_ring_alloc_t       *alloc,
-                            pka_operand_t           operands[])
+int pka_get_worker_stats(pka_instance_t      instance,
+                         uint32_t            worker_id,
+                         pka_worker_stats_t *stats)
 {
-    pka_worker_t  *worker;
-    pka_queue_t   *cmd_queue;
+    pka_worker_t *worker;
+    uint64_t      ticks_per_us;
 
-    int ret;
+    if (instance != (pka_instance_t) pka_gbl_info->main_pid || !stats ||
+            worker_id >= pka_gbl_info->queues_cnt)
+        return -EINVAL;
 
-    worker    = &gbl_info->workers[worker_id];
-    cmd_queue = worker->cmd_queue;
+    worker       = &pka_gbl_info->workers[worker_id];
+    ticks_per_us = pka_gbl_info->dispatch.ticks_per_us;
 
-    // Check whether operands are valid
-    if (operands != PKA_INVALID_OPERANDS)
-        // Set command ring descriptor and copy operands to window RAM.
-        ret = pka_ring_set_cmd_desc(ring_desc, alloc, cmd_desc->opcode,
-                    cmd_desc->operand_cnt, cmd_desc->shift_cnt, operands);
-    else
-        // Dequeue command from SW queue, set command ring descriptor
-        // and copy operands to window RAM.
-        ret = pka_queue_cmd_dequeue(cmd_queue, ring_desc, alloc);
+    stats->served_cmds     = worker->served_cmds;
+    stats->served_bytes    = worker->served_bytes;
+    stats->delay_ns        = (worker->delay * 1000) / ticks_per_us;
+    stats->max_delay_ns    = (worker->max_delay * 1000) / ticks_per_us;
+    stats->stolen_cmds     = worker->stolen_cmds;
+    stats->stolen_delay_ns = (worker->stolen_delay * 1000) / ticks_per_us;
+    stats->weight          = worker->weight;
 
-    return ret;
+    return 0;
 }
 
-static int pka_rslt_dequeue(pka_local_info_t *local_info)
+int pka_get_lock_stats(pka_instance_t instance, pka_lock_stats_t *stats)
 {
-    pka_global_info_t       *gbl_info;
-    pka_ring_info_t         *ring;
-    pka_ring_hw_rslt_desc_t  ring_desc;
-    pka_queue_rslt_desc_t    rslt_desc;
-    pka_queue_t             *rslt_queue;
-    uint64_t                 user_data, cmd_num;
-    uint8_t                  queue_num, ring_num, ring_idx;
+    pka_owner_t *owner;
+    uint32_t     bucket;
 
-    int rc     = 0;
-    int errors = 0;
+    if (instance != (pka_instance_t) pka_gbl_info->main_pid || !stats)
+        return -EINVAL;
 
-    gbl_info = local_info->gbl_info;
+    owner           = &pka_gbl_info->owner;
+    stats->holds    = owner->holds.v;
+    stats->handoffs = owner->handoffs.v;
+    for (bucket = 0; bucket < PKA_HOLD_HIST_BUCKETS; bucket++)
+        stats->hold_hist[bucket] = owner->hold_hist[bucket].v;
 
-    memset(&ring_desc, 0, sizeof(pka_ring_hw_rslt_desc_t));
+    return 0;
+}
 
-    for (ring_idx = 0; ring_idx < gbl_info->rings_cnt; ring_idx++)
+int pka_get_load(pka_instance_t instance, pka_load_t *load)
+{
+    pka_dispatch_t  *dispatch;
+    pka_ring_info_t *ring;
+    pka_ring_load_t *ring_load;
+    pka_worker_t    *worker;
+    pka_queue_t     *cmd_queue;
+    uint64_t         pending_cost, cmd_cost;
+    uint32_t         pending_cmds, workers_cnt, idx;
+
+    if (instance != (pka_instance_t) pka_gbl_info->main_pid || !load)
+        return -EINVAL;
+
+    memset(load, 0, sizeof(pka_load_t));
+    dispatch     = &pka_gbl_info->dispatch;
+    pending_cost = 0;
+    pending_cmds = 0;
+
+    load->rings_cnt = MIN(pka_gbl_info->rings_cnt, PKA_LOAD_MAX_RINGS);
+    for (idx = 0; idx < load->rings_cnt; idx++)
     {
-        ring = &gbl_info->rings[ring_idx];
-        while (pka_ring_has_ready_rslt(ring))
-        {
-            // optional check of return value. This call is no supposed to fail.
-            if (rc != pka_ring_dequeue_rslt_desc(ring, &ring_desc))
-            {
-                PKA_DEBUG(PKA_USER, "failed to dequeue result from ring\n");
-                errors += 1;
-                continue;
-            }
+        ring                    = &pka_gbl_info->rings[idx];
+        ring_load               = &load->rings[idx];
+        ring_load->ring_id      = ring->ring_id;
+        ring_load->free_descs   = pka_ring_has_available_room(ring);
+        ring_load->free_mem     = pka_mem_free_size(ring->ring_id);
+        ring_load->pending_cmds = ring->ring_desc.cmd_desc_cnt;
+
+        pending_cost += pka_dispatch_ring_backlog(dispatch, ring->ring_id);
+        pending_cmds += ring_load->pending_cmds;
+    }
 
-            // Check if the tag is valid, otherwise discard the result.
-            if (!pka_ring_pop_tag(&ring_desc, &user_data, &cmd_num, &queue_num,
-                                    &ring_num))
-            {
-                PKA_DEBUG(PKA_USER, "tag is invalid! result is dropped\n");
-                errors += 1;
-                continue;
-            }
+    workers_cnt = pka_atomic32_load_acq(&pka_gbl_info->slots_cnt);
+    for (idx = 0; idx < workers_cnt * PKA_CMD_CLASSES_CNT; idx++)
+    {
+        worker    = &pka_gbl_info->workers[idx / PKA_CMD_CLASSES_CNT];
+        cmd_queue = worker->cmd_queues[idx % PKA_CMD_CLASSES_CNT];
 
-            // Get result queue
-            rslt_queue = gbl_info->workers[queue_num].rslt_queue;
+        load->queued_cmds  += pka_queue_objs(cmd_queue);
+        load->queued_bytes += pka_queue_count(cmd_queue);
+        load->queues_size  += cmd_queue->capacity;
+    }
 
-            memset(&rslt_desc, 0, sizeof(pka_queue_rslt_desc_t));
-            if (!pka_queue_is_full(rslt_queue))
-            {
-                pka_queue_set_rslt_desc(&rslt_desc, &ring_desc, cmd_num,
-                                            user_data, queue_num);
+    load->credits = pka_atomic32_load(&pka_gbl_info->credits);
 
-                if (rc != pka_queue_rslt_enqueue(rslt_queue, ring, &ring_desc,
-                                                    &rslt_desc))
-                {
-                    PKA_DEBUG(PKA_USER, "failed to enqueue result in"
-                                        "queue %d\n", queue_num);
-                    errors += 1;
-                }
+    // The rings work in parallel. The costs of the queued commands are not
+    // known until they reach a ring, they are assumed to be those of the
+    // commands pending on the rings.
+    if (load->rings_cnt)
+    {
+        cmd_cost = dispatch->hw_base;
+        if (pending_cmds)
+            cmd_cost = pending_cost / pending_cmds;
 
-                // Capture processing cycles cnt
-                pka_stats_processing_cycles_cnt(queue_num, cmd_num);
-            }
-        }
+        load->drain_ns  = pending_cost + load->queued_cmds * cmd_cost;
+        load->drain_ns /= load->rings_cnt;
+        load->drain_ns  = (load->drain_ns * 1000) / dispatch->ticks_per_us;
     }
 
-    return errors;
+    return 0;
 }
 
-static int pka_cmd_enqueue(pka_global_info_t    *gbl_info,
-                           uint8_t               worker_id,
-                           pka_queue_cmd_desc_t *cmd_desc,
-                           pka_operand_t         operands[])
+// Return the number of descriptors available on a ring for a command whose
+// operands take 'vectors_size' bytes of window RAM, or 0 if the ring cannot
+// take the command.
+static uint32_t pka_ring_room(pka_ring_info_t *ring_info,
+                              uint32_t         vectors_size)
 {
-    pka_ring_info_t        *ring_info;
-    pka_ring_hw_cmd_desc_t  ring_desc;
-    pka_ring_alloc_t        alloc;
-    uint32_t                base_offset, max_offset;
-    uint32_t                avail_descs_num;
+    uint32_t cnt;
 
-    // Pick a specific ring to use. Currently this is done in a simple
-    // round robin fashion, with only one command outstanding at a time.
-    ring_info = pka_has_available_ring(gbl_info->rings, gbl_info->rings_cnt,
-                                cmd_desc->operands_len, &avail_descs_num);
-    if (!ring_info)
-    {
-        PKA_DEBUG(PKA_USER, "there are no rings available\n");
-        return -ENOBUFS;
-    }
+    cnt = pka_ring_has_available_room(ring_info);
+    if (cnt && pka_mem_is_full(ring_info->ring_id, vectors_size))
+        return 0;
 
-    alloc.ring   = ring_info;
-    // Allocate some window RAM for the total set vectors.
-    base_offset  = pka_mem_alloc(ring_info->ring_id, cmd_desc->operands_len);
-    max_offset   = base_offset + cmd_desc->operands_len;
-    // Set operands offsets
-    alloc.dst_offset       = base_offset;
-    alloc.max_dst_offset   = max_offset;
+    return cnt;
+}
 
-    // Clear window RAM in order to write operands.
-    pka_mem_reset(alloc.dst_offset, ring_info->mem_ptr,
-                    cmd_desc->operands_len);
+// Pick the ring with the most free descriptors, among the rings of 'shim_id'
+// unless it is negative.
+static pka_ring_info_t *pka_ring_most_free_in(pka_global_info_t *gbl_info,
+                                              uint32_t           vectors_size,
+                                              int                shim_id)
+{
+    pka_ring_info_t *ring_info, *best_ring;
+    uint32_t         cnt, best_cnt;
+    uint8_t          ring_idx;
 
-    // Create a command descriptor associated with the command.
-    memset(&ring_desc, 0, sizeof(pka_ring_hw_cmd_desc_t));
-    if (pka_set_cmd_desc(gbl_info, worker_id, cmd_desc, &ring_desc, &alloc,
-                            operands))
+    best_ring = NULL;
+    best_cnt  = 0;
+
+    for (ring_idx = 0; ring_idx < gbl_info->shared_rings_cnt; ring_idx++)
     {
-        PKA_DEBUG(PKA_USER, "failed to set ring command descriptor\n");
-        return -EWOULDBLOCK;
-    }
+        ring_info = &gbl_info->rings[ring_idx];
+        if (shim_id >= 0 && PKA_RING_SHIM_ID(ring_info) != shim_id)
+            continue;
 
-    // Set descriptor tag field.
-    pka_ring_push_tag(&ring_desc, cmd_desc->user_data, cmd_desc->cmd_num,
-                      worker_id, ring_info->ring_id);
+        cnt = pka_ring_room(ring_info, vectors_size);
+        if (cnt > best_cnt)
+        {
+            best_ring = ring_info;
+            best_cnt  = cnt;
+        }
+    }
+
+    return best_ring;
+}
+
+// Ring selection policy - the ring with the most free descriptors.
+static pka_ring_info_t *pka_ring_most_free(pka_global_info_t    *gbl_info,
+                                           uint8_t               worker_id,
+                                           pka_queue_cmd_desc_t *cmd_desc)
+{
+    return pka_ring_most_free_in(gbl_info, cmd_desc->operands_len, -1);
+}
+
+// Ring selection policy - the ring with the least outstanding work, as
+// estimated by the dispatch cost model.
+static pka_ring_info_t *pka_ring_least_loaded(pka_global_info_t    *gbl_info,
+                                              uint8_t               worker_id,
+                                              pka_queue_cmd_desc_t *cmd_desc)
+{
+    pka_ring_info_t *ring_info, *best_ring;
+    uint64_t         backlog, best_backlog;
+    uint8_t          ring_idx;
+
+    best_ring    = NULL;
+    best_backlog = UINT64_MAX;
+
+    for (ring_idx = 0; ring_idx < gbl_info->shared_rings_cnt; ring_idx++)
+    {
+        ring_info = &gbl_info->rings[ring_idx];
+        if (!pka_ring_room(ring_info, cmd_desc->operands_len))
+            continue;
+
+        backlog = pka_dispatch_ring_backlog(&gbl_info->dispatch,
+                                            ring_info->ring_id);
+        if (backlog < best_backlog)
+        {
+            best_ring    = ring_info;
+            best_backlog = backlog;
+        }
+    }
+
+    return best_ring;
+}
+
+// Ring selection policy - the ring whose largest free window RAM chunk is
+// the smallest one that fits the operands.
+static pka_ring_info_t *pka_ring_best_fit(pka_global_info_t    *gbl_info,
+                                          uint8_t               worker_id,
+                                          pka_queue_cmd_desc_t *cmd_desc)
+{
+    pka_ring_info_t *ring_info, *best_ring;
+    uint32_t         chunk_size, best_chunk_size;
+    uint8_t          ring_idx;
+
+    best_ring       = NULL;
+    best_chunk_size = UINT32_MAX;
+
+    for (ring_idx = 0; ring_idx < gbl_info->shared_rings_cnt; ring_idx++)
+    {
+        ring_info = &gbl_info->rings[ring_idx];
+        if (!pka_ring_room(ring_info, cmd_desc->operands_len))
+            continue;
+
+        chunk_size = pka_mem_largest_chunk_size(ring_info->ring_id);
+        if (chunk_size < best_chunk_size)
+        {
+            best_ring       = ring_info;
+            best_chunk_size = chunk_size;
+        }
+    }
+
+    return best_ring;
+}
+
+// Ring selection policy - the ring the previous command with the same
+// opcode was appended to, if it has room. Otherwise the next ring with room,
+// in round robin, which becomes the ring of the opcode.
+static pka_ring_info_t *pka_ring_affinity(pka_global_info_t    *gbl_info,
+                                          uint8_t               worker_id,
+                                          pka_queue_cmd_desc_t *cmd_desc)
+{
+    pka_ring_info_t *ring_info;
+    uint32_t         cnt;
+    uint8_t         *affinity, ring_idx;
+
+    affinity = &gbl_info->ring_affinity[cmd_desc->opcode %
+                                            PKA_RING_AFFINITY_SIZE];
+    if (*affinity < gbl_info->shared_rings_cnt)
+    {
+        ring_info = &gbl_info->rings[*affinity];
+        if (pka_ring_room(ring_info, cmd_desc->operands_len))
+            return ring_info;
+    }
+
+    for (cnt = 0; cnt < gbl_info->shared_rings_cnt; cnt++)
+    {
+        ring_idx          = gbl_info->ring_rr;
+        gbl_info->ring_rr = (ring_idx + 1) % gbl_info->shared_rings_cnt;
+
+        ring_info = &gbl_info->rings[ring_idx];
+        if (pka_ring_room(ring_info, cmd_desc->operands_len))
+        {
+            *affinity = ring_idx;
+            return ring_info;
+        }
+    }
+
+    return NULL;
+}
+
+// Ring selection policy - the ring with the most free descriptors among the
+// rings of the shim the worker sticks to, else among all the rings.
+static pka_ring_info_t *pka_ring_shim_local(pka_global_info_t    *gbl_info,
+                                            uint8_t               worker_id,
+                                            pka_queue_cmd_desc_t *cmd_desc)
+{
+    pka_ring_info_t *ring_info;
+    int              shim_id;
+
+    // Spread the workers over the shims of the rings.
+    ring_info = &gbl_info->rings[worker_id % gbl_info->shared_rings_cnt];
+    shim_id   = PKA_RING_SHIM_ID(ring_info);
+
+    ring_info = pka_ring_most_free_in(gbl_info, cmd_desc->operands_len,
+                                      shim_id);
+    if (!ring_info)
+        ring_info = pka_ring_most_free_in(gbl_info, cmd_desc->operands_len,
+                                          -1);
+
+    return ring_info;
+}
+
+typedef pka_ring_info_t *(*pka_ring_policy_t)(pka_global_info_t    *gbl_info,
+                                              uint8_t               worker_id,
+                                              pka_queue_cmd_desc_t *cmd_desc);
+
+// Ring selection policies, indexed by PKA_RING_POLICY().
+static const pka_ring_policy_t pka_ring_policies[] =
+{
+    pka_ring_most_free,
+    pka_ring_least_loaded,
+    pka_ring_best_fit,
+    pka_ring_affinity,
+    pka_ring_shim_local
+};
+
+// Notify the HW of the commands appended to the shared rings since the last
+// flush.
+static void pka_flush_rings(pka_global_info_t *gbl_info)
+{
+    uint8_t ring_idx;
+
+    for (ring_idx = 0; ring_idx < gbl_info->pool_rings_cnt; ring_idx++)
+        pka_ring_flush_cmd_descs(&gbl_info->rings[ring_idx]);
+}
+
+// Take the lock of the lane of a worker. The worker appends commands to its
+// lane under the lock, while the workers whose commands it stole may read the
+// results of the lane - see pka_lane_rslt_dequeue().
+static void pka_lane_lock(pka_worker_t *worker)
+{
+    while (!pka_spin_trylock(&worker->lane_lock))
+        pka_cpu_relax();
+}
+
+// Release the lock of the lane of a worker.
+static void pka_lane_unlock(pka_worker_t *worker)
+{
+    pka_spin_unlock(&worker->lane_lock);
+}
+
+// Notify the HW of the commands appended to the lane of a worker since the
+// last flush.
+static void pka_flush_lane(pka_global_info_t *gbl_info, pka_worker_t *worker)
+{
+    uint8_t ring_idx;
+
+    pka_lane_lock(worker);
+    for (ring_idx = worker->lane_idx;
+            ring_idx < worker->lane_idx + worker->lane_cnt; ring_idx++)
+        pka_ring_flush_cmd_descs(&gbl_info->rings[ring_idx]);
+    pka_lane_unlock(worker);
+}
+
+// Check if there is an available descriptor across the rings a command may
+// use. This function should return as soon as possible.
+static bool pka_has_avail_descs(pka_global_info_t    *gbl_info,
+                                pka_queue_cmd_desc_t *cmd_desc)
+{
+    pka_ring_info_t *ring;
+    bool             has_avail_desc;
+    uint8_t          ring_idx, rings_cnt;
+
+    rings_cnt       = gbl_info->shared_rings_cnt;
+    if (cmd_desc->priority == PKA_PRIORITY_HIGH)
+        rings_cnt   = gbl_info->pool_rings_cnt;
+    has_avail_desc  = false;
+
+    for (ring_idx = 0; ring_idx < rings_cnt; ring_idx++)
+    {
+        ring = &gbl_info->rings[ring_idx];
+        if (pka_ring_has_available_room(ring))
+        {
+            has_avail_desc = true;
+            break;
+        }
+    }
+
+    return has_avail_desc;
+}
+
+// Determine the number of available descriptors.
+uint32_t pka_avail_desc_count(pka_global_info_t *gbl_info)
+{
+    pka_ring_info_t *ring;
+    uint32_t         avail_descs_cnt;
+    uint8_t          ring_idx, rings_cnt;
+
+    rings_cnt       = gbl_info->rings_cnt;
+    avail_descs_cnt = 0;
+
+    for (ring_idx = 0; ring_idx < rings_cnt; ring_idx++)
+    {
+        ring             = &gbl_info->rings[ring_idx];
+        avail_descs_cnt += pka_ring_has_available_room(ring);
+    }
+
+    return avail_descs_cnt;
+}
+
+// Return the SW command queue of a worker the command belongs to, according
+// to the priority and the size class of the command.
+static __pka_inline pka_queue_t *pka_cmd_queue(pka_worker_t         *worker,
+                                               pka_queue_cmd_desc_t *cmd_desc)
+{
+    if (cmd_desc->priority == PKA_PRIORITY_HIGH)
+        return worker->cmd_queues[PKA_CMD_CLASS_HIGH];
+
+    if (cmd_desc->operands_len <= PKA_CMD_SMALL_LEN)
+        return worker->cmd_queues[PKA_CMD_CLASS_SMALL];
+
+    return worker->cmd_queues[PKA_CMD_CLASS_LARGE];
+}
+
+// Set HW ring command descriptor to enqueue.
+static int pka_set_cmd_desc(pka_global_info_t      *gbl_info,
+                            uint8_t                 worker_id,
+                            pka_queue_cmd_desc_t   *cmd_desc,
+                            pka_ring_hw_cmd_desc_t *ring_desc,
+                            pka_ring_alloc_t       *alloc,
+                            pka_operand_t           operands[])
+{
+    pka_worker_t  *worker;
+    pka_queue_t   *cmd_queue;
+
+    int ret;
+
+    worker    = &gbl_info->workers[worker_id];
+    cmd_queue = pka_cmd_queue(worker, cmd_desc);
+
+    // Check whether operands are valid
+    if (operands != PKA_INVALID_OPERANDS)
+        // Set command ring descriptor and copy operands to window RAM.
+        ret = pka_ring_set_cmd_desc(ring_desc, alloc, cmd_desc->opcode,
+                    cmd_desc->operand_cnt, cmd_desc->shift_cnt, operands);
+    else
+        // Dequeue command from SW queue, set command ring descriptor
+        // and copy operands to window RAM.
+        ret = pka_queue_cmd_dequeue(cmd_queue, ring_desc, alloc);
+
+    return ret;
+}
+
+// Return whether the result operands of a result descriptor fit in the user
+// result buffers, if any.
+static bool pka_rslt_bufs_fit(pka_results_t         *rslt_bufs,
+                              pka_queue_rslt_desc_t *rslt_desc)
+{
+    uint32_t result_len[MAX_RESULT_CNT];
+    uint8_t  result_idx;
+
+    if (!rslt_bufs)
+        return false;
+
+    result_len[0] = rslt_desc->result1_len;
+    result_len[1] = rslt_desc->result2_len;
+    for (result_idx = 0; result_idx < rslt_desc->result_cnt; result_idx++)
+    {
+        if (!rslt_bufs->results[result_idx].buf_ptr ||
+                rslt_bufs->results[result_idx].buf_len <
+                    result_len[result_idx])
+            return false;
+    }
+
+    return true;
+}
+
+// Enqueue the completion record of a result whose operands were copied to
+// the user result buffers, once the operands information is set.
+static int pka_rslt_bufs_cmpl_enqueue(pka_queue_t           *rslt_queue,
+                                      pka_queue_rslt_desc_t *rslt_desc,
+                                      pka_results_t         *rslt_bufs,
+                                      uint8_t                big_endian)
+{
+    pka_operand_t *result;
+    uint32_t       result_len[MAX_RESULT_CNT];
+    uint8_t        result_idx;
+
+    result_len[0] = rslt_desc->result1_len;
+    result_len[1] = rslt_desc->result2_len;
+    for (result_idx = 0; result_idx < rslt_desc->result_cnt; result_idx++)
+    {
+        result             = &rslt_bufs->results[result_idx];
+        result->actual_len = result_len[result_idx];
+        result->big_endian = big_endian;
+    }
+
+    rslt_desc->rslt_bufs = (uint64_t) rslt_bufs;
+    return pka_queue_rslt_cmpl_enqueue(rslt_queue, rslt_desc);
+}
+
+// Take the lock of the SW result queue of a worker. Its results are enqueued
+// by the workers moving the results of the rings its commands went to - the
+// owner of the lock of the instance, or the workers with a lane - and by the
+// threads of the worker which process commands in software, while another
+// worker may own the lock of the instance.
+static void pka_rslt_queue_lock(pka_worker_t *worker)
+{
+    while (!pka_spin_trylock(&worker->rslt_lock))
+        pka_cpu_relax();
+}
+
+// Release the lock of the SW result queue of a worker.
+static void pka_rslt_queue_unlock(pka_worker_t *worker)
+{
+    pka_spin_unlock(&worker->rslt_lock);
+}
+
+// Signal the completion fd of the workers whose bit is set in 'workers_mask',
+// if any - see pka_get_result_fd(). The fd is signalled under the lock of the
+// SW result queue of the worker, under which pka_term_local() clears it
+// before closing it.
+static void pka_notify_workers(pka_global_info_t *gbl_info,
+                               uint64_t           workers_mask)
+{
+    pka_worker_t *worker;
+    uint8_t       worker_idx;
+    int           rslt_fd;
+
+    for (worker_idx = 0; workers_mask; worker_idx++, workers_mask >>= 1)
+    {
+        worker = &gbl_info->workers[worker_idx];
+        if (!(workers_mask & 1) ||
+                (int) pka_atomic32_load_acq(&worker->rslt_fd) < 0)
+            continue;
+
+        pka_rslt_queue_lock(worker);
+        rslt_fd = (int) pka_atomic32_load(&worker->rslt_fd);
+        if (rslt_fd >= 0)
+            eventfd_write(rslt_fd, 1);
+        pka_rslt_queue_unlock(worker);
+    }
+}
+
+// Move a result descriptor read from a HW ring, and its result operands, to
+// the SW result queue of the worker that submitted the command. Returns the
+// number of errors.
+static int pka_rslt_enqueue(pka_global_info_t       *gbl_info,
+                            pka_ring_info_t         *ring,
+                            pka_ring_hw_rslt_desc_t *ring_desc,
+                            uint64_t                *workers_mask)
+{
+    pka_queue_rslt_desc_t    rslt_desc;
+    pka_worker_t            *worker;
+    pka_queue_t             *rslt_queue;
+    pka_results_t           *rslt_bufs;
+    pka_ring_cost_t          cost;
+    uint64_t                 user_data, bufs_addr, cmd_num;
+    uint8_t                  queue_num, ring_num;
+
+    int rc     = 0;
+    int errors = 0;
+
+    // Check if the tag is valid, otherwise discard the result.
+    if (!pka_ring_pop_tag(ring_desc, &user_data, &bufs_addr, &cmd_num,
+                            &queue_num, &ring_num, &cost))
+    {
+        PKA_DEBUG(PKA_USER, "tag is invalid! result is dropped\n");
+        return 1;
+    }
+
+    // Refine the HW costs of the dispatch cost model.
+    pka_dispatch_hw_complete(&gbl_info->dispatch, ring->ring_id,
+                             cost.enqueue_time, cost.cost_units,
+                             cost.hw_cost,
+                             ring->ring_desc.cmd_desc_cnt == 0);
+
+    // Get result queue
+    worker     = &gbl_info->workers[queue_num];
+    rslt_queue = worker->rslt_queue;
+
+    // The command was stolen by a worker with a lane - see pka_steal_cmds().
+    if (ring->idx >= gbl_info->pool_rings_cnt &&
+            (ring->idx < worker->lane_idx ||
+                ring->idx >= worker->lane_idx + worker->lane_cnt))
+        pka_atomic32_dec(&worker->stolen);
+
+    memset(&rslt_desc, 0, sizeof(pka_queue_rslt_desc_t));
+    pka_rslt_queue_lock(worker);
+    if (!pka_queue_is_full(rslt_queue))
+    {
+        pka_queue_set_rslt_desc(&rslt_desc, ring_desc, cmd_num,
+                                    user_data, queue_num);
+
+        // Copy the result operands straight to the user result buffers
+        // when possible, the result queue then only holds a completion
+        // record.
+        rslt_bufs = (pka_results_t *) bufs_addr;
+        if (pka_rslt_bufs_fit(rslt_bufs, &rslt_desc))
+        {
+            pka_ring_get_result_bufs(ring, ring_desc,
+                                     rslt_bufs->results[0].buf_ptr,
+                                     rslt_bufs->results[1].buf_ptr,
+                                     rslt_desc.result1_len,
+                                     rslt_desc.result2_len);
+            rc = pka_rslt_bufs_cmpl_enqueue(rslt_queue, &rslt_desc,
+                                            rslt_bufs, ring->big_endian);
+        }
+        else
+        {
+            rc = pka_queue_rslt_enqueue(rslt_queue, ring, ring_desc,
+                                        &rslt_desc);
+            // A result which does not fit in the SW result queue is dropped,
+            // but its operands must still leave the window RAM, or the ring
+            // would starve.
+            if (rc)
+                pka_ring_drop_result(ring, ring_desc);
+        }
+
+        if (rc)
+        {
+            PKA_DEBUG(PKA_USER, "failed to enqueue result in"
+                                "queue %d\n", queue_num);
+            errors += 1;
+        }
+        else
+        {
+            *workers_mask |= (uint64_t) 1 << queue_num;
+        }
+
+        // Capture processing cycles cnt
+        pka_stats_processing_cycles_cnt(queue_num, cmd_num);
+    }
+    else
+    {
+        pka_ring_drop_result(ring, ring_desc);
+    }
+    pka_rslt_queue_unlock(worker);
+
+    return errors;
+}
+
+// Move the results ready on a HW ring to the SW result queues. Returns the
+// number of errors.
+static int pka_ring_rslt_dequeue(pka_global_info_t *gbl_info,
+                                 pka_ring_info_t   *ring,
+                                 uint64_t          *workers_mask)
+{
+    pka_ring_hw_rslt_desc_t  ring_desc;
+    uint32_t                 rslt_cnt;
+
+    int errors = 0;
+
+    memset(&ring_desc, 0, sizeof(pka_ring_hw_rslt_desc_t));
+
+    pka_ring_clear_irq(ring);
+    // Read the ring result count once for all the ready results, and
+    // acknowledge them all at once.
+    while ((rslt_cnt = pka_ring_has_ready_rslt(ring)))
+    {
+        for (; rslt_cnt; rslt_cnt--)
+        {
+            pka_ring_fetch_rslt_desc(ring, &ring_desc);
+            errors += pka_rslt_enqueue(gbl_info, ring, &ring_desc,
+                                       workers_mask);
+        }
+
+        pka_ring_ack_rslt_descs(ring);
+    }
+
+    return errors;
+}
+
+// Move the results of the lane of a worker to the SW result queues, unless
+// another worker holds the lock of the lane - the results are then left to
+// a later call. Returns the number of errors.
+static int pka_lane_rslt_dequeue(pka_global_info_t *gbl_info,
+                                 pka_worker_t      *worker,
+                                 uint64_t          *workers_mask)
+{
+    uint8_t ring_idx;
+
+    int errors = 0;
+
+    if (!pka_spin_trylock(&worker->lane_lock))
+        return 0;
+
+    for (ring_idx = worker->lane_idx;
+            ring_idx < worker->lane_idx + worker->lane_cnt; ring_idx++)
+        errors += pka_ring_rslt_dequeue(gbl_info, &gbl_info->rings[ring_idx],
+                                        workers_mask);
+
+    pka_spin_unlock(&worker->lane_lock);
+    return errors;
+}
+
+// Move the results of the lane of a worker whose handle is terminated - see
+// pka_reclaim_slots().
+static void pka_drain_lane(pka_global_info_t *gbl_info, pka_worker_t *worker)
+{
+    uint64_t workers_mask;
+    int      errors;
+
+    workers_mask = 0;
+    errors       = pka_lane_rslt_dequeue(gbl_info, worker, &workers_mask);
+    if (errors)
+        PKA_DEBUG(PKA_USER, "failed to dequeue %d results\n", errors);
+
+    pka_notify_workers(gbl_info, workers_mask);
+}
+
+// Move the results of the shared rings to the SW result queues. The lanes
+// are left to their workers - see pka_lane_process().
+static int pka_rslt_dequeue(pka_local_info_t *local_info)
+{
+    pka_global_info_t       *gbl_info;
+    uint64_t                 workers_mask;
+    uint8_t                  ring_idx;
+
+    int errors = 0;
+
+    gbl_info     = local_info->gbl_info;
+    workers_mask = 0;
+
+    for (ring_idx = 0; ring_idx < gbl_info->pool_rings_cnt; ring_idx++)
+        errors += pka_ring_rslt_dequeue(gbl_info, &gbl_info->rings[ring_idx],
+                                        &workers_mask);
+
+    pka_notify_workers(gbl_info, workers_mask);
+
+    return errors;
+}
+
+// Pick a shared ring for a command: the reserved ring for high priority
+// commands, if any and if it has room, else according to the ring selection
+// policy of the instance. Returns NULL if no shared ring can take it.
+static pka_ring_info_t *pka_pool_ring(pka_global_info_t    *gbl_info,
+                                      uint8_t               worker_id,
+                                      pka_queue_cmd_desc_t *cmd_desc)
+{
+    pka_ring_policy_t policy;
+
+    if (cmd_desc->priority == PKA_PRIORITY_HIGH &&
+            gbl_info->prio_ring != PKA_PRIORITY_RING_NONE &&
+            pka_ring_room(&gbl_info->rings[gbl_info->prio_ring],
+                          cmd_desc->operands_len))
+        return &gbl_info->rings[gbl_info->prio_ring];
+
+    if (!gbl_info->shared_rings_cnt)
+        return NULL;
+
+    policy = pka_ring_policies[PKA_RING_POLICY(gbl_info->flags)];
+    return policy(gbl_info, worker_id, cmd_desc);
+}
+
+// Pick the ring of the lane of a worker with the most free descriptors.
+// Returns NULL if the lane cannot take the command.
+static pka_ring_info_t *pka_lane_ring(pka_global_info_t    *gbl_info,
+                                      pka_worker_t         *worker,
+                                      pka_queue_cmd_desc_t *cmd_desc)
+{
+    pka_ring_info_t *ring_info, *best_ring;
+    uint32_t         cnt, best_cnt;
+    uint8_t          ring_idx;
+
+    best_ring = NULL;
+    best_cnt  = 0;
+
+    for (ring_idx = worker->lane_idx;
+            ring_idx < worker->lane_idx + worker->lane_cnt; ring_idx++)
+    {
+        ring_info = &gbl_info->rings[ring_idx];
+        cnt       = pka_ring_room(ring_info, cmd_desc->operands_len);
+        if (cnt > best_cnt)
+        {
+            best_ring = ring_info;
+            best_cnt  = cnt;
+        }
+    }
+
+    return best_ring;
+}
+
+// Append a command to a given HW ring. Unless 'flush' is set, the HW is
+// notified of the command when the ring is flushed - see pka_flush_rings().
+static int pka_ring_cmd_enqueue(pka_global_info_t    *gbl_info,
+                                pka_ring_info_t      *ring_info,
+                                uint8_t               worker_id,
+                                pka_queue_cmd_desc_t *cmd_desc,
+                                pka_operand_t         operands[],
+                                bool                  flush)
+{
+    pka_ring_hw_cmd_desc_t  ring_desc;
+    pka_ring_alloc_t        alloc;
+    pka_ring_cost_t         cost;
+    uint32_t                base_offset, max_offset;
+
+    alloc.ring   = ring_info;
+    // Allocate some window RAM for the total set vectors.
+    base_offset  = pka_mem_alloc(ring_info->ring_id, cmd_desc->operands_len);
+    max_offset   = base_offset + cmd_desc->operands_len;
+    // Set operands offsets
+    alloc.dst_offset       = base_offset;
+    alloc.max_dst_offset   = max_offset;
+
+    // Clear window RAM in order to write operands.
+    pka_mem_reset(alloc.dst_offset, ring_info->mem_ptr,
+                    cmd_desc->operands_len);
+
+    // Create a command descriptor associated with the command.
+    memset(&ring_desc, 0, sizeof(pka_ring_hw_cmd_desc_t));
+    if (pka_set_cmd_desc(gbl_info, worker_id, cmd_desc, &ring_desc, &alloc,
+                            operands))
+    {
+        PKA_DEBUG(PKA_USER, "failed to set ring command descriptor\n");
+        return -EWOULDBLOCK;
+    }
+
+    // Set descriptor tag field.
+    pka_stats_ring_cost(gbl_info, cmd_desc, &cost);
+    pka_ring_push_tag(&ring_desc, cmd_desc->user_data, cmd_desc->rslt_bufs,
+                      cmd_desc->cmd_num, worker_id, ring_info->ring_id,
+                      &cost);
+
+    // Append descriptor to a ring. No need to check return value, this call
+    // is not supposed to fail.
+    pka_ring_append_cmd_desc(ring_info, &ring_desc);
+    if (flush)
+        pka_ring_flush_cmd_descs(ring_info);
+    pka_dispatch_hw_enqueue(&gbl_info->dispatch, ring_info->ring_id,
+                            cost.hw_cost);
+
+    // increment the request counter.
+    gbl_info->requests_cnt += 1;
+
+    // Capture overhead cycles cnt
+    pka_stats_overhead_cycles_cnt(worker_id, cmd_desc->cmd_num);
+
+    return 0;
+}
+
+// Append a command to a HW ring: a ring of the lane of the worker if it has
+// one, else a shared ring. Unless 'flush' is set, the HW is notified of the
+// command when the rings are flushed - see pka_flush_rings() and
+// pka_flush_lane().
+static int pka_cmd_enqueue(pka_global_info_t    *gbl_info,
+                           uint8_t               worker_id,
+                           pka_queue_cmd_desc_t *cmd_desc,
+                           pka_operand_t         operands[],
+                           bool                  flush)
+{
+    pka_ring_info_t *ring_info;
+    pka_worker_t    *worker;
+
+    int rc;
+
+    worker = &gbl_info->workers[worker_id];
+    if (!worker->lane_cnt)
+    {
+        ring_info = pka_pool_ring(gbl_info, worker_id, cmd_desc);
+        if (!ring_info)
+        {
+            PKA_DEBUG(PKA_USER, "there are no rings available\n");
+            return -ENOBUFS;
+        }
+
+        return pka_ring_cmd_enqueue(gbl_info, ring_info, worker_id, cmd_desc,
+                                    operands, flush);
+    }
+
+    rc = -ENOBUFS;
+    pka_lane_lock(worker);
+    ring_info = pka_lane_ring(gbl_info, worker, cmd_desc);
+    if (ring_info)
+        rc = pka_ring_cmd_enqueue(gbl_info, ring_info, worker_id, cmd_desc,
+                                  operands, flush);
+    pka_lane_unlock(worker);
+
+    if (!ring_info)
+        PKA_DEBUG(PKA_USER, "there are no rings available\n");
+
+    return rc;
+}
+
+// Drop the command at the head of a SW command queue of a worker, and
+// return its result with the given status and no result operand. Returns 0
+// on success, or a negative error code if the result queue of the worker is
+// full, in which case the command stays queued.
+static int pka_cmd_drop(pka_global_info_t    *gbl_info,
+                        uint8_t               worker_id,
+                        pka_queue_t          *cmd_queue,
+                        pka_queue_cmd_desc_t *cmd_desc,
+                        pka_result_code_t     status)
+{
+    pka_dispatch_stats_t  *dispatch_stats;
+    pka_queue_rslt_desc_t  rslt_desc;
+    pka_worker_t          *worker;
+    pka_queue_t           *rslt_queue;
+
+    int rc;
+
+    worker     = &gbl_info->workers[worker_id];
+    rslt_queue = worker->rslt_queue;
+
+    memset(&rslt_desc, 0, sizeof(pka_queue_rslt_desc_t));
+    rslt_desc.opcode    = cmd_desc->opcode;
+    rslt_desc.status    = status;
+    rslt_desc.queue_num = worker_id;
+    rslt_desc.cmd_num   = cmd_desc->cmd_num;
+    rslt_desc.user_data = cmd_desc->user_data;
+
+    pka_rslt_queue_lock(worker);
+    rc = pka_queue_rslt_cmpl_enqueue(rslt_queue, &rslt_desc);
+    pka_rslt_queue_unlock(worker);
+    if (rc)
+    {
+        PKA_DEBUG(PKA_USER, "failed to enqueue the result of a dropped "
+                                "command in queue %d\n", worker_id);
+        return rc;
+    }
+
+    pka_queue_cmd_discard(cmd_queue);
+    pka_notify_workers(gbl_info, (uint64_t) 1 << worker_id);
+
+    dispatch_stats = &gbl_info->dispatch_stats[worker_id];
+    if (status == RC_TIMEOUT)
+        dispatch_stats->expired_cmds += 1;
+    else
+        dispatch_stats->canceled_cmds += 1;
+
+    return 0;
+}
+
+// Append the command at the head of a SW command queue of a worker to a HW
+// ring, or drop it if it was canceled or if its deadline passed. Unless
+// 'deficit' is NULL, the command is only appended if its operands fit the
+// deficit of the worker, which is then charged for them. Returns 1 if it was
+// appended or dropped, 0 if the queue is empty, if the command does not fit
+// the deficit or if no ring can take it, in which case 'blocked' is set.
+static int pka_process_cmd_queue(pka_global_info_t *gbl_info,
+                                 uint8_t            worker_id,
+                                 pka_queue_t       *cmd_queue,
+                                 uint32_t          *deficit,
+                                 bool              *blocked)
+{
+    pka_queue_cmd_desc_t  cmd_desc;
+    pka_result_code_t     status;
+    pka_worker_t         *worker;
+    uint64_t              delay;
+
+    int rc = 0;
+
+    *blocked = false;
+
+    if (pka_queue_is_empty(cmd_queue))
+        return 0;
+
+    // Dequeue SW queue.
+    memset(&cmd_desc, 0, sizeof(pka_queue_cmd_desc_t));
+    if (rc == pka_queue_load_cmd_desc(&cmd_desc, cmd_queue))
+    {
+        // Do not spend ring time on a command nobody waits for anymore.
+        status = RC_NO_ERROR;
+        if (cmd_desc.flags & PKA_QUEUE_CMD_F_CANCELED)
+            status = RC_CANCELED;
+        else if (cmd_desc.deadline && pka_cpu_cycles() >= cmd_desc.deadline)
+            status = RC_TIMEOUT;
+
+        if (status != RC_NO_ERROR)
+        {
+            if (pka_cmd_drop(gbl_info, worker_id, cmd_queue, &cmd_desc,
+                             status))
+            {
+                *blocked = true;
+                return 0;
+            }
+
+            return 1;
+        }
+
+        if (deficit && cmd_desc.operands_len > *deficit)
+            return 0;
+
+        // Enqueue cmd descriptor in HW rings.
+        if(rc != pka_cmd_enqueue(gbl_info, worker_id, &cmd_desc,
+                                    PKA_INVALID_OPERANDS, true))
+        {
+            PKA_DEBUG(PKA_USER, "failed to enqueue a command descriptor"
+                                    " of worker %d on HW rings\n", worker_id);
+            *blocked = true;
+            return 0;
+        }
+
+        if (deficit)
+            *deficit -= cmd_desc.operands_len;
+
+        worker                = &gbl_info->workers[worker_id];
+        delay                 = pka_cpu_cycles() - cmd_desc.submit_time;
+        worker->served_cmds  += 1;
+        worker->served_bytes += cmd_desc.operands_len;
+        worker->delay        += delay;
+        worker->max_delay     = MAX(worker->max_delay, delay);
+
+        return 1;
+    }
+
+    PKA_DEBUG(PKA_USER, "failed to dequeue a command descriptor from SW"
+                            " queue of worker %d\n", worker_id);
+    return 0;
+}
+
+// Append the commands at the head of the SW command queues of a worker to the
+// HW rings, one per class from 'first_class' to 'last_class', so that a
+// command no ring can take does not hold back the commands of the other
+// classes. Unless 'deficit' is NULL, the commands must fit the deficit of
+// the worker. Returns the number of commands appended, and the number of
+// classes whose command no ring could take in 'blocked_cnt', if not NULL.
+static int pka_process_cmd_queues(pka_global_info_t *gbl_info,
+                                  uint8_t            worker_id,
+                                  uint8_t            first_class,
+                                  uint8_t            last_class,
+                                  uint32_t          *deficit,
+                                  uint32_t          *blocked_num)
+{
+    pka_dispatch_stats_t *dispatch_stats;
+    pka_worker_t         *worker;
+    uint32_t              blocked_cnt;
+    uint8_t               class_idx;
+    bool                  blocked;
+
+    int cmds_num = 0;
+
+    worker      = &gbl_info->workers[worker_id];
+    blocked_cnt = 0;
+
+    for (class_idx = first_class; class_idx <= last_class; class_idx++)
+    {
+        cmds_num    += pka_process_cmd_queue(gbl_info, worker_id,
+                                             worker->cmd_queues[class_idx],
+                                             deficit, &blocked);
+        blocked_cnt += blocked;
+    }
+
+    if (blocked_cnt)
+    {
+        dispatch_stats                = &gbl_info->dispatch_stats[worker_id];
+        dispatch_stats->blocked_cmds += blocked_cnt;
+        dispatch_stats->bypass_cmds  += cmds_num;
+    }
+
+    if (blocked_num)
+        *blocked_num = blocked_cnt;
+
+    return cmds_num;
+}
+
+// Return the number of commands waiting in the SW command queues of a worker.
+static uint32_t pka_cmd_queues_objs(pka_worker_t *worker)
+{
+    uint32_t objs;
+    uint8_t  class_idx;
+
+    objs = 0;
+    for (class_idx = 0; class_idx < PKA_CMD_CLASSES_CNT; class_idx++)
+        objs += pka_queue_objs(worker->cmd_queues[class_idx]);
+
+    return objs;
+}
+
+// Return whether commands of high priority wait in the SW command queues of
+// the workers without a lane. Commands of normal priority are then queued
+// behind them rather than appended to the shared rings.
+static bool pka_high_pending(pka_global_info_t *gbl_info)
+{
+    pka_worker_t *worker;
+    uint32_t      workers_cnt, worker_idx;
+
+    workers_cnt = pka_atomic32_load_acq(&gbl_info->slots_cnt);
+    for (worker_idx = 0; worker_idx < workers_cnt; worker_idx++)
+    {
+        worker = &gbl_info->workers[worker_idx];
+        if (!worker->lane_cnt &&
+                !pka_queue_is_empty(worker->cmd_queues[PKA_CMD_CLASS_HIGH]))
+            return true;
+    }
+
+    return false;
+}
+
+// Return whether a command may be appended straight to a HW ring, rather
+// than to the SW command queue of its worker.
+static bool pka_cmd_can_bypass(pka_global_info_t    *gbl_info,
+                               pka_queue_cmd_desc_t *cmd_desc)
+{
+    if (cmd_desc->priority != PKA_PRIORITY_HIGH &&
+            pka_high_pending(gbl_info))
+        return false;
+
+    return pka_has_avail_descs(gbl_info, cmd_desc);
+}
+
+// Return whether the SW command queues of normal priority of a worker are
+// empty.
+static bool pka_normal_queues_empty(pka_worker_t *worker)
+{
+    return pka_queue_is_empty(worker->cmd_queues[PKA_CMD_CLASS_SMALL]) &&
+                pka_queue_is_empty(worker->cmd_queues[PKA_CMD_CLASS_LARGE]);
+}
+
+// Serve a worker in deficit round robin. At the start of its turn, the
+// deficit of the worker grows by its quantum; its commands of normal
+// priority are then appended to the rings while their operands fit the
+// deficit. The turn ends once the deficit does not fit the commands, or
+// once the queues are empty, in which case the deficit is lost. When no
+// ring can take the commands, the turn goes on at the next sweep, without
+// growing the deficit again. Returns the number of commands appended or
+// dropped.
+static uint32_t pka_drr_serve(pka_global_info_t *gbl_info, uint8_t worker_id)
+{
+    pka_worker_t *worker;
+    uint32_t      cmds_num, served_num, blocked_cnt;
+
+    worker = &gbl_info->workers[worker_id];
+    if (pka_normal_queues_empty(worker))
+    {
+        worker->deficit  = 0;
+        worker->drr_turn = false;
+        return 0;
+    }
+
+    if (!worker->drr_turn)
+    {
+        worker->deficit += worker->weight * PKA_DRR_QUANTUM;
+        worker->drr_turn = true;
+    }
+
+    served_num = 0;
+    do
+    {
+        cmds_num    = pka_process_cmd_queues(gbl_info, worker_id,
+                                             PKA_CMD_CLASS_SMALL,
+                                             PKA_CMD_CLASS_LARGE,
+                                             &worker->deficit,
+                                             &blocked_cnt);
+        served_num += cmds_num;
+    } while (cmds_num);
+
+    if (pka_normal_queues_empty(worker))
+    {
+        worker->deficit  = 0;
+        worker->drr_turn = false;
+    }
+    else if (!blocked_cnt)
+    {
+        worker->drr_turn = false;
+    }
+
+    return served_num;
+}
+
+// Try to take the lock of an instance, see pka_try_acquire_lock(), and note
+// when it was taken.
+static pka_lock_t pka_lock_acquire(pka_global_info_t *gbl_info,
+                                   uint32_t           id,
+                                   bool               set_bit)
+{
+    pka_lock_t lock;
+
+    lock = pka_try_acquire_lock(&gbl_info->lock.v, id, set_bit);
+    if (lock == LOCK_ACQUIRED)
+        gbl_info->owner.acquired = pka_cpu_cycles();
+
+    return lock;
+}
+
+// Add a hold of the lock of an instance to the histogram of the hold times.
+static void pka_lock_account(pka_global_info_t *gbl_info, uint64_t hold)
+{
+    uint64_t hold_us;
+    uint32_t bucket;
+
+    hold_us = hold / gbl_info->dispatch.ticks_per_us;
+    bucket  = hold_us ? 64 - __builtin_clzll(hold_us) : 0;
+    bucket  = MIN(bucket, PKA_HOLD_HIST_BUCKETS - 1);
+
+    pka_atomic64_inc(&gbl_info->owner.holds);
+    pka_atomic64_inc(&gbl_info->owner.hold_hist[bucket]);
+}
+
+// Try to release the lock of an instance, see pka_try_release_lock().
+static int pka_lock_release(pka_global_info_t *gbl_info, uint32_t id)
+{
+    uint64_t hold;
+    int      lock;
+
+    // Once released, the lock might be taken over right away.
+    hold = pka_cpu_cycles() - gbl_info->owner.acquired;
+    lock = pka_try_release_lock(&gbl_info->lock.v, id);
+    if (lock == LOCK_RELEASED)
+        pka_lock_account(gbl_info, hold);
+
+    return lock;
+}
+
+// Release the lock of an instance whose owner ran out of budget, whether or
+// not other workers requested it. Their commands wait in the SW command
+// queues, they are woken up so that one of them takes the lock over. The
+// workers without a completion fd cannot be woken up: their requests are
+// kept for the next owner of the lock to serve.
+static void pka_lock_handoff(pka_global_info_t *gbl_info)
+{
+    uint64_t hold, keep_mask, workers_mask;
+    uint32_t workers_cnt, worker_idx;
+
+    keep_mask   = 0;
+    workers_cnt = pka_atomic32_load_acq(&gbl_info->slots_cnt);
+    for (worker_idx = 0; worker_idx < workers_cnt; worker_idx++)
+    {
+        if ((int) pka_atomic32_load(&gbl_info->workers[worker_idx].rslt_fd) <
+                0)
+            keep_mask |= (uint64_t) 1 << worker_idx;
+    }
+
+    hold         = pka_cpu_cycles() - gbl_info->owner.acquired;
+    workers_mask = pka_force_release_lock(&gbl_info->lock.v, keep_mask);
+    pka_lock_account(gbl_info, hold);
+    if (!workers_mask)
+        return;
+
+    pka_atomic64_inc(&gbl_info->owner.handoffs);
+    pka_notify_workers(gbl_info, workers_mask);
+}
+
+// Start the budget of the owner of the lock of an instance, from the time it
+// took the lock.
+static void pka_budget_start(pka_global_info_t *gbl_info,
+                             pka_budget_t      *budget)
+{
+    budget->cmds     = 0;
+    budget->max_cmds = gbl_info->owner.max_cmds;
+    budget->deadline = 0;
+    if (gbl_info->owner.max_ticks)
+        budget->deadline = gbl_info->owner.acquired +
+                                gbl_info->owner.max_ticks;
+}
+
+// Charge commands to the budget of the owner of the lock, if any. Returns
+// whether the budget is spent.
+static bool pka_budget_charge(pka_budget_t *budget, uint32_t cmds_num)
+{
+    if (!budget)
+        return false;
+
+    budget->cmds += cmds_num;
+    if (budget->max_cmds && budget->cmds >= budget->max_cmds)
+        return true;
+
+    return budget->deadline && pka_cpu_cycles() >= budget->deadline;
+}
+
+// Process all SW cmd queues at least once. The high priority queues of all
+// the workers are drained first, then the other ones are served in deficit
+// round robin - see pka_set_weight(). A sweep starts with the first worker
+// whose turn was cut short by the rings, so that it resumes its turn first;
+// the other workers are served meanwhile, so that the commands the rings
+// can take do not wait. Stop when a full sweep of the SW cmd queues results
+// in nothing, or once the budget of the owner of the lock - if any - is spent.
+// The SW cmd queues of the workers with a lane are left to their workers -
+// see pka_lane_process().
+static void pka_sweep_cmd_queues(pka_global_info_t *gbl_info,
+                                 pka_budget_t      *budget)
+{
+    pka_worker_t *worker;
+    uint32_t      cmds_num, workers_cnt, idx, next;
+    uint8_t       worker_idx;
+
+    workers_cnt = pka_atomic32_load_acq(&gbl_info->slots_cnt);
+    if (!workers_cnt)
+        return;
+
+    while (true)
+    {
+        cmds_num = 0;
+        for (worker_idx = 0; worker_idx < workers_cnt; worker_idx++)
+        {
+            if (!gbl_info->workers[worker_idx].lane_cnt)
+                cmds_num += pka_process_cmd_queues(gbl_info, worker_idx,
+                                                   PKA_CMD_CLASS_HIGH,
+                                                   PKA_CMD_CLASS_HIGH, NULL,
+                                                   NULL);
+        }
+
+        if (pka_budget_charge(budget, cmds_num))
+            break;
+
+        if (cmds_num != 0)
+            continue;
+
+        next = workers_cnt;
+        for (idx = 0; idx < workers_cnt; idx++)
+        {
+            worker_idx = (gbl_info->drr_next + idx) % workers_cnt;
+            worker     = &gbl_info->workers[worker_idx];
+            if (worker->lane_cnt)
+                continue;
+
+            cmds_num  += pka_drr_serve(gbl_info, worker_idx);
+            if (worker->drr_turn && next == workers_cnt)
+                next = worker_idx;
+        }
+
+        if (next == workers_cnt)
+            next = gbl_info->drr_next + 1;
+        gbl_info->drr_next = next % workers_cnt;
+
+        if (pka_budget_charge(budget, cmds_num) || cmds_num == 0)
+            break;
+    }
+}
+
+// Append commands waiting in the SW command queues of the workers with a lane
+// to the lane of another worker, or to the shared rings if 'lane' is NULL.
+// They are tagged with the queue number of their worker, so their results
+// go back to it. The commands of the worker with the most commands waiting
+// are taken, from the queues no other consumer holds; those to drop are left
+// to their worker. Returns the number of commands appended.
+static uint32_t pka_steal_cmds(pka_global_info_t *gbl_info,
+                               uint8_t            thief_id,
+                               pka_worker_t      *lane)
+{
+    pka_queue_cmd_desc_t  cmd_desc;
+    pka_ring_info_t      *ring_info;
+    pka_worker_t         *worker, *thief;
+    pka_queue_t          *cmd_queue;
+    uint32_t              workers_cnt, worker_idx, objs, max_objs, cmds_num;
+    uint8_t               victim_id, class_idx;
+    int                   rc;
+
+    workers_cnt = pka_atomic32_load_acq(&gbl_info->slots_cnt);
+    victim_id   = 0;
+    max_objs    = 0;
+    for (worker_idx = 0; worker_idx < workers_cnt; worker_idx++)
+    {
+        worker = &gbl_info->workers[worker_idx];
+        if (!worker->lane_cnt || (lane && worker_idx == thief_id))
+            continue;
+
+        objs = pka_cmd_queues_objs(worker);
+        if (objs > max_objs)
+        {
+            victim_id = worker_idx;
+            max_objs  = objs;
+        }
+    }
+
+    if (!max_objs)
+        return 0;
+
+    thief    = &gbl_info->workers[thief_id];
+    worker   = &gbl_info->workers[victim_id];
+    cmds_num = 0;
+    for (class_idx = 0; class_idx < PKA_CMD_CLASSES_CNT; class_idx++)
+    {
+        cmd_queue = worker->cmd_queues[class_idx];
+        if (pka_queue_is_empty(cmd_queue) ||
+                !pka_queue_cons_trylock(cmd_queue))
+            continue;
+
+        while (!pka_queue_is_empty(cmd_queue))
+        {
+            memset(&cmd_desc, 0, sizeof(pka_queue_cmd_desc_t));
+            if (pka_queue_load_cmd_desc(&cmd_desc, cmd_queue) ||
+                    (cmd_desc.flags & PKA_QUEUE_CMD_F_CANCELED) ||
+                    (cmd_desc.deadline &&
+                        pka_cpu_cycles() >= cmd_desc.deadline))
+                break;
+
+            if (lane)
+            {
+                pka_lane_lock(lane);
+                ring_info = pka_lane_ring(gbl_info, lane, &cmd_desc);
+            }
+            else
+                ring_info = pka_pool_ring(gbl_info, victim_id, &cmd_desc);
+
+            // Count the command before its result might come back.
+            rc = -ENOBUFS;
+            if (ring_info)
+            {
+                if (lane)
+                    pka_atomic32_inc(&worker->stolen);
+                rc = pka_ring_cmd_enqueue(gbl_info, ring_info, victim_id,
+                                          &cmd_desc, PKA_INVALID_OPERANDS,
+                                          true);
+                if (rc && lane)
+                    pka_atomic32_dec(&worker->stolen);
+            }
+
+            if (lane)
+                pka_lane_unlock(lane);
+            if (rc)
+                break;
+
+            cmds_num            += 1;
+            thief->stolen_cmds  += 1;
+            thief->stolen_delay += pka_cpu_cycles() - cmd_desc.submit_time;
+        }
+
+        pka_queue_cons_unlock(cmd_queue);
+    }
+
+    return cmds_num;
+}
+
+static int pka_process_queues_sync(pka_local_info_t *local_info)
+{
+    pka_global_info_t *gbl_info;
+    pka_budget_t       budget;
+    pka_lock_t         lock;
+    uint32_t           cmds_num;
+    uint8_t            worker_idx;
+
+    int ret;
+
+    gbl_info    = local_info->gbl_info;
+    // We are now the owner of all of the PK context - including all
+    // the HW rings.
+    pka_budget_start(gbl_info, &budget);
+
+    // First we do reply processing.
+    ret = pka_rslt_dequeue(local_info);
+    if (ret)
+        PKA_DEBUG(PKA_USER, "failed to dequeue %d results\n", ret);
+
+    // Next process all SW cmd queues.
+    pka_sweep_cmd_queues(gbl_info, &budget);
+
+    // Lend the room left on the shared rings to the workers whose lane is
+    // full.
+    cmds_num = 0;
+    if (gbl_info->lanes_cnt && gbl_info->pool_rings_cnt &&
+            !pka_budget_charge(&budget, 0))
+        cmds_num = pka_steal_cmds(gbl_info, local_info->id, NULL);
+
+    // Now try to release the lock, but if we can't because of some other
+    // thread's request bit is set, then re-process that SW cmd queue. Once
+    // our budget is spent, leave the pending requests to their threads.
+    while (true)
+    {
+        if (pka_budget_charge(&budget, cmds_num))
+        {
+            pka_lock_handoff(gbl_info);
+            break;
+        }
+
+        lock = pka_lock_release(gbl_info, local_info->id);
+        if (lock == LOCK_RELEASED)
+            break; // lock was released.
+
+        worker_idx = lock;
+        cmds_num   = pka_process_cmd_queues(gbl_info, worker_idx, 0,
+                                            PKA_CMD_CLASSES_CNT - 1, NULL,
+                                            NULL);
+    }
+
+    return 0;
+}
+
+static int pka_process_queues_nosync(pka_local_info_t *local_info)
+{
+    int ret;
+
+    // First we do reply processing.
+    ret = pka_rslt_dequeue(local_info);
+    if (ret)
+        PKA_DEBUG(PKA_USER, "failed to dequeue %d results\n", ret);
+
+    // Next process all SW cmd queues.
+    pka_sweep_cmd_queues(local_info->gbl_info, NULL);
+
+    return 0;
+}
+
+// Process the lane of a worker, without the lock of the instance: move the
+// results of its rings to the SW result queues, then append the commands of
+// its SW command queues to its rings. Other workers with a lane may take
+// these commands as well, so the consumer side of the queues is taken
+// first. Once its queues are empty, the worker takes commands from the
+// other ones if its lane has room - see pka_steal_cmds().
+static void pka_lane_process(pka_local_info_t *local_info)
+{
+    pka_global_info_t *gbl_info;
+    pka_worker_t      *worker;
+    uint64_t           workers_mask;
+    uint32_t           workers_cnt, worker_idx, cmds_num;
+    uint8_t            class_idx;
+
+    int errors = 0;
+
+    gbl_info     = local_info->gbl_info;
+    worker       = &gbl_info->workers[local_info->id];
+    workers_mask = 0;
+
+    errors += pka_lane_rslt_dequeue(gbl_info, worker, &workers_mask);
+
+    // Move the results of our commands stolen by other workers as well,
+    // rather than wait for them to process their lane.
+    if (pka_atomic32_load(&worker->stolen))
+    {
+        workers_cnt = pka_atomic32_load_acq(&gbl_info->slots_cnt);
+        for (worker_idx = 0; worker_idx < workers_cnt; worker_idx++)
+        {
+            if (worker_idx != local_info->id &&
+                    gbl_info->workers[worker_idx].lane_cnt)
+                errors += pka_lane_rslt_dequeue(gbl_info,
+                                                &gbl_info->workers[worker_idx],
+                                                &workers_mask);
+        }
+    }
+
+    if (errors)
+        PKA_DEBUG(PKA_USER, "failed to dequeue %d results\n", errors);
+
+    pka_notify_workers(gbl_info, workers_mask);
+
+    for (class_idx = 0; class_idx < PKA_CMD_CLASSES_CNT; class_idx++)
+        pka_queue_cons_lock(worker->cmd_queues[class_idx]);
+
+    do
+    {
+        cmds_num = pka_process_cmd_queues(gbl_info, local_info->id, 0,
+                                          PKA_CMD_CLASSES_CNT - 1, NULL,
+                                          NULL);
+    } while (cmds_num);
+
+    for (class_idx = 0; class_idx < PKA_CMD_CLASSES_CNT; class_idx++)
+        pka_queue_cons_unlock(worker->cmd_queues[class_idx]);
+
+    if (!pka_cmd_queues_objs(worker))
+        pka_steal_cmds(gbl_info, local_info->id, worker);
+}
+
+// Return whether commands are in flight on the shared rings.
+static bool pka_pool_busy(pka_global_info_t *gbl_info)
+{
+    uint8_t ring_idx;
+
+    for (ring_idx = 0; ring_idx < gbl_info->pool_rings_cnt; ring_idx++)
+    {
+        if (gbl_info->rings[ring_idx].ring_desc.cmd_desc_cnt)
+            return true;
+    }
+
+    return false;
+}
+
+// Return whether commands are pending in the SW command queues or in flight
+// on the HW rings.
+static bool pka_progress_busy(pka_global_info_t *gbl_info)
+{
+    pka_worker_t *worker;
+    uint32_t      workers_cnt, idx;
+
+    workers_cnt = pka_atomic32_load_acq(&gbl_info->slots_cnt);
+    for (idx = 0; idx < workers_cnt * PKA_CMD_CLASSES_CNT; idx++)
+    {
+        worker = &gbl_info->workers[idx / PKA_CMD_CLASSES_CNT];
+        if (!pka_queue_is_empty(worker->cmd_queues[idx % PKA_CMD_CLASSES_CNT]))
+            return true;
+    }
+
+    // There are no lanes with a progress thread.
+    return pka_pool_busy(gbl_info);
+}
+
+// Main loop of the progress thread. The thread alone moves the results from
+// the HW rings to the SW result queues and the commands from the SW command
+// queues to the HW rings. It spins while commands are in flight, and sleeps
+// on its doorbell when there is nothing left to do.
+static void *pka_progress_loop(void *arg)
+{
+    pka_global_info_t *gbl_info;
+    pka_progress_t    *progress;
+    pka_local_info_t   local_info;
+    struct pollfd      pfd;
+    eventfd_t          cnt;
+
+    gbl_info = (pka_global_info_t *) arg;
+    progress = &gbl_info->progress;
+
+    memset(&local_info, 0, sizeof(pka_local_info_t));
+    local_info.id       = PKA_PROGRESS_ID;
+    local_info.gbl_info = gbl_info;
+    local_info.event_fd = -1;
+
+    pfd.fd     = progress->doorbell_fd;
+    pfd.events = POLLIN;
+
+    while (!progress->stop)
+    {
+        // The lock is only contended by the workers withdrawing queued
+        // commands, see pka_cancel().
+        while (pka_lock_acquire(gbl_info, PKA_PROGRESS_ID,
+                                    false) != LOCK_ACQUIRED)
+            pka_cpu_relax();
+
+        pka_process_queues_sync(&local_info);
+
+        if (pka_progress_busy(gbl_info))
+        {
+            sched_yield();
+            continue;
+        }
+
+        // Nothing is in flight. Sleep until a worker rings the doorbell,
+        // once we made sure that no command was enqueued meanwhile - see
+        // pka_progress_kick().
+        progress->idle = true;
+        pka_mb_full();
+        if (!pka_progress_busy(gbl_info) && !progress->stop)
+            poll(&pfd, 1, -1);
+
+        progress->idle = false;
+        eventfd_read(progress->doorbell_fd, &cnt);
+    }
+
+    return NULL;
+}
+
+// Wake up the progress thread, if it sleeps, once a command was enqueued on a
+// SW command queue.
+static void pka_progress_kick(pka_global_info_t *gbl_info)
+{
+    pka_mb_full();
+    if (gbl_info->progress.idle)
+        eventfd_write(gbl_info->progress.doorbell_fd, 1);
+}
+
+// Start the progress thread of an instance. The thread is pinned to the last
+// CPU the caller may run on, application threads usually start from the first
+// ones.
+static int pka_progress_start(pka_global_info_t *gbl_info)
+{
+    pka_progress_t *progress;
+    pthread_attr_t  attr;
+    cpu_set_t       cpu_set;
+    int             cpu, last_cpu;
+
+    int ret;
+
+    progress       = &gbl_info->progress;
+    progress->idle = false;
+    progress->stop = false;
+
+    progress->doorbell_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (progress->doorbell_fd < 0)
+        return -errno;
+
+    pthread_attr_init(&attr);
+    if (!sched_getaffinity(0, sizeof(cpu_set_t), &cpu_set))
+    {
+        last_cpu = -1;
+        for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (CPU_ISSET(cpu, &cpu_set))
+                last_cpu = cpu;
+        }
+
+        CPU_ZERO(&cpu_set);
+        CPU_SET(last_cpu, &cpu_set);
+        pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpu_set);
+    }
+
+    ret = pthread_create(&progress->thread, &attr, pka_progress_loop,
+                         gbl_info);
+    pthread_attr_destroy(&attr);
+    if (ret)
+    {
+        close(progress->doorbell_fd);
+        return -ret;
+    }
+
+    return 0;
+}
+
+// Stop the progress thread of an instance.
+static void pka_progress_stop(pka_global_info_t *gbl_info)
+{
+    pka_progress_t *progress;
+
+    progress       = &gbl_info->progress;
+    progress->stop = true;
+    pka_mb_full();
+    eventfd_write(progress->doorbell_fd, 1);
+
+    pthread_join(progress->thread, NULL);
+    close(progress->doorbell_fd);
+}
+
+// Process a PK command in software. Operands are read in the rings byte
+// order - i.e. as they would be written to window RAM - so that results
+// are returned as HW rings would return them.
+static int pka_soft_cmd_process(pka_global_info_t    *gbl_info,
+                                pka_queue_cmd_desc_t *cmd_desc,
+                                pka_operands_t       *operands,
+                                pka_soft_rslt_t      *soft_rslt)
+{
+    pka_operand_t operand_descs[MAX_OPERAND_CNT];
+    uint8_t       operand_idx, operand_cnt;
+
+    operand_cnt = cmd_desc->operand_cnt;
+    if (operand_cnt > MAX_OPERAND_CNT)
+        return -EINVAL;
+
+    for (operand_idx = 0; operand_idx < operand_cnt; operand_idx++)
+    {
+        operand_descs[operand_idx]            = operands->operands[operand_idx];
+        operand_descs[operand_idx].big_endian = gbl_info->rings_byte_order;
+    }
+
+    return pka_soft_process_cmd(cmd_desc->opcode, operand_cnt,
+                                cmd_desc->shift_cnt, operand_descs, soft_rslt);
+}
+
+// Append the result of a PK command processed in software to the result
+// queue of the worker. Only the lock of the result queue is taken, the owner
+// of the lock of the instance may be moving results to it meanwhile.
+static pka_status_t pka_soft_rslt_enqueue(pka_local_info_t     *local_info,
+                                          pka_queue_cmd_desc_t *cmd_desc,
+                                          pka_soft_rslt_t      *soft_rslt)
+{
+    pka_global_info_t     *gbl_info;
+    pka_queue_rslt_desc_t  rslt_desc;
+    pka_worker_t          *worker;
+    pka_queue_t           *rslt_queue;
+    pka_results_t         *rslt_bufs;
+    pka_operand_t         *result;
+    uint8_t                worker_id, result_idx, big_endian;
+
+    int rc = 0;
+
+    gbl_info   = local_info->gbl_info;
+    worker_id  = local_info->id;
+    worker     = &gbl_info->workers[worker_id];
+    rslt_queue = worker->rslt_queue;
+    rslt_bufs  = (pka_results_t *) cmd_desc->rslt_bufs;
+
+    memset(&rslt_desc, 0, sizeof(pka_queue_rslt_desc_t));
+    pka_queue_set_soft_rslt_desc(&rslt_desc, soft_rslt, cmd_desc->opcode,
+                                 cmd_desc->cmd_num, cmd_desc->user_data,
+                                 worker_id);
+
+    pka_rslt_queue_lock(worker);
+    if (pka_rslt_bufs_fit(rslt_bufs, &rslt_desc))
+    {
+        big_endian = 0;
+        for (result_idx = 0; result_idx < rslt_desc.result_cnt; result_idx++)
+        {
+            result     = &soft_rslt->results[result_idx];
+            big_endian = result->big_endian;
+            memcpy(rslt_bufs->results[result_idx].buf_ptr, result->buf_ptr,
+                   result->actual_len);
+        }
+
+        rc = pka_rslt_bufs_cmpl_enqueue(rslt_queue, &rslt_desc, rslt_bufs,
+                                        big_endian);
+    }
+    else
+    {
+        rc = pka_queue_soft_rslt_enqueue(rslt_queue, &rslt_desc, soft_rslt);
+    }
+    pka_rslt_queue_unlock(worker);
+
+    if (rc)
+    {
+        PKA_DEBUG(PKA_USER, "worker %d - failed to enqueue a result on SW "
+                                "queue\n", worker_id);
+    }
+    else
+    {
+        pka_stats_processing_cycles_cnt(worker_id, cmd_desc->cmd_num);
+        pka_notify_workers(gbl_info, (uint64_t) 1 << worker_id);
+    }
+
+    return (rc) ? FAILURE : SUCCESS;
+}
+
+// Take the lock of the request accounting of a handle, when several threads
+// share it - see PKA_F_SHARED_HANDLES.
+static void pka_handle_lock(pka_local_info_t *local_info)
+{
+    if (!(local_info->gbl_info->flags & PKA_F_SHARED_HANDLES))
+        return;
+
+    while (!pka_spin_trylock(&local_info->lock))
+        pka_cpu_relax();
+}
+
+// Release the lock of the request accounting of a shared handle.
+static void pka_handle_unlock(pka_local_info_t *local_info)
+{
+    if (local_info->gbl_info->flags & PKA_F_SHARED_HANDLES)
+        pka_spin_unlock(&local_info->lock);
+}
+
+// Account for a submitted request of a handle. The work units of the
+// outstanding requests give the expected completion time of the requests
+// - see pka_wait_result().
+static void pka_request_add(pka_local_info_t *local_info, uint32_t cmd_num)
+{
+    pka_cmd_stats_db_t *stats_db;
+
+    stats_db = &pka_cmd_stats_db[local_info->id];
+
+    pka_handle_lock(local_info);
+
+    local_info->req_num   += 1;
+    local_info->req_units += stats_db->cmd_stats[cmd_num].cost_units;
+
+    if (local_info->credits)
+    {
+        local_info->credits  -= 1;
+        local_info->credited += 1;
+    }
+
+    pka_handle_unlock(local_info);
+}
+
+// Process a PK command on the calling CPU, when it can be appended neither
+// to a HW ring nor to the SW queue of the worker, or when there are no rings.
+// This spills the excess of commands to the CPUs instead of dropping them.
+// It also processes the commands the dispatch cost model sends to the CPU,
+// in which case 'spill' is false.
+static pka_status_t pka_soft_submit_cmd(pka_local_info_t     *local_info,
+                                        pka_queue_cmd_desc_t *cmd_desc,
+                                        pka_operands_t       *operands,
+                                        bool                  spill)
+{
+    pka_global_info_t    *gbl_info;
+    pka_dispatch_stats_t *dispatch_stats;
+    pka_soft_rslt_t       soft_rslt;
+
+    gbl_info = local_info->gbl_info;
+    if (!(gbl_info->flags & PKA_F_SOFT_FALLBACK))
+        return FAILURE;
+
+    pka_stats_overhead_cycles_cnt(local_info->id, cmd_desc->cmd_num);
+
+    if (pka_soft_cmd_process(gbl_info, cmd_desc, operands, &soft_rslt))
+    {
+        PKA_DEBUG(PKA_USER, "worker %d - failed to process a command in "
+                                "software\n", local_info->id);
+        return FAILURE;
+    }
+
+    if (pka_soft_rslt_enqueue(local_info, cmd_desc, &soft_rslt) != SUCCESS)
+        return FAILURE;
+
+    dispatch_stats = &gbl_info->dispatch_stats[local_info->id];
+    if (spill)
+        dispatch_stats->spilled_cmds += 1;
+    else
+        dispatch_stats->cpu_cmds += 1;
+
+    pka_request_add(local_info, cmd_desc->cmd_num);
+    return SUCCESS;
+}
+
+// Set the descriptor of a PK command to submit, and start its statistics.
+static pka_status_t pka_prepare_cmd(pka_local_info_t     *local_info,
+                                    void                 *user_data,
+                                    pka_results_t        *rslt_bufs,
+                                    pka_opcode_t          opcode,
+                                    pka_operands_t       *operands,
+                                    pka_queue_cmd_desc_t *cmd_desc,
+                                    uint64_t             *cost_units)
+{
+    uint32_t cmd_num;
+    uint8_t  worker_id;
+
+    worker_id = local_info->id;
+
+    // Preapare statistics
+    cmd_num     = pka_stats_start_cycles_cnt(worker_id,
+                        local_info->gbl_info->flags & PKA_F_SHARED_HANDLES);
+    *cost_units = pka_dispatch_cmd_units(opcode, operands);
+    pka_stats_cost_units(worker_id, cmd_num, *cost_units);
+
+    // Set a command descriptor to enqueue.
+    //cmd_num    = local_info->req_num;
+    memset(cmd_desc, 0, sizeof(pka_queue_cmd_desc_t));
+    if (pka_queue_set_cmd_desc(cmd_desc, cmd_num, user_data, opcode,
+                                    operands))
+    {
+        PKA_DEBUG(PKA_USER, "failed to set command descriptor\n");
+        pka_stats_discard(worker_id, cmd_num);
+        return FAILURE;
+    }
+
+    cmd_desc->rslt_bufs = (uint64_t) rslt_bufs;
+    cmd_desc->priority    = local_info->priority;
+    cmd_desc->cost_units  = *cost_units;
+    cmd_desc->submit_time = pka_cpu_cycles();
+    if (local_info->timeout)
+        cmd_desc->deadline = cmd_desc->submit_time + local_info->timeout;
+    if (cmd_desc->priority == PKA_PRIORITY_HIGH)
+        local_info->gbl_info->dispatch_stats[worker_id].high_cmds += 1;
+
+    return SUCCESS;
+}
+
+// Return whether a PK command should be processed on the CPU, because it is
+// expected to complete sooner than on the HW rings - e.g. small commands on
+// busy rings.
+static bool pka_use_cpu(pka_global_info_t *gbl_info,
+                        pka_opcode_t       opcode,
+                        pka_operands_t    *operands,
+                        uint64_t           cost_units)
+{
+    if (!(gbl_info->flags & PKA_F_SOFT_FALLBACK))
+        return false;
+
+    return pka_dispatch_use_cpu(&gbl_info->dispatch, gbl_info->rings,
+                                gbl_info->rings_cnt, opcode, operands,
+                                cost_units);
+}
+
+// Record a PK command of a batch. The command is submitted later on, along
+// with the other commands of the batch - see pka_submit_batch().
+static pka_status_t pka_batch_add_cmd(pka_batch_t    *batch,
+                                      void           *user_data,
+                                      pka_results_t  *rslt_bufs,
+                                      pka_opcode_t    opcode,
+                                      pka_operands_t *operands)
+{
+    pka_batch_entry_t *entry;
+
+    if (batch->cnt >= PKA_MAX_BATCH_CNT)
+        return FAILURE;
+
+    entry            = &batch->entries[batch->cnt++];
+    entry->user_data = user_data;
+    entry->rslt_bufs = rslt_bufs;
+    entry->opcode    = opcode;
+    entry->operands  = *operands;
+
+    return SUCCESS;
+}
+
+// Append a command of a worker whose lane is full to a shared ring, if the
+// lock of the instance can be taken right away. The queues are then
+// processed as usual before the lock is released. Returns 0 on success, or
+// a negative error code.
+static int pka_pool_cmd_enqueue(pka_local_info_t     *local_info,
+                                pka_queue_cmd_desc_t *cmd_desc,
+                                pka_operands_t       *operands)
+{
+    pka_global_info_t *gbl_info;
+    pka_ring_info_t   *ring_info;
+
+    int rc = -ENOBUFS;
+
+    gbl_info = local_info->gbl_info;
+    if (!gbl_info->pool_rings_cnt)
+        return -ENOBUFS;
+
+    if (pka_lock_acquire(gbl_info, local_info->id, false) != LOCK_ACQUIRED)
+        return -EBUSY;
+
+    if (pka_cmd_can_bypass(gbl_info, cmd_desc))
+    {
+        ring_info = pka_pool_ring(gbl_info, local_info->id, cmd_desc);
+        if (ring_info)
+            rc = pka_ring_cmd_enqueue(gbl_info, ring_info, local_info->id,
+                                      cmd_desc, operands->operands, true);
+    }
+
+    pka_process_queues_sync(local_info);
+    return rc;
+}
+
+// Append a command of a worker with a lane to one of its rings, unless
+// commands of the same class already wait in its SW command queue. Once the
+// lane is full, the command goes to a shared ring if possible, else to the
+// SW command queue, which the worker drains to its lane. Returns 0 on
+// success, or a negative error code.
+static int pka_lane_cmd_enqueue(pka_local_info_t     *local_info,
+                                pka_queue_cmd_desc_t *cmd_desc,
+                                pka_operands_t       *operands,
+                                bool                  flush)
+{
+    pka_global_info_t *gbl_info;
+    pka_queue_t       *cmd_queue;
+
+    int rc;
+
+    gbl_info  = local_info->gbl_info;
+    cmd_queue = pka_cmd_queue(&gbl_info->workers[local_info->id], cmd_desc);
+
+    if (pka_queue_is_empty(cmd_queue) &&
+            !pka_cmd_enqueue(gbl_info, local_info->id, cmd_desc,
+                             operands->operands, flush))
+        return 0;
+
+    if (!pka_pool_cmd_enqueue(local_info, cmd_desc, operands))
+        return 0;
+
+    rc = pka_queue_cmd_enqueue(cmd_queue, cmd_desc, operands);
+    if (rc)
+        PKA_DEBUG(PKA_USER, "worker %d - failed to enqueue a command "
+                                "descriptor on SW queue\n", local_info->id);
+
+    return rc;
+}
+
+// Submit PK command
+static pka_status_t pka_submit_cmd(pka_handle_t    handle,
+                                   void           *user_data,
+                                   pka_opcode_t    opcode,
+                                   pka_operands_t *operands)
+{
+    pka_global_info_t    *gbl_info;
+    pka_local_info_t     *local_info;
+    pka_worker_t         *worker;
+    pka_dispatch_stats_t *dispatch_stats;
+    pka_results_t        *rslt_bufs;
+    pka_queue_t          *cmd_queue;
+    pka_lock_t            lock;
+    uint8_t               worker_id;
+    bool                  spill;
+
+    pka_queue_cmd_desc_t  cmd_desc;
+    uint64_t              cost_units;
+
+    int rc = 0;
+
+    // Get context information.
+    local_info = (pka_local_info_t *) handle;
+    gbl_info   = local_info->gbl_info;
+    worker_id  = local_info->id;
+    worker     = &gbl_info->workers[worker_id];
+
+    dispatch_stats = &gbl_info->dispatch_stats[worker_id];
+
+    // The reserved command must be committed first, no other command may be
+    // enqueued meanwhile - see pka_reserve_cmd().
+    if (local_info->resv.cmd_queue)
+    {
+        PKA_DEBUG(PKA_USER, "worker %d - a command is reserved\n", worker_id);
+        return FAILURE;
+    }
+
+    // Result buffers attached with pka_set_result_bufs() only apply to this
+    // command.
+    rslt_bufs             = local_info->rslt_bufs;
+    local_info->rslt_bufs = NULL;
+
+    // Commands of a batch are only recorded here, see pka_submit_batch().
+    if (local_info->batch)
+        return pka_batch_add_cmd(local_info->batch, user_data, rslt_bufs,
+                                 opcode, operands);
+
+    if (pka_prepare_cmd(local_info, user_data, rslt_bufs, opcode, operands,
+                        &cmd_desc, &cost_units) != SUCCESS)
+        return FAILURE;
+
+    cmd_queue = pka_cmd_queue(worker, &cmd_desc);
+
+    //
+    // Start processing PK command.
+    //
+
+    // Without rings, every command is processed in software.
+    if (!gbl_info->rings_cnt)
+        return pka_soft_submit_cmd(local_info, &cmd_desc, operands,
+                                   true);
+
+    // Process the command on the CPU if it is expected to complete sooner
+    // than on the HW rings. Go on with the HW rings if this fails.
+    if (pka_use_cpu(gbl_info, opcode, operands, cost_units) &&
+            pka_soft_submit_cmd(local_info, &cmd_desc, operands,
+                                false) == SUCCESS)
+        return SUCCESS;
+
+    // The progress thread alone owns the HW rings, just append the command
+    // to our SW queue.
+    if (gbl_info->flags & PKA_F_PROGRESS_THREAD)
+    {
+        if (rc != pka_queue_cmd_enqueue(cmd_queue, &cmd_desc,
+                                            operands))
+        {
+            PKA_DEBUG(PKA_USER, "worker %d - failed to enqueue a command"
+                                   " descriptor on SW queue\n", worker_id);
+            return pka_soft_submit_cmd(local_info, &cmd_desc, operands,
+                                       true);
+        }
+
+        pka_request_add(local_info, cmd_desc.cmd_num);
+        dispatch_stats->hw_cmds += 1;
+        pka_progress_kick(gbl_info);
+        return SUCCESS;
+    }
+
+    // A worker with a lane appends the command to its own rings, without
+    // the lock.
+    if (worker->lane_cnt)
+    {
+        if (pka_lane_cmd_enqueue(local_info, &cmd_desc, operands, true))
+            return pka_soft_submit_cmd(local_info, &cmd_desc, operands,
+                                       true);
+
+        pka_request_add(local_info, cmd_desc.cmd_num);
+        dispatch_stats->hw_cmds += 1;
+        pka_lane_process(local_info);
+        return SUCCESS;
+    }
+
+    // Check the synchronization mode
+    if (gbl_info->flags & PKA_F_SYNC_MODE_DISABLE)
+    {
+        // simple case where no synchronization need to be done
+        if (!pka_cmd_can_bypass(gbl_info, &cmd_desc))
+        {
+            PKA_DEBUG(PKA_USER, "there are no available descs\n");
+
+            if (rc != pka_queue_cmd_enqueue(cmd_queue, &cmd_desc,
+                                                operands))
+            {
+                PKA_DEBUG(PKA_USER, "worker %d - failed to enqueue a "
+                                        "command descriptor on SW queue\n",
+                                        worker_id);
+                return pka_soft_submit_cmd(local_info, &cmd_desc, operands,
+                                           true);
+            }
+
+        }
+        else
+        {
+            if(rc != pka_cmd_enqueue(gbl_info, worker_id, &cmd_desc,
+                                        operands->operands, true))
+            {
+                PKA_DEBUG(PKA_USER, "worker %d - failed to enqueue a "
+                                        "command descriptor on HW ring\n",
+                                         worker_id);
+                return FAILURE;
+            }
+        }
+
+        pka_request_add(local_info, cmd_desc.cmd_num);
+        dispatch_stats->hw_cmds += 1;
+        pka_process_queues_nosync(local_info);
+        return SUCCESS;
+    }
+
+    // Multi-threading/lock-free case:
+
+    // BIG ASSUMPTION:  Assume that the pka_handle is locked/owned less than
+    // 10% of the time worst case and often less than 1% of the time!
+
+    // Based upon the assumption above, first just optimistically try to
+    // acquire the lock.  Should succeed the vast majority of time.  Make sure
+    // set_bit is FALSE here, since we have not yet copied the request
+    // (cmd and operands) into the sw_request ring.
+    lock = pka_lock_acquire(gbl_info, local_info->id, false);
+    if (lock == LOCK_ACQUIRED)
+    {
+        spill = false;
+
+        // We are now the owner of all of the global state - including all
+        // the HW rings.  Note that we do want to copy the request to the
+        // end of the sw_req queue if we can instead directly append it to
+        // the end of a HW cmd ring!  Hence the following code.
+        if (!pka_cmd_can_bypass(gbl_info, &cmd_desc))
+        {
+            PKA_DEBUG(PKA_USER, "there are no available descs\n");
+
+            if (rc != pka_queue_cmd_enqueue(cmd_queue, &cmd_desc,
+                                            operands))
+            {
+                PKA_DEBUG(PKA_USER, "worker %d - failed to enqueue a "
+                                        "command descriptor on SW queue\n",
+                                         worker_id);
+                spill = true;
+            }
+        }
+        else
+        {
+            if(rc != pka_cmd_enqueue(gbl_info, worker_id, &cmd_desc,
+                                        operands->operands, true))
+            {
+                PKA_DEBUG(PKA_USER, "worker %d - failed to enqueue a "
+                                        "command descriptor on HW ring\n",
+                                         worker_id);
+                // If we cannot append command to HW ring we enqueue it in
+                // our SW queue.
+                if (rc != pka_queue_cmd_enqueue(cmd_queue, &cmd_desc,
+                                                    operands))
+                {
+                    PKA_DEBUG(PKA_USER, "worker %d - failed to enqueue a "
+                                            "command descriptor on SW queue\n",
+                                             worker_id);
+                    spill = true;
+                }
+            }
+        }
+
+        pka_process_queues_sync(local_info);
+
+        // The command was neither appended to a HW ring nor to our SW
+        // queue. Process it in software, now that the lock is released.
+        if (spill)
+            return pka_soft_submit_cmd(local_info, &cmd_desc, operands,
+                                       true);
+
+        pka_request_add(local_info, cmd_desc.cmd_num);
+        dispatch_stats->hw_cmds += 1;
+        return SUCCESS;
+    }
+
+    // We now need to append our request to the end of our SW cmd queue,
+    // after making sure that there is room!
+    if (rc != pka_queue_cmd_enqueue(cmd_queue, &cmd_desc,
+                                        operands))
+    {
+        PKA_DEBUG(PKA_USER, "worker %d - failed to enqueue a command"
+                               " descriptor on SW queue\n", worker_id);
+        // There is not enough room in the SW cmd queue, process the command
+        // in software rather than failing.
+        return pka_soft_submit_cmd(local_info, &cmd_desc, operands,
+                                   true);
+    }
+
+    pka_request_add(local_info, cmd_desc.cmd_num);
+    dispatch_stats->hw_cmds += 1;
+
+    // We failed on our first attempt to acquire the lock.  We will make a
+    // second attempt, but first we need to register our request, in case
+    // we fail a second time.  Note that this call first waits (if neccessary)
+    // for any previous request bit of ours to be cleared, since if we set it
+    // a second time there is no record of the fact that we made multiple
+    // requests.  Thats because each bit setting corresponds to exactly one
+    // pk request.  Note that "bit" is TRUE here.
+    lock = pka_lock_acquire(gbl_info, local_info->id, true);
+    if (lock == LOCK_ACQUIRED)
+    {
+        pka_process_queues_sync(local_info);
+        return SUCCESS;
+    }
+
+    // This is the somewhat rare case of failing a second attempt to acquire
+    // the global lock.  We assume/require that the current owner is guaranteed
+    // to see our previously set request bit and act on it before it can
+    // release the lock.  Hence we can just return.
+    return SUCCESS;
+
+}
+
+// Path of a PK command of a batch.
+typedef enum
+{
+    PKA_BATCH_PATH_HW,      // HW rings.
+    PKA_BATCH_PATH_CPU,     // CPU, chosen by the dispatch cost model.
+    PKA_BATCH_PATH_SPILL    // CPU, the HW cannot take the command.
+} pka_batch_path_t;
+
+// Append a PK command of a batch to our lane, if any, or to the HW rings if
+// we own the lock, else to our SW queue. The HW is not notified yet. Returns
+// 0 on success, and sets 'queued' if the command waits in the SW queue.
+static int pka_batch_hw_enqueue(pka_local_info_t     *local_info,
+                                pka_queue_cmd_desc_t *cmd_desc,
+                                pka_operands_t       *operands,
+                                bool                  owner,
+                                bool                 *queued)
+{
+    pka_global_info_t *gbl_info;
+    pka_worker_t      *worker;
+    uint8_t            worker_id;
+
+    gbl_info  = local_info->gbl_info;
+    worker_id = local_info->id;
+    worker    = &gbl_info->workers[worker_id];
+
+    if (worker->lane_cnt)
+        return pka_lane_cmd_enqueue(local_info, cmd_desc, operands, false);
+
+    if (owner && pka_cmd_can_bypass(gbl_info, cmd_desc) &&
+            !pka_cmd_enqueue(gbl_info, worker_id, cmd_desc,
+                             operands->operands, false))
+        return 0;
+
+    if (pka_queue_cmd_enqueue(pka_cmd_queue(worker, cmd_desc), cmd_desc,
+                              operands))
+    {
+        PKA_DEBUG(PKA_USER, "worker %d - failed to enqueue a command "
+                                "descriptor on SW queue\n", worker_id);
+        return -ENOBUFS;
+    }
+
+    *queued = true;
+    return 0;
+}
+
+// Submit the PK commands of a batch. The lock is taken once for the batch,
+// and each ring is notified once of all the commands appended to it. The
+// commands are submitted in order, up to the first one which cannot be
+// submitted. Returns the number of commands submitted - i.e. the index of
+// that command.
+//
+// A command processed on the CPU may take long, so the commands appended
+// before it are notified to the HW and the lock is released first, as
+// pka_submit_cmd() does. The commands after it go through our SW queue.
+static int pka_submit_batch_cmds(pka_local_info_t *local_info,
+                                 pka_batch_t      *batch)
+{
+    pka_global_info_t    *gbl_info;
+    pka_worker_t         *worker;
+    pka_dispatch_stats_t *dispatch_stats;
+    pka_batch_entry_t    *entry;
+    pka_queue_cmd_desc_t  cmd_descs[PKA_MAX_BATCH_CNT];
+    pka_batch_path_t      paths[PKA_MAX_BATCH_CNT];
+    uint64_t              cost_units;
+    uint32_t              idx, prepared_cnt;
+    uint8_t               worker_id;
+    bool                  sync, owner, queued;
+
+    int submitted_cnt;
+
+    gbl_info       = local_info->gbl_info;
+    worker_id      = local_info->id;
+    worker         = &gbl_info->workers[worker_id];
+    dispatch_stats = &gbl_info->dispatch_stats[worker_id];
+    sync           = !(gbl_info->flags & PKA_F_SYNC_MODE_DISABLE);
+    queued         = false;
+
+    // Set the command descriptors, and pick the commands to process on the
+    // CPU, before taking the lock.
+    for (idx = 0; idx < batch->cnt; idx++)
+    {
+        entry = &batch->entries[idx];
+        if (pka_prepare_cmd(local_info, entry->user_data, entry->rslt_bufs,
+                            entry->opcode, &entry->operands, &cmd_descs[idx],
+                            &cost_units) != SUCCESS)
+            break;
+
+        if (!gbl_info->rings_cnt)
+            paths[idx] = PKA_BATCH_PATH_SPILL;
+        else if (pka_use_cpu(gbl_info, entry->opcode, &entry->operands,
+                             cost_units))
+            paths[idx] = PKA_BATCH_PATH_CPU;
+        else
+            paths[idx] = PKA_BATCH_PATH_HW;
+    }
+
+    prepared_cnt = idx;
+
+    owner = true;
+    if ((gbl_info->flags & PKA_F_PROGRESS_THREAD) || worker->lane_cnt)
+        owner = false;
+    else if (sync)
+        owner = (pka_lock_acquire(gbl_info, worker_id, false) ==
+                    LOCK_ACQUIRED);
+
+    // Submit the commands in order, so that those submitted are a prefix of
+    // the batch. A command the HW cannot take spills to the CPU, and the
+    // commands for the CPU are processed in place.
+    for (idx = 0; idx < prepared_cnt; idx++)
+    {
+        entry = &batch->entries[idx];
+        if (paths[idx] == PKA_BATCH_PATH_HW)
+        {
+            if (!pka_batch_hw_enqueue(local_info, &cmd_descs[idx],
+                                      &entry->operands, owner, &queued))
+            {
+                pka_request_add(local_info, cmd_descs[idx].cmd_num);
+                dispatch_stats->hw_cmds += 1;
+                continue;
+            }
+
+            paths[idx] = PKA_BATCH_PATH_SPILL;
+        }
+
+        if (worker->lane_cnt)
+        {
+            pka_flush_lane(gbl_info, worker);
+        }
+        else if (owner)
+        {
+            pka_flush_rings(gbl_info);
+            if (sync)
+            {
+                pka_process_queues_sync(local_info);
+                owner = false;
+            }
+        }
+
+        if (pka_soft_submit_cmd(local_info, &cmd_descs[idx], &entry->operands,
+                                paths[idx] == PKA_BATCH_PATH_SPILL) != SUCCESS)
+            break;
+    }
+
+    submitted_cnt = idx;
+    for (; idx < prepared_cnt; idx++)
+        pka_stats_discard(worker_id, cmd_descs[idx].cmd_num);
+
+    if (worker->lane_cnt)
+    {
+        pka_flush_lane(gbl_info, worker);
+        pka_lane_process(local_info);
+    }
+    else if (owner)
+    {
+        // Ring the doorbell of each ring once for the whole batch.
+        pka_flush_rings(gbl_info);
+
+        if (sync)
+            pka_process_queues_sync(local_info);
+        else
+            pka_process_queues_nosync(local_info);
+    }
+    else if (queued && (gbl_info->flags & PKA_F_PROGRESS_THREAD))
+    {
+        pka_progress_kick(gbl_info);
+    }
+    else if (queued)
+    {
+        // Same as pka_submit_cmd() - register our request, the lock owner
+        // will see it if we fail a second time.
+        if (pka_lock_acquire(gbl_info, worker_id, true) ==
+                LOCK_ACQUIRED)
+            pka_process_queues_sync(local_info);
+    }
+
+    return submitted_cnt;
+}
+
+static void pka_parse_result(pka_queue_rslt_desc_t *rslt_desc,
+                             pka_results_t         *results)
+{
+    // Get command descriptor information.
+    results->user_data      = (void *) rslt_desc->user_data;
+    results->opcode         = rslt_desc->opcode;
+    results->result_cnt     = rslt_desc->result_cnt;
+    results->status         = rslt_desc->status;
+    results->compare_result = rslt_desc->compare_result;
+}
+
+// Acknowledgement for returned result.
+static void pka_result_ack(pka_local_info_t      *local_info,
+                           pka_queue_rslt_desc_t *rslt_desc)
+{
+    pka_cmd_stats_db_t *stats_db;
+    uint64_t            cost_units;
+
+    stats_db   = &pka_cmd_stats_db[local_info->id];
+    cost_units = stats_db->cmd_stats[rslt_desc->cmd_num].cost_units;
+
+    pka_handle_lock(local_info);
+
+    if (local_info->req_num > 0)
+        local_info->req_num -= 1;
+
+    // The statistics entry might have been reused by a newer command.
+    if (local_info->req_num == 0 || local_info->req_units < cost_units)
+        local_info->req_units = 0;
+    else
+        local_info->req_units -= cost_units;
+
+    // Results do not tell whether their request consumed a credit. Credits
+    // go back to the instance as soon as there are fewer outstanding requests
+    // than credited ones, i.e. at the latest once all of them completed.
+    if (local_info->credited > local_info->req_num)
+    {
+        _pka_atomic32_fetch_add_relaxed(&local_info->gbl_info->credits,
+                                        local_info->credited -
+                                            local_info->req_num);
+        local_info->credited = local_info->req_num;
+    }
+
+    pka_handle_unlock(local_info);
+}
+
+// Take the consumer side of the SW result queue of a handle, when several
+// threads share it - see PKA_F_SHARED_HANDLES.
+static void pka_rslt_cons_lock(pka_global_info_t *gbl_info,
+                               pka_queue_t       *rslt_queue)
+{
+    if (gbl_info->flags & PKA_F_SHARED_HANDLES)
+        pka_queue_cons_lock(rslt_queue);
+}
+
+// Release the consumer side of the SW result queue of a shared handle.
+static void pka_rslt_cons_unlock(pka_global_info_t *gbl_info,
+                                 pka_queue_t       *rslt_queue)
+{
+    if (gbl_info->flags & PKA_F_SHARED_HANDLES)
+        pka_queue_cons_unlock(rslt_queue);
+}
+
+// Process the queues before returning results, if the lock can be taken.
+static void pka_rslt_process_queues(pka_local_info_t *local_info)
+{
+    pka_global_info_t *gbl_info;
+    pka_lock_t         lock;
+
+    gbl_info = local_info->gbl_info;
+
+    // The progress thread processes the queues.
+    if (gbl_info->flags & PKA_F_PROGRESS_THREAD)
+        return;
+
+    // A worker with a lane processes it, and only takes the lock when
+    // commands - its own perhaps - are in flight on the shared rings.
+    if (gbl_info->workers[local_info->id].lane_cnt)
+    {
+        pka_lane_process(local_info);
+        if (!pka_pool_busy(gbl_info))
+            return;
+    }
+
+    // Do queue processing -- if our result is not available i.e. our
+    // SW queue is empty, we can process SW queues a second time. Calling
+    // pka_process_queues_(no)sync() might help to dequeue our result and
+    // push it to SW queue, if our result is ready in HW rings- Otherwise
+    // our command might be pending in SW queue, so the call might cause
+    // the enqueue of our cmd from SW queue to a HW ring and next time
+    // when we will call again pka_get_rslt() (after tn > t0 + T), we
+    // make sure that our result will be ready.
+    if (gbl_info->flags & PKA_F_SYNC_MODE_DISABLE)
+    {
+        pka_process_queues_nosync(local_info);
+    }
+    else
+    {
+        lock = pka_lock_acquire(gbl_info, local_info->id, false);
+        if (lock == LOCK_ACQUIRED)
+            pka_process_queues_sync(local_info);
+    }
+}
+
+// Clear the completion fd of a handle, if any, and signal it again when
+// results are left in its SW result queue - i.e. the fd remains readable
+// as long as results might be pending.
+static void pka_rearm_result_fd(pka_local_info_t *local_info)
+{
+    pka_worker_t *worker;
+    eventfd_t     cnt;
+    int           rslt_fd;
+
+    worker  = &local_info->gbl_info->workers[local_info->id];
+    rslt_fd = (int) pka_atomic32_load(&worker->rslt_fd);
+    if (rslt_fd < 0)
+        return;
+
+    eventfd_read(rslt_fd, &cnt);
+    if (!pka_queue_is_empty(worker->rslt_queue))
+        eventfd_write(rslt_fd, 1);
+}
+
+// Return results pending in SW queue.
+int pka_get_result(pka_handle_t handle, pka_results_t *results)
+{
+    pka_local_info_t      *local_info;
+    pka_global_info_t     *gbl_info;
+    pka_worker_t          *worker;
+    pka_queue_rslt_desc_t  rslt_desc;
+    pka_queue_t           *rslt_queue;
+    uint8_t                worker_id;
+
+    int rc = 0;
+
+    local_info = (pka_local_info_t *) handle;
+    if (!local_info)
+    {
+        PKA_DEBUG(PKA_USER, "bad PK handle");
+        return FAILURE;
+    }
 
-    // Append descriptor to a ring. No need to check return value, this call
-    // is not supposed to fail.
-    pka_ring_enqueue_cmd_desc(ring_info, &ring_desc);
+    gbl_info  = local_info->gbl_info;
+    worker_id = local_info->id;
+    worker    = &gbl_info->workers[worker_id];
 
-    // increment the request counter.
-    gbl_info->requests_cnt += 1;
+    pka_rslt_process_queues(local_info);
 
-    // Capture overhead cycles cnt
-    pka_stats_overhead_cycles_cnt(worker_id, cmd_desc->cmd_num);
+    if (pka_queue_is_empty(worker->rslt_queue))
+    {
+        //PKA_DEBUG(PKA_USER, "worker %d's result queue is empty\n",
+        //            local_info->id);
+        // *TBD* make a second attempt to process queues (cost?)
+        pka_rearm_result_fd(local_info);
+        return FAILURE;
+    }
 
-    return 0;
+    rslt_queue = worker->rslt_queue;
+    memset(&rslt_desc, 0, sizeof(pka_queue_rslt_desc_t));
+    pka_rslt_cons_lock(gbl_info, rslt_queue);
+    rc = pka_queue_rslt_dequeue(rslt_queue, &rslt_desc, results);
+    pka_rslt_cons_unlock(gbl_info, rslt_queue);
+    if (!rc)
+    {
+        pka_parse_result(&rslt_desc, results);
+        pka_result_ack(local_info, &rslt_desc);
+        pka_rearm_result_fd(local_info);
+        return SUCCESS;
+    }
+
+    // Another thread sharing the handle might have taken the result.
+    PKA_DEBUG(PKA_USER, "worker %d failed to dequeue result "
+                                "descriptor from SW queue\n", worker_id);
+
+    return FAILURE;
 }
 
-static int pka_process_cmd_queues(pka_global_info_t *gbl_info,
-                                  uint8_t            worker_id)
+// Return up to 'max_cnt' results pending in SW queue, after a single pass
+// of queue processing.
+int pka_get_results(pka_handle_t  handle,
+                    pka_results_t results[],
+                    uint32_t      max_cnt)
 {
-    pka_queue_cmd_desc_t  cmd_desc;
-    pka_worker_t         *worker;
-    pka_queue_t          *cmd_queue;
+    pka_local_info_t      *local_info;
+    pka_queue_rslt_desc_t  rslt_desc;
+    pka_queue_t           *rslt_queue;
+    uint32_t               rslt_cnt;
 
     int rc = 0;
 
-    worker    = &gbl_info->workers[worker_id];
-    cmd_queue = worker->cmd_queue;
+    local_info = (pka_local_info_t *) handle;
+    if (!local_info || !results)
+    {
+        PKA_DEBUG(PKA_USER, "bad PK handle");
+        return -EINVAL;
+    }
 
-    if (pka_queue_is_empty(cmd_queue))
-        return 0;
+    rslt_queue = local_info->gbl_info->workers[local_info->id].rslt_queue;
 
-    // Dequeue SW queue.
-    memset(&cmd_desc, 0, sizeof(pka_queue_cmd_desc_t));
-    if (rc == pka_queue_load_cmd_desc(&cmd_desc, cmd_queue))
+    pka_rslt_process_queues(local_info);
+
+    pka_rslt_cons_lock(local_info->gbl_info, rslt_queue);
+    for (rslt_cnt = 0; rslt_cnt < max_cnt; rslt_cnt++)
     {
-        // Enqueue cmd descriptor in HW rings.
-        if(rc != pka_cmd_enqueue(gbl_info, worker_id, &cmd_desc,
-                                    PKA_INVALID_OPERANDS))
+        if (pka_queue_is_empty(rslt_queue))
+            break;
+
+        memset(&rslt_desc, 0, sizeof(pka_queue_rslt_desc_t));
+        if (rc != pka_queue_rslt_dequeue(rslt_queue, &rslt_desc,
+                                         &results[rslt_cnt]))
         {
-            PKA_DEBUG(PKA_USER, "failed to enqueue a command descriptor"
-                                    " of worker %d on HW rings\n", worker_id);
-            return 0;
+            PKA_DEBUG(PKA_USER, "worker %d failed to dequeue result "
+                        "descriptor from SW queue\n", local_info->id);
+            break;
         }
 
-        return 1;
+        pka_parse_result(&rslt_desc, &results[rslt_cnt]);
+        pka_result_ack(local_info, &rslt_desc);
     }
+    pka_rslt_cons_unlock(local_info->gbl_info, rslt_queue);
 
-    PKA_DEBUG(PKA_USER, "failed to dequeue a command descriptor from SW"
-                            " queue of worker %d\n", worker_id);
-    return 0;
+    pka_rearm_result_fd(local_info);
+
+    return rslt_cnt;
 }
 
-static int pka_process_queues_sync(pka_local_info_t *local_info)
+// Return the completion fd of a handle, routing the ring interrupts to it
+// on first use.
+int pka_get_result_fd(pka_handle_t handle)
 {
-    pka_global_info_t *gbl_info;
-    pka_lock_t         lock;
-    uint32_t           cmds_num, workers_cnt;
-    uint8_t            worker_idx;
+    pka_local_info_t   *local_info;
+    pka_global_info_t  *gbl_info;
+    pka_worker_t       *worker;
+    struct epoll_event  event;
+    uint32_t            ring_idx, rings_cnt;
+    int                 event_fd, rslt_fd, irq_fd;
 
-    int ret;
+    int ret = 0;
 
-    gbl_info    = local_info->gbl_info;
-    workers_cnt = pka_atomic32_load(&gbl_info->workers_cnt);
-    // We are now the owner of all of the PK context - including all
-    // the HW rings.
+    local_info = (pka_local_info_t *) handle;
+    if (!local_info)
+    {
+        PKA_DEBUG(PKA_USER, "bad PK handle");
+        return -EINVAL;
+    }
 
-    // First we do reply processing.
-    ret = pka_rslt_dequeue(local_info);
-    if (ret)
-        PKA_DEBUG(PKA_USER, "failed to dequeue %d results\n", ret);
+    if (local_info->event_fd >= 0)
+        return local_info->event_fd;
 
-    // Next process all SW cmd queues at least once. Stop when a full sweep
-    // of the SW cmd queues results in nothing.
-    while (true)
+    gbl_info = local_info->gbl_info;
+    worker   = &gbl_info->workers[local_info->id];
+
+    // File descriptors are not shared with the other processes, which might
+    // move the results of the handle.
+    if (gbl_info->flags & PKA_F_PROCESS_MODE_MULTI)
     {
-        cmds_num = 0;
-        for (worker_idx = 0; worker_idx < workers_cnt; worker_idx++)
-            cmds_num += pka_process_cmd_queues(gbl_info, worker_idx);
+        PKA_DEBUG(PKA_USER, "completion fds are not supported in multi "
+                                "process mode\n");
+        return -EPERM;
+    }
 
-        if (cmds_num == 0)
-            break;
+    // Results that complete on the HW rings are only moved to the SW result
+    // queue when the queues are processed. Thus a waiting thread must also
+    // be woken up by the ring interrupts, otherwise it might sleep forever.
+    // This is not needed when the progress thread processes the queues.
+    rings_cnt = gbl_info->rings_cnt;
+    if (gbl_info->flags & PKA_F_PROGRESS_THREAD)
+        rings_cnt = 0;
+
+    pthread_mutex_lock(&pka_irq_lock);
+    for (ring_idx = 0; ring_idx < rings_cnt && !ret; ring_idx++)
+        ret = pka_ring_enable_irq(&gbl_info->rings[ring_idx]);
+    pthread_mutex_unlock(&pka_irq_lock);
+    if (ret)
+        return ret;
+
+    rslt_fd  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    event_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (rslt_fd < 0 || event_fd < 0)
+    {
+        ret = -errno;
+        goto exit_error;
     }
 
-    // Now try to release the lock, but if we can't because of some other
-    // thread's request bit is set, then re-process that SW cmd queue.
-    while (true)
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    if (epoll_ctl(event_fd, EPOLL_CTL_ADD, rslt_fd, &event))
     {
-        lock = pka_try_release_lock(&gbl_info->lock.v, local_info->id);
-        if (lock == LOCK_RELEASED)
-            break; // lock was released.
+        ret = -errno;
+        goto exit_error;
+    }
 
-        worker_idx = lock;
-        pka_process_cmd_queues(gbl_info, worker_idx);
+    for (ring_idx = 0; ring_idx < rings_cnt; ring_idx++)
+    {
+        irq_fd = gbl_info->rings[ring_idx].irq_fd;
+        if (epoll_ctl(event_fd, EPOLL_CTL_ADD, irq_fd, &event))
+        {
+            ret = -errno;
+            goto exit_error;
+        }
     }
 
-    return 0;
-}
+    pka_atomic32_store_rel(&worker->rslt_fd, rslt_fd);
+    local_info->event_fd = event_fd;
 
-static int pka_process_queues_nosync(pka_local_info_t *local_info)
-{
-    uint32_t workers_cnt, cmds_num;
-    uint8_t  worker_idx;
+    // Outstanding requests might have completed before the ring interrupts
+    // were routed; make sure the next wait returns so that they are polled.
+    if (local_info->req_num)
+        eventfd_write(rslt_fd, 1);
 
-    int ret;
+    return event_fd;
 
-    // First we do reply processing.
-    ret = pka_rslt_dequeue(local_info);
-    if (ret)
-        PKA_DEBUG(PKA_USER, "failed to dequeue %d results\n", ret);
+exit_error:
+    PKA_DEBUG(PKA_USER, "failed to create completion fd of handle %d\n",
+                local_info->id);
+    if (rslt_fd >= 0)
+        close(rslt_fd);
+    if (event_fd >= 0)
+        close(event_fd);
+    return ret;
+}
 
-    workers_cnt = pka_atomic32_load(&local_info->gbl_info->workers_cnt);
-    // Next process all SW cmd queues at least once. Stop when a full sweep
-    // of the SW cmd queues results in nothing.
-    while (true)
-    {
-        cmds_num = 0;
-        for (worker_idx = 0; worker_idx < workers_cnt; worker_idx++)
-            cmds_num += pka_process_cmd_queues(local_info->gbl_info,
-                                                    worker_idx);
+// Block until the completion fd of a handle is signalled, for at most
+// 'timeout_us' microseconds. When the fd is not supported, sleep instead,
+// doubling the sleep time 'sleep_us' at each call.
+static void pka_wait_block(pka_handle_t handle,
+                           uint64_t     timeout_us,
+                           uint32_t    *sleep_us)
+{
+    struct pollfd   pfd;
+    struct timespec req;
+    uint64_t        sleep_time;
 
-        if (cmds_num == 0)
-            break;
+    pfd.fd     = pka_get_result_fd(handle);
+    pfd.events = POLLIN;
+    if (pfd.fd >= 0)
+    {
+        if (timeout_us == PKA_WAIT_FOREVER)
+            poll(&pfd, 1, -1);
+        else
+            poll(&pfd, 1, (timeout_us + 999) / 1000);
+        return;
     }
 
-    return 0;
+    sleep_time  = MIN(*sleep_us, timeout_us);
+    req.tv_sec  = sleep_time / 1000000;
+    req.tv_nsec = (sleep_time % 1000000) * 1000;
+    nanosleep(&req, NULL);
+
+    *sleep_us = MIN(*sleep_us * 2, PKA_WAIT_SLEEP_MAX_US);
 }
 
-// Submit PK command
-static pka_status_t pka_submit_cmd(pka_handle_t    handle,
-                                   void           *user_data,
-                                   pka_opcode_t    opcode,
-                                   pka_operands_t *operands)
+// Wait for a result of the handle - spin, then yield and finally block.
+int pka_wait_result(pka_handle_t      handle,
+                    pka_results_t    *results,
+                    uint32_t          timeout_us,
+                    pka_wait_stats_t *stats)
 {
-    pka_global_info_t *gbl_info;
-    pka_local_info_t  *local_info;
-    pka_worker_t      *worker;
-    pka_lock_t         lock;
-    uint8_t            worker_id;
-
-    pka_queue_cmd_desc_t  cmd_desc;
-    uint32_t              cmd_num;
+    pka_local_info_t *local_info;
+    pka_dispatch_t   *dispatch;
+    pka_wait_stats_t  wait_stats;
+    uint64_t          ticks_per_us, start, last, now, elapsed, timeout;
+    uint64_t          spin_window, remaining_us, *phase_ns;
+    uint32_t          yield_cnt, sleep_us, idx;
 
-    int rc = 0;
+    int ret;
 
-    // Get context information.
     local_info = (pka_local_info_t *) handle;
-    gbl_info   = local_info->gbl_info;
-    worker_id  = local_info->id;
-    worker     = &gbl_info->workers[worker_id];
-
-    // Preapare statistics
-    cmd_num = pka_stats_start_cycles_cnt(worker_id);
-
-    // Set a command descriptor to enqueue.
-    //cmd_num    = local_info->req_num;
-    memset(&cmd_desc, 0, sizeof(pka_queue_cmd_desc_t));
-    if (pka_queue_set_cmd_desc(&cmd_desc, cmd_num, user_data, opcode,
-                                    operands))
+    if (!local_info || !results)
     {
-        PKA_DEBUG(PKA_USER, "failed to set command descriptor\n");
-        pka_stats_discard(worker_id, cmd_num);
-        return FAILURE;
+        PKA_DEBUG(PKA_USER, "bad PK handle");
+        return -EINVAL;
     }
 
-    //
-    // Start processing PK command.
-    //
+    memset(&wait_stats, 0, sizeof(wait_stats));
 
-    // Check the synchronization mode
-    if (gbl_info->flags & PKA_F_SYNC_MODE_DISABLE)
+    dispatch     = &local_info->gbl_info->dispatch;
+    ticks_per_us = dispatch->ticks_per_us;
+    timeout      = (uint64_t) timeout_us * ticks_per_us;
+
+    // Spin for the expected completion time of an average outstanding
+    // request, i.e. until the next result is likely to be available.
+    spin_window = 0;
+    if (local_info->req_num)
+        spin_window = pka_dispatch_hw_cost(dispatch,
+                            local_info->req_units / local_info->req_num);
+    spin_window = MAX(spin_window, PKA_WAIT_SPIN_MIN_US * ticks_per_us);
+    spin_window = MIN(spin_window, PKA_WAIT_SPIN_MAX_US * ticks_per_us);
+
+    yield_cnt = 1;
+    sleep_us  = PKA_WAIT_SLEEP_MIN_US;
+    start     = pka_cpu_cycles();
+    last      = start;
+    phase_ns  = &wait_stats.spin_ns;
+
+    while (true)
     {
-        // simple case where no synchronization need to be done
-        if (!pka_has_avail_descs(gbl_info))
+        if (!pka_get_result(handle, results))
         {
-            PKA_DEBUG(PKA_USER, "there are no available descs\n");
+            ret = 0;
+            break;
+        }
 
-            if (rc != pka_queue_cmd_enqueue(worker->cmd_queue, &cmd_desc,
-                                                operands))
-            {
-                PKA_DEBUG(PKA_USER, "worker %d - failed to enqueue a "
-                                        "command descriptor on SW queue\n",
-                                        worker_id);
-                return FAILURE;
-            }
+        if (!local_info->req_num)
+        {
+            ret = -ENOENT;
+            break;
+        }
+
+        now     = pka_cpu_cycles();
+        elapsed = pka_cpu_cycles_diff(now, start);
+        if (timeout_us != PKA_WAIT_FOREVER && elapsed >= timeout)
+        {
+            ret = -ETIMEDOUT;
+            break;
+        }
 
+        if (elapsed < spin_window)
+        {
+            phase_ns = &wait_stats.spin_ns;
+            pka_wait();
+        }
+        else if (yield_cnt <= PKA_WAIT_YIELD_MAX_CNT)
+        {
+            phase_ns = &wait_stats.yield_ns;
+            for (idx = 0; idx < yield_cnt; idx++)
+                sched_yield();
+            yield_cnt *= 2;
         }
         else
         {
-            if(rc != pka_cmd_enqueue(gbl_info, worker_id, &cmd_desc,
-                                        operands->operands))
-            {
-                PKA_DEBUG(PKA_USER, "worker %d - failed to enqueue a "
-                                        "command descriptor on HW ring\n",
-                                         worker_id);
-                return FAILURE;
-            }
+            phase_ns     = &wait_stats.sleep_ns;
+            remaining_us = PKA_WAIT_FOREVER;
+            if (timeout_us != PKA_WAIT_FOREVER)
+                remaining_us = (timeout - elapsed + ticks_per_us - 1) /
+                                    ticks_per_us;
+            pka_wait_block(handle, remaining_us, &sleep_us);
         }
 
-        local_info->req_num += 1;
-        pka_process_queues_nosync(local_info);
-        return SUCCESS;
+        // Account for the time of this attempt in the current phase.
+        now        = pka_cpu_cycles();
+        *phase_ns += (pka_cpu_cycles_diff(now, last) * 1000) / ticks_per_us;
+        last       = now;
     }
 
-    // Multi-threading/lock-free case:
+    // The last attempt belongs to the phase it concludes.
+    *phase_ns += (pka_cpu_cycles_diff(pka_cpu_cycles(), last) * 1000) /
+                        ticks_per_us;
 
-    // BIG ASSUMPTION:  Assume that the pka_handle is locked/owned less than
-    // 10% of the time worst case and often less than 1% of the time!
+    if (stats)
+        *stats = wait_stats;
 
-    // Based upon the assumption above, first just optimistically try to
-    // acquire the lock.  Should succeed the vast majority of time.  Make sure
-    // set_bit is FALSE here, since we have not yet copied the request
-    // (cmd and operands) into the sw_request ring.
-    lock = pka_try_acquire_lock(&gbl_info->lock.v, local_info->id, false);
-    if (lock == LOCK_ACQUIRED)
+    return ret;
+}
+
+// Attach result buffers to the next PK command submitted.
+int pka_set_result_bufs(pka_handle_t handle, pka_results_t *results)
+{
+    pka_local_info_t *local_info;
+
+    local_info = (pka_local_info_t *) handle;
+    if (!local_info)
     {
-        // We are now the owner of all of the global state - including all
-        // the HW rings.  Note that we do want to copy the request to the
-        // end of the sw_req queue if we can instead directly append it to
-        // the end of a HW cmd ring!  Hence the following code.
-        if (!pka_has_avail_descs(gbl_info))
-        {
-            PKA_DEBUG(PKA_USER, "there are no available descs\n");
+        PKA_DEBUG(PKA_USER, "bad PK handle");
+        return -EINVAL;
+    }
 
-            if (rc != pka_queue_cmd_enqueue(worker->cmd_queue, &cmd_desc,
-                                            operands))
-                PKA_DEBUG(PKA_USER, "worker %d - failed to enqueue a "
-                                        "command descriptor on SW queue\n",
-                                         worker_id);
-        }
-        else
-        {
-            if(rc != pka_cmd_enqueue(gbl_info, worker_id, &cmd_desc,
-                                        operands->operands))
-            {
-                PKA_DEBUG(PKA_USER, "worker %d - failed to enqueue a "
-                                        "command descriptor on HW ring\n",
-                                         worker_id);
-                // If we cannot append command to HW ring we enqueue it in
-                // our SW queue.
-                if (rc != pka_queue_cmd_enqueue(worker->cmd_queue, &cmd_desc,
-                                                    operands))
-                    PKA_DEBUG(PKA_USER, "worker %d - failed to enqueue a "
-                                            "command descriptor on SW queue\n",
-                                             worker_id);
-            }
-        }
+    // The next command could be submitted by another thread.
+    if (local_info->gbl_info->flags & PKA_F_SHARED_HANDLES)
+        return -EPERM;
 
-        pka_process_queues_sync(local_info);
-        local_info->req_num += 1;
-        return SUCCESS;
+    // The result could be written by the lock owner, which might be another
+    // process to which the buffers are not mapped.
+    if (local_info->gbl_info->flags & PKA_F_PROCESS_MODE_MULTI)
+    {
+        PKA_DEBUG(PKA_USER, "result buffers cannot be attached in multi "
+                                "process mode\n");
+        return -EPERM;
     }
 
-    // We now need to append our request to the end of our SW cmd queue,
-    // after making sure that there is room!
-    if (rc != pka_queue_cmd_enqueue(worker->cmd_queue, &cmd_desc,
-                                        operands))
+    local_info->rslt_bufs = results;
+    return 0;
+}
+
+int pka_set_priority(pka_handle_t handle, pka_priority_t priority)
+{
+    pka_local_info_t *local_info;
+
+    local_info = (pka_local_info_t *) handle;
+    if (!local_info || priority >= PKA_PRIORITY_CNT)
+    {
+        PKA_DEBUG(PKA_USER, "bad PK handle or priority");
+        return -EINVAL;
+    }
+
+    local_info->priority = priority;
+    return 0;
+}
+
+int pka_set_weight(pka_handle_t handle, uint32_t weight)
+{
+    pka_local_info_t *local_info;
+
+    local_info = (pka_local_info_t *) handle;
+    if (!local_info || weight == 0 || weight > PKA_WEIGHT_MAX)
     {
-        PKA_DEBUG(PKA_USER, "worker %d - failed to enqueue a command"
-                               " descriptor on SW queue\n", worker_id);
-        return FAILURE; // There is not enough room in the SW cmd queue.
+        PKA_DEBUG(PKA_USER, "bad PK handle or weight");
+        return -EINVAL;
     }
 
-    local_info->req_num += 1;
+    local_info->gbl_info->workers[local_info->id].weight = weight;
+    return 0;
+}
 
-    // We failed on our first attempt to acquire the lock.  We will make a
-    // second attempt, but first we need to register our request, in case
-    // we fail a second time.  Note that this call first waits (if neccessary)
-    // for any previous request bit of ours to be cleared, since if we set it
-    // a second time there is no record of the fact that we made multiple
-    // requests.  Thats because each bit setting corresponds to exactly one
-    // pk request.  Note that "bit" is TRUE here.
-    lock = pka_try_acquire_lock(&gbl_info->lock.v, local_info->id, true);
-    if (lock == LOCK_ACQUIRED)
+int pka_set_timeout(pka_handle_t handle, uint32_t timeout_us)
+{
+    pka_local_info_t *local_info;
+
+    local_info = (pka_local_info_t *) handle;
+    if (!local_info)
     {
-        pka_process_queues_sync(local_info);
-        return SUCCESS;
+        PKA_DEBUG(PKA_USER, "bad PK handle");
+        return -EINVAL;
     }
 
-    // This is the somewhat rare case of failing a second attempt to acquire
-    // the global lock.  We assume/require that the current owner is guaranteed
-    // to see our previously set request bit and act on it before it can
-    // release the lock.  Hence we can just return.
-    return SUCCESS;
+    local_info->timeout = 0;
+    if (timeout_us != PKA_WAIT_FOREVER)
+        local_info->timeout = MAX((uint64_t) timeout_us *
+                        local_info->gbl_info->dispatch.ticks_per_us, 1);
 
+    return 0;
 }
 
-static void pka_parse_result(pka_queue_rslt_desc_t *rslt_desc,
-                             pka_results_t         *results)
+// Drop the commands left in the SW command queues of a handle being
+// terminated, with the same exclusion as pka_cancel(). Returns the number of
+// commands dropped.
+static uint32_t pka_flush_cmd_queues(pka_local_info_t *local_info)
 {
-    // Get command descriptor information.
-    results->user_data      = (void *) rslt_desc->user_data;
-    results->opcode         = rslt_desc->opcode;
-    results->result_cnt     = rslt_desc->result_cnt;
-    results->status         = rslt_desc->status;
-    results->compare_result = rslt_desc->compare_result;
-}
+    pka_global_info_t *gbl_info;
+    pka_worker_t      *worker;
+    pka_queue_t       *cmd_queue;
+    uint32_t           dropped;
+    uint8_t            worker_id, class_idx;
+    bool               locked;
 
-// Acknowledgement for returned result.
-static void pka_result_ack(pka_local_info_t *local_info)
-{
-    if (local_info->req_num > 0)
-        local_info->req_num -= 1;
+    gbl_info  = local_info->gbl_info;
+    worker_id = local_info->id;
+    worker    = &gbl_info->workers[worker_id];
+    locked    = false;
+    dropped   = 0;
+
+    if (!worker->lane_cnt &&
+            (!(gbl_info->flags & PKA_F_SYNC_MODE_DISABLE) ||
+                (gbl_info->flags & PKA_F_PROGRESS_THREAD)))
+    {
+        while (pka_lock_acquire(gbl_info, worker_id, false) !=
+                    LOCK_ACQUIRED)
+            pka_cpu_relax();
+        locked = true;
+    }
+
+    for (class_idx = 0; class_idx < PKA_CMD_CLASSES_CNT; class_idx++)
+    {
+        cmd_queue = worker->cmd_queues[class_idx];
+
+        // Other workers with a lane may read the queues of a lane.
+        if (worker->lane_cnt)
+            pka_queue_cons_lock(cmd_queue);
+
+        while (!pka_queue_is_empty(cmd_queue) &&
+                    !pka_queue_cmd_discard(cmd_queue))
+            dropped += 1;
+
+        if (worker->lane_cnt)
+            pka_queue_cons_unlock(cmd_queue);
+    }
+
+    // Release the lock, serving the pending requests of the other workers
+    // first, as pka_cancel() does.
+    if (!locked)
+        return dropped;
+
+    if (gbl_info->flags & PKA_F_PROGRESS_THREAD)
+    {
+        pka_lock_release(gbl_info, worker_id);
+        pka_progress_kick(gbl_info);
+    }
+    else
+        pka_process_queues_sync(local_info);
+
+    return dropped;
 }
 
-// Return results pending in SW queue.
-int pka_get_result(pka_handle_t handle, pka_results_t *results)
+// Withdraw the queued commands of a handle with the given user data. The SW
+// command queues of the handle are only read by the owner of the lock, so
+// the lock is acquired to mark the commands; they are then dropped as they
+// reach the head of the queues - see pka_process_cmd_queue(). The queues of
+// a handle with a lane are read without the lock, by the handles with a lane
+// which take their consumer side first.
+int pka_cancel(pka_handle_t handle, void *user_data)
 {
-    pka_local_info_t      *local_info;
-    pka_global_info_t     *gbl_info;
-    pka_worker_t          *worker;
-    pka_queue_rslt_desc_t  rslt_desc;
-    pka_queue_t           *rslt_queue;
-    pka_lock_t             lock;
-    uint8_t                worker_id;
+    pka_local_info_t  *local_info;
+    pka_global_info_t *gbl_info;
+    pka_worker_t      *worker;
+    uint8_t            worker_id, class_idx;
 
-    int rc = 0;
+    int canceled_cnt = 0;
 
     local_info = (pka_local_info_t *) handle;
     if (!local_info)
     {
         PKA_DEBUG(PKA_USER, "bad PK handle");
-        return FAILURE;
+        return -EINVAL;
     }
 
     gbl_info  = local_info->gbl_info;
     worker_id = local_info->id;
     worker    = &gbl_info->workers[worker_id];
 
-    // Do queue processing -- if our result is not available i.e. our
-    // SW queue is empty, we can process SW queues a second time. Calling
-    // pka_process_queues_(no)sync() might help to dequeue our result and
-    // push it to SW queue, if our result is ready in HW rings- Otherwise
-    // our command might be pending in SW queue, so the call might cause
-    // the enqueue of our cmd from SW queue to a HW ring and next time
-    // when we will call again pka_get_rslt() (after tn > t0 + T), we
-    // make sure that our result will be ready.
-    if (gbl_info->flags & PKA_F_SYNC_MODE_DISABLE)
+    if (!worker->lane_cnt &&
+            (!(gbl_info->flags & PKA_F_SYNC_MODE_DISABLE) ||
+                (gbl_info->flags & PKA_F_PROGRESS_THREAD)))
     {
-        pka_process_queues_nosync(local_info);
+        while (pka_lock_acquire(gbl_info, worker_id, false) !=
+                    LOCK_ACQUIRED)
+            pka_cpu_relax();
+    }
+
+    for (class_idx = 0; class_idx < PKA_CMD_CLASSES_CNT; class_idx++)
+    {
+        // Other workers with a lane may read the queues of a lane.
+        if (worker->lane_cnt)
+            pka_queue_cons_lock(worker->cmd_queues[class_idx]);
+
+        canceled_cnt += pka_queue_cmd_cancel(worker->cmd_queues[class_idx],
+                                             (uint64_t) user_data);
+
+        if (worker->lane_cnt)
+            pka_queue_cons_unlock(worker->cmd_queues[class_idx]);
     }
+
+    // Drop the commands already at the head of the queues, and release the
+    // lock.
+    if (worker->lane_cnt)
+        pka_lane_process(local_info);
+    else if (gbl_info->flags & PKA_F_PROGRESS_THREAD)
+    {
+        pka_lock_release(gbl_info, worker_id);
+        pka_progress_kick(gbl_info);
+    }
+    else if (gbl_info->flags & PKA_F_SYNC_MODE_DISABLE)
+        pka_process_queues_nosync(local_info);
     else
+        pka_process_queues_sync(local_info);
+
+    return (canceled_cnt) ? canceled_cnt : -ENOENT;
+}
+
+int pka_acquire_credits(pka_handle_t handle, uint32_t cnt)
+{
+    pka_local_info_t  *local_info;
+    pka_global_info_t *gbl_info;
+    uint32_t           credits;
+
+    local_info = (pka_local_info_t *) handle;
+    if (!local_info)
     {
-        lock = pka_try_acquire_lock(&gbl_info->lock.v, local_info->id, false);
-        if (lock == LOCK_ACQUIRED)
-            pka_process_queues_sync(local_info);
+        PKA_DEBUG(PKA_USER, "bad PK handle");
+        return -EINVAL;
     }
 
-    if (pka_queue_is_empty(worker->rslt_queue))
+    // The credits of a handle are not shared by its threads.
+    gbl_info = local_info->gbl_info;
+    if (gbl_info->flags & PKA_F_SHARED_HANDLES)
+        return -EPERM;
+
+    // Without rings, commands are processed on the CPU as they are
+    // submitted.
+    if (!gbl_info->credits_max)
+        return 0;
+
+    credits = pka_atomic32_load(&gbl_info->credits);
+    do
     {
-        //PKA_DEBUG(PKA_USER, "worker %d's result queue is empty\n",
-        //            local_info->id);
-        // *TBD* make a second attempt to process queues (cost?)
-        return FAILURE;
+        if (credits < cnt)
+            return -EAGAIN;
+    } while (!pka_atomic32_cas_acq_rel(&gbl_info->credits, &credits,
+                                       credits - cnt));
+
+    local_info->credits += cnt;
+    return 0;
+}
+
+int pka_release_credits(pka_handle_t handle, uint32_t cnt)
+{
+    pka_local_info_t *local_info;
+
+    local_info = (pka_local_info_t *) handle;
+    if (!local_info || cnt > local_info->credits)
+    {
+        PKA_DEBUG(PKA_USER, "bad PK handle or credits count");
+        return -EINVAL;
     }
 
-    rslt_queue = worker->rslt_queue;
-    memset(&rslt_desc, 0, sizeof(pka_queue_rslt_desc_t));
-    if (rc == pka_queue_rslt_dequeue(rslt_queue, &rslt_desc, results))
+    local_info->credits -= cnt;
+    _pka_atomic32_fetch_add_relaxed(&local_info->gbl_info->credits, cnt);
+    return 0;
+}
+
+// Register an operand so that queued commands reference its buffer instead
+// of holding a copy of it.
+int pka_register_operand(pka_handle_t handle, pka_operand_t *operand)
+{
+    pka_local_info_t *local_info;
+
+    local_info = (pka_local_info_t *) handle;
+    if (!local_info || !operand || !operand->buf_ptr)
     {
-        pka_parse_result(&rslt_desc, results);
-        pka_result_ack(local_info);
-        return SUCCESS;
+        PKA_DEBUG(PKA_USER, "bad PK handle or operand");
+        return -EINVAL;
     }
 
-    PKA_DEBUG(PKA_USER, "worker %d failed to dequeue result "
-                                "descriptor from SW queue\n", worker_id);
+    // Commands of a process might be dequeued by another process, which
+    // cannot read the operand buffers of the submitting process.
+    if (local_info->gbl_info->flags & PKA_F_PROCESS_MODE_MULTI)
+    {
+        PKA_DEBUG(PKA_USER, "operands cannot be registered in multi "
+                                "process mode\n");
+        return -EPERM;
+    }
 
-    return FAILURE;
+    operand->internal_use |= PKA_OPERAND_F_REGISTERED;
+    return 0;
+}
+
+// Unregister an operand - i.e. queued commands hold a copy of it again.
+int pka_unregister_operand(pka_handle_t handle, pka_operand_t *operand)
+{
+    if (!handle || !operand)
+    {
+        PKA_DEBUG(PKA_USER, "bad PK handle or operand");
+        return -EINVAL;
+    }
+
+    operand->internal_use &= ~PKA_OPERAND_F_REGISTERED;
+    return 0;
 }
 
 // Return if there is a avilable results.
@@ -2130,3 +5137,326 @@ int pka_dsa_signature_verify(pka_handle_t     handle,
         return pka_submit_cmd(handle, user_data, CC_DSA_VERIFY, &operands);
 }
 
+// Check the operands of a PK command of a batch. Commands are checked by
+// the pka_*() functions, which record them in the batch rather than
+// submitting them.
+static int pka_batch_check_cmd(pka_handle_t handle, pka_batch_cmd_t *cmd)
+{
+    void **args;
+
+    args = cmd->args;
+
+    switch (cmd->opcode)
+    {
+    case CC_ADD:
+        return pka_add(handle, cmd->user_data, args[0], args[1]);
+    case CC_SUBTRACT:
+        return pka_subtract(handle, cmd->user_data, args[0], args[1]);
+    case CC_ADD_SUBTRACT:
+        return pka_add_subtract(handle, cmd->user_data, args[0], args[1],
+                                args[2]);
+    case CC_MULTIPLY:
+        return pka_multiply(handle, cmd->user_data, args[0], args[1]);
+    case CC_DIVIDE:
+        return pka_divide(handle, cmd->user_data, args[0], args[1]);
+    case CC_MODULO:
+        return pka_modulo(handle, cmd->user_data, args[0], args[1]);
+    case CC_SHIFT_LEFT:
+        return pka_shift_left(handle, cmd->user_data, args[0],
+                              cmd->shift_cnt);
+    case CC_SHIFT_RIGHT:
+        return pka_shift_right(handle, cmd->user_data, args[0],
+                               cmd->shift_cnt);
+    case CC_MODULAR_EXP:
+        return pka_modular_exp(handle, cmd->user_data, args[0], args[1],
+                               args[2]);
+    case CC_MOD_EXP_CRT:
+        return pka_modular_exp_crt(handle, cmd->user_data, args[0], args[1],
+                                   args[2], args[3], args[4], args[5]);
+    case CC_MODULAR_INVERT:
+        return pka_modular_inverse(handle, cmd->user_data, args[0], args[1]);
+    case CC_ECC_PT_ADD:
+        return pka_ecc_pt_add(handle, cmd->user_data, args[0], args[1],
+                              args[2]);
+    case CC_ECC_PT_MULTIPLY:
+        return pka_ecc_pt_mult(handle, cmd->user_data, args[0], args[1],
+                               args[2]);
+    case CC_ECDSA_GENERATE:
+        return pka_ecdsa_signature_generate(handle, cmd->user_data, args[0],
+                                            args[1], args[2], args[3],
+                                            args[4], args[5]);
+    case CC_ECDSA_VERIFY:
+    case CC_ECDSA_VERIFY_NO_WRITE:
+        return pka_ecdsa_signature_verify(handle, cmd->user_data, args[0],
+                                          args[1], args[2], args[3], args[4],
+                                          args[5], cmd->opcode ==
+                                                CC_ECDSA_VERIFY_NO_WRITE);
+    case CC_DSA_GENERATE:
+        return pka_dsa_signature_generate(handle, cmd->user_data, args[0],
+                                          args[1], args[2], args[3], args[4],
+                                          args[5]);
+    case CC_DSA_VERIFY:
+    case CC_DSA_VERIFY_NO_WRITE:
+        return pka_dsa_signature_verify(handle, cmd->user_data, args[0],
+                                        args[1], args[2], args[3], args[4],
+                                        args[5], cmd->opcode ==
+                                                CC_DSA_VERIFY_NO_WRITE);
+    default:
+        PKA_DEBUG(PKA_USER, "opcode 0x%x cannot be batched\n", cmd->opcode);
+        return -EINVAL;
+    }
+}
+
+int pka_submit_batch(pka_handle_t     handle,
+                     pka_batch_cmd_t  cmds[],
+                     uint32_t         cmd_cnt)
+{
+    pka_local_info_t *local_info;
+    pka_batch_t       batch;
+    uint32_t          idx;
+
+    int rc = 0;
+
+    local_info = (pka_local_info_t *) handle;
+    if (!local_info || !cmds || (PKA_MAX_BATCH_CNT < cmd_cnt))
+    {
+        PKA_DEBUG(PKA_USER, "bad batch of PK commands\n");
+        return -EINVAL;
+    }
+
+    // The batch is recorded in the handle, see pka_batch_add_cmd().
+    if (local_info->gbl_info->flags & PKA_F_SHARED_HANDLES)
+        return -EPERM;
+
+    // The reserved command must be committed first, as in pka_submit_cmd().
+    if (local_info->resv.cmd_queue)
+    {
+        PKA_DEBUG(PKA_USER, "worker %d - a command is reserved\n",
+                  local_info->id);
+        return -EBUSY;
+    }
+
+    // Check all the commands first, none is submitted if one is not valid.
+    batch.cnt         = 0;
+    local_info->batch = &batch;
+    for (idx = 0; (idx < cmd_cnt) && !rc; idx++)
+    {
+        local_info->rslt_bufs = cmds[idx].rslt_bufs;
+        rc = pka_batch_check_cmd(handle, &cmds[idx]);
+    }
+    local_info->batch     = NULL;
+    local_info->rslt_bufs = NULL;
+
+    // The pka_*() functions return a pka_status_t, which must not be taken
+    // for a count of submitted commands.
+    if (rc)
+        return (rc > 0) ? -EINVAL : rc;
+
+    return pka_submit_batch_cmds(local_info, &batch);
+}
+
+// Reserve room for a PK command in the SW command queue of the handle. The
+// operand buffers are handed out in place when the room is contiguous, else
+// in the staging buffer of the handle, which is copied to the room on
+// commit.
+int pka_reserve_cmd(pka_handle_t   handle,
+                    void          *user_data,
+                    pka_opcode_t   opcode,
+                    pka_operand_t  operands[],
+                    uint32_t       operand_cnt,
+                    uint32_t       shift_cnt)
+{
+    pka_global_info_t *gbl_info;
+    pka_local_info_t  *local_info;
+    pka_results_t     *rslt_bufs;
+    pka_operand_t     *operand;
+    pka_resv_t        *resv;
+    uint64_t           cost_units;
+    uint32_t           idx;
+    uint8_t           *buf_ptr;
+    uint8_t            big_endian;
+
+    int rc;
+
+    local_info = (pka_local_info_t *) handle;
+    if (!local_info || !operands || !operand_cnt ||
+            (MAX_OPERAND_CNT < operand_cnt))
+    {
+        PKA_DEBUG(PKA_USER, "bad PK handle or operands\n");
+        return -EINVAL;
+    }
+
+    // The SW queues of shared handles take several producers, which cannot
+    // reserve room - see pka_queue_cmd_reserve().
+    gbl_info = local_info->gbl_info;
+    if (gbl_info->flags & PKA_F_SHARED_HANDLES)
+        return -EPERM;
+
+    resv     = &local_info->resv;
+    if (resv->cmd_queue || local_info->batch)
+    {
+        PKA_DEBUG(PKA_USER, "a PK command is already reserved\n");
+        return -EBUSY;
+    }
+
+    // Reserved commands are only processed by the HW rings.
+    if (!gbl_info->rings_cnt)
+        return -ENODEV;
+
+    big_endian = gbl_info->rings_byte_order;
+
+    memset(&resv->operands, 0, sizeof(pka_operands_t));
+    resv->operands.operand_cnt  = operand_cnt;
+    resv->operands.shift_amount = shift_cnt;
+    for (idx = 0; idx < operand_cnt; idx++)
+    {
+        operand = &operands[idx];
+        if (!operand->actual_len || (MAX_BYTE_LEN < operand->actual_len) ||
+                operand->internal_use)
+        {
+            PKA_DEBUG(PKA_USER, "bad operand %u\n", idx);
+            return -EINVAL;
+        }
+
+        operand->buf_len             = operand->actual_len;
+        operand->big_endian          = big_endian;
+        resv->operands.operands[idx] = *operand;
+    }
+
+    // Result buffers attached with pka_set_result_bufs() apply to this
+    // command.
+    rslt_bufs             = local_info->rslt_bufs;
+    local_info->rslt_bufs = NULL;
+
+    if (pka_prepare_cmd(local_info, user_data, rslt_bufs, opcode,
+                        &resv->operands, &resv->cmd_desc,
+                        &cost_units) != SUCCESS)
+        return -EINVAL;
+
+    // Unknown commands have no operands length.
+    if (!resv->cmd_desc.operands_len)
+    {
+        PKA_DEBUG(PKA_USER, "bad PK command code %u\n", opcode);
+        pka_stats_discard(local_info->id, resv->cmd_desc.cmd_num);
+        return -EINVAL;
+    }
+
+    resv->cmd_queue = pka_cmd_queue(&gbl_info->workers[local_info->id],
+                                    &resv->cmd_desc);
+    rc = pka_queue_cmd_reserve(resv->cmd_queue, &resv->cmd_desc,
+                               &resv->operands);
+
+    // The command wraps around the end of the queue, stage its operand data.
+    resv->staged = (rc == -EAGAIN);
+    if (resv->staged)
+    {
+        buf_ptr = resv->buf;
+        for (idx = 0; idx < operand_cnt; idx++)
+        {
+            resv->operands.operands[idx].buf_ptr = buf_ptr;
+            buf_ptr += resv->operands.operands[idx].actual_len;
+        }
+
+        rc = 0;
+    }
+
+    if (rc)
+    {
+        PKA_DEBUG(PKA_USER, "worker %d - failed to reserve a command "
+                                "descriptor on SW queue\n", local_info->id);
+        pka_stats_discard(local_info->id, resv->cmd_desc.cmd_num);
+        resv->cmd_queue = NULL;
+        return rc;
+    }
+
+    for (idx = 0; idx < operand_cnt; idx++)
+        operands[idx].buf_ptr = resv->operands.operands[idx].buf_ptr;
+
+    return 0;
+}
+
+// Submit the PK command reserved by the handle. As a command appended to
+// the SW queue by pka_submit_cmd(), it is then moved to the HW rings by the
+// owner of the rings.
+int pka_commit_cmd(pka_handle_t handle)
+{
+    pka_global_info_t *gbl_info;
+    pka_local_info_t  *local_info;
+    pka_operand_t     *operand;
+    pka_resv_t        *resv;
+    uint32_t           idx;
+    uint8_t            msb;
+
+    local_info = (pka_local_info_t *) handle;
+    if (!local_info)
+    {
+        PKA_DEBUG(PKA_USER, "bad PK handle\n");
+        return -EINVAL;
+    }
+
+    gbl_info = local_info->gbl_info;
+    resv     = &local_info->resv;
+    if (!resv->cmd_queue)
+        return -ENOENT;
+
+    // The rings expect operands without leading zero bytes, which the
+    // operand lengths were given for.
+    for (idx = 0; idx < resv->operands.operand_cnt; idx++)
+    {
+        operand = &resv->operands.operands[idx];
+        msb     = gbl_info->rings_byte_order ?
+                        operand->buf_ptr[0] :
+                        operand->buf_ptr[operand->actual_len - 1];
+        if (!msb)
+        {
+            PKA_DEBUG(PKA_USER, "operand %u has a leading zero byte\n", idx);
+            pka_abort_cmd(handle);
+            return -EINVAL;
+        }
+    }
+
+    pka_queue_cmd_commit(resv->cmd_queue, &resv->cmd_desc,
+                         resv->staged ? &resv->operands : NULL);
+
+    resv->cmd_queue = NULL;
+    pka_request_add(local_info, resv->cmd_desc.cmd_num);
+    gbl_info->dispatch_stats[local_info->id].hw_cmds += 1;
+
+    // Have the command moved to the HW rings, as pka_submit_cmd() does for
+    // the commands it appends to the SW queue.
+    if (gbl_info->flags & PKA_F_PROGRESS_THREAD)
+        pka_progress_kick(gbl_info);
+    else if (gbl_info->workers[local_info->id].lane_cnt)
+        pka_lane_process(local_info);
+    else if (gbl_info->flags & PKA_F_SYNC_MODE_DISABLE)
+        pka_process_queues_nosync(local_info);
+    else if (pka_lock_acquire(gbl_info, local_info->id, true) ==
+                LOCK_ACQUIRED)
+        pka_process_queues_sync(local_info);
+
+    return 0;
+}
+
+// Drop the PK command reserved by the handle.
+int pka_abort_cmd(pka_handle_t handle)
+{
+    pka_local_info_t *local_info;
+    pka_resv_t       *resv;
+
+    local_info = (pka_local_info_t *) handle;
+    if (!local_info)
+    {
+        PKA_DEBUG(PKA_USER, "bad PK handle\n");
+        return -EINVAL;
+    }
+
+    resv = &local_info->resv;
+    if (!resv->cmd_queue)
+        return -ENOENT;
+
+    pka_queue_cmd_abort(resv->cmd_queue);
+
+    pka_stats_discard(local_info->id, resv->cmd_desc.cmd_num);
+    resv->cmd_queue = NULL;
+    return 0;
+}
@@ -174,7 +174,93 @@ typedef enum
 /// All PK operations are synchronized :
 /// The PK library uses internal lock to ensure that multiple threads making
 /// PK calls are properly synchronized.
-    PKA_F_SYNC_MODE_ENABLE         = 0x8
+    PKA_F_SYNC_MODE_ENABLE         = 0x8,
+///
+/// Software fallback enabled :
+/// By default, a PK command which can be appended neither to a HW ring nor
+/// to the SW queue of the calling thread - e.g. under overload - fails, and
+/// pka_init_global() fails when rings cannot be retrieved. With this flag,
+/// such commands are processed in software on the calling CPU instead, and
+/// so are all the commands of an instance which has no ring. Small commands
+/// may also be dispatched to the CPU when it is expected to complete them
+/// sooner than the HW rings, see pka_dispatch_params_t.
+///
+/// @note The software engine is NOT constant time: the duration of a command
+/// processed on the CPU depends on the values of its operands. Only set this
+/// flag when timing side channels on the operands are not a concern.
+    PKA_F_SOFT_FALLBACK            = 0x10,
+///
+/// Progress thread mode :
+/// By default, the worker thread which holds the internal lock appends the
+/// commands of every worker to the HW rings and distributes the results, which
+/// adds unpredictable latency to that thread. With this flag, the instance
+/// starts an internal progress thread which alone owns the HW rings: worker
+/// threads only enqueue commands to their SW queue and dequeue results from
+/// it, without taking the lock. The thread spins while commands are in flight
+/// and sleeps otherwise. It is pinned to the last CPU the caller of
+/// pka_init_global() may run on, see pka_set_progress_cpu(). The
+/// synchronization mode flags then only apply to the commands processed in
+/// software. Not supported in multi process mode.
+    PKA_F_PROGRESS_THREAD          = 0x20,
+///
+/// Priority ring :
+/// Reserve one of the HW rings of the instance for the commands of high
+/// priority - see pka_set_priority(). Commands of normal priority are never
+/// appended to that ring, so that high priority commands do not wait behind
+/// them. A ring which is the first ring of its EIP-154 is picked if possible,
+/// since the EIP-154 may be configured to serve it first - see
+/// PKA_RING_OPTIONS_PRIORITY. Ignored when the instance has a single ring.
+    PKA_F_PRIORITY_RING            = 0x40,
+///
+/// Lane mode :
+/// Give each handle a lane of HW rings of its own, so that it appends its
+/// commands and retrieves its results without taking the internal lock.
+/// The rings are split evenly between the handles the instance is created
+/// for; the rings left over, if any, form a shared pool that handles fall
+/// back to, under the lock, when their lane is full. With fewer rings than
+/// handles, one ring forms the pool and the other ones are the lanes of the
+/// first handles. The priority ring, if any, is taken from the pool. A handle
+/// whose SW queues are empty takes the commands waiting in the SW queues of
+/// another handle, if its lane has room, and so does the owner of the lock
+/// with the room left on the pool; their results are returned to the
+/// handle which submitted them. Only applies in synchronized mode, without
+/// a progress thread.
+    PKA_F_LANE_MODE                = 0x80,
+///
+/// Ring selection policy :
+/// The following values select how commands are assigned to the HW rings,
+/// at most one of them might be given.
+/// By default, the ring with the most free descriptors is picked.
+    PKA_F_RING_POLICY_MOST_FREE    = 0x000,
+/// The ring with the least outstanding work, in cycles estimated by the
+/// dispatch cost model, so that short commands do not queue up behind long
+/// ones.
+    PKA_F_RING_POLICY_LEAST_LOADED = 0x100,
+/// The ring whose largest free window RAM chunk fits the operands of the
+/// command best, so that large chunks remain available for large commands.
+    PKA_F_RING_POLICY_BEST_FIT     = 0x200,
+/// Round robin, except that commands with the same opcode stick to the same
+/// ring as long as it has room.
+    PKA_F_RING_POLICY_AFFINITY     = 0x300,
+/// Each thread sticks to the rings of one EIP-154 (shim), picking the ring
+/// with the most free descriptors, and only uses the other rings when these
+/// are full.
+    PKA_F_RING_POLICY_SHIM_LOCAL   = 0x400,
+/// Mask of the ring selection policy.
+    PKA_F_RING_POLICY_MASK         = 0x700,
+///
+/// Shared handles :
+/// Let several threads use the same handle at once, so that more threads
+/// than handles - e.g. the threads of a thread-per-connection server - submit
+/// commands without locks of their own. The SW command queues then take
+/// several producers, which claim their room with a CAS rather than a lock.
+/// The results of a handle are returned to whichever of its threads asks
+/// first, so the user data should tell the threads which result is theirs.
+/// Attached result buffers, credits, batches and reserved commands belong to
+/// a single thread: pka_set_result_bufs(), pka_acquire_credits(),
+/// pka_submit_batch() and pka_reserve_cmd() fail with -EPERM. Lane mode is
+/// ignored.
+    PKA_F_SHARED_HANDLES           = 0x800
 } pka_flags_t;
 
 /// Global PKA initialization. This function must be called once (per instance)
@@ -187,17 +273,21 @@ typedef enum
 ///                          memory object to be created.
 /// @param flags             Flags used to select the processing mode and the
 ///                          synchronization mechanism. See pka_flags_t above.
+///                          Note that PKA_F_SOFT_FALLBACK lets commands run
+///                          on the CPU, which is not constant time.
 /// @param ring_cnt          Number of HW rings requested.
 /// @param queue_cnt         Number of queues that will be assigned to the
 ///                          worker threads. It might also refer to the number
-///                          of threads allowed to request PK operation.
+///                          of threads allowed to request PK operation at
+///                          once, at most 55. The queues of a handle are
+///                          created when the handle is first initialized.
 /// @param cmd_queue_size    Size of a software request queue (in bytes).
 /// @param result_queue_size Size of a software reply queue (in bytes).
 ///
 /// @return                  A valid PK instance on success,
 ///                          PKA_INSTANCE_INVALID on failure.
 pka_instance_t pka_init_global(const char* name,
-                               uint8_t     flags,
+                               uint32_t    flags,
                                uint32_t    ring_cnt,
                                uint32_t    queue_cnt,
                                uint32_t    cmd_queue_size,
@@ -209,6 +299,39 @@ pka_instance_t pka_init_global(const char* name,
 /// @param instance     A PK instance handle.
 void pka_term_global(pka_instance_t instance);
 
+/// Pin the progress thread of a PK instance to a CPU - e.g. a core dedicated
+/// to PK processing, isolated from the application threads.
+///
+/// @param instance     A PK instance handle, created with the
+///                     PKA_F_PROGRESS_THREAD flag.
+/// @param cpu          CPU to run the progress thread on.
+///
+/// @return             0 on success, a negative error code on failure - e.g.
+///                     -EPERM if the instance has no progress thread.
+int pka_set_progress_cpu(pka_instance_t instance, uint32_t cpu);
+
+/// Bound the work of the owner of the lock of a PK instance. Unless the
+/// instance has a progress thread, the thread which takes the lock appends
+/// the commands of all the handles from the SW queues to the HW rings, for as
+/// long as other handles request it - a submission may then cost many times
+/// its own command. Once an owner has appended 'max_cmds' commands, or spent
+/// 'max_us' microseconds since it took the lock, it releases the lock even
+/// though requests are pending. The handles whose requests are left pending
+/// are woken up, see pka_get_result_fd(), and take the lock over on their
+/// next call - e.g. pka_get_result(). The requests of the handles without a
+/// completion fd are kept, and served by the next owner of the lock. By
+/// default, the work is unbounded.
+///
+/// @param instance     A PK instance handle.
+/// @param max_cmds     Commands per acquisition of the lock, 0 if unbounded.
+/// @param max_us       Time per acquisition of the lock, in microseconds, 0
+///                     if unbounded.
+///
+/// @return             0 on success, a negative error code on failure.
+int pka_set_owner_budget(pka_instance_t instance,
+                         uint32_t       max_cmds,
+                         uint32_t       max_us);
+
 /// Return the number of rings allocated to a PK instance.
 ///
 /// @param instance     A PK instance handle.
@@ -223,19 +346,203 @@ uint32_t pka_get_rings_count(pka_instance_t instance);
 /// @return             The bitmask of allocated HW rings.
 uint32_t pka_get_rings_bitmask(pka_instance_t instance);
 
+/// Parameters of the cost model which dispatches PK commands either to the
+/// HW rings or to the CPU. For small commands - e.g. additions, shifts or
+/// RSA verifications with a short public exponent - the round trip through
+/// the HW rings costs more than the math itself. The cost of a command is
+/// estimated on both paths as a fixed cost plus a cost per work unit, a work
+/// unit being one 64x64-bit multiply-accumulate, the HW estimate including
+/// the commands already pending in the rings. The command is then processed
+/// wherever it is expected to complete first.
+///
+/// The CPU costs and the largest command sent to the CPU are calibrated by
+/// pka_init_global(), and the HW costs are refined from the latencies of the
+/// HW commands unless 'hw_autotune' is cleared.
+///
+/// Commands are only dispatched to the CPU by instances created with the
+/// PKA_F_SOFT_FALLBACK flag and, unless 'cpu_secret_ops' is set, only when
+/// their operands are deemed public - i.e. additions, subtractions, shifts,
+/// comparisons, copies, signature verifications and modular exponentiations
+/// with an exponent of at most 32 bits. Private key operations always run on
+/// the HW rings, which are constant time.
+typedef struct
+{
+    uint32_t hw_base_ns;    ///< fixed cost of a HW command, in ns.
+    uint32_t hw_unit_ps;    ///< HW cost per work unit, in ps.
+    uint32_t cpu_base_ns;   ///< fixed cost of a CPU command, in ns.
+    uint32_t cpu_unit_ps;   ///< CPU cost per work unit, in ps.
+    uint32_t max_cpu_units; ///< largest command processed on the CPU, in
+                            ///  work units. Zero disables the CPU path,
+                            ///  except for commands the HW cannot take.
+    uint8_t  hw_autotune;   ///< if set, HW costs follow the measurements.
+    uint8_t  cpu_secret_ops; ///< if set, commands on secret operands - e.g.
+                             ///  private key operations - may also be
+                             ///  processed on the CPU. Cleared by default.
+} pka_dispatch_params_t;
+
+/// Number of PK commands handled by each path since pka_init_global(), and
+/// how often commands were blocked in, or went past others in, the SW queues.
+typedef struct
+{
+    uint64_t hw_cmds;       ///< commands dispatched to the HW rings.
+    uint64_t cpu_cmds;      ///< commands dispatched to the CPU by the cost
+                            ///  model.
+    uint64_t spilled_cmds;  ///< commands processed on the CPU because the
+                            ///  HW could not take them.
+    uint64_t blocked_cmds;  ///< times the command at the head of a SW queue
+                            ///  could not be appended to any ring.
+    uint64_t bypass_cmds;   ///< commands appended to a ring from a SW queue
+                            ///  while a command of another class of the
+                            ///  same worker was blocked.
+    uint64_t high_cmds;     ///< commands of high priority, whichever path.
+    uint64_t expired_cmds;  ///< commands dropped from a SW queue, their
+                            ///  deadline passed.
+    uint64_t canceled_cmds; ///< commands dropped from a SW queue by
+                            ///  pka_cancel().
+} pka_dispatch_stats_t;
+
+/// Return the parameters of the HW/CPU dispatch cost model.
+///
+/// @param instance     A PK instance handle.
+/// @param params       Parameters of the cost model.
+///
+/// @return             0 on success, a negative error code on failure.
+int pka_get_dispatch_params(pka_instance_t         instance,
+                            pka_dispatch_params_t *params);
+
+/// Update the parameters of the HW/CPU dispatch cost model. This function
+/// may be called at any time.
+///
+/// @param instance     A PK instance handle.
+/// @param params       Parameters of the cost model.
+///
+/// @return             0 on success, a negative error code on failure.
+int pka_set_dispatch_params(pka_instance_t         instance,
+                            pka_dispatch_params_t *params);
+
+/// Return the number of commands handled by the HW rings and the CPU.
+///
+/// @param instance     A PK instance handle.
+/// @param stats        Dispatch counters.
+///
+/// @return             0 on success, a negative error code on failure.
+int pka_get_dispatch_stats(pka_instance_t        instance,
+                           pka_dispatch_stats_t *stats);
+
+/// Service of the SW command queues of a handle, since pka_init_local().
+typedef struct
+{
+    uint64_t served_cmds;   ///< commands appended to a HW ring after
+                            ///  waiting in the SW queues.
+    uint64_t served_bytes;  ///< window RAM bytes of those commands.
+    uint64_t delay_ns;      ///< total time those commands waited, from
+                            ///  their submission.
+    uint64_t max_delay_ns;  ///< longest time one of them waited.
+    uint64_t stolen_cmds;   ///< commands of other handles the handle took
+                            ///  from their SW queues, see PKA_F_LANE_MODE.
+    uint64_t stolen_delay_ns; ///< total time those commands waited, from
+                              ///  their submission.
+    uint32_t weight;        ///< current weight, see pka_set_weight().
+} pka_worker_stats_t;
+
+/// Return the service of the SW command queues of a handle of an instance.
+///
+/// @param instance     A PK instance handle.
+/// @param worker_id    Index of the handle - a handle initialized with
+///                     pka_init_local() takes the lowest index free, from 0.
+///                     The counters start from zero whenever a handle takes
+///                     the index.
+/// @param stats        Counters of the handle.
+///
+/// @return             0 on success, a negative error code on failure.
+int pka_get_worker_stats(pka_instance_t      instance,
+                         uint32_t            worker_id,
+                         pka_worker_stats_t *stats);
+
+/// Number of buckets of the histogram of the lock hold times.
+#define PKA_HOLD_HIST_BUCKETS   16
+
+/// Ownership of the lock of a PK instance since pka_init_global(). Bucket 0
+/// of the histogram counts the holds shorter than 1us, bucket i the holds
+/// from 2^(i-1)us up to 2^i us, and the last bucket the longer ones.
+typedef struct
+{
+    uint64_t holds;         ///< times the lock was taken and released.
+    uint64_t handoffs;      ///< times an owner ran out of budget with
+                            ///  requests pending, see
+                            ///  pka_set_owner_budget().
+    uint64_t hold_hist[PKA_HOLD_HIST_BUCKETS]; ///< holds per duration.
+} pka_lock_stats_t;
+
+/// Return how long the lock of a PK instance is held by its owners.
+///
+/// @param instance     A PK instance handle.
+/// @param stats        Lock counters.
+///
+/// @return             0 on success, a negative error code on failure.
+int pka_get_lock_stats(pka_instance_t instance, pka_lock_stats_t *stats);
+
+/// Largest number of HW rings of a PK instance.
+#define PKA_LOAD_MAX_RINGS      16
+
+/// Load of a HW ring of a PK instance.
+typedef struct
+{
+    uint32_t ring_id;       ///< HW ring identifier.
+    uint32_t free_descs;    ///< command descriptors available.
+    uint32_t free_mem;      ///< window RAM bytes available for operands,
+                            ///  possibly fragmented.
+    uint32_t pending_cmds;  ///< commands appended and not yet completed.
+} pka_ring_load_t;
+
+/// Load of a PK instance, to steer new work away from a saturated instance
+/// before its queues overflow. The values are read without synchronization
+/// with the threads of the instance, and only give a recent picture of it.
+typedef struct
+{
+    uint32_t        rings_cnt;      ///< number of HW rings of the instance.
+    pka_ring_load_t rings[PKA_LOAD_MAX_RINGS]; ///< load of each ring.
+    uint32_t        queued_cmds;    ///< commands waiting in the SW command
+                                    ///  queues.
+    uint32_t        queued_bytes;   ///< bytes used in the SW command queues.
+    uint32_t        queues_size;    ///< capacity of the SW command queues,
+                                    ///  in bytes.
+    uint32_t        credits;        ///< credits left to acquire, see
+                                    ///  pka_acquire_credits().
+    uint64_t        drain_ns;       ///< estimated time to complete the
+                                    ///  commands pending on the HW rings and
+                                    ///  waiting in the SW command queues.
+} pka_load_t;
+
+/// Return a snapshot of the load of a PK instance. The call takes no lock
+/// and does not walk the queues, it may be called as often as needed.
+///
+/// @param instance     A PK instance handle.
+/// @param load         Load of the instance.
+///
+/// @return             0 on success, a negative error code on failure.
+int pka_get_load(pka_instance_t instance, pka_load_t *load);
+
 /// Thread local PKA initialization. All threads must call this function before
 /// calling any other PKA API functions. The instance parameter specifies which
 /// PKA instance the thread joins. A thread may be part of at most one PKA
-/// instance at any given time.
+/// instance at any given time. Threads may come and go: the handle takes
+/// the place of a terminated one, if any - see pka_term_local().
 ///
 /// @param instance     A PK instance handle.
 ///
 /// @return             A valid PK handle on success,
-///                     PKA_HANDLE_INVALID on failure.
+///                     PKA_HANDLE_INVALID on failure - e.g. when as many
+///                     handles as queues given to pka_init_global() are in
+///                     use.
 pka_handle_t pka_init_local(pka_instance_t instance);
 
 /// Thread local PKA termination. This function is the last PKA call made by
-/// a given thread, other than the final call to pka_term_global().
+/// a given thread, other than the final call to pka_term_global(). The
+/// results not returned yet are dropped. The place of the handle is only
+/// taken by another one once the results of its commands in flight are
+/// dropped as well, the result buffers attached to them - if any - must then
+/// remain valid until the commands complete.
 ///
 /// @param handle       An initialized PKA handle.
 void pka_term_local(pka_handle_t handle);
@@ -280,7 +587,8 @@ typedef struct  // 16 bytes long
     uint16_t actual_len;    ///< Actual minimum # of bytes used by the operand.
     uint8_t  is_encrypted;  ///< Reserved for future use.
     uint8_t  big_endian;    ///< Indicates byte order of the big integer operand
-    uint8_t  internal_use;  ///< Internal use.  Must be set to 0 by users.
+    uint8_t  internal_use;  ///< Internal use.  Must be set to 0 by users,
+                            ///  see pka_register_operand().
     uint8_t  pad;           ///< Reserved for future use.
     uint8_t* buf_ptr;       ///< Pointer to the buffer holding the big integer.
 } pka_operand_t;
@@ -380,7 +688,13 @@ typedef enum
     /// Farm memory too small for operation.
     RC_TOO_LITTLE_MEMORY     = 0xC0,
     /// Memory deadlock error.
-    RC_MEMORY_DEADLOCK       = 0xC1
+    RC_MEMORY_DEADLOCK       = 0xC1,
+    /// Deadline passed before the command reached a HW ring, the command
+    /// was dropped - see pka_set_timeout(). Not returned by the HW.
+    RC_TIMEOUT               = 0xE0,
+    /// Command withdrawn with pka_cancel() before it reached a HW ring. Not
+    /// returned by the HW.
+    RC_CANCELED              = 0xE1
 } pka_result_code_t;
 
 /// PKA Compare Result Code Values.
@@ -416,6 +730,212 @@ typedef struct  // 50 bytes long
 /// @return             0 on success, and 1 on failure.
 int pka_get_result(pka_handle_t handle, pka_results_t* results);
 
+/// Return up to 'max_cnt' results pending in queue. Unlike pka_get_result()
+/// called in a loop, the queues are processed once for all the results - i.e.
+/// the PK lock is attempted once, and the ready results of each HW ring are
+/// acknowledged at once.
+///
+/// @param handle       An initialized PKA handle.
+/// @param results      Table of results structures to store the PK results.
+///                     Result buffers must be set as for pka_get_result().
+/// @param max_cnt      Number of results structures.
+///
+/// @return             The number of results returned - i.e. 0 if there is
+///                     none, or a negative error code on failure.
+int pka_get_results(pka_handle_t  handle,
+                    pka_results_t results[],
+                    uint32_t      max_cnt);
+
+/// Attach result buffers to the next PK command submitted with the handle.
+/// The result operands of the command are then copied from the HW rings
+/// directly into these buffers, instead of being copied to the SW queue of
+/// the handle first and then to the buffers passed to pka_get_result().
+/// When the result is retrieved, the result operands returned refer to the
+/// attached buffers, and their 'actual_len' and 'big_endian' fields are set.
+/// Buffers that are too small for the result are ignored - i.e. the result is
+/// then copied to the buffers passed to pka_get_result() as usual.
+///
+/// @param handle       An initialized PKA handle.
+/// @param results      Result buffers; 'buf_ptr' and 'buf_len' of the result
+///                     operands must be set. The structure and its buffers
+///                     must remain valid until the result is retrieved.
+///                     NULL detaches previously attached buffers.
+///
+/// @note Result buffers are not supported in multi process mode, since the
+/// result might be written by another process - the call then fails with
+/// -EPERM.
+///
+/// @return             0 on success, a negative error code on failure.
+int pka_set_result_bufs(pka_handle_t handle, pka_results_t *results);
+
+/// Priority classes of PK commands.
+typedef enum
+{
+    PKA_PRIORITY_HIGH   = 0,  ///< latency sensitive, e.g. TLS handshakes.
+    PKA_PRIORITY_NORMAL = 1,  ///< default, e.g. background key generation.
+    PKA_PRIORITY_CNT
+} pka_priority_t;
+
+/// Set the priority of the next PK commands submitted with the handle. High
+/// priority commands waiting in the SW queues are appended to the HW rings
+/// before any command of normal priority, and may use a ring of their own -
+/// see PKA_F_PRIORITY_RING.
+///
+/// @param handle       An initialized PKA handle.
+/// @param priority     Priority of the next commands, PKA_PRIORITY_NORMAL
+///                     by default.
+///
+/// @return             0 on success, a negative error code on failure.
+int pka_set_priority(pka_handle_t handle, pka_priority_t priority);
+
+/// Largest weight of a handle, see pka_set_weight().
+#define PKA_WEIGHT_MAX          64
+
+/// Set the share of the HW rings of the commands of normal priority of a
+/// handle, when they have to wait in the SW command queues. The queues of
+/// the handles are served in deficit round robin: each round, a handle may
+/// append up to its weight times 1KB of operands to the rings, so that a
+/// handle with a deep queue cannot starve the other ones.
+///
+/// @param handle       An initialized PKA handle.
+/// @param weight       Weight of the handle, from 1 - the default - to
+///                     PKA_WEIGHT_MAX.
+///
+/// @return             0 on success, a negative error code on failure.
+int pka_set_weight(pka_handle_t handle, uint32_t weight);
+
+/// Set the time the next PK commands submitted with the handle may wait in
+/// the SW command queues. A command whose deadline passes before it reaches
+/// a HW ring is dropped, and its result is returned with the RC_TIMEOUT
+/// status and no result operand. Commands already on a HW ring, or processed
+/// on the CPU, always complete.
+///
+/// @param handle       An initialized PKA handle.
+/// @param timeout_us   Maximum waiting time, in microseconds, or
+///                     PKA_WAIT_FOREVER - the default - for no deadline.
+///
+/// @return             0 on success, a negative error code on failure.
+int pka_set_timeout(pka_handle_t handle, uint32_t timeout_us);
+
+/// Withdraw the PK commands submitted with the handle and the given user
+/// data which still wait in the SW command queues. Each withdrawn command
+/// is returned by pka_get_result() with the RC_CANCELED status and no
+/// result operand. Commands already on a HW ring complete as usual.
+///
+/// @param handle       An initialized PKA handle.
+/// @param user_data    User data the commands were submitted with.
+///
+/// @return             the number of commands withdrawn, -ENOENT if no
+///                     command waits with this user data, or another
+///                     negative error code on failure.
+int pka_cancel(pka_handle_t handle, void *user_data);
+
+/// Reserve capacity for 'cnt' PK commands before building their operands.
+/// The credits of an instance are sized from the descriptors of its HW
+/// rings, so that the commands of the handles which hold credits neither
+/// overflow the SW queues nor spill to the CPU. Each command submitted while
+/// the handle holds credits consumes one of them, which goes back to the
+/// instance once the result of the command is returned. Credits are
+/// optional: commands submitted without credits are not accounted for, and
+/// all credits are granted to an instance without rings.
+///
+/// @param handle       An initialized PKA handle.
+/// @param cnt          Number of credits to acquire.
+///
+/// @return             0 on success, -EAGAIN if fewer than 'cnt' credits are
+///                     left, or another negative error code on failure.
+int pka_acquire_credits(pka_handle_t handle, uint32_t cnt);
+
+/// Give back credits acquired with pka_acquire_credits() and not consumed
+/// yet - e.g. the connection they were reserved for went away.
+///
+/// @param handle       An initialized PKA handle.
+/// @param cnt          Number of credits to release, at most the number of
+///                     credits held by the handle.
+///
+/// @return             0 on success, a negative error code on failure.
+int pka_release_credits(pka_handle_t handle, uint32_t cnt);
+
+/// Register a long-lived operand - e.g. an RSA modulus, a private exponent
+/// or a curve parameter. When a command that uses a registered operand has
+/// to wait in the SW command queue of the handle, the queue holds a reference
+/// to the operand buffer instead of a copy of its data; the buffer is copied
+/// once, directly to the HW ring, when the command is dequeued.
+/// Registration is not supported in multi process mode.
+///
+/// @param handle       An initialized PKA handle.
+/// @param operand      Operand to register. The operand and its buffer must
+///                     remain valid and unchanged until it is unregistered and
+///                     every command that uses it has completed.
+///
+/// @return             0 on success, a negative error code on failure.
+int pka_register_operand(pka_handle_t handle, pka_operand_t *operand);
+
+/// Unregister an operand registered with pka_register_operand(). Commands
+/// submitted afterwards hold a copy of the operand again.
+///
+/// @param handle       An initialized PKA handle.
+/// @param operand      Registered operand.
+///
+/// @return             0 on success, a negative error code on failure.
+int pka_unregister_operand(pka_handle_t handle, pka_operand_t *operand);
+
+/// Return a file descriptor that becomes readable when results of the handle
+/// might be pending, so that threads can wait for results in poll(), select()
+/// or epoll - e.g. by adding the fd to an epoll set with EPOLLIN - instead of
+/// busy polling pka_get_result().
+///
+/// The fd is signalled when results are moved to the SW result queue of the
+/// handle and when the HW rings raise their result interrupt; the first call
+/// routes the ring interrupts. The fd remains readable as long as results are
+/// pending in the SW queue, and is cleared by pka_get_result() and
+/// pka_get_results(). Once it becomes readable, results must be retrieved
+/// with these functions, which also process the rings; a wake up might not
+/// yield any result of the handle. The fd is owned by the handle and closed
+/// by pka_term_local(); it must not be read nor closed by the application.
+///
+/// @param handle       An initialized PKA handle.
+///
+/// @return             A file descriptor on success, a negative error code on
+///                     failure - e.g. -EPERM in multi process mode, or a
+///                     negative code if the ring interrupts cannot be routed.
+int pka_get_result_fd(pka_handle_t handle);
+
+/// Timeout of pka_wait_result() which waits until a result is available.
+#define PKA_WAIT_FOREVER        UINT32_MAX
+
+/// Time spent by pka_wait_result() in each of its phases.
+typedef struct
+{
+    uint64_t spin_ns;       ///< time spent busy polling for a result.
+    uint64_t yield_ns;      ///< time spent polling while yielding the CPU.
+    uint64_t sleep_ns;      ///< time spent blocked, see pka_get_result_fd().
+} pka_wait_stats_t;
+
+/// Wait for a result of the handle and return it, as pka_get_result() does.
+///
+/// The library first busy polls for a window sized from the expected
+/// completion time of the outstanding commands of the handle, then keeps on
+/// polling while yielding the CPU, with an exponential back off, and finally
+/// blocks on the completion fd of the handle - or sleeps when the fd is not
+/// supported, e.g. in multi process mode. Short commands are thus returned
+/// with the latency of busy polling, while long waits do not burn the CPU.
+///
+/// @param handle       An initialized PKA handle.
+/// @param results      Results of the command, see pka_get_result().
+/// @param timeout_us   Maximum time to wait, in microseconds. Zero polls
+///                     once, and PKA_WAIT_FOREVER waits without timeout.
+/// @param stats        If not NULL, set to the time spent in each phase.
+///
+/// @return             0 on success, -ETIMEDOUT if no result was available
+///                     within the timeout, -ENOENT if the handle has no
+///                     outstanding command, or another negative error code
+///                     on failure.
+int pka_wait_result(pka_handle_t      handle,
+                    pka_results_t    *results,
+                    uint32_t          timeout_us,
+                    pka_wait_stats_t *stats);
+
 /// Return if there is pending results in queue.
 ///
 /// @param handle       An initialized PKA handle.
@@ -1039,5 +1559,104 @@ int pka_dsa_signature_verify(pka_handle_t     handle,
                              dsa_signature_t* rcvd_signature,
                              uint8_t          no_write);
 
+/// Largest number of commands submitted by a single pka_submit_batch() call.
+#define PKA_MAX_BATCH_CNT       64
+
+/// Largest number of parameters of a command submitted by pka_submit_batch().
+#define PKA_MAX_BATCH_ARGS      6
+
+/// The pka_batch_cmd_t is the record type used to describe a PK command of a
+/// batch. 'args' holds the parameters that follow 'user_data' in the pka_*()
+/// function issuing the same command, in the same order - e.g. { value,
+/// addend } for CC_ADD, { exponent, modulus, value } for CC_MODULAR_EXP or
+/// { curve, base_pt, base_pt_order, public_key, hash, rcvd_signature } for
+/// CC_ECDSA_VERIFY. CC_MOD_EXP_CRT follows pka_modular_exp_crt(), the shift
+/// commands take the shift count from 'shift_cnt', and the *_NO_WRITE
+/// opcodes select signature verifications without write-back.
+typedef struct
+{
+    void          *user_data;               ///< returned with the result.
+    pka_results_t *rslt_bufs;               ///< result buffers, or NULL -
+                                            ///  see pka_set_result_bufs().
+    pka_opcode_t   opcode;                  ///< PK command code.
+    uint32_t       shift_cnt;               ///< shift count of shifts.
+    void          *args[PKA_MAX_BATCH_ARGS]; ///< command parameters.
+} pka_batch_cmd_t;
+
+/// Submit a batch of PK commands. The operands of all the commands are
+/// checked first, and none of the commands is submitted if one of them is
+/// not valid. The commands are then submitted at once - i.e. the PK lock is
+/// taken once, and each HW ring is notified once of all the commands appended
+/// to it, though a command processed on the CPU first releases the lock and
+/// notifies the rings of the commands before it. They are submitted in
+/// order, and the submission stops at the first command which cannot be
+/// submitted: the commands submitted are always the first ones of the batch,
+/// and the others may be submitted again. Results are retrieved with
+/// pka_get_result(), as for commands submitted one at a time.
+///
+/// @param handle       An initialized PKA handle to use for these commands.
+/// @param cmds         Table of commands.
+/// @param cmd_cnt      Number of commands, at most PKA_MAX_BATCH_CNT.
+///
+/// @return             The number of commands submitted - i.e. the index of the
+///                     first command not submitted, which is lower than
+///                     'cmd_cnt' if the HW rings and the SW queue are full
+///                     and the command cannot run on the CPU - or -EINVAL if
+///                     a command is not valid, or -EBUSY if a command is
+///                     reserved - see pka_reserve_cmd().
+int pka_submit_batch(pka_handle_t     handle,
+                     pka_batch_cmd_t  cmds[],
+                     uint32_t         cmd_cnt);
+
+/// Reserve room for a PK command in the SW command queue of a handle, so
+/// that the operand data is written in place by the caller rather than
+/// copied by the library - i.e. the command is built directly in the queue.
+/// The caller gives the exact length of each operand in its 'actual_len'
+/// field, and on success writes the operand data at the 'buf_ptr' returned,
+/// in the byte order of the rings - see pka_get_rings_byte_order(). The most
+/// significant byte of each operand must not be zero. The command is then
+/// submitted with pka_commit_cmd(), or dropped with pka_abort_cmd().
+///
+/// A handle reserves one command at a time, and submits no other command
+/// until it is committed or aborted. The operands are not checked as the
+/// function of each command does - e.g. pka_modular_exp() checks that the
+/// modulus is odd - and reserved commands are always processed by the HW
+/// rings. When the command would wrap around the end of the SW queue, the
+/// operand buffers are taken from the handle and copied on commit.
+///
+/// @param handle      An initialized PKA handle to use for this command.
+/// @param user_data   Opaque pointer returned with the result.
+/// @param opcode      Code of the command - e.g. CC_MODULAR_EXP.
+/// @param operands    Operands of the command, in the order of the
+///                    arguments of its function - e.g. exponent, modulus
+///                    then value for CC_MODULAR_EXP.
+/// @param operand_cnt Number of operands.
+/// @param shift_cnt   Number of bits to shift for CC_SHIFT_LEFT and
+///                    CC_SHIFT_RIGHT, 0 otherwise.
+///
+/// @return            0 on success, -EBUSY if a command is already reserved,
+///                    -ENOBUFS if the SW queue is full, or another negative
+///                    error code.
+int pka_reserve_cmd(pka_handle_t   handle,
+                    void          *user_data,
+                    pka_opcode_t   opcode,
+                    pka_operand_t  operands[],
+                    uint32_t       operand_cnt,
+                    uint32_t       shift_cnt);
+
+/// Submit the PK command reserved by a handle, once its operand data is
+/// written - see pka_reserve_cmd(). The result is retrieved with
+/// pka_get_result(), as for the other commands.
+///
+/// @return            0 on success, -ENOENT if no command is reserved, or
+///                    -EINVAL if an operand has a leading zero byte - in
+///                    which case the command is dropped.
+int pka_commit_cmd(pka_handle_t handle);
+
+/// Drop the PK command reserved by a handle - see pka_reserve_cmd().
+///
+/// @return            0 on success, -ENOENT if no command is reserved.
+int pka_abort_cmd(pka_handle_t handle);
+
 
 #endif // __PKA_H__
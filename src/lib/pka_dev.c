@@ -46,10 +46,14 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/ioctl.h>
 #include <fcntl.h>
 #endif
 
 #include "pka_dev.h"
+#ifdef PKA_LIB_SIM
+#include "pka_sim.h"
+#endif
 
 #ifdef __KERNEL__
 pka_dev_gbl_config_t pka_gbl_config;
@@ -269,6 +273,8 @@ static int pka_dev_init_ring(pka_dev_ring_t *ring, uint32_t ring_id,
     ring->ring_id        = ring_id;
     ring->shim           = shim;
     ring->resources_num  = PKA_MAX_NUM_RING_RESOURCES;
+    ring->num_cmd_desc   = PKA_RING_NUM_CMD_DESC;
+    ring->data_mem_size  = PKA_WINDOW_RAM_DATA_MEM_SIZE;
 
     shim_ring_id              = ring_id % PKA_MAX_NUM_IO_BLOCK_RINGS;
     shim->rings[shim_ring_id] = ring;
@@ -365,8 +371,8 @@ static int pka_dev_release_ring(pka_dev_ring_t *ring)
     return ret;
 }
 
-// Partition the window RAM for a given PKA ring.  Here we statically divide
-// the 16K memory region into three partitions:  First partition is reserved
+// Partition the window RAM for a given PKA ring.  By default we divide the
+// 16K memory region into three partitions:  First partition is reserved
 // for command descriptor ring (1K), second partition is reserved for result
 // descriptor ring (1K), and the remaining 14K are reserved for vector data.
 // Through this memroy partition scheme, command/result descriptor rings hold
@@ -384,7 +390,8 @@ static int pka_dev_release_ring(pka_dev_ring_t *ring)
 // We believe that the aformentionned memory partition help us to leverage
 // the trade-off between supported descriptors and required vectors. Note
 // that these examples gives approximative values and does not include buffer
-// word padding across vectors.
+// word padding across vectors. Deployments with other operand sizes may pick
+// another partition per ring - see pka_dev_set_ring_partition().
 //
 // The function also writes the result descriptor rings base addresses, size
 // and type, and initialize the read and write pointers and statistics. It
@@ -409,7 +416,7 @@ static int pka_dev_partition_mem(pka_dev_ring_t *ring)
     uint64_t rslt_desc_ring_base;
     uint32_t rslt_desc_ring_size;
 
-    uint16_t num_cmd_desc;
+    uint32_t num_cmd_desc;
     uint16_t host_desc_size;
     uint8_t  ring_in_order;
 
@@ -425,28 +432,34 @@ static int pka_dev_partition_mem(pka_dev_ring_t *ring)
     ring_in_order   = shim->ring_type;
     window_ram_base = ring->resources.window_ram.base;
     window_ram_size = ring->resources.window_ram.size;
-    // Partition ring memory.  Give ring pair (cmmd descriptor ring and rslt
-    // descriptor ring) an equal portion of the memory.  The cmmd descriptor
-    // ring and result descriptor ring are used as "non-overlapping" ring.
-    // Currently set aside 1/8 of the window RAM for command/result descriptor
-    // rings - giving a total of 1K/64B = 16 descriptors per ring.
-    // The remaining memory is "Data Memory" - i.e. memory to hold the command
-    // operands and results - also called input/output vectors (in all cases
-    // these vectors are just single large integers - often in the range of
-    // hundreds to thousands of bits long).
-    ring_mem_size  = PKA_WINDOW_RAM_RING_MEM_SIZE / 2;
-    data_mem_size  = PKA_WINDOW_RAM_DATA_MEM_SIZE;
+    // Partition ring memory.  The bottom of the window RAM is "Data Memory"
+    // - i.e. memory to hold the command operands and results - also called
+    // input/output vectors (in all cases these vectors are just single large
+    // integers - often in the range of hundreds to thousands of bits long).
+    // Its size is chosen at ring initialization - see data_mem_size - and
+    // defaults to 14KB. Give ring pair (cmmd descriptor ring and rslt
+    // descriptor ring) an equal portion of the remaining memory - by default
+    // up to 1K/64B = 16 descriptors per ring. The cmmd descriptor ring and
+    // result descriptor ring are used as "non-overlapping" ring. The ring
+    // depth itself is the one chosen at ring initialization - see num_cmd_desc.
+    data_mem_size  = ring->data_mem_size;
+    ring_mem_size  = (window_ram_size - data_mem_size) / 2;
     data_mem_base  = window_ram_base;
     ring_mem_base  = data_mem_base + data_mem_size;
 
-    num_cmd_desc   = ring_mem_size / CMD_DESC_SIZE;
+    num_cmd_desc   = ring->num_cmd_desc;
     host_desc_size = CMD_DESC_SIZE / BYTES_PER_WORD;
 
+    if (num_cmd_desc > ring_mem_size / CMD_DESC_SIZE)
+    {
+        PKA_ERROR(PKA_DEV, "ring %d depth %u exceeds ring memory\n",
+                    ring->ring_id, num_cmd_desc);
+        return -EINVAL;
+    }
+
     cmd_desc_ring_size  = num_cmd_desc * CMD_DESC_SIZE;
     rslt_desc_ring_size = cmd_desc_ring_size;
 
-    ring->num_cmd_desc  = num_cmd_desc;
-
     // The command and result descriptor rings may be placed at different
     // (non-overlapping) locations in Window RAM memory space. PKI command
     // interface: Most of the functionality is defined by the EIP-154 master
@@ -1328,6 +1341,39 @@ static int __pka_dev_unregister_ring(pka_dev_ring_t *ring)
     return ret;
 }
 
+int pka_dev_set_ring_depth(pka_dev_ring_t *ring, uint32_t num_cmd_desc)
+{
+    if (!ring || num_cmd_desc < PKA_RING_NUM_CMD_DESC_MIN ||
+            num_cmd_desc > PKA_RING_NUM_CMD_DESC_MAX)
+        return -EINVAL;
+
+    if (ring->status != PKA_DEV_RING_STATUS_INITIALIZED)
+        return -EPERM;
+
+    ring->num_cmd_desc = num_cmd_desc;
+
+    return 0;
+}
+
+int pka_dev_set_ring_partition(pka_dev_ring_t *ring, uint32_t data_mem_size)
+{
+    if (!ring || data_mem_size < PKA_WINDOW_RAM_DATA_MEM_MIN_SIZE ||
+            data_mem_size % PKA_WINDOW_RAM_PARTITION_ALIGN)
+        return -EINVAL;
+
+    if (ring->status != PKA_DEV_RING_STATUS_INITIALIZED)
+        return -EPERM;
+
+    // Leave room for at least one descriptor in each descriptor ring.
+    if (data_mem_size + (2 * CMD_DESC_SIZE) >
+            ring->resources.window_ram.size)
+        return -EINVAL;
+
+    ring->data_mem_size = data_mem_size;
+
+    return 0;
+}
+
 int pka_dev_unregister_ring(pka_dev_ring_t *ring)
 {
     pka_gbl_config.dev_rings[ring->ring_id]  = NULL;
@@ -1655,7 +1701,11 @@ int pka_dev_get_ring_info(pka_ring_info_t *ring_info)
         return -EINVAL;
 
     // Get ring parameters
+#ifdef PKA_LIB_SIM
+    ret = pka_sim_get_ring_info(ring_info, &hw_ring_info);
+#else
     ret = ioctl(ring_info->fd, PKA_VFIO_GET_RING_INFO, &hw_ring_info);
+#endif
     if (ret)
     {
         PKA_ERROR(PKA_DEV, "failed to get ring information\n");
@@ -1674,12 +1724,16 @@ int pka_dev_get_ring_info(pka_ring_info_t *ring_info)
     ring_info->ring_desc.num_descs      = hw_ring_info.size + 1;
     ring_info->ring_desc.cmd_desc_cnt   = 0;
     ring_info->ring_desc.rslt_desc_cnt  = 0;
-    ring_info->ring_desc.cmd_desc_mask  = 0;
-
-    // This code assumes that Data Memory is in the bottom 14KB of the "PKA
-    // window RAM" and so the addresses for the rings start at offset 0x3800.
+    memset(ring_info->ring_desc.cmd_desc_mask, 0,
+                sizeof(ring_info->ring_desc.cmd_desc_mask));
+    ring_info->ring_desc.cmd_pending_cnt = 0;
+    ring_info->ring_desc.rslt_ack_cnt    = 0;
+
+    // This code assumes that Data Memory is at the bottom of the "PKA window
+    // RAM" and so the command ring starts right at its end - i.e. at offset
+    // 0x3800 with the default partition.
     operand_base     = hw_ring_info.cmmd_base & ~(ring_info->mem_size - 1);
-    operand_ring_len = PKA_WINDOW_RAM_DATA_MEM_SIZE;
+    operand_ring_len = hw_ring_info.cmmd_base & (ring_info->mem_size - 1);
 
     ring_info->ring_desc.operands_base  = operand_base;
     ring_info->ring_desc.operands_end   = operand_base + operand_ring_len;
@@ -1687,7 +1741,7 @@ int pka_dev_get_ring_info(pka_ring_info_t *ring_info)
     return ret;
 }
 
-
+#ifndef PKA_LIB_SIM
 // Returns a prefix associated to the given ring. Note that prefix is set
 // according to either the linux device-tree (DT) and the ACPI tables.
 static char *pka_dev_get_ring_prefix(uint32_t ring_id, bool dt)
@@ -1790,6 +1844,7 @@ static int pka_dev_get_group_no(const char *sysfs_base,
 
     return 1;
 }
+#endif // !PKA_LIB_SIM
 #endif
 
 #ifdef __KERNEL__
@@ -1841,6 +1896,8 @@ int pka_dev_open_ring(pka_ring_info_t *ring_info)
 {
 #ifdef __KERNEL__
     return __pka_dev_open_ring(ring_info->ring_id);
+#elif defined(PKA_LIB_SIM)
+    return pka_sim_open_ring(ring_info);
 #else
 
     struct vfio_group_status  group_status;
@@ -1968,6 +2025,8 @@ int pka_dev_close_ring(pka_ring_info_t *ring_info)
     {
 #ifdef __KERNEL__
         return __pka_dev_close_ring(ring_info->ring_id);
+#elif defined(PKA_LIB_SIM)
+        return pka_sim_close_ring(ring_info);
 #else
         // Close ring file descriptor.
         close(ring_info->fd);
@@ -1994,6 +2053,8 @@ int pka_dev_mmap_ring(pka_ring_info_t *ring_info)
 {
 #ifdef __KERNEL__
     return __pka_dev_mmap_ring(ring_info->ring_id);
+#elif defined(PKA_LIB_SIM)
+    return pka_sim_mmap_ring(ring_info);
 #else
 
     pka_dev_region_info_t region_info;
@@ -2063,6 +2124,8 @@ int pka_dev_munmap_ring(pka_ring_info_t *ring_info)
     {
 #ifdef __KERNEL__
         return __pka_dev_munmap_ring(ring_info->ring_id);
+#elif defined(PKA_LIB_SIM)
+        return pka_sim_munmap_ring(ring_info);
 #else
         munmap(ring_info->mem_ptr, ring_info->mem_size);
         munmap(ring_info->reg_ptr, ring_info->reg_size);
@@ -2072,3 +2135,47 @@ int pka_dev_munmap_ring(pka_ring_info_t *ring_info)
     return 0;
 }
 
+// Route the ring result interrupt to an eventfd (user-space).
+int pka_dev_set_ring_irq(pka_ring_info_t *ring_info, int irq_fd)
+{
+#ifdef __KERNEL__
+    //not implemented
+    return -EPERM;
+#elif defined(PKA_LIB_SIM)
+    return pka_sim_set_ring_irq(ring_info, irq_fd);
+#else
+    struct vfio_irq_set *irq_set;
+    uint8_t              irq_set_buf[sizeof(*irq_set) + sizeof(int32_t)];
+
+    if (!ring_info)
+        return -EINVAL;
+
+    irq_set        = (struct vfio_irq_set *) irq_set_buf;
+    irq_set->index = 0;
+    irq_set->start = 0;
+    if (irq_fd >= 0)
+    {
+        irq_set->argsz = sizeof(irq_set_buf);
+        irq_set->flags = VFIO_IRQ_SET_DATA_EVENTFD |
+                            VFIO_IRQ_SET_ACTION_TRIGGER;
+        irq_set->count = 1;
+        memcpy(&irq_set->data, &irq_fd, sizeof(int32_t));
+    }
+    else
+    {
+        // A zero count with no data disables the interrupt.
+        irq_set->argsz = sizeof(*irq_set);
+        irq_set->flags = VFIO_IRQ_SET_DATA_NONE | VFIO_IRQ_SET_ACTION_TRIGGER;
+        irq_set->count = 0;
+    }
+
+    if (ioctl(ring_info->fd, VFIO_DEVICE_SET_IRQS, irq_set))
+    {
+        PKA_DEBUG(PKA_DEV, "ring %d - failed to set interrupt\n",
+                    ring_info->ring_id);
+        return -EOPNOTSUPP;
+    }
+
+    return 0;
+#endif
+}
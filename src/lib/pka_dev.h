@@ -121,6 +121,9 @@ typedef struct
 
     pka_dev_hw_ring_info_t *ring_info;      ///< ring information.
     uint32_t                num_cmd_desc;   ///< number of command descriptors.
+    uint32_t                data_mem_size;  ///< size of the window RAM data
+                                            ///  memory, the remaining memory
+                                            ///  holding the descriptor rings.
 
     int8_t                  status;         ///< status of the ring.
 } pka_dev_ring_t;
@@ -254,6 +257,19 @@ pka_dev_ring_t *pka_dev_register_ring(uint32_t ring_id, uint32_t shim_id);
 /// Unregister a Ring
 int pka_dev_unregister_ring(pka_dev_ring_t *ring);
 
+/// Set the depth of a Ring, i.e. the number of command descriptors it can
+/// hold in flight. It must be called once the ring is registered and before
+/// its shim is created; otherwise the ring keeps PKA_RING_NUM_CMD_DESC. It
+/// returns 0 on success, a negative error code on failure.
+int pka_dev_set_ring_depth(pka_dev_ring_t *ring, uint32_t num_cmd_desc);
+
+/// Set the window RAM partition of a Ring, i.e. the size of the data memory
+/// which holds the command operands and results. The descriptor rings get the
+/// remaining window RAM. Like the ring depth, it must be set before the shim
+/// is created; otherwise the ring keeps PKA_WINDOW_RAM_DATA_MEM_SIZE. It
+/// returns 0 on success, a negative error code on failure.
+int pka_dev_set_ring_partition(pka_dev_ring_t *ring, uint32_t data_mem_size);
+
 /// Register PKA IO block. This function initializes a shim and configures its
 /// related resources, and returns a pointer to that ring.
 pka_dev_shim_t *pka_dev_register_shim(uint32_t shim_id, uint64_t shim_base,
@@ -290,4 +306,9 @@ int pka_dev_mmap_ring(pka_ring_info_t *ring_info);
 /// Unmap ring resources.
 int pka_dev_munmap_ring(pka_ring_info_t *ring_info);
 
+/// Route the result interrupt of a ring to an eventfd, or detach it if
+/// 'irq_fd' is negative. The function returns 0 if successful, negative
+/// value to indicate an error - e.g. the ring interrupt is not exposed.
+int pka_dev_set_ring_irq(pka_ring_info_t *ring_info, int irq_fd);
+
 #endif /// __PKA_DEV_H__
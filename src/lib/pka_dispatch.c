@@ -0,0 +1,456 @@
+//
+//   BSD LICENSE
+//
+//   Copyright(c) 2016 Mellanox Technologies, Ltd. All rights reserved.
+//   All rights reserved.
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions
+//   are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in
+//       the documentation and/or other materials provided with the
+//       distribution.
+//     * Neither the name of Mellanox Technologies nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <string.h>
+#include <time.h>
+
+#include "pka_dispatch.h"
+#include "pka_soft.h"
+#include "pka_utils.h"
+
+// Number of runs of each calibration command. The fastest run is kept.
+#define PKA_DISPATCH_CALIB_RUNS     4
+
+// Time spent to measure the rate of pka_cpu_cycles(), in nanoseconds.
+#define PKA_DISPATCH_CALIB_NS       1000000
+
+// Upper bound of the calibrated largest command sent to the CPU - i.e. about
+// a 2048-bit RSA verification with a short public exponent.
+#define PKA_DISPATCH_MAX_CPU_UNITS  (1 << 16)
+
+// Exponents up to that many bits are deemed public - e.g. the public exponent
+// of an RSA key - secret exponents being much longer.
+#define PKA_DISPATCH_PUBLIC_EXP_BITS    32
+
+// Operand lengths of the calibration commands.
+#define PKA_DISPATCH_CALIB_ADD_LEN  32
+#define PKA_DISPATCH_CALIB_MOD_LEN  128
+#define PKA_DISPATCH_CALIB_EXP_LEN  8
+
+static uint64_t pka_dispatch_words(pka_operand_t *operand)
+{
+    return MAX(1, (operand->actual_len + 7) / 8);
+}
+
+static uint64_t pka_dispatch_bits(pka_operand_t *operand)
+{
+    return 8 * operand->actual_len;
+}
+
+// Cost of a modular exponentiation - i.e. about 1.25 modular multiplications
+// per exponent bit with a sliding window, a Montgomery multiplication taking
+// 2 * words^2 work units.
+static uint64_t pka_dispatch_exp_units(uint64_t exp_bits, uint64_t words)
+{
+    return (exp_bits + (exp_bits / 4)) * 2 * words * words;
+}
+
+// Cost of an ECC point multiplication - i.e. about 10 modular multiplications
+// per multiplier bit, points being in Jacobian coordinates.
+static uint64_t pka_dispatch_ecc_units(uint64_t bits, uint64_t words)
+{
+    return bits * 10 * 2 * words * words;
+}
+
+// Return the cost of a command, in work units.
+uint64_t pka_dispatch_cmd_units(pka_opcode_t opcode, pka_operands_t *operands)
+{
+    pka_operand_t *operand;
+    uint64_t       words;
+    uint32_t       idx;
+
+    operand = operands->operands;
+    words   = 1;
+    for (idx = 0; idx < operands->operand_cnt; idx++)
+        words = MAX(words, pka_dispatch_words(&operand[idx]));
+
+    switch (opcode)
+    {
+    case CC_MULTIPLY:
+    case CC_DIVIDE:
+    case CC_MODULO:
+        return pka_dispatch_words(&operand[0]) *
+                    pka_dispatch_words(&operand[1]);
+
+    case CC_MODULAR_INVERT:
+        return 2 * pka_dispatch_bits(&operand[1]) *
+                    pka_dispatch_words(&operand[1]);
+
+    case CC_MODULAR_EXP:
+        return pka_dispatch_exp_units(pka_dispatch_bits(&operand[0]),
+                                      pka_dispatch_words(&operand[1]));
+
+    case CC_MOD_EXP_CRT:
+        return 2 * pka_dispatch_exp_units(pka_dispatch_bits(&operand[3]),
+                                          pka_dispatch_words(&operand[0]));
+
+    case CC_ECC_PT_ADD:
+        return 12 * 2 * words * words;
+
+    case CC_ECC_PT_MULTIPLY:
+        return pka_dispatch_ecc_units(pka_dispatch_bits(&operand[0]), words);
+
+    case CC_ECDSA_GENERATE:
+        return pka_dispatch_ecc_units(pka_dispatch_bits(&operand[8]), words);
+
+    case CC_ECDSA_VERIFY:
+    case CC_ECDSA_VERIFY_NO_WRITE:
+        return 2 * pka_dispatch_ecc_units(pka_dispatch_bits(&operand[8]),
+                                          words);
+
+    case CC_DSA_GENERATE:
+        return pka_dispatch_exp_units(pka_dispatch_bits(&operand[2]),
+                                      pka_dispatch_words(&operand[0]));
+
+    case CC_DSA_VERIFY:
+    case CC_DSA_VERIFY_NO_WRITE:
+        return 2 * pka_dispatch_exp_units(pka_dispatch_bits(&operand[2]),
+                                          pka_dispatch_words(&operand[0]));
+
+    default:
+        // Additions, subtractions, shifts and comparisons.
+        return words;
+    }
+}
+
+// Return whether the operands of a command are deemed public - i.e. whether
+// the command may run on the CPU although the software engine is not
+// constant time.
+static bool pka_dispatch_public_cmd(pka_opcode_t    opcode,
+                                    pka_operands_t *operands)
+{
+    switch (opcode)
+    {
+    case CC_ADD:
+    case CC_SUBTRACT:
+    case CC_ADD_SUBTRACT:
+    case CC_SHIFT_LEFT:
+    case CC_SHIFT_RIGHT:
+    case CC_COMPARE:
+    case CC_COPY:
+    case CC_ECDSA_VERIFY:
+    case CC_ECDSA_VERIFY_NO_WRITE:
+    case CC_DSA_VERIFY:
+    case CC_DSA_VERIFY_NO_WRITE:
+        return true;
+
+    case CC_MODULAR_EXP:
+        return pka_dispatch_bits(&operands->operands[0]) <=
+                    PKA_DISPATCH_PUBLIC_EXP_BITS;
+
+    default:
+        // Multiplications, divisions and inversions may take secret values,
+        // e.g. when recombining CRT results, and the remaining commands are
+        // private key operations.
+        return false;
+    }
+}
+
+static void pka_dispatch_set_operand(pka_operand_t *operand,
+                                     uint8_t       *buf,
+                                     uint16_t       len,
+                                     uint8_t        fill,
+                                     uint8_t        msb)
+{
+    memset(buf, fill, len);
+    buf[0]       |= 1;    // odd, as a modulus must be.
+    buf[len - 1]  = msb;
+
+    memset(operand, 0, sizeof(pka_operand_t));
+    operand->buf_ptr    = buf;
+    operand->buf_len    = len;
+    operand->actual_len = len;
+    operand->big_endian = 0;
+}
+
+// Return the smallest number of ticks taken by a command processed in
+// software, out of a few runs.
+static uint64_t pka_dispatch_time_cmd(pka_opcode_t   opcode,
+                                      pka_operands_t *operands)
+{
+    pka_soft_rslt_t rslt;
+    uint64_t        start, ticks, min_ticks;
+    uint32_t        run;
+
+    min_ticks = UINT64_MAX;
+    for (run = 0; run < PKA_DISPATCH_CALIB_RUNS; run++)
+    {
+        start = pka_cpu_cycles();
+        pka_soft_process_cmd(opcode, operands->operand_cnt, 0,
+                             operands->operands, &rslt);
+        ticks = pka_cpu_cycles() - start;
+
+        min_ticks = MIN(min_ticks, ticks);
+    }
+
+    return min_ticks;
+}
+
+// Measure the rate of pka_cpu_cycles(), in ticks per microsecond.
+static uint64_t pka_dispatch_ticks_per_us(void)
+{
+    struct timespec start, now;
+    uint64_t        start_ticks, ticks, ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    start_ticks = pka_cpu_cycles();
+    do
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        ns = ((now.tv_sec - start.tv_sec) * NS_PER_S) +
+                now.tv_nsec - start.tv_nsec;
+    } while (ns < PKA_DISPATCH_CALIB_NS);
+    ticks = pka_cpu_cycles() - start_ticks;
+
+    return MAX(1, (ticks * 1000) / ns);
+}
+
+// Calibrate the CPU costs and reset the HW costs to their default values.
+void pka_dispatch_init(pka_dispatch_t *dispatch)
+{
+    pka_operands_t        add_operands, exp_operands;
+    uint64_t              add_ticks, exp_ticks, add_units, exp_units;
+    uint64_t              cross_units;
+    uint8_t               add_buf[2][PKA_DISPATCH_CALIB_ADD_LEN];
+    uint8_t               exp_buf[PKA_DISPATCH_CALIB_EXP_LEN];
+    uint8_t               mod_buf[PKA_DISPATCH_CALIB_MOD_LEN];
+    uint8_t               val_buf[PKA_DISPATCH_CALIB_MOD_LEN];
+
+    memset(dispatch, 0, sizeof(pka_dispatch_t));
+    dispatch->ticks_per_us = pka_dispatch_ticks_per_us();
+
+    // Time a short addition, and an exponentiation large enough for the
+    // fixed cost to be negligible.
+    memset(&add_operands, 0, sizeof(pka_operands_t));
+    add_operands.operand_cnt = 2;
+    pka_dispatch_set_operand(&add_operands.operands[0], add_buf[0],
+                             PKA_DISPATCH_CALIB_ADD_LEN, 0xA5, 0x5A);
+    pka_dispatch_set_operand(&add_operands.operands[1], add_buf[1],
+                             PKA_DISPATCH_CALIB_ADD_LEN, 0x5A, 0xA5);
+
+    memset(&exp_operands, 0, sizeof(pka_operands_t));
+    exp_operands.operand_cnt = 3;
+    pka_dispatch_set_operand(&exp_operands.operands[0], exp_buf,
+                             PKA_DISPATCH_CALIB_EXP_LEN, 0x9B, 0xB9);
+    pka_dispatch_set_operand(&exp_operands.operands[1], mod_buf,
+                             PKA_DISPATCH_CALIB_MOD_LEN, 0xC3, 0xF1);
+    pka_dispatch_set_operand(&exp_operands.operands[2], val_buf,
+                             PKA_DISPATCH_CALIB_MOD_LEN, 0x3C, 0x12);
+
+    add_ticks = pka_dispatch_time_cmd(CC_ADD, &add_operands);
+    exp_ticks = pka_dispatch_time_cmd(CC_MODULAR_EXP, &exp_operands);
+    add_units = pka_dispatch_cmd_units(CC_ADD, &add_operands);
+    exp_units = pka_dispatch_cmd_units(CC_MODULAR_EXP, &exp_operands);
+
+    exp_ticks           = MAX(exp_ticks, add_ticks);
+    dispatch->cpu_unit  = ((exp_ticks - add_ticks) << PKA_DISPATCH_FP_SHIFT) /
+                                (exp_units - add_units);
+    dispatch->cpu_base  = add_ticks -
+            MIN(add_ticks, (add_units * dispatch->cpu_unit) >>
+                                PKA_DISPATCH_FP_SHIFT);
+
+    dispatch->hw_base     = (PKA_DISPATCH_HW_BASE_NS *
+                                dispatch->ticks_per_us) / 1000;
+    dispatch->hw_unit     = ((PKA_DISPATCH_HW_UNIT_PS *
+                                dispatch->ticks_per_us) <<
+                                    PKA_DISPATCH_FP_SHIFT) / 1000000;
+    dispatch->hw_autotune = true;
+
+    // The largest command sent to the CPU is derived from the size of the
+    // command for which both paths cost the same on idle rings.
+    if (dispatch->cpu_unit <= dispatch->hw_unit)
+        cross_units = PKA_DISPATCH_MAX_CPU_UNITS;
+    else if (dispatch->cpu_base < dispatch->hw_base)
+        cross_units = ((dispatch->hw_base - dispatch->cpu_base) <<
+                            PKA_DISPATCH_FP_SHIFT) /
+                                (dispatch->cpu_unit - dispatch->hw_unit);
+    else
+        cross_units = 0;
+
+    dispatch->max_cpu_units = MIN(PKA_DISPATCH_MAX_CPU_UNITS,
+                                  PKA_DISPATCH_MAX_CPU_FACTOR * cross_units);
+}
+
+// Return the estimated cost of a command processed by the HW.
+uint64_t pka_dispatch_hw_cost(pka_dispatch_t *dispatch, uint64_t units)
+{
+    return dispatch->hw_base +
+                ((units * dispatch->hw_unit) >> PKA_DISPATCH_FP_SHIFT);
+}
+
+// Return whether a command should rather be processed on the CPU.
+bool pka_dispatch_use_cpu(pka_dispatch_t  *dispatch,
+                          pka_ring_info_t  rings[],
+                          uint32_t         rings_cnt,
+                          pka_opcode_t     opcode,
+                          pka_operands_t  *operands,
+                          uint64_t         units)
+{
+    uint64_t backlog, cpu_cost, hw_cost;
+    uint32_t ring_idx;
+
+    if (units > dispatch->max_cpu_units)
+        return false;
+
+    if (!dispatch->cpu_secret_ops &&
+            !pka_dispatch_public_cmd(opcode, operands))
+        return false;
+
+    backlog = UINT64_MAX;
+    for (ring_idx = 0; ring_idx < rings_cnt; ring_idx++)
+        backlog = MIN(backlog,
+                      pka_dispatch_ring_backlog(dispatch,
+                                                rings[ring_idx].ring_id));
+
+    cpu_cost = dispatch->cpu_base +
+                    ((units * dispatch->cpu_unit) >> PKA_DISPATCH_FP_SHIFT);
+    hw_cost  = pka_dispatch_hw_cost(dispatch, units) + backlog;
+
+    return cpu_cost < hw_cost;
+}
+
+// Return the estimated cost of the commands pending in a ring.
+uint64_t pka_dispatch_ring_backlog(pka_dispatch_t *dispatch,
+                                   uint32_t        ring_id)
+{
+    return pka_atomic64_load(&dispatch->ring_backlog[ring_id]);
+}
+
+// Account for a command appended to a ring.
+void pka_dispatch_hw_enqueue(pka_dispatch_t *dispatch,
+                             uint32_t        ring_id,
+                             uint64_t        cost)
+{
+    _pka_atomic64_fetch_add_relaxed(&dispatch->ring_backlog[ring_id], cost);
+}
+
+static uint64_t pka_dispatch_ewma(uint64_t avg, uint64_t sample)
+{
+    return avg - (avg >> PKA_DISPATCH_EWMA_SHIFT) +
+                (sample >> PKA_DISPATCH_EWMA_SHIFT);
+}
+
+// Account for a result dequeued from a ring, and refine the HW costs.
+void pka_dispatch_hw_complete(pka_dispatch_t *dispatch,
+                              uint32_t        ring_id,
+                              uint64_t        enqueue_time,
+                              uint64_t        units,
+                              uint64_t        cost,
+                              bool            ring_idle)
+{
+    pka_atomic64_t *ring_backlog;
+    uint64_t        now, start, ticks, unit_ticks, backlog, left;
+
+    now   = pka_cpu_cycles();
+    // Rings process their commands in order, so the processing of the
+    // command started when it was enqueued or when the previous result
+    // was ready, whichever came last.
+    start = MAX(enqueue_time,
+                pka_atomic64_load(&dispatch->ring_last_rslt[ring_id]));
+    ticks = now - start;
+
+    pka_atomic64_store(&dispatch->ring_last_rslt[ring_id], now);
+
+    // Commands might be appended to the ring meanwhile, the backlog must
+    // not wrap around.
+    ring_backlog = &dispatch->ring_backlog[ring_id];
+    backlog      = pka_atomic64_load(ring_backlog);
+    do
+        left = ring_idle ? 0 : backlog - MIN(cost, backlog);
+    while (!pka_atomic64_cas_acq_rel(ring_backlog, &backlog, left));
+
+    if (!dispatch->hw_autotune || !enqueue_time || !units)
+        return;
+
+    if (!pka_spin_trylock(&dispatch->lock))
+        return;
+
+    // Small commands refine the fixed cost, large ones the cost per unit.
+    unit_ticks = (units * dispatch->hw_unit) >> PKA_DISPATCH_FP_SHIFT;
+    if (unit_ticks < dispatch->hw_base)
+        dispatch->hw_base = pka_dispatch_ewma(dispatch->hw_base,
+                                ticks - MIN(ticks, unit_ticks));
+    else
+        dispatch->hw_unit = pka_dispatch_ewma(dispatch->hw_unit,
+                                ((ticks - MIN(ticks, dispatch->hw_base)) <<
+                                    PKA_DISPATCH_FP_SHIFT) / units);
+
+    pka_spin_unlock(&dispatch->lock);
+}
+
+// Convert the cost model to its public representation.
+void pka_dispatch_get_params(pka_dispatch_t        *dispatch,
+                             pka_dispatch_params_t *params)
+{
+    uint64_t ticks_per_us;
+
+    ticks_per_us = dispatch->ticks_per_us;
+
+    params->hw_base_ns     = (dispatch->hw_base * 1000) / ticks_per_us;
+    params->hw_unit_ps     = ((dispatch->hw_unit * 1000000) / ticks_per_us) >>
+                                     PKA_DISPATCH_FP_SHIFT;
+    params->cpu_base_ns    = (dispatch->cpu_base * 1000) / ticks_per_us;
+    params->cpu_unit_ps    = ((dispatch->cpu_unit * 1000000) / ticks_per_us) >>
+                                     PKA_DISPATCH_FP_SHIFT;
+    params->max_cpu_units  = dispatch->max_cpu_units;
+    params->hw_autotune    = dispatch->hw_autotune;
+    params->cpu_secret_ops = dispatch->cpu_secret_ops;
+}
+
+// Convert the cost model from its public representation.
+void pka_dispatch_set_params(pka_dispatch_t        *dispatch,
+                             pka_dispatch_params_t *params)
+{
+    uint64_t ticks_per_us;
+
+    ticks_per_us = dispatch->ticks_per_us;
+
+    while (!pka_spin_trylock(&dispatch->lock))
+        pka_cpu_relax();
+
+    dispatch->hw_base        = ((uint64_t) params->hw_base_ns * ticks_per_us) /
+                                     1000;
+    dispatch->hw_unit        = (((uint64_t) params->hw_unit_ps *
+                                     ticks_per_us) << PKA_DISPATCH_FP_SHIFT) /
+                                         1000000;
+    dispatch->cpu_base       = ((uint64_t) params->cpu_base_ns * ticks_per_us) /
+                                     1000;
+    dispatch->cpu_unit       = (((uint64_t) params->cpu_unit_ps *
+                                     ticks_per_us) << PKA_DISPATCH_FP_SHIFT) /
+                                         1000000;
+    dispatch->max_cpu_units  = params->max_cpu_units;
+    dispatch->hw_autotune    = params->hw_autotune;
+    dispatch->cpu_secret_ops = params->cpu_secret_ops;
+
+    pka_spin_unlock(&dispatch->lock);
+}
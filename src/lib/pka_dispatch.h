@@ -0,0 +1,164 @@
+//
+//   BSD LICENSE
+//
+//   Copyright(c) 2016 Mellanox Technologies, Ltd. All rights reserved.
+//   All rights reserved.
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions
+//   are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in
+//       the documentation and/or other materials provided with the
+//       distribution.
+//     * Neither the name of Mellanox Technologies nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#ifndef __PKA_DISPATCH_H__
+#define __PKA_DISPATCH_H__
+
+///
+/// @file
+///
+/// This file describes the cost model used to dispatch PK commands either to
+/// the HW rings or to the CPU (see pka_soft.h).
+///
+/// For small commands - e.g. additions, shifts or RSA verifications with a
+/// short public exponent - the round trip through the window RAM and the HW
+/// rings costs more than the math itself. The cost of a command is estimated
+/// on both paths as a fixed cost plus a cost per work unit, a work unit being
+/// one 64x64-bit multiply-accumulate. The HW estimate also includes the cost
+/// of the commands already pending in the least loaded ring. The command is
+/// then sent to whichever path is expected to finish first.
+///
+/// The CPU costs are calibrated by pka_dispatch_init(), by timing the software
+/// engine, while the HW costs start from default values and are refined from
+/// the latencies measured when results are dequeued from the rings. Costs are
+/// kept in pka_cpu_cycles() ticks, costs per work unit being 16.16 fixed
+/// point numbers.
+///
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "pka.h"
+#include "pka_config.h"
+#include "pka_ring.h"
+#include "pka_utils.h"
+
+/// Default HW costs, used until the HW latencies get measured.
+#define PKA_DISPATCH_HW_BASE_NS         2000
+#define PKA_DISPATCH_HW_UNIT_PS         750
+
+/// Largest command, in work units, sent to the CPU is that many times as
+/// large as the command for which both paths cost the same on idle rings.
+#define PKA_DISPATCH_MAX_CPU_FACTOR     8
+
+/// Weight, as a power of two, of the previous estimate in the moving averages
+/// of the HW costs.
+#define PKA_DISPATCH_EWMA_SHIFT         4
+
+/// Fractional bits of the costs per work unit.
+#define PKA_DISPATCH_FP_SHIFT           16
+
+typedef struct
+{
+    uint64_t ticks_per_us;    ///< pka_cpu_cycles() ticks per microsecond.
+    uint64_t hw_base;         ///< fixed cost of a command on the HW rings.
+    uint64_t hw_unit;         ///< HW cost per work unit (fixed point).
+    uint64_t cpu_base;        ///< fixed cost of a command on the CPU.
+    uint64_t cpu_unit;        ///< CPU cost per work unit (fixed point).
+    uint64_t max_cpu_units;   ///< largest command sent to the CPU, in work
+                              ///  units. Zero disables the CPU path.
+    bool     hw_autotune;     ///< whether HW costs follow the measurements.
+    bool     cpu_secret_ops;  ///< whether commands on secret operands may be
+                              ///  sent to the CPU.
+
+    pka_atomic32_t lock;      ///< serializes the updates of the HW costs.
+
+    pka_atomic64_t ring_backlog[PKA_MAX_NUM_RINGS];   ///< estimated cost of
+                                                      ///  the commands pending
+                                                      ///  in each ring.
+    pka_atomic64_t ring_last_rslt[PKA_MAX_NUM_RINGS]; ///< time of the last
+                                                      ///  result dequeued from
+                                                      ///  each ring.
+} pka_dispatch_t;
+
+/// Return the cost of a command, in work units.
+uint64_t pka_dispatch_cmd_units(pka_opcode_t opcode, pka_operands_t *operands);
+
+/// Calibrate the CPU costs and reset the HW costs to their default values.
+void pka_dispatch_init(pka_dispatch_t *dispatch);
+
+/// Return the estimated cost of a command processed by the HW, excluding
+/// the commands pending in the rings.
+uint64_t pka_dispatch_hw_cost(pka_dispatch_t *dispatch, uint64_t units);
+
+/// Return whether a command should rather be processed on the CPU. Unless
+/// 'cpu_secret_ops' is set, only commands whose operands are deemed public -
+/// e.g. additions, shifts, comparisons, signature verifications and short
+/// exponent modular exponentiations - are sent to the CPU.
+///
+/// @param dispatch     Dispatch cost model.
+/// @param rings        Table of rings that may process the command.
+/// @param rings_cnt    Number of rings.
+/// @param opcode       Opcode of the command.
+/// @param operands     Operands of the command.
+/// @param units        Cost of the command, in work units.
+bool pka_dispatch_use_cpu(pka_dispatch_t  *dispatch,
+                          pka_ring_info_t  rings[],
+                          uint32_t         rings_cnt,
+                          pka_opcode_t     opcode,
+                          pka_operands_t  *operands,
+                          uint64_t         units);
+
+/// Return the estimated cost of the commands pending in a ring.
+uint64_t pka_dispatch_ring_backlog(pka_dispatch_t *dispatch,
+                                   uint32_t        ring_id);
+
+/// Account for a command appended to a ring, whose estimated cost is 'cost'.
+/// Rings may be fed by several threads at once.
+void pka_dispatch_hw_enqueue(pka_dispatch_t *dispatch,
+                             uint32_t        ring_id,
+                             uint64_t        cost);
+
+/// Account for a result dequeued from a ring, and refine the HW costs. The
+/// HW costs are refined by one thread at a time: a measurement made while
+/// another one is being accounted is dropped.
+///
+/// @param dispatch     Dispatch cost model.
+/// @param ring_id      Ring the result was dequeued from.
+/// @param enqueue_time Time the command was appended to the ring.
+/// @param units        Cost of the command, in work units.
+/// @param cost         Estimated cost of the command, as given on enqueue.
+/// @param ring_idle    Whether the ring has no more pending commands.
+void pka_dispatch_hw_complete(pka_dispatch_t *dispatch,
+                              uint32_t        ring_id,
+                              uint64_t        enqueue_time,
+                              uint64_t        units,
+                              uint64_t        cost,
+                              bool            ring_idle);
+
+/// Convert the cost model to/from its public representation.
+void pka_dispatch_get_params(pka_dispatch_t        *dispatch,
+                             pka_dispatch_params_t *params);
+void pka_dispatch_set_params(pka_dispatch_t        *dispatch,
+                             pka_dispatch_params_t *params);
+
+#endif // __PKA_DISPATCH_H__
@@ -45,17 +45,73 @@
 
 #include "pka_queue.h"
 #include "pka_ring.h"
+#include "pka_dispatch.h"
 
 #define PKA_LIB_VERSION          "v1"
 
 #define PKA_DEFAULT_NAME         "default"
 #define PKA_DEFAULT_SIZE         (16 * MEGABYTE) // 16 MB
 
-#define PKA_MAX_QUEUES_NUM        16
+// Worker slots of an instance, one per handle. The lock word of the instance
+// has a request bit per lock number, bits 8 to 63 - see
+// pka_try_acquire_lock() - and the last one goes to the progress thread.
+#define PKA_MAX_QUEUES_NUM        55
 #define PKA_SHMEM_SIZE_MASK       0x0FFFFFFFUL
 #define PKA_SHMEM_NAME_SIZE       32
 #define PKA_SHMEM_PREFIX          "PKA_"
 
+// Lock number of the progress thread, next to the worker ones: its request
+// bit is bit 63 of the lock word, and its owner byte 56 is distinct from
+// those of the workers.
+#define PKA_PROGRESS_ID           PKA_MAX_QUEUES_NUM
+
+// Ring selection policy of an instance, as an index - see pka_flags_t.
+#define PKA_RING_POLICY(flags)    (((flags) & PKA_F_RING_POLICY_MASK) >> 8)
+
+// EIP-154 (shim) a ring belongs to.
+#define PKA_RING_SHIM_ID(ring)    \
+    ((int) ((ring)->ring_id / PKA_MAX_NUM_IO_BLOCK_RINGS))
+
+// Classes of the SW command queues of a worker. Commands of high priority
+// have their own queue, swept before the other ones. Commands of normal
+// priority whose operands take at most PKA_CMD_SMALL_LEN bytes of window RAM
+// have their own queue, so that they go past a large command which no ring
+// can take yet. Both are a quarter of the size of the queue of large
+// commands. Commands of a class remain in order.
+#define PKA_CMD_CLASS_HIGH        0
+#define PKA_CMD_CLASS_SMALL       1
+#define PKA_CMD_CLASS_LARGE       2
+#define PKA_CMD_CLASSES_CNT       3
+#define PKA_CMD_SMALL_LEN         1024
+#define PKA_CMD_SMALL_QUEUE_SHIFT 2
+
+// Rings of the opcodes, for the opcode affinity ring selection policy.
+#define PKA_RING_AFFINITY_SIZE    64
+#define PKA_RING_AFFINITY_NONE    0xFF
+
+// No ring reserved for high priority commands - see PKA_F_PRIORITY_RING.
+#define PKA_PRIORITY_RING_NONE    0xFF
+
+// Deficit round robin across the SW command queues of normal priority of the
+// workers. Each turn, a worker may append up to its weight times
+// PKA_DRR_QUANTUM bytes of window RAM operands to the rings. The allowance it
+// did not use carries over while it has commands queued.
+#define PKA_DRR_QUANTUM           1024
+
+// Credits of an instance per descriptor of its rings - i.e. a command on a
+// ring and another one waiting in a SW queue. See pka_acquire_credits().
+#define PKA_CREDITS_PER_DESC      2
+
+// Bounds of the phases of pka_wait_result(). The spin window is sized from
+// the expected completion time of the outstanding requests; then the thread
+// yields the CPU, doubling the number of yields between two attempts, and
+// finally blocks.
+#define PKA_WAIT_SPIN_MIN_US      1
+#define PKA_WAIT_SPIN_MAX_US      100
+#define PKA_WAIT_YIELD_MAX_CNT    64
+#define PKA_WAIT_SLEEP_MIN_US     8
+#define PKA_WAIT_SLEEP_MAX_US     1000
+
 // Shared memory object information
 typedef struct
 {
@@ -68,10 +124,72 @@ typedef struct
 
 typedef struct
 {
-    pka_queue_t *cmd_queue;  ///< pointer to SW command queue.
+    pka_queue_t *cmd_queues[PKA_CMD_CLASSES_CNT]; ///< pointers to SW command
+                                                  ///  queues, per class.
     pka_queue_t *rslt_queue; ///< pointer to SW result queue.
+    pka_atomic32_t rslt_fd;  ///< eventfd signalled when results are enqueued
+                             ///  on the SW result queue, or -1. Cleared
+                             ///  under 'rslt_lock'.
+    uint32_t     weight;     ///< share of the rings of the worker - see
+                             ///  pka_set_weight().
+    uint32_t     deficit;    ///< window RAM bytes the worker may still
+                             ///  append in its turn.
+    bool         drr_turn;   ///< whether the turn of the worker is in
+                             ///  progress - see pka_sweep_cmd_queues().
+    uint8_t      lane_idx;   ///< index of the first ring of the lane of the
+                             ///  worker - see PKA_F_LANE_MODE.
+    uint8_t      lane_cnt;   ///< number of rings of the lane, 0 if none.
+    pka_atomic32_t rslt_lock; ///< serializes the writers of the SW result
+                              ///  queue of the worker.
+    pka_atomic32_t lane_lock; ///< serializes the appends of the worker to
+                              ///  its lane and the readers of its results.
+    pka_atomic32_t stolen;    ///< commands of the worker appended to the lane
+                              ///  of another worker, not completed yet.
+    uint64_t     served_cmds;  ///< commands appended to a ring from the SW
+                               ///  command queues.
+    uint64_t     served_bytes; ///< window RAM bytes of those commands.
+    uint64_t     delay;        ///< total cycles those commands waited.
+    uint64_t     max_delay;    ///< longest wait, in cycles.
+    uint64_t     stolen_cmds;  ///< commands of other workers the worker
+                               ///  appended to a ring - see
+                               ///  pka_steal_cmds().
+    uint64_t     stolen_delay; ///< total cycles those commands waited.
+    uint32_t     orphans;      ///< results still expected once the handle
+                               ///  of the slot is terminated - see
+                               ///  pka_free_slot().
 } pka_worker_t;
 
+// Progress thread of an instance - see PKA_F_PROGRESS_THREAD.
+typedef struct
+{
+    pthread_t        thread;      ///< progress thread identifier.
+    int              doorbell_fd; ///< eventfd signalled to wake up the thread.
+    volatile bool    idle;        ///< set while the thread sleeps.
+    volatile bool    stop;        ///< set to terminate the thread.
+} pka_progress_t;
+
+// Owner of the lock of an instance: its work budget, and how long the lock is
+// held - see pka_set_owner_budget(). The statistics are updated once the lock
+// is released, hence atomically.
+typedef struct
+{
+    uint32_t         max_cmds;   ///< commands per acquisition, 0 if
+                                 ///  unbounded.
+    uint64_t         max_ticks;  ///< cycles per acquisition, 0 if unbounded.
+    uint64_t         acquired;   ///< cycle count when the lock was taken.
+    pka_atomic64_t   holds;      ///< times the lock was taken and released.
+    pka_atomic64_t   handoffs;   ///< releases with requests pending.
+    pka_atomic64_t   hold_hist[PKA_HOLD_HIST_BUCKETS]; ///< holds per duration.
+} pka_owner_t;
+
+// Work left to the owner of the lock of an instance in its current hold.
+typedef struct
+{
+    uint32_t         cmds;       ///< commands appended so far.
+    uint32_t         max_cmds;   ///< commands allowed, 0 if unbounded.
+    uint64_t         deadline;   ///< cycle count past which the owner stops,
+                                 ///  0 if none.
+} pka_budget_t;
 
 // Shared structure - Should be visible to PK process and threads
 typedef struct
@@ -81,9 +199,20 @@ typedef struct
     uint32_t         requests_cnt;       ///< command request counter.
     uint32_t         queues_cnt;         ///< number of queues supported.
     uint32_t         cmd_queue_size;     ///< size of a command queue.
+    uint32_t         small_queue_size;   ///< size of a command queue of small
+                                         ///  commands.
     uint32_t         rslt_queue_size;    ///< size of a result queue.
 
     pka_atomic32_t   workers_cnt;        ///< number of active workers.
+    pka_atomic32_t   slots_cnt;          ///< number of worker slots whose
+                                         ///  queues are created, the ones
+                                         ///  the workers are looked up in.
+    pka_atomic32_t   slots_lock;         ///< serializes the allocation of
+                                         ///  worker slots.
+    uint64_t         slots_mask;         ///< bitmask of the worker slots in
+                                         ///  use, draining ones included.
+    uint64_t         orphans_mask;       ///< bitmask of the worker slots
+                                         ///  released with results pending.
     pka_worker_t     workers[PKA_MAX_QUEUES_NUM]; ///< table of initialized
                                                   ///  thread workers.
 
@@ -93,6 +222,29 @@ typedef struct
     pka_ring_info_t  rings[PKA_MAX_NUM_RINGS];    ///< table of allocated rings
                                                   ///  to process PK commands.
 
+    pka_dispatch_t   dispatch;           ///< HW/CPU dispatch cost model.
+
+    uint8_t          ring_affinity[PKA_RING_AFFINITY_SIZE]; ///< ring of each
+                                         ///  opcode, see ring policies.
+    uint32_t         ring_rr;            ///< next ring in round robin.
+    uint32_t         drr_next;           ///< next worker served by the
+                                         ///  deficit round robin.
+    uint8_t          pool_rings_cnt;     ///< number of rings shared under
+                                         ///  the lock, the lanes - if any -
+                                         ///  come next.
+    uint8_t          lane_rings_cnt;     ///< number of rings per lane.
+    uint8_t          lanes_cnt;          ///< number of workers with a lane.
+    uint8_t          shared_rings_cnt;   ///< number of rings commands of any
+                                         ///  priority may use, the reserved
+                                         ///  ring - if any - comes next.
+    uint8_t          prio_ring;          ///< index of the ring reserved for
+                                         ///  high priority commands.
+    pka_atomic32_t   credits;            ///< credits left to acquire.
+    uint32_t         credits_max;        ///< credits of the instance, 0 if
+                                         ///  they are not accounted for.
+    pka_dispatch_stats_t dispatch_stats[PKA_MAX_QUEUES_NUM]; ///< dispatch
+                                                  ///  counters per worker.
+
     pka_shmem_info_t shmem_info;         ///< shared memory information.
 
     /// Lock-free implementations have higher performance and scale better
@@ -101,8 +253,11 @@ typedef struct
     /// these flags tend to optimize performance on platforms that implement
     /// a performance critical operation using locks.
     pka_atomic64_t   lock;               ///< protect shared resources.
+    pka_owner_t      owner;              ///< owner of the lock.
     pka_flags_t      flags;              ///< flags supplied during creation.
 
+    pka_progress_t   progress;           ///< progress thread, if any.
+
     uint8_t         *mem_ptr;            ///< pointer to free memory space of
                                          ///  SW queues.
 
@@ -110,12 +265,64 @@ typedef struct
                                          ///  here.
 } pka_global_info_t;
 
+/// PK command of a batch, recorded by pka_submit_batch().
+typedef struct
+{
+    void           *user_data;  ///< opaque user data of the command.
+    pka_results_t  *rslt_bufs;  ///< user result buffers, if any.
+    pka_opcode_t    opcode;     ///< PK command code.
+    pka_operands_t  operands;   ///< checked operands of the command.
+} pka_batch_entry_t;
+
+typedef struct
+{
+    uint32_t          cnt;                        ///< number of commands.
+    pka_batch_entry_t entries[PKA_MAX_BATCH_CNT]; ///< commands of the batch.
+} pka_batch_t;
+
+/// PK command reserved by a handle, whose operand data the user writes in
+/// place - see pka_reserve_cmd().
+typedef struct
+{
+    pka_queue_t          *cmd_queue; ///< SW queue of the command, NULL if
+                                     ///  no command is reserved.
+    pka_queue_cmd_desc_t  cmd_desc;  ///< descriptor of the command.
+    pka_operands_t        operands;  ///< operands of the command.
+    bool                  staged;    ///< whether the operand data is written
+                                     ///  to 'buf' then copied, because the
+                                     ///  command wraps around the end of
+                                     ///  the SW queue.
+    uint8_t               buf[PKA_QUEUE_DESC_MAX_SIZE]; ///< staging buffer.
+} pka_resv_t;
+
 typedef struct
 {
     uint32_t            id;         ///< handle identifier - thread specific.
     uint32_t            req_num;    ///< number of outstanding requests.
+    uint64_t            req_units;  ///< work units of the outstanding
+                                    ///  requests - see pka_wait_result().
     pka_global_info_t  *gbl_info;   ///< pointer to the instance information the
                                     ///  handle belongs to.
+    pka_batch_t        *batch;      ///< batch of commands being recorded, if
+                                    ///  any - see pka_submit_batch().
+    pka_results_t      *rslt_bufs;  ///< result buffers attached to the next
+                                    ///  command - see pka_set_result_bufs().
+    pka_priority_t      priority;   ///< priority of the next commands - see
+                                    ///  pka_set_priority().
+    uint64_t            timeout;    ///< cycles the next commands may wait in
+                                    ///  the SW queues, 0 if no limit - see
+                                    ///  pka_set_timeout().
+    uint32_t            credits;    ///< credits not consumed yet - see
+                                    ///  pka_acquire_credits().
+    uint32_t            credited;   ///< outstanding requests which consumed
+                                    ///  a credit.
+    int                 event_fd;   ///< completion fd of the handle, or -1 -
+                                    ///  see pka_get_result_fd().
+    pka_resv_t          resv;       ///< command reserved by the handle, if
+                                    ///  any - see pka_reserve_cmd().
+    pka_atomic32_t      lock;       ///< serializes the request accounting
+                                    ///  of a shared handle - see
+                                    ///  PKA_F_SHARED_HANDLES.
 } pka_local_info_t;
 
 static pka_global_info_t *pka_gbl_info; ///< PK global information.
@@ -128,6 +335,7 @@ typedef struct
     uint64_t    overhead_cycles;    ///< overhead cycles count from submitting
                                     ///  a cmd until pushing it to the HW ring.
     uint64_t    processing_cycles;  ///< cmd processing cycles count.
+    uint64_t    cost_units;         ///< cmd cost in work units.
     uint32_t    valid;              ///< if set to 'PKA_CMD_STATS_VALID'
                                     ///  then the stats entry is valid.
 } pka_cmd_stats_t;
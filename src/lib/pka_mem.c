@@ -538,6 +538,17 @@ uint32_t pka_mem_largest_chunk_size(uint32_t ring_id)
     return 0;
 }
 
+// Return the size (in bytes) of the free memory, possibly fragmented.
+uint32_t pka_mem_free_size(uint32_t ring_id)
+{
+    pka_mem_desc_t *data_mem;
+
+    data_mem = pka_data_mem_tbl[ring_id];
+    PKA_ASSERT(data_mem != NULL);
+
+    return data_mem->size - data_mem->alloc_bytes;
+}
+
 /// Return the size (in bytes) of the used memory starting at the given offset.
 uint32_t pka_mem_in_use_size(uint32_t ring_id, uint16_t offset)
 {
@@ -552,7 +563,7 @@ uint32_t pka_mem_in_use_size(uint32_t ring_id, uint16_t offset)
 
     used_offset = offset;
     map_idx     = used_offset >> ALIGN_SHIFT;
-    PKA_ASSERT(used_offset < DATA_MEM_SIZE);
+    PKA_ASSERT(used_offset < data_mem->size);
 
     map = data_mem->mem_map_tbl[map_idx];
     PKA_ASSERT(IS_USED_MEM(map));
@@ -580,7 +591,7 @@ bool pka_mem_is_full(uint32_t ring_id, uint32_t data_size)
     // First check if there is even a possibility of a match.
     if ((MAX_ALLOCS <= data_mem->alloc_cnt) ||
           (data_mem->free_list.size <= 2) ||
-          (DATA_MEM_SIZE <= (data_mem->alloc_bytes + data_size)))
+          (data_mem->size <= (data_mem->alloc_bytes + data_size)))
         return true;
 
     data_size = MAX(MIN_ALLOC_SIZE, data_size);
@@ -591,7 +602,7 @@ bool pka_mem_is_full(uint32_t ring_id, uint32_t data_size)
     }
 
     // If allocBytes is less than 50% then there must be room
-    if (data_mem->alloc_bytes < (DATA_MEM_SIZE / 2))
+    if (data_mem->alloc_bytes < (data_mem->size / 2))
         return false;
 
     // General purpose, but expensive check
@@ -620,7 +631,7 @@ uint16_t pka_mem_alloc(uint32_t ring_id, uint32_t size)
     // First check if there is even a possibility of a match.
     if ((MAX_ALLOCS <= data_mem->alloc_cnt) ||
         (data_mem->free_list.size <= 2) ||
-        (DATA_MEM_SIZE <= (data_mem->alloc_bytes + size)))
+        (data_mem->size <= (data_mem->alloc_bytes + size)))
         return 0;
 
     // Want to do a specific type of best fit match.
@@ -689,7 +700,7 @@ void pka_mem_free(uint32_t ring_id, uint16_t offset)
     used_offset = offset;
     map_idx     = used_offset >> ALIGN_SHIFT;
     PKA_ASSERT((used_offset & ALIGN_MASK) == 0);
-    PKA_ASSERT(used_offset < DATA_MEM_SIZE);
+    PKA_ASSERT(used_offset < data_mem->size);
 
     map = data_mem->mem_map_tbl[map_idx];
     PKA_ASSERT(IS_USED_MEM(map));
@@ -713,7 +724,7 @@ void pka_mem_free(uint32_t ring_id, uint16_t offset)
         if (IS_AVAIL_MEM(prev_map))
         {
             // See if we are coalescing both preceding and following blocks.
-            if (end_map_idx != MAX_MEM_MAP_IDX)
+            if (end_map_idx != data_mem->last_map_idx)
             {
                 next_map = data_mem->mem_map_tbl[end_map_idx + 1];
                 if (IS_AVAIL_MEM(next_map))
@@ -732,7 +743,7 @@ void pka_mem_free(uint32_t ring_id, uint16_t offset)
     }
 
     // If following block is free space, coalesce with it.
-    if (end_map_idx != MAX_MEM_MAP_IDX)
+    if (end_map_idx != data_mem->last_map_idx)
     {
         next_map = data_mem->mem_map_tbl[end_map_idx + 1];
         if (IS_AVAIL_MEM(next_map))
@@ -749,20 +760,34 @@ void pka_mem_free(uint32_t ring_id, uint16_t offset)
 }
 
 /// Create a new data memory in PKA Window RAM.
-void pka_mem_create(uint32_t ring_id)
+int pka_mem_create(uint32_t ring_id, uint32_t size)
 {
     pka_mem_idx_t    chunk_idx;
     pka_mem_chunk_t *chunk;
     pka_mem_desc_t  *data_mem;
     uint32_t         list_idx;
 
-    if (pka_data_mem_tbl[ring_id] != NULL)
-        return;
+    size &= ~ALIGN_MASK;
+    if (size < (ALIGNMENT + MAX_ALLOC_SIZE) || MAX_DATA_MEM_SIZE < size)
+    {
+        PKA_DEBUG(PKA_MEM, "bad data memory size=%u\n", size);
+        return -EINVAL;
+    }
 
-    data_mem = malloc(sizeof(pka_mem_desc_t));
-    memset(data_mem, 0, sizeof(pka_mem_desc_t));
+    // Keep the data memory of the ring unless it was partitioned otherwise.
+    data_mem = pka_data_mem_tbl[ring_id];
+    if (data_mem != NULL && data_mem->size == size)
+        return 0;
 
+    free(data_mem);
+    data_mem = malloc(sizeof(pka_mem_desc_t));
     pka_data_mem_tbl[ring_id] = data_mem;
+    if (data_mem == NULL)
+        return -ENOMEM;
+
+    memset(data_mem, 0, sizeof(pka_mem_desc_t));
+    data_mem->size         = size;
+    data_mem->last_map_idx = (size >> ALIGN_SHIFT) - 1;
     for (list_idx = 1; list_idx < NUM_OF_AVAIL_SIZES; list_idx++)
         data_mem->avail_lists[list_idx].list_idx = list_idx;
 
@@ -780,9 +805,11 @@ void pka_mem_create(uint32_t ring_id)
     chunk_idx     = pka_mem_alloc_chunk(data_mem);
     chunk         = &data_mem->chunk_tbl[chunk_idx];
     chunk->offset = ALIGNMENT;
-    chunk->size   = DATA_MEM_SIZE - ALIGNMENT;
+    chunk->size   = size - ALIGNMENT;
     chunk->kind   = AVAIL_MEM;
     pka_mem_add_chunk_to_avail(data_mem, chunk_idx);
+
+    return 0;
 }
 
 /// Clear allocated memory. Should be called before copying input vectors and
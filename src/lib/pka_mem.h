@@ -52,9 +52,10 @@
 /// memory pieces to hold the individual operand, but not single piece large
 /// enough to hold all of the operands).
 ///
-/// This code assumes that Data Memory is in the bottom 14KB of the "PKA window
-/// RAM" and so the addresses for the rings start at offset 0x3800.  Also, note
-/// that just because the rings hold 16 descriptors, does not mean that 16
+/// This code assumes that Data Memory is at the bottom of the "PKA window RAM"
+/// - 14KB by default, the size being chosen per ring when the window RAM is
+/// partitioned - and so the addresses for the rings start at its end.  Also,
+/// note that just because the rings hold 16 descriptors, does not mean that 16
 /// commands can be outstanding - since it is expected that often the Data
 /// Memory will run out before any or all of the rings are full themselves.
 /// Of course the opposite can also happen (though less likely) - that is the
@@ -84,19 +85,19 @@
 #define ALIGN_MASK   (ALIGNMENT - 1)
 #define MAX_PADDING  (3 * ALIGNMENT)
 
-#ifdef PKA_WINDOW_RAM_DATA_MEM_SIZE
-#define DATA_MEM_SIZE    PKA_WINDOW_RAM_DATA_MEM_SIZE
-#else
-#define DATA_MEM_SIZE    0x3800  // 14 KB
-#endif
+// Largest Data Memory, i.e. the whole window RAM of a ring, whether the
+// window RAM is split or not. It must not exceed 64KB.
+#define MAX_DATA_MEM_SIZE   MAX(PKA_RING_MEM_0_SIZE, PKA_RING_MEM_1_SIZE)
 
 #define MIN_ALLOC_SIZE      192
 #define MAX_ALLOC_SIZE      2560
 
-#define MAX_ALLOCS          248
-#define MAX_CHUNK_IDX       250
+// Each allocation may leave a free chunk behind, hence two chunks per
+// allocation. Chunk indexes must fit in a MemMap entry (12 bits).
+#define MAX_ALLOCS          MAX(248, MAX_DATA_MEM_SIZE / MIN_ALLOC_SIZE)
+#define MAX_CHUNK_IDX       (MAX_ALLOCS + 2)
 #define NUM_OF_AVAIL_SIZES  40
-#define MAX_MEM_MAP_IDX     ((DATA_MEM_SIZE >> ALIGN_SHIFT) - 1)
+#define MAX_MEM_MAP_IDX     ((MAX_DATA_MEM_SIZE >> ALIGN_SHIFT) - 1)
 
 #define ON_FREE_LIST        0
 #define AVAIL_MEM           1
@@ -104,19 +105,19 @@
 
 #define IS_AVAIL_MEM(map_value)  ((map_value >> 12) == AVAIL_MEM)
 #define IS_USED_MEM(map_value)   ((map_value >> 12) == USED_MEM)
-#define MEM_DESC_IDX(map_value)  (map_value & 0x00FF)
+#define MEM_DESC_IDX(map_value)  (map_value & 0x0FFF)
 #define USED_SIZE(map_value)     (map_value & 0x0FFF)
 
-typedef uint8_t pka_mem_idx_t;
+typedef uint16_t pka_mem_idx_t;
 
 /// This structure declares a "view" into memory allowing access to necessary
 /// fields at known offsets from a given base. The size field holds bytes
-/// representing a multiple of 64, and can range in size from 64 bytes to
-/// 14K bytes (i.e. all of Data Memory can be described by a single free space
-/// descriptor and will be when there are no allocations). A value of zero
+/// representing a multiple of 64, and can range in size from 64 bytes to the
+/// Data Memory size (i.e. all of Data Memory can be described by a single free
+/// space descriptor and will be when there are no allocations). A value of zero
 /// indicates that this is NOT a currently valid descriptor i.e. it must be
 /// on the free list.
-typedef struct // 8 bytes long.
+typedef struct // 10 bytes long.
 {
     uint16_t offset;                    ///< chunk offset in bytes.
     uint16_t size;                      ///< chunk size in bytes, including
@@ -130,11 +131,11 @@ typedef struct // 8 bytes long.
 } pka_mem_chunk_t;
 
 /// This structure declares linked lists used by memory descriptor below.
-typedef struct // 4 bytes long
+typedef struct // 8 bytes long
 {
     pka_mem_idx_t head;
     pka_mem_idx_t tail;
-    uint8_t       size;
+    uint16_t      size;
     uint8_t       list_idx;
 } pka_mem_chunk_list_t;
 
@@ -163,11 +164,18 @@ typedef struct
 
     uint32_t alloc_cnt;
     uint32_t alloc_bytes;
+
+    uint32_t size;          ///< Data Memory size in bytes.
+    uint32_t last_map_idx;  ///< MemMap index of the end of Data Memory.
 } pka_mem_desc_t;
 
 /// Return the size (in bytes) of the largest memory chunk available.
 uint32_t pka_mem_largest_chunk_size(uint32_t ring_id);
 
+/// Return the size (in bytes) of the free memory, possibly fragmented - i.e.
+/// not all of it might be allocated at once.
+uint32_t pka_mem_free_size(uint32_t ring_id);
+
 /// Return the size (in bytes) of the used memory starting at the given offset.
 uint32_t pka_mem_in_use_size(uint32_t ring_id, uint16_t offset);
 
@@ -187,8 +195,10 @@ void pka_mem_free(uint32_t ring_id, uint16_t offset);
 
 /// Create a new data memory in PKA Window RAM. This function allocate memory
 /// and make it available. All elements of the memory are allocated, in one
-/// continuous chunk of memory.
-void pka_mem_create(uint32_t ring_id);
+/// continuous chunk of memory. 'size' is the Data Memory size of the ring, as
+/// partitioned - see pka_ring_desc_t operands_base and operands_end. It
+/// returns 0 on success, a negative error code on failure.
+int pka_mem_create(uint32_t ring_id, uint32_t size);
 
 /// Reset allocated PKA window RAM region.
 void pka_mem_reset(uint32_t dst_offset, void* mem_ptr, uint32_t operands_size);
@@ -31,6 +31,8 @@
 //   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //
 
+#include <stddef.h>
+
 #include "pka_queue.h"
 #include "pka_mem.h"
 
@@ -40,6 +42,9 @@
 // True if x is a power of 2
 #define POWEROF2(x) ((((x)-1) & (x)) == 0)
 
+// Zero bytes used to pad operand data up to a multiple of 8 bytes.
+static uint8_t pka_queue_zero_pad[8];
+
 // Calculate the memory size (in bytes) needed for a queue.
 ssize_t pka_queue_get_memsize(uint32_t size)
 {
@@ -70,8 +75,8 @@ pka_queue_t *pka_queue_create(ssize_t size, uint32_t flags, void *mem)
     q = (pka_queue_t *) mem;
     memset(q, 0, sizeof(*q));
 
-    // The current implemetation supports simple producer/consumer.
-    // We set then the queue flags to a default value.
+    // The current implemetation supports simple producer/consumer, unless
+    // several producers are requested - see PKA_QUEUE_F_MP.
     q->flags     = flags;
 
     // Set queue head and tails.
@@ -380,7 +385,8 @@ int pka_queue_set_cmd_desc(pka_queue_cmd_desc_t *cmd_desc,
         // from/to window RAM. Thus to leverage the trade-off between the
         // memory space occupied by items in the queue and performance of
         // data copy, we propose to align operand data.
-        cmd_desc_size += PKA_ALIGN(operand->actual_len, 8);
+        // Registered operands are not copied to the queue.
+        cmd_desc_size += pka_queue_operand_data_len(operand);
     }
 
     // Add the operand info. It consist of a header for each operand
@@ -415,6 +421,7 @@ int pka_queue_set_rslt_desc(pka_queue_rslt_desc_t   *rslt_desc,
     rslt_desc->queue_num      = queue_num;
     rslt_desc->cmd_num        = cmd_num;
     rslt_desc->user_data      = user_data;
+    rslt_desc->rslt_bufs      = 0;
 
     // Get the result length and result count.
     rslt_desc->result_cnt = pka_ring_results_len(ring_desc,
@@ -440,6 +447,40 @@ int pka_queue_set_rslt_desc(pka_queue_rslt_desc_t   *rslt_desc,
     return 0;
 }
 
+// Set queue result descriptor of a command processed in software.
+int pka_queue_set_soft_rslt_desc(pka_queue_rslt_desc_t *rslt_desc,
+                                 pka_soft_rslt_t       *soft_rslt,
+                                 uint32_t               opcode,
+                                 uint32_t               cmd_num,
+                                 uint64_t               user_data,
+                                 uint8_t                queue_num)
+{
+    rslt_desc->opcode         = opcode;
+    rslt_desc->status         = soft_rslt->status;
+    rslt_desc->compare_result = soft_rslt->compare_result;
+    rslt_desc->queue_num      = queue_num;
+    rslt_desc->cmd_num        = cmd_num;
+    rslt_desc->user_data      = user_data;
+    rslt_desc->rslt_bufs      = 0;
+    rslt_desc->result_cnt     = soft_rslt->result_cnt;
+
+    // Result lengths are already 8 byte aligned by the software engine.
+    rslt_desc->result1_len = 0;
+    rslt_desc->result2_len = 0;
+    if (rslt_desc->result_cnt > 0)
+        rslt_desc->result1_len = soft_rslt->results[0].actual_len;
+
+    if (rslt_desc->result_cnt > 1)
+        rslt_desc->result2_len = soft_rslt->results[1].actual_len;
+
+    // Set the size of the queue result descriptor.
+    rslt_desc->size  = sizeof(pka_queue_rslt_desc_t);
+    rslt_desc->size += sizeof(pka_operand_t) * rslt_desc->result_cnt;
+    rslt_desc->size += rslt_desc->result1_len + rslt_desc->result2_len;
+
+    return 0;
+}
+
 // The actual enqueue of pointers on the queue. Placed here since identical
 // code needed in both header and data enqueue.
 static __pka_inline void pka_queue_do_enqueue(pka_queue_t *queue,
@@ -513,29 +554,42 @@ pka_queue_move_prod_head(pka_queue_t  *queue,
                          uint32_t     *free_entries)
 {
     const uint32_t capacity = queue->capacity;
+    uint32_t       cons_tail;
 
-    // move prod.head atomically
-    *old_head = queue->prod.head;
-
-    // add rmb barrier to avoid load/load reorder in weak memory model.
-    pka_rmb();
-
-    const uint32_t cons_tail = queue->cons.tail;
-    //  The subtraction is done between two unsigned 32bits value
-    // (the result is always modulo 32 bits even if we have
-    // *old_head > cons_tail). So 'free_entries' is always between 0
-    // and capacity (which is < size).
-    *free_entries = (capacity + cons_tail - *old_head);
-
-    // check that we have enough room in queue
-    if (unlikely(n > *free_entries))
-        n = 0;
+    do
+    {
+        // move prod.head atomically
+        *old_head = queue->prod.head;
 
-    if (n == 0)
-        return 0;
+        // add rmb barrier to avoid load/load reorder in weak memory model.
+        pka_rmb();
 
-    *new_head        = (*old_head + n) & queue->mask;
-    queue->prod.head = *new_head;
+        cons_tail = queue->cons.tail;
+        // The heads and tails are offsets in the queue, so the subtraction
+        // is done modulo the queue size - i.e. even once the producer
+        // wrapped around the end of the queue before the consumer. So
+        // 'free_entries' is always between 0 and capacity (which is < size).
+        *free_entries = (capacity + cons_tail - *old_head) & queue->mask;
+
+        // check that we have enough room in queue
+        if (unlikely(n > *free_entries))
+            n = 0;
+
+        if (n == 0)
+            return 0;
+
+        *new_head = (*old_head + n) & queue->mask;
+        if (!(queue->flags & PKA_QUEUE_F_MP))
+        {
+            queue->prod.head = *new_head;
+            return n;
+        }
+
+        // Several producers claim their room by moving the head with a
+        // CAS, and try again with the new head if another one moved it.
+    } while (!__atomic_compare_exchange_n(&queue->prod.head, old_head,
+                                          *new_head, 0, __ATOMIC_RELAXED,
+                                          __ATOMIC_RELAXED));
 
     return n;
 }
@@ -554,11 +608,10 @@ pka_queue_move_cons_head(pka_queue_t  *queue,
     pka_rmb();
 
     const uint32_t prod_tail = queue->prod.tail;
-    // The subtraction is done between two unsigned 32bits value
-    // (the result is always modulo 32 bits even if we have
-    // cons_head > prod_tail). So 'entries' is always between 0
+    // The subtraction is done modulo the queue size, as the heads and
+    // tails are offsets in the queue. So 'entries' is always between 0
     // and size(queue)-1.
-    *entries = (prod_tail - *old_head);
+    *entries = (prod_tail - *old_head) & queue->mask;
 
     // Set the actual entries for dequeue
     if (n > *entries)
@@ -583,22 +636,126 @@ pka_queue_update_tail(pka_queue_headtail_t *ht,
     else
         pka_rmb();
 
-    ht->tail = new_val;
+    ht->tail  = new_val;
+    ht->objs += 1;
+}
+
+// Publish the objects a producer wrote from 'old_head' up to 'new_head'.
+// With several producers, the objects are published in the order their
+// room was claimed: a producer waits for those before it to move the tail.
+static __pka_inline void pka_queue_update_prod_tail(pka_queue_t *queue,
+                                                    uint32_t     old_head,
+                                                    uint32_t     new_head)
+{
+    if (!(queue->flags & PKA_QUEUE_F_MP))
+    {
+        pka_queue_update_tail(&queue->prod, new_head, 1);
+        return;
+    }
+
+    while (queue->prod.tail != old_head)
+        pka_cpu_relax();
+
+    // The count of objects is only written in turn too.
+    queue->prod.objs += 1;
+    pka_wmb();
+    queue->prod.tail  = new_head;
+}
+
+// Write a command to the queue from 'head' on (copy command from user
+// context -> queue).
+static void pka_queue_cmd_write(pka_queue_t          *queue,
+                                uint32_t              head,
+                                pka_queue_cmd_desc_t *cmd_desc,
+                                pka_operands_t       *operands)
+{
+    pka_operand_t *operand;
+    uint32_t       operand_idx, operand_cnt, pad_len;
+    uint64_t       operand_buf_addr;
+    uint8_t       *operand_buf_ptr;
+
+    // write the command header.
+    pka_queue_do_enqueue(queue, &head, (uint8_t *) cmd_desc,
+                            sizeof(pka_queue_cmd_desc_t));
+
+    operand_cnt   = cmd_desc->operand_cnt;
+    // write the operands information and data.
+    for (operand_idx = 0;  operand_idx < operand_cnt;  operand_idx++)
+    {
+        operand = &operands->operands[operand_idx];
+
+        // Registered operands are referenced rather than copied - i.e. only
+        // the operand information is written, and the operand buffer is read
+        // when the command is dequeued.
+        if (operand->internal_use & PKA_OPERAND_F_REGISTERED)
+        {
+            pka_queue_do_enqueue(queue, &head, (uint8_t *) operand,
+                                    sizeof(pka_operand_t));
+            continue;
+        }
+
+        // Save the operand buffer pointer and reset the operand buffer address.
+        operand_buf_ptr  = operand->buf_ptr;
+        operand_buf_addr = head + sizeof(pka_operand_t);
+        operand->buf_ptr = (uint8_t *)(queue->mem + operand_buf_addr);
+
+        // copy the operand information.
+        pka_queue_do_enqueue(queue, &head, (uint8_t *) operand,
+                                        sizeof(pka_operand_t));
+
+        // copy the operand buffer data, and zero the padding rather than
+        // reading past the end of the user buffer - the padding bytes end
+        // up in the most significant word of the operand.
+        pad_len = PKA_ALIGN(operand->actual_len, 8) - operand->actual_len;
+        pka_queue_do_enqueue(queue, &head, operand_buf_ptr,
+                                operand->actual_len);
+        pka_queue_do_enqueue(queue, &head, pka_queue_zero_pad, pad_len);
+    }
 }
 
 // Enqueue a command on the queue (copy command from user context -> queue).
 int pka_queue_cmd_enqueue(pka_queue_t          *queue,
                           pka_queue_cmd_desc_t *cmd_desc,
                           pka_operands_t       *operands)
+{
+    uint32_t total_size;
+    uint32_t prod_head, prod_next, free_entries;
+
+    if (!(queue->flags & PKA_QUEUE_TYPE_CMD))
+        return -EPERM;
+
+    total_size = pka_queue_move_prod_head(queue, cmd_desc->size, &prod_head,
+                                            &prod_next, &free_entries);
+    if (total_size == 0)
+    {
+        PKA_DEBUG(PKA_QUEUE, "not enough room in queue\n");
+        __QUEUE_STAT_ADD(queue, enq_fail_objs, 1);
+        return -ENOBUFS;
+    }
+
+    pka_queue_cmd_write(queue, prod_head, cmd_desc, operands);
+    pka_queue_update_prod_tail(queue, prod_head, prod_next);
+
+    __QUEUE_STAT_ADD(queue, enq_success, 1);
+    return 0;
+}
+
+// Reserve room on the queue for a command whose operand data is written in
+// place by the caller. The descriptor and the operands information are
+// written right away, the data is only published by pka_queue_cmd_commit().
+int pka_queue_cmd_reserve(pka_queue_t          *queue,
+                          pka_queue_cmd_desc_t *cmd_desc,
+                          pka_operands_t       *operands)
 {
     pka_operand_t *operand;
     uint32_t       total_size;
     uint32_t       prod_head, prod_next, free_entries;
-    uint32_t       operand_idx, operand_cnt;
-    uint64_t       operand_buf_addr;
-    uint8_t       *operand_buf_ptr;
+    uint32_t       operand_idx, operand_cnt, pad_len;
 
-    if (queue->flags != PKA_QUEUE_TYPE_CMD)
+    // The reserved room is published from the head of the queue, which
+    // several producers would move meanwhile.
+    if (!(queue->flags & PKA_QUEUE_TYPE_CMD) ||
+            (queue->flags & PKA_QUEUE_F_MP))
         return -EPERM;
 
     total_size = pka_queue_move_prod_head(queue, cmd_desc->size, &prod_head,
@@ -610,34 +767,53 @@ int pka_queue_cmd_enqueue(pka_queue_t          *queue,
         return -ENOBUFS;
     }
 
+    // The operand buffers handed to the caller must be contiguous, so the
+    // command is written on commit when it wraps around the end of the
+    // queue.
+    if (prod_head + cmd_desc->size > queue->size)
+        return -EAGAIN;
+
     // write the command header.
     pka_queue_do_enqueue(queue, &prod_head, (uint8_t *) cmd_desc,
                             sizeof(pka_queue_cmd_desc_t));
 
-    operand_cnt   = cmd_desc->operand_cnt;
-    // write the operands information and data.
+    operand_cnt = cmd_desc->operand_cnt;
+    // write the operands information, and hand out the operand buffers.
     for (operand_idx = 0;  operand_idx < operand_cnt;  operand_idx++)
     {
-        operand = &operands->operands[operand_idx];
-
-        // Save the operand buffer pointer and reset the operand buffer address.
-        operand_buf_ptr  = operand->buf_ptr;
-        operand_buf_addr = prod_head + sizeof(pka_operand_t);
-        operand->buf_ptr = (uint8_t *)(queue->mem + operand_buf_addr);
+        operand          = &operands->operands[operand_idx];
+        operand->buf_ptr = queue->mem + prod_head + sizeof(pka_operand_t);
 
-        // copy the operand information.
         pka_queue_do_enqueue(queue, &prod_head, (uint8_t *) operand,
-                                        sizeof(pka_operand_t));
+                                sizeof(pka_operand_t));
 
-        // copy the operand buffer data.
-        pka_queue_do_enqueue(queue, &prod_head, operand_buf_ptr,
-                                PKA_ALIGN(operand->actual_len, 8));
+        // zero the padding now, the caller only writes the operand data.
+        pad_len = PKA_ALIGN(operand->actual_len, 8) - operand->actual_len;
+        memset(operand->buf_ptr + operand->actual_len, 0, pad_len);
+        prod_head += operand->actual_len + pad_len;
     }
 
-    pka_queue_update_tail(&queue->prod, prod_next, 1);
+    return 0;
+}
+
+// Publish the command reserved on the queue, after writing it if it wraps
+// around the end of the queue.
+void pka_queue_cmd_commit(pka_queue_t          *queue,
+                          pka_queue_cmd_desc_t *cmd_desc,
+                          pka_operands_t       *operands)
+{
+    if (operands)
+        pka_queue_cmd_write(queue, queue->prod.tail, cmd_desc, operands);
+
+    pka_queue_update_tail(&queue->prod, queue->prod.head, 1);
 
     __QUEUE_STAT_ADD(queue, enq_success, 1);
-    return 0;
+}
+
+// Give back the room reserved on the queue.
+void pka_queue_cmd_abort(pka_queue_t *queue)
+{
+    queue->prod.head = queue->prod.tail;
 }
 
 // Enqueue a result on a queue.
@@ -652,7 +828,7 @@ int pka_queue_rslt_enqueue(pka_queue_t             *queue,
     uint32_t       total_size, queue_size, queue_mask, rslt_desc_size;
     uint32_t       result_cnt, result1_offset, result2_offset;
 
-    if (queue->flags != PKA_QUEUE_TYPE_RSLT)
+    if (!(queue->flags & PKA_QUEUE_TYPE_RSLT))
         return -EPERM;
 
     total_size = pka_queue_move_prod_head(queue, rslt_desc->size, &prod_head,
@@ -689,6 +865,7 @@ int pka_queue_rslt_enqueue(pka_queue_t             *queue,
         rslt2_ptr             = (pka_operand_t *) (queue->mem + result2_offset);
         rslt2_ptr->actual_len = rslt_desc->result2_len;
         rslt2_ptr->buf_len    = rslt_desc->result2_len;
+        rslt2_ptr->big_endian = ring->big_endian;
         result2_offset       += sizeof(pka_operand_t);
         result2_offset       &= queue_mask;
         rslt2_ptr->buf_ptr    = (uint8_t *) (queue->mem + result2_offset);
@@ -697,6 +874,7 @@ int pka_queue_rslt_enqueue(pka_queue_t             *queue,
         rslt1_ptr             = (pka_operand_t *) (queue->mem + result1_offset);
         rslt1_ptr->actual_len = rslt_desc->result1_len;
         rslt1_ptr->buf_len    = rslt_desc->result1_len;
+        rslt1_ptr->big_endian = ring->big_endian;
         result1_offset       += sizeof(pka_operand_t);
         result1_offset       &= queue_mask;
         rslt1_ptr->buf_ptr    = (uint8_t *) (queue->mem + result1_offset);
@@ -716,13 +894,92 @@ int pka_queue_rslt_enqueue(pka_queue_t             *queue,
     return 0;
 }
 
+// Enqueue the result of a command processed in software on a queue.
+int pka_queue_soft_rslt_enqueue(pka_queue_t           *queue,
+                                pka_queue_rslt_desc_t *rslt_desc,
+                                pka_soft_rslt_t       *soft_rslt)
+{
+    pka_operand_t  result;
+    uint32_t       prod_head, prod_next, free_entries;
+    uint32_t       total_size, result_idx;
+
+    if (!(queue->flags & PKA_QUEUE_TYPE_RSLT))
+        return -EPERM;
+
+    total_size = pka_queue_move_prod_head(queue, rslt_desc->size, &prod_head,
+                                            &prod_next, &free_entries);
+    if (total_size == 0)
+    {
+        PKA_DEBUG(PKA_QUEUE, "not enough room in queue\n");
+        __QUEUE_STAT_ADD(queue, enq_fail_objs, 1);
+        return -ENOBUFS;
+    }
+
+    // write the result header.
+    pka_queue_do_enqueue(queue, &prod_head, (uint8_t *) rslt_desc,
+                            sizeof(pka_queue_rslt_desc_t));
+
+    // write the result operands information and data, using the same layout
+    // as results copied from rings.
+    for (result_idx = 0;  result_idx < rslt_desc->result_cnt;  result_idx++)
+    {
+        result         = soft_rslt->results[result_idx];
+        result.buf_len = result.actual_len;
+        result.buf_ptr = (uint8_t *) (queue->mem +
+                    ((prod_head + sizeof(pka_operand_t)) & queue->mask));
+
+        pka_queue_do_enqueue(queue, &prod_head, (uint8_t *) &result,
+                                sizeof(pka_operand_t));
+        pka_queue_do_enqueue(queue, &prod_head,
+                                soft_rslt->results[result_idx].buf_ptr,
+                                result.actual_len);
+    }
+
+    pka_queue_update_tail(&queue->prod, prod_next, 1);
+
+    __QUEUE_STAT_ADD(queue, enq_success, 1);
+    return 0;
+}
+
+// Enqueue the completion record of a result whose operands were already
+// copied to the user result buffers - i.e. only the result descriptor is
+// written on the queue.
+int pka_queue_rslt_cmpl_enqueue(pka_queue_t           *queue,
+                                pka_queue_rslt_desc_t *rslt_desc)
+{
+    uint32_t prod_head, prod_next, free_entries;
+    uint32_t total_size;
+
+    if (!(queue->flags & PKA_QUEUE_TYPE_RSLT))
+        return -EPERM;
+
+    rslt_desc->size = sizeof(pka_queue_rslt_desc_t);
+
+    total_size = pka_queue_move_prod_head(queue, rslt_desc->size, &prod_head,
+                                            &prod_next, &free_entries);
+    if (total_size == 0)
+    {
+        PKA_DEBUG(PKA_QUEUE, "not enough room in queue\n");
+        __QUEUE_STAT_ADD(queue, enq_fail_objs, 1);
+        return -ENOBUFS;
+    }
+
+    pka_queue_do_enqueue(queue, &prod_head, (uint8_t *) rslt_desc,
+                            rslt_desc->size);
+
+    pka_queue_update_tail(&queue->prod, prod_next, 1);
+
+    __QUEUE_STAT_ADD(queue, enq_success, 1);
+    return 0;
+}
+
 // Read command descriptor from queue. This function is not thread-safe.
 int pka_queue_load_cmd_desc(pka_queue_cmd_desc_t *cmd_desc, pka_queue_t *queue)
 {
     uint32_t cons_head, prod_tail, entries;
     uint32_t cmd_desc_size;
 
-    if (queue->flags != PKA_QUEUE_TYPE_CMD)
+    if (!(queue->flags & PKA_QUEUE_TYPE_CMD))
         return -EPERM;
 
     cons_head = queue->cons.head;
@@ -731,11 +988,10 @@ int pka_queue_load_cmd_desc(pka_queue_cmd_desc_t *cmd_desc, pka_queue_t *queue)
     pka_rmb();
 
     prod_tail = queue->prod.tail;
-    // The subtraction is done between two unsigned 32bits value
-    // (the result is always modulo 32 bits even if we have
-    // cons_head > prod_tail). So 'entries' is always between 0
+    // The subtraction is done modulo the queue size, as the heads and
+    // tails are offsets in the queue. So 'entries' is always between 0
     // and size(queue)-1.
-    entries = (prod_tail - cons_head);
+    entries = (prod_tail - cons_head) & queue->mask;
 
     cmd_desc_size = sizeof(pka_queue_cmd_desc_t);
 
@@ -761,11 +1017,13 @@ int pka_queue_cmd_dequeue(pka_queue_t            *queue,
     pka_operand_t         operands[MAX_OPERAND_CNT];
     pka_operand_t        *operand;
     uint32_t              cons_head, cons_next, entries;
-    uint32_t              total_size;
+    uint32_t              total_size, desc_off;
     uint32_t              operand_idx, operand_cnt;
     uint16_t              buf_len;
+    uint8_t               desc_buf[PKA_QUEUE_DESC_MAX_SIZE];
+    uint8_t              *desc_mem;
 
-    if (queue->flags != PKA_QUEUE_TYPE_CMD)
+    if (!(queue->flags & PKA_QUEUE_TYPE_CMD))
         return -EPERM;
 
     // Retrieve the size of the descriptor to dequeue. Note that the first
@@ -784,7 +1042,17 @@ int pka_queue_cmd_dequeue(pka_queue_t            *queue,
         return -EPERM;
     }
 
-    cons_head  += sizeof(pka_queue_cmd_desc_t);
+    // A descriptor which wraps around the end of the queue is first copied
+    // to a linear buffer, so that its operands are contiguous.
+    desc_mem = &queue->mem[cons_head];
+    if (cons_head + total_size > queue->size)
+    {
+        pka_queue_do_dequeue(queue, &cons_head, desc_buf, total_size);
+        desc_mem = desc_buf;
+    }
+
+    cmd_desc    = (pka_queue_cmd_desc_t *) desc_mem;
+    desc_off    = sizeof(pka_queue_cmd_desc_t);
 
     operand_cnt = cmd_desc->operand_cnt;
     memset(&operands[0], 0, sizeof(pka_operand_t) * MAX_OPERAND_CNT);
@@ -792,11 +1060,16 @@ int pka_queue_cmd_dequeue(pka_queue_t            *queue,
     for (operand_idx = 0;  operand_idx < operand_cnt;  operand_idx++)
     {
         // write the operand info and data.
-        operand    = (pka_operand_t *) &queue->mem[cons_head];
+        operand    = (pka_operand_t *) &desc_mem[desc_off];
         operands[operand_idx] = *operand;
-
-        buf_len    = PKA_ALIGN(operand->actual_len, 8);
-        cons_head += sizeof(pka_operand_t) + buf_len;
+        desc_off  += sizeof(pka_operand_t);
+
+        // The operand data follows its information, unless it is
+        // registered.
+        buf_len    = pka_queue_operand_data_len(operand);
+        if (!(operand->internal_use & PKA_OPERAND_F_REGISTERED))
+            operands[operand_idx].buf_ptr = &desc_mem[desc_off];
+        desc_off  += buf_len;
     }
     // Set ring descriptor and copy operands to window RAM.
     pka_ring_set_cmd_desc(ring_desc, alloc, cmd_desc->opcode,
@@ -808,18 +1081,88 @@ int pka_queue_cmd_dequeue(pka_queue_t            *queue,
     return 0;
 }
 
+// Drop the command at the head of the queue - e.g. a command whose deadline
+// passed before it could be appended to a HW ring.
+int pka_queue_cmd_discard(pka_queue_t *queue)
+{
+    pka_queue_cmd_desc_t *cmd_desc;
+    uint32_t              cons_head, cons_next, entries;
+
+    if (!(queue->flags & PKA_QUEUE_TYPE_CMD))
+        return -EPERM;
+
+    // The size is in the first word of the descriptor, see
+    // pka_queue_cmd_dequeue().
+    cmd_desc = (pka_queue_cmd_desc_t *) &queue->mem[queue->cons.head];
+    if (!pka_queue_move_cons_head(queue, cmd_desc->size, &cons_head,
+                                  &cons_next, &entries))
+    {
+        PKA_DEBUG(PKA_QUEUE, "no entries in queue\n");
+        __QUEUE_STAT_ADD(queue, deq_fail, 1);
+        return -EPERM;
+    }
+
+    pka_queue_update_tail(&queue->cons, cons_next, 0);
+
+    __QUEUE_STAT_ADD(queue, deq_success, 1);
+    return 0;
+}
+
+// Mark the queued commands with the given user data as canceled. The queue
+// is walked from its head without moving it; the flags of the matching
+// command descriptors are written in place.
+int pka_queue_cmd_cancel(pka_queue_t *queue, uint64_t user_data)
+{
+    pka_queue_cmd_desc_t cmd_desc;
+    uint32_t             head, idx, entries, flags_idx;
+
+    int canceled_cnt = 0;
+
+    if (!(queue->flags & PKA_QUEUE_TYPE_CMD))
+        return -EPERM;
+
+    head = queue->cons.head;
+
+    // add rmb barrier to avoid load/load reorder in weak memory model.
+    pka_rmb();
+
+    entries = (queue->prod.tail - head) & queue->mask;
+    while (entries >= sizeof(pka_queue_cmd_desc_t))
+    {
+        // The descriptor might wrap around the end of the queue.
+        idx = head;
+        pka_queue_do_dequeue(queue, &idx, (uint8_t *) &cmd_desc,
+                                sizeof(pka_queue_cmd_desc_t));
+
+        if (cmd_desc.user_data == user_data &&
+                !(cmd_desc.flags & PKA_QUEUE_CMD_F_CANCELED))
+        {
+            flags_idx  = head + offsetof(pka_queue_cmd_desc_t, flags);
+            flags_idx &= queue->mask;
+            queue->mem[flags_idx] |= PKA_QUEUE_CMD_F_CANCELED;
+            canceled_cnt          += 1;
+        }
+
+        head     = (head + cmd_desc.size) & queue->mask;
+        entries -= cmd_desc.size;
+    }
+
+    return canceled_cnt;
+}
+
 int pka_queue_rslt_dequeue(pka_queue_t            *queue,
                            pka_queue_rslt_desc_t  *rslt_desc,
                            pka_results_t          *results)
 {
     pka_queue_rslt_desc_t *dummy_rslt_desc; // used to avoid breaking strict
                                             // aliasing rule.
+    pka_results_t         *rslt_bufs;
     pka_operand_t         *result;
     uint32_t               cons_head, cons_next, entries, total_size;
     uint32_t               rslt_desc_size, result_idx, result_cnt;
     uint8_t               *buf_ptr;
 
-    if (queue->flags != PKA_QUEUE_TYPE_RSLT)
+    if (!(queue->flags & PKA_QUEUE_TYPE_RSLT))
         return -EPERM;
 
     // Retrieve the size of the descriptor to dequeue. Note that the first
@@ -846,10 +1189,19 @@ int pka_queue_rslt_dequeue(pka_queue_t            *queue,
                             rslt_desc_size);
 
     result_cnt = rslt_desc->result_cnt;
+    rslt_bufs  = (pka_results_t *) rslt_desc->rslt_bufs;
     // Read the operand info and data.
     for (result_idx = 0;  result_idx < result_cnt;  result_idx++)
     {
         result  = &results->results[result_idx];
+        if (rslt_bufs)
+        {
+            // The result operand was copied to the user result buffer, only
+            // return its information.
+            *result = rslt_bufs->results[result_idx];
+            continue;
+        }
+
         buf_ptr = result->buf_ptr;
 
         // copy the result operand information.
@@ -867,6 +1219,33 @@ int pka_queue_rslt_dequeue(pka_queue_t            *queue,
     return 0;
 }
 
+// Drop the result at the head of the queue - e.g. a result left to a handle
+// already terminated.
+int pka_queue_rslt_discard(pka_queue_t *queue)
+{
+    pka_queue_rslt_desc_t *rslt_desc;
+    uint32_t               cons_head, cons_next, entries;
+
+    if (!(queue->flags & PKA_QUEUE_TYPE_RSLT))
+        return -EPERM;
+
+    // The size is in the first word of the descriptor, see
+    // pka_queue_rslt_dequeue().
+    rslt_desc = (pka_queue_rslt_desc_t *) &queue->mem[queue->cons.head];
+    if (!pka_queue_move_cons_head(queue, rslt_desc->size, &cons_head,
+                                  &cons_next, &entries))
+    {
+        PKA_DEBUG(PKA_QUEUE, "no entries in queue\n");
+        __QUEUE_STAT_ADD(queue, deq_fail, 1);
+        return -EPERM;
+    }
+
+    pka_queue_update_tail(&queue->cons, cons_next, 0);
+
+    __QUEUE_STAT_ADD(queue, deq_success, 1);
+    return 0;
+}
+
 // dump the status of the queue on the console
 void pka_queue_dump(pka_queue_t *queue)
 {
@@ -56,7 +56,12 @@
 /// at least N pointers.
 ///
 /// Note that the current API implements an Enq/Deq a fixed number of items
-/// from a queue and does not support multi producer/consumer.
+/// from a queue and is single producer/consumer by default. Command queues
+/// created with PKA_QUEUE_F_MP take several producers, which claim their
+/// room with a CAS on the producer head and publish their commands in turn.
+/// Several consumers - e.g. a worker and the workers stealing its commands -
+/// must take the consumer side of the queue first, see
+/// pka_queue_cons_lock().
 ///
 /// Also note that the implementation includes a mechanism which exert a back
 /// pressure to inform a given client to pause. It defines a threshold, once
@@ -72,6 +77,7 @@
 
 #include "pka_utils.h"
 #include "pka_ring.h"
+#include "pka_soft.h"
 
 /// PK queue result descriptor structure. This structure characterize an
 /// item in PK SW queue.  One can enqueue/dequeue descriptors similar to
@@ -80,7 +86,7 @@
 /// processing. This structure holds the minimal information required to
 /// retrieve a PK result.   It also aims to increase the number of items
 /// -i.e. results in the result queue.
-typedef struct // 32 bytes
+typedef struct // 40 bytes
 {
     uint32_t  size;            // total size the result descriptor. This
                                // field is common to both result and cmd
@@ -94,6 +100,9 @@ typedef struct // 32 bytes
     uint32_t  result2_len;     // length of the second result.
 
     uint64_t  user_data;       // opaque user data information address.
+    uint64_t  rslt_bufs;       // user result buffers address. If set, the
+                               // result operands were copied there and
+                               // do not follow the descriptor.
     uint32_t  opcode;          // PK operation code
     uint8_t   result_cnt;      // might be 0, 1 or 2
     uint8_t   status;          // the raw result_code.
@@ -110,7 +119,7 @@ typedef struct // 32 bytes
 /// which holds the minimal information required  to process PK commands
 /// and decrease the overhead added due to SW queue.  Note that it tends
 /// to increase the number of items -i.e. results in the result queue.
-typedef struct // 40 bytes.
+typedef struct // 64 bytes.
 {
     uint16_t  size;           // total size the command descriptor. This
                               // field is common to both result and cmd
@@ -123,17 +132,44 @@ typedef struct // 40 bytes.
     uint8_t   shift_cnt;      // shift value used by the PK command.
 
     uint64_t  user_data;      // opaque user data information address.
+    uint64_t  rslt_bufs;      // user result buffers address, if any.
     uint32_t  opcode;         // code of the requeted PK command.
     uint32_t  operands_len;   // aligned and padded data vectors size. It
                               // refers to size of both command and result
                               // operands.
 
     uint32_t  cmd_num;        // command request number.
+    uint8_t   priority;       // priority class, see pka_priority_t.
+    uint8_t   flags;          // PKA_QUEUE_CMD_F_* flags.
+    uint64_t  deadline;       // cycle count after which the command is
+                              // dropped from the queue, 0 if none.
+    uint64_t  submit_time;    // cycle count when the command was submitted.
+    uint64_t  cost_units;     // cost of the command in work units, see
+                              // pka_dispatch_cmd_units().
 
 } pka_queue_cmd_desc_t __pka_aligned(8);
 
+/// The command was withdrawn while queued - see pka_queue_cmd_cancel().
+#define PKA_QUEUE_CMD_F_CANCELED    0x1
+
 #define QUEUE_CMD_DESC_SIZE  sizeof(pka_queue_cmd_desc_t)
 
+/// Flag set in the 'internal_use' field of registered operands - see
+/// pka_register_operand(). The SW command queue only holds the operand
+/// information of registered operands and not their data; the operand
+/// buffer is read when the command is copied to window RAM.
+#define PKA_OPERAND_F_REGISTERED  0x1
+
+/// Return the number of data bytes that follow an operand in a SW command
+/// queue.
+static inline uint32_t pka_queue_operand_data_len(pka_operand_t *operand)
+{
+    if (operand->internal_use & PKA_OPERAND_F_REGISTERED)
+        return 0;
+
+    return PKA_ALIGN(operand->actual_len, 8);
+}
+
 #ifdef PKA_LIB_QUEUE_DEBUG
 // A structure that stores the queue statistics.
 struct pka_queue_debug_stats {
@@ -148,6 +184,7 @@ struct pka_queue_debug_stats {
 typedef struct {
     volatile uint32_t head;  /**< Prod/consumer head. */
     volatile uint32_t tail;  /**< Prod/consumer tail. */
+    volatile uint32_t objs;  /**< Objects moved past the tail. */
 } pka_queue_headtail_t;
 
 typedef struct
@@ -165,6 +202,7 @@ typedef struct
 
     // Queue consumer status.
     pka_queue_headtail_t cons __pka_cache_aligned;
+    pka_atomic32_t       cons_lock; ///< consumer side, when shared.
     uint8_t  pad2 __pka_cache_aligned; ///< empty cache line.
 
 #ifdef PKA_LIB_QUEUE_DEBUG
@@ -180,6 +218,8 @@ typedef struct
 
 #define PKA_QUEUE_TYPE_CMD  0x1 ///< the default type is command queue.
 #define PKA_QUEUE_TYPE_RSLT 0x2 ///< The default type is result queue.
+#define PKA_QUEUE_F_MP      0x4 ///< several threads enqueue commands - e.g.
+                                ///  threads sharing a handle.
 
 #define PKA_QUEUE_MASK_SIZE  (unsigned)(0x007fffff)  ///< Queue mask size (8MB)
 
@@ -223,22 +263,69 @@ int pka_queue_cmd_enqueue(pka_queue_t          *queue,
                           pka_queue_cmd_desc_t *cmd_desc,
                           pka_operands_t       *operands);
 
+/// Reserve room on the queue for a command, whose operand data the caller
+/// then writes in place rather than having it copied. The descriptor and the
+/// operands information are written right away, and the address of the data
+/// of each operand is returned in its 'buf_ptr' field. The command is only
+/// seen by the consumer once pka_queue_cmd_commit() is called, and no other
+/// command may be enqueued meanwhile. Returns 0 on success, or -ENOBUFS if
+/// there is not enough room. Returns -EAGAIN if the room is reserved but
+/// wraps around the end of the queue: nothing is written then, and the
+/// caller gives the operand data to pka_queue_cmd_commit() instead.
+/// Registered operands and queues with several producers are not supported.
+int pka_queue_cmd_reserve(pka_queue_t          *queue,
+                          pka_queue_cmd_desc_t *cmd_desc,
+                          pka_operands_t       *operands);
+
+/// Publish the command reserved on the queue - see pka_queue_cmd_reserve().
+/// The command is first written from 'operands' unless it is NULL, i.e.
+/// when its room wraps around the end of the queue.
+void pka_queue_cmd_commit(pka_queue_t          *queue,
+                          pka_queue_cmd_desc_t *cmd_desc,
+                          pka_operands_t       *operands);
+
+/// Give back the room reserved on the queue - see pka_queue_cmd_reserve().
+void pka_queue_cmd_abort(pka_queue_t *queue);
+
 /// Enqueue a result on the queue (copy result from ring -> queue).
 int pka_queue_rslt_enqueue(pka_queue_t             *queue,
                            pka_ring_info_t         *ring,
                            pka_ring_hw_rslt_desc_t *ring_desc,
                            pka_queue_rslt_desc_t   *rslt_desc);
 
+/// Enqueue the result of a command processed in software on the queue (copy
+/// result from software buffers -> queue).
+int pka_queue_soft_rslt_enqueue(pka_queue_t           *queue,
+                                pka_queue_rslt_desc_t *rslt_desc,
+                                pka_soft_rslt_t       *soft_rslt);
+
+int pka_queue_rslt_cmpl_enqueue(pka_queue_t           *queue,
+                                pka_queue_rslt_desc_t *rslt_desc);
+
 /// Dequeue a command from a queue (copy cmd from queue -> ring).
 int pka_queue_cmd_dequeue(pka_queue_t            *queue,
                           pka_ring_hw_cmd_desc_t *ring_desc,
                           pka_ring_alloc_t       *alloc);
 
+/// Drop the command at the head of a queue, without copying it.
+int pka_queue_cmd_discard(pka_queue_t *queue);
+
+/// Mark the commands of a queue with the given user data as canceled. The
+/// commands stay in the queue until they are discarded. Returns the number
+/// of commands marked. The caller must be both the producer and the
+/// consumer of the queue - e.g. the worker of the queue, owning the PK lock
+/// or the consumer side of the queue. With several producers, the commands
+/// enqueued meanwhile are not marked.
+int pka_queue_cmd_cancel(pka_queue_t *queue, uint64_t user_data);
+
 /// Dequeue a result from a queue (copy result from queue -> user context).
 int pka_queue_rslt_dequeue(pka_queue_t            *queue,
                            pka_queue_rslt_desc_t  *rslt_desc,
                            pka_results_t          *results);
 
+/// Drop the result at the head of a queue, without copying it.
+int pka_queue_rslt_discard(pka_queue_t *queue);
+
 /// Set queue command descriptor.
 int pka_queue_set_cmd_desc(pka_queue_cmd_desc_t *cmd_desc,
                            uint32_t              cmd_num,
@@ -253,9 +340,23 @@ int pka_queue_set_rslt_desc(pka_queue_rslt_desc_t   *rslt_desc,
                             uint64_t                 user_data,
                             uint8_t                  queue_num);
 
+/// Set queue result descriptor of a command processed in software.
+int pka_queue_set_soft_rslt_desc(pka_queue_rslt_desc_t *rslt_desc,
+                                 pka_soft_rslt_t       *soft_rslt,
+                                 uint32_t               opcode,
+                                 uint32_t               cmd_num,
+                                 uint64_t               user_data,
+                                 uint8_t                queue_num);
+
 /// Load a command descriptor from a queue.
 int pka_queue_load_cmd_desc(pka_queue_cmd_desc_t *cmd_desc, pka_queue_t *queue);
 
+/// Return the number of objects in a queue - e.g. commands or results.
+static inline uint32_t pka_queue_objs(pka_queue_t *queue)
+{
+    return queue->prod.objs - queue->cons.objs;
+}
+
 /// Return the number of entries in a queue (in bytes).
 static inline uint32_t pka_queue_count(pka_queue_t *queue)
 {
@@ -283,6 +384,27 @@ static inline int pka_queue_is_empty(pka_queue_t *queue)
     return pka_queue_count(queue) == 0;
 }
 
+/// Try to take the consumer side of a queue with several consumers. Returns 1
+/// if it was taken, 0 if another consumer holds it.
+static inline int pka_queue_cons_trylock(pka_queue_t *queue)
+{
+    return pka_spin_trylock(&queue->cons_lock);
+}
+
+/// Take the consumer side of a queue with several consumers, waiting for
+/// the other consumer to release it.
+static inline void pka_queue_cons_lock(pka_queue_t *queue)
+{
+    while (!pka_queue_cons_trylock(queue))
+        pka_cpu_relax();
+}
+
+/// Release the consumer side of a queue with several consumers.
+static inline void pka_queue_cons_unlock(pka_queue_t *queue)
+{
+    pka_spin_unlock(&queue->cons_lock);
+}
+
 /// dump the status of the queue on the console
 void pka_queue_dump(pka_queue_t *queue);
 
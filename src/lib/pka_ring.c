@@ -34,16 +34,77 @@
 //#ifndef __KERNEL__
 //TODO Code should be used by both Kernel services and user space applications.
 
+#include <sys/eventfd.h>
+
 #include "pka_ring.h"
 #include "pka_mem.h"
 #include "pka_dev.h"
+#ifdef PKA_LIB_SIM
+#include "pka_sim.h"
+#endif
 
 #include "pka_utils.h"
 
+// Access to the ring count registers. Note that these registers do not behave
+// as memory: writes to the command count increment it and writes to the result
+// count decrement it. Thus the simulated device has to trap these accesses.
+#ifdef PKA_LIB_SIM
+#define pka_ring_reg_read(ring, off)       pka_sim_reg_read((ring), (off))
+#define pka_ring_reg_write(ring, off, val) \
+    pka_sim_reg_write((ring), (off), (val))
+#else
+#define pka_ring_reg_read(ring, off)       \
+    pka_mmio_read((ring)->reg_ptr + (off))
+#define pka_ring_reg_write(ring, off, val) \
+    pka_mmio_write((ring)->reg_ptr + (off), (val))
+#endif
+
 // This structure is used to hold "user_data" information associated
 // with PK commands.
 pka_udata_db_t pka_ring_udata_db[PKA_MAX_NUM_RINGS];
 
+// Return whether a command descriptor is in use.
+static __pka_inline bool
+pka_ring_test_cmd_desc(pka_ring_desc_t *ring_desc, uint32_t index)
+{
+    return (ring_desc->cmd_desc_mask[index / 64] >> (index % 64)) & 1;
+}
+
+// Mark a command descriptor in use(1) or free(0).
+static __pka_inline void
+pka_ring_mark_cmd_desc(pka_ring_desc_t *ring_desc, uint32_t index, bool used)
+{
+    if (used)
+        ring_desc->cmd_desc_mask[index / 64] |= 1ULL << (index % 64);
+    else
+        ring_desc->cmd_desc_mask[index / 64] &= ~(1ULL << (index % 64));
+}
+
+// Size the user data information data base of a ring to its depth. It returns
+// 0 on success, a negative error code on failure.
+static int pka_ring_create_udata_db(pka_ring_info_t *ring)
+{
+    pka_udata_db_t   *udata_db;
+    pka_udata_info_t *entries;
+    uint32_t          size;
+
+    udata_db = &pka_ring_udata_db[ring->ring_id];
+    size     = 2 * ring->ring_desc.num_descs;
+    if (udata_db->entries != NULL && udata_db->size == size)
+        return 0;
+
+    entries = calloc(size, sizeof(pka_udata_info_t));
+    if (!entries)
+        return -ENOMEM;
+
+    free(udata_db->entries);
+    udata_db->entries = entries;
+    udata_db->size    = size;
+    udata_db->index   = 0;
+
+    return 0;
+}
+
 // Returns offset of the command count register.
 static uint32_t pka_ring_cmd_cnt_offset(uint64_t base)
 {
@@ -74,7 +135,7 @@ static void pka_ring_inc_cmd_cnt(pka_ring_info_t *ring, uint64_t inc)
     uint32_t reg_offset;
 
     reg_offset = pka_ring_cmd_cnt_offset(ring->reg_addr);
-    pka_mmio_write(ring->reg_ptr + reg_offset, inc);
+    pka_ring_reg_write(ring, reg_offset, inc);
 
 }
 
@@ -84,7 +145,7 @@ static void pka_ring_dec_rslt_cnt(pka_ring_info_t *ring, uint64_t dec)
     uint32_t reg_offset;
 
     reg_offset = pka_ring_rslt_cnt_offset(ring->reg_addr);
-    pka_mmio_write(ring->reg_ptr + reg_offset, dec);
+    pka_ring_reg_write(ring, reg_offset, dec);
 }
 
 // The function checks to see if the PKA HW counters are properly initialized.
@@ -98,12 +159,12 @@ static bool pka_ring_has_nonzero_counters(pka_ring_info_t *ring)
     uint32_t reg_offset;
 
     reg_offset = pka_ring_cmd_cnt_offset(ring->reg_addr);
-    cmd_count  = pka_mmio_read(ring->reg_ptr + reg_offset);
+    cmd_count  = pka_ring_reg_read(ring, reg_offset);
 
     PKA_DEBUG(PKA_RING, "CMMD_CTR_INC_%u=%lu\n", ring->ring_id, cmd_count);
 
     reg_offset = pka_ring_rslt_cnt_offset(ring->reg_addr);
-    rslt_count = pka_mmio_read(ring->reg_ptr + reg_offset);
+    rslt_count = pka_ring_reg_read(ring, reg_offset);
 
     PKA_DEBUG(PKA_RING, "RSLT_CTR_DEC_%u=%lu\n", ring->ring_id, rslt_count);
 
@@ -113,10 +174,10 @@ static bool pka_ring_has_nonzero_counters(pka_ring_info_t *ring)
     if ((rslt_count != 0) && (cmd_count == 0))
     {
         // Decrement result count by the number we read out.
-        pka_mmio_write(ring->reg_ptr + reg_offset, rslt_count);
+        pka_ring_reg_write(ring, reg_offset, rslt_count);
 
         // Reread the result count to see if the reset worked.
-        rslt_count = pka_mmio_read(ring->reg_ptr + reg_offset);
+        rslt_count = pka_ring_reg_read(ring, reg_offset);
         if (rslt_count == 0)
         {
             PKA_DEBUG(PKA_RING, "successfully cleared non-zero "
@@ -171,6 +232,10 @@ int pka_ring_lookup(pka_ring_info_t rings[],
         return 0;
     }
 
+#ifdef PKA_LIB_SIM
+    // Simulated rings do not need any VFIO container.
+    container = -1;
+#else
     // Create a new container
     container = open(PKA_VFIO_CONTAINER_PATH, O_RDWR);
     if (container < 0)
@@ -192,6 +257,7 @@ int pka_ring_lookup(pka_ring_info_t rings[],
         close(container);
         return -EFAULT;
     }
+#endif
 
     // Lookup for available ring.
     for (ring_idx = 0; ring_idx < req_rings_num; ring_idx++)
@@ -228,14 +294,29 @@ int pka_ring_lookup(pka_ring_info_t rings[],
         //       the firmware instable).
         pka_ring_has_nonzero_counters(ring);
 
-        // Initialize data memory for the ring.
-        pka_mem_create(ring->ring_id);
+        // Initialize user data information and data memory for the ring.
+        if (pka_ring_create_udata_db(ring) ||
+                pka_mem_create(ring->ring_id, ring->ring_desc.operands_end -
+                                    ring->ring_desc.operands_base))
+        {
+            PKA_DEBUG(PKA_RING, "failed to set up ring %d memory\n",
+                            ring->ring_id);
+            pka_dev_munmap_ring(ring);
+            pka_dev_close_ring(ring);
+            if (!(*cnt))
+            {
+                close(container);
+                return -ENOMEM;
+            }
+            break;
+        }
 
         // Clear memory content.
         pka_ring_reset_mem(ring);
 
         ring->idx        = ring_idx;
         ring->big_endian = byte_order;
+        ring->irq_fd     = -1;
         // Set ring bit in mask
         *mask     |= 1 << ring->ring_id;
         *cnt      += 1;
@@ -249,12 +330,14 @@ static int pka_ring_put(pka_ring_info_t *ring, uint32_t cnt)
 {
     if (ring)
     {
+        // Detach the ring interrupt, if routed.
+        pka_ring_disable_irq(ring);
         // Unmap ring
         pka_dev_munmap_ring(ring);
         // Close ring
         pka_dev_close_ring(ring);
 
-        if (!cnt) // check for last ring
+        if (!cnt && ring->container >= 0) // check for last ring
             // close container
             close(ring->container);
 
@@ -296,7 +379,6 @@ int pka_ring_free(pka_ring_info_t rings[], uint32_t *mask, uint32_t *cnt)
 // Return the number of available rooms to append a command descriptors.
 uint32_t pka_ring_has_available_room(pka_ring_info_t *ring)
 {
-    uint64_t used_desc_mask;
     uint32_t total_descs_num, used_descs_num, next_desc_idx;
 
     if (ring)
@@ -308,9 +390,8 @@ uint32_t pka_ring_has_available_room(pka_ring_info_t *ring)
         // even when there are available descriptors in the ring. Thus always
         // check for whether the descriptor at the next command index has been
         // processed, i.e., associated result dequeued.
-        next_desc_idx  = ring->ring_desc.cmd_idx;
-        used_desc_mask = ring->ring_desc.cmd_desc_mask;
-        if ((1 << next_desc_idx) & used_desc_mask)
+        next_desc_idx = ring->ring_desc.cmd_idx;
+        if (pka_ring_test_cmd_desc(&ring->ring_desc, next_desc_idx))
             return 0;
 
         total_descs_num = ring->ring_desc.num_descs;
@@ -321,6 +402,51 @@ uint32_t pka_ring_has_available_room(pka_ring_info_t *ring)
     return 0;
 }
 
+// Route the ring result interrupt to a new eventfd.
+int pka_ring_enable_irq(pka_ring_info_t *ring)
+{
+    int irq_fd, ret;
+
+    if (ring->irq_fd >= 0)
+        return 0;
+
+    irq_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (irq_fd < 0)
+        return -errno;
+
+    ret = pka_dev_set_ring_irq(ring, irq_fd);
+    if (ret)
+    {
+        PKA_DEBUG(PKA_RING, "ring %d interrupt cannot be routed\n",
+                    ring->ring_id);
+        close(irq_fd);
+        return ret;
+    }
+
+    ring->irq_fd = irq_fd;
+    return 0;
+}
+
+// Detach the ring result interrupt and close its eventfd.
+void pka_ring_disable_irq(pka_ring_info_t *ring)
+{
+    if (ring->irq_fd < 0)
+        return;
+
+    pka_dev_set_ring_irq(ring, -1);
+    close(ring->irq_fd);
+    ring->irq_fd = -1;
+}
+
+// Clear the pending ring result interrupt.
+void pka_ring_clear_irq(pka_ring_info_t *ring)
+{
+    eventfd_t cnt;
+
+    if (ring->irq_fd >= 0)
+        eventfd_read(ring->irq_fd, &cnt);
+}
+
 // Returns the number of available results (when result is ready).
 uint32_t pka_ring_has_ready_rslt(pka_ring_info_t *ring)
 {
@@ -338,19 +464,21 @@ uint32_t pka_ring_has_ready_rslt(pka_ring_info_t *ring)
 
         rslt_cnt_off = (ring->reg_addr + RESULT_COUNT_0_ADDR)
                                     & ~page_mask; // should be 0x88
-        rslt_cnt_val = (uint32_t) pka_mmio_read(ring->reg_ptr + rslt_cnt_off);
+        rslt_cnt_val = (uint32_t) pka_ring_reg_read(ring, rslt_cnt_off);
     }
 
     return rslt_cnt_val;
 }
 
-// Return whether the returned values of 'user_data', 'cmd_num', 'queue_num'
-// and 'ring_num' are valid.
+// Return whether the returned values of 'user_data', 'rslt_bufs', 'cmd_num',
+// 'queue_num' and 'ring_num' are valid.
 bool pka_ring_pop_tag(pka_ring_hw_rslt_desc_t *result_desc,
                       uint64_t                *user_data,
+                      uint64_t                *rslt_bufs,
                       uint64_t                *cmd_num,
                       uint8_t                 *queue_num,
-                      uint8_t                 *ring_num)
+                      uint8_t                 *ring_num,
+                      pka_ring_cost_t         *cost)
 {
     pka_udata_info_t *udata_info;
 
@@ -361,7 +489,9 @@ bool pka_ring_pop_tag(pka_ring_hw_rslt_desc_t *result_desc,
         *cmd_num   = udata_info->cmd_num;
         *queue_num = udata_info->queue_num;
         *user_data = udata_info->user_data;
+        *rslt_bufs = udata_info->rslt_bufs;
         *ring_num  = udata_info->ring_num; // future use - statistics
+        *cost      = udata_info->cost;
 
         // reset user data info
         udata_info->valid = 0;
@@ -378,20 +508,25 @@ bool pka_ring_pop_tag(pka_ring_hw_rslt_desc_t *result_desc,
 // data entry that is reserved from the data base 'pka_ring_udata_db'.
 void pka_ring_push_tag(pka_ring_hw_cmd_desc_t *cmd,
                        uint64_t                user_data,
+                       uint64_t                rslt_bufs,
                        uint64_t                cmd_num,
                        uint8_t                 queue_num,
-                       uint8_t                 ring_num)
+                       uint8_t                 ring_num,
+                       pka_ring_cost_t        *cost)
 {
     pka_udata_db_t   *udata_db;
     pka_udata_info_t *udata_info;
 
     udata_db   = &pka_ring_udata_db[ring_num]; // Kind of memory allocation
     udata_info = &udata_db->entries[udata_db->index++];
+    udata_db->index %= udata_db->size;
 
     udata_info->user_data = user_data;
+    udata_info->rslt_bufs = rslt_bufs;
     udata_info->cmd_num   = cmd_num;
     udata_info->queue_num = queue_num;
     udata_info->ring_num  = ring_num;
+    udata_info->cost      = *cost;
 
     udata_info->valid     = PKA_UDATA_INFO_VALID;
 
@@ -403,7 +538,7 @@ pka_ring_update_cmd_desc_mask(pka_ring_info_t *ring,
                               uint64_t         tag)
 {
     pka_udata_info_t *udata_info;
-    uint8_t           index;
+    uint32_t          index;
 
     udata_info = (pka_udata_info_t *) tag;
     if (udata_info != NULL &&
@@ -418,26 +553,24 @@ pka_ring_update_cmd_desc_mask(pka_ring_info_t *ring,
         // Set command descriptor bit
         index = ring->ring_desc.cmd_idx;
     }
-    ring->ring_desc.cmd_desc_mask &= ~(1 << index);
+    pka_ring_mark_cmd_desc(&ring->ring_desc, index, false);
 }
 
 static __pka_inline void
 pka_ring_store_cmd_desc_idx(pka_ring_desc_t *ring_desc,
                             uint64_t         tag,
-                            uint8_t          cmd_idx)
+                            uint32_t         cmd_idx)
 {
     pka_udata_info_t *udata_info;
-    uint8_t           cmd_desc_idx;
 
-    cmd_desc_idx = (uint8_t) (cmd_idx & 0x3f); // max descs num is 64 (6 bits)
     // Set command descriptor bit.
-    ring_desc->cmd_desc_mask |= 1 << cmd_desc_idx;
+    pka_ring_mark_cmd_desc(ring_desc, cmd_idx, true);
 
     // update user data information.
     udata_info = (pka_udata_info_t *) tag;
     if (udata_info != NULL &&
             udata_info->valid == PKA_UDATA_INFO_VALID)
-        udata_info->cmd_desc_idx = cmd_desc_idx;
+        udata_info->cmd_desc_idx = cmd_idx;
 }
 
 // Write data in window RAM.
@@ -494,11 +627,11 @@ static __pka_inline void pka_ring_read_mem(pka_ring_info_t *ring,
     }
 }
 
-// Enqueue one command descriptor on a ring. This function verifies if there is
-// space in the queue for the command and append the descriptor. The command
-// descriptor number cmd_desc_num is written and might be used by the caller.
-int pka_ring_enqueue_cmd_desc(pka_ring_info_t        *ring,
-                              pka_ring_hw_cmd_desc_t *cmd_desc)
+// Append one command descriptor to a ring, without notifying the HW. This
+// function verifies if there is space in the queue for the command and append
+// the descriptor. The HW processes the descriptor once the ring is flushed.
+int pka_ring_append_cmd_desc(pka_ring_info_t        *ring,
+                             pka_ring_hw_cmd_desc_t *cmd_desc)
 {
     pka_ring_desc_t *ring_desc;
     uint32_t         cmd_idx;
@@ -557,8 +690,8 @@ int pka_ring_enqueue_cmd_desc(pka_ring_info_t        *ring,
     ring_desc->cmd_idx += 1;
     ring_desc->cmd_idx %= ring_desc->num_descs;
 
-    // Increment command count.
-    pka_ring_inc_cmd_cnt(ring, 1);
+    // The command count is incremented when the ring is flushed.
+    ring_desc->cmd_pending_cnt += 1;
 
     // Store the command descriptor index.
     pka_ring_store_cmd_desc_idx(ring_desc, cmd_desc->tag, cmd_idx);
@@ -568,16 +701,41 @@ int pka_ring_enqueue_cmd_desc(pka_ring_info_t        *ring,
     return 0;
 }
 
+// Notify the HW of the command descriptors appended to a ring since the last
+// flush. This takes a single increment of the command count register.
+void pka_ring_flush_cmd_descs(pka_ring_info_t *ring)
+{
+    pka_ring_desc_t *ring_desc;
+
+    ring_desc = &ring->ring_desc;
+    if (!ring_desc->cmd_pending_cnt)
+        return;
+
+    // Increment command count.
+    pka_ring_inc_cmd_cnt(ring, ring_desc->cmd_pending_cnt);
+    ring_desc->cmd_pending_cnt = 0;
+}
+
+// Enqueue one command descriptor on a ring. This function verifies if there is
+// space in the queue for the command and append the descriptor. The command
+// descriptor number cmd_desc_num is written and might be used by the caller.
+int pka_ring_enqueue_cmd_desc(pka_ring_info_t        *ring,
+                              pka_ring_hw_cmd_desc_t *cmd_desc)
+{
+    int ret;
+
+    ret = pka_ring_append_cmd_desc(ring, cmd_desc);
+    if (!ret)
+        pka_ring_flush_cmd_descs(ring);
+
+    return ret;
+}
+
 // Dequeue one result descriptor from a ring. This function verifies if there is
 // a ready result in the queue for the command and read the descriptor.
 int pka_ring_dequeue_rslt_desc(pka_ring_info_t         *ring,
                                pka_ring_hw_rslt_desc_t *result_desc)
 {
-    pka_ring_desc_t *ring_desc;
-    uint32_t         rslt_idx;
-    uint32_t         rslt_head_addr;
-    uint32_t         rslt_desc_wlen;
-
     if (!ring)
         return -EINVAL;
 
@@ -587,6 +745,23 @@ int pka_ring_dequeue_rslt_desc(pka_ring_info_t         *ring,
         return -EPERM;
     }
 
+    pka_ring_fetch_rslt_desc(ring, result_desc);
+    pka_ring_ack_rslt_descs(ring);
+
+    return 0;
+}
+
+// Read the next result descriptor of a ring, without decrementing the ring
+// result count register. The caller must know that the result is ready -
+// see pka_ring_has_ready_rslt().
+void pka_ring_fetch_rslt_desc(pka_ring_info_t         *ring,
+                              pka_ring_hw_rslt_desc_t *result_desc)
+{
+    pka_ring_desc_t *ring_desc;
+    uint32_t         rslt_idx;
+    uint32_t         rslt_head_addr;
+    uint32_t         rslt_desc_wlen;
+
     ring_desc = &ring->ring_desc;
 
     rslt_idx        = ring_desc->rslt_idx % ring_desc->num_descs;
@@ -602,16 +777,29 @@ int pka_ring_dequeue_rslt_desc(pka_ring_info_t         *ring,
     ring_desc->rslt_idx += 1;
     ring_desc->rslt_idx %= ring_desc->num_descs;
 
-    // Decrement result count
-    pka_ring_dec_rslt_cnt(ring, 1);
+    // The result count is decremented when the results are acknowledged.
+    ring_desc->rslt_ack_cnt += 1;
 
     // update command descriptor counter
     pka_ring_update_cmd_desc_mask(ring, result_desc->tag);
     ring->ring_desc.cmd_desc_cnt -= 1;
 
     __RING_STAT_ADD(ring, deq_success_rslt, 1);
+}
 
-    return 0;
+// Acknowledge the result descriptors read from a ring since the last
+// acknowledgement. This takes a single decrement of the result count register.
+void pka_ring_ack_rslt_descs(pka_ring_info_t *ring)
+{
+    pka_ring_desc_t *ring_desc;
+
+    ring_desc = &ring->ring_desc;
+    if (!ring_desc->rslt_ack_cnt)
+        return;
+
+    // Decrement result count
+    pka_ring_dec_rslt_cnt(ring, ring_desc->rslt_ack_cnt);
+    ring_desc->rslt_ack_cnt = 0;
 }
 
 static __pka_inline uint16_t pka_ring_get_mem_ptr(pka_ring_info_t *ring,
@@ -638,16 +826,27 @@ static void pka_ring_write_operand(pka_ring_alloc_t *alloc,
                                    uint32_t          word_len,
                                    uint32_t          pad_len)
 {
-    uint32_t src_word_len;
+    uint64_t tail_data;
+    uint32_t head_wlen, tail_len;
     uint16_t dst_addr;
     uint8_t *src_ptr;
 
     // Now load the operand into the 64KB window ram.
     PKA_ASSERT((alloc->dst_offset & 0x7) == 0);
-    src_ptr      = src_operand->buf_ptr;
-    dst_addr     = alloc->dst_offset;
-    src_word_len = PKA_ALIGN(src_operand->actual_len, 8) / 4;
-    pka_ring_write_mem(alloc->ring, dst_addr, src_ptr, src_word_len, word_len);
+    src_ptr   = src_operand->buf_ptr;
+    dst_addr  = alloc->dst_offset;
+    head_wlen = (src_operand->actual_len & ~0x7) / 4;
+    tail_len  = src_operand->actual_len & 0x7;
+    pka_ring_write_mem(alloc->ring, dst_addr, src_ptr, head_wlen, head_wlen);
+
+    // Copy the last partial 8-byte chunk through a zeroed buffer, so that
+    // the bytes past the end of the operand buffer are neither read nor
+    // given to the engine.
+    tail_data = 0;
+    memcpy(&tail_data, src_ptr + (4 * head_wlen), tail_len);
+    pka_ring_write_mem(alloc->ring, dst_addr + (4 * head_wlen), &tail_data,
+                       (tail_len + 3) / 4,
+                       (word_len > head_wlen) ? word_len - head_wlen : 0);
     alloc->dst_offset += 4 * (word_len + pad_len);
     if ((alloc->dst_offset & 0x7) != 0)
         alloc->dst_offset = PKA_ALIGN(alloc->dst_offset, 8);
@@ -1151,25 +1350,14 @@ pka_ring_copy_result(pka_ring_info_t *ring,
     return idx;
 }
 
-// Copy output vector(s) associated with a result descriptor from ring memory.
-uint32_t pka_ring_get_result(pka_ring_info_t         *ring,
-                             pka_ring_hw_rslt_desc_t *result_desc,
-                             uint8_t                 *queue_ptr,
-                             uint32_t                 queue_size,
-                             uint32_t                 result1_offset,
-                             uint32_t                 result2_offset,
-                             uint32_t                 result1_size,
-                             uint32_t                 result2_size)
+// Get the window RAM address of the output vector(s) associated with a result
+// descriptor, and return the number of output vectors.
+static uint32_t pka_ring_results_addr(pka_ring_hw_rslt_desc_t *result_desc,
+                                      uint32_t                *result1_addr,
+                                      uint32_t                *result2_addr)
 {
-    uint32_t       lengthB;
-    uint32_t       skip_bytes;
-    uint32_t       y_offset;
-    uint32_t       s_offset;
-    uint32_t       index;
-    uint32_t       operands_base;
-    uint32_t       operands_off;
-
-    index = 0;
+    uint32_t lengthB;
+    uint32_t skip_bytes;
 
     switch (result_desc->command)
     {
@@ -1178,97 +1366,145 @@ uint32_t pka_ring_get_result(pka_ring_info_t         *ring,
     case CC_MULTIPLY:
     case CC_SHIFT_LEFT:
     case CC_SHIFT_RIGHT:
+    case CC_MODULO:
         // All of these opcodes return a single result using pointer_c.
-        index = pka_ring_copy_result(ring, queue_ptr, result1_offset,
-                    result_desc->pointer_c, result1_size, queue_size);
-
-        break;
+        *result1_addr = result_desc->pointer_c;
+        return 1;
 
     case CC_ADD_SUBTRACT:
-        // Returns a single result using pointer_d.
-        index = pka_ring_copy_result(ring, queue_ptr, result1_offset,
-                    result_desc->pointer_d, result1_size, queue_size);
-
-        break;
+    case CC_MODULAR_EXP:
+    case CC_MOD_EXP_CRT:
+    case CC_MODULAR_INVERT:
+    case CC_ECDSA_VERIFY:
+    case CC_DSA_VERIFY:
+        // All of these opcodes return a single result using pointer_d.
+        *result1_addr = result_desc->pointer_d;
+        return 1;
 
     case CC_DIVIDE:
         // Returns two results using pointer_c (remainder) and pointer_d
         // (quotient).
-        index  = pka_ring_copy_result(ring, queue_ptr, result1_offset,
-                    result_desc->pointer_c, result1_size, queue_size);
-
-        index  = pka_ring_copy_result(ring, queue_ptr, result2_offset,
-                        result_desc->pointer_d, result2_size, queue_size);
-        break;
-
-    case CC_MODULO:
-        // Returns a single result using pointer_c.
-        index = pka_ring_copy_result(ring, queue_ptr, result1_offset,
-                    result_desc->pointer_c, result1_size, queue_size);
-
-        break;
-
-    case CC_COMPARE:
-        // Returns zero results.
-        break;
-
-    case CC_MODULAR_EXP:
-    case CC_MOD_EXP_CRT:
-    case CC_MODULAR_INVERT:
-        // Returns a single result using pointer_d.
-        index = pka_ring_copy_result(ring, queue_ptr, result1_offset,
-                    result_desc->pointer_d, result1_size, queue_size);
-        break;
+        *result1_addr = result_desc->pointer_c;
+        *result2_addr = result_desc->pointer_d;
+        return 2;
 
     case CC_ECC_PT_ADD:
     case CC_ECC_PT_MULTIPLY:
-        // Returns two results (x and y values of an ECC point) using pointer_d.
-        index = pka_ring_copy_result(ring, queue_ptr, result1_offset,
-                    result_desc->pointer_d, result1_size, queue_size);
-
-        lengthB    = result_desc->length_b;
-        skip_bytes = 4 * (((lengthB & 1) == 0) ? 2 : 3);
-        y_offset   = result_desc->pointer_d + (4 * lengthB) + skip_bytes;
-        index = pka_ring_copy_result(ring, queue_ptr, result2_offset, y_offset,
-                                        result2_size, queue_size);
-        break;
-
     case CC_ECDSA_GENERATE:
     case CC_DSA_GENERATE:
-        // Returns two results (r and s values of an signature) using pointer_d.
-        index = pka_ring_copy_result(ring, queue_ptr, result1_offset,
-                    result_desc->pointer_d, result1_size, queue_size);
-        lengthB    = result_desc->length_b;
-        skip_bytes = 4 * (((lengthB & 1) == 0) ? 2 : 3);
-        s_offset   = result_desc->pointer_d + (4 * lengthB) + skip_bytes;
-        index      = pka_ring_copy_result(ring, queue_ptr, result2_offset,
-                                            s_offset, result2_size, queue_size);
-        break;
-
-    case CC_ECDSA_VERIFY:
-    case CC_DSA_VERIFY:
-        index = pka_ring_copy_result(ring, queue_ptr, result1_offset,
-                    result_desc->pointer_d, result1_size, queue_size);
-        break;
+        // Returns two results using pointer_d - i.e. x and y values of an
+        // ECC point, or r and s values of a signature.
+        lengthB       = result_desc->length_b;
+        skip_bytes    = 4 * (((lengthB & 1) == 0) ? 2 : 3);
+        *result1_addr = result_desc->pointer_d;
+        *result2_addr = result_desc->pointer_d + (4 * lengthB) + skip_bytes;
+        return 2;
 
+    case CC_COMPARE:
     case CC_ECDSA_VERIFY_NO_WRITE:
     case CC_DSA_VERIFY_NO_WRITE:
         // Returns zero operands.
-        break;
+        return 0;
 
     default:
         PKA_ASSERT(0);
-        break;
+        return 0;
     }
+}
+
+// Free up the operands and results of a command from window RAM.
+static __pka_inline void
+pka_ring_free_operands(pka_ring_info_t         *ring,
+                       pka_ring_hw_rslt_desc_t *result_desc)
+{
+    uint32_t operands_base;
+    uint32_t operands_off;
 
-    // Free up operands and results from memory.
     operands_base = ring->ring_desc.operands_base;
     operands_off  = result_desc->pointer_a & ~operands_base;
     pka_mem_free(ring->ring_id, operands_off);
+}
+
+// Copy output vector(s) associated with a result descriptor from ring memory.
+uint32_t pka_ring_get_result(pka_ring_info_t         *ring,
+                             pka_ring_hw_rslt_desc_t *result_desc,
+                             uint8_t                 *queue_ptr,
+                             uint32_t                 queue_size,
+                             uint32_t                 result1_offset,
+                             uint32_t                 result2_offset,
+                             uint32_t                 result1_size,
+                             uint32_t                 result2_size)
+{
+    uint32_t result1_addr, result2_addr;
+    uint32_t result_cnt;
+    uint32_t index;
+
+    index      = 0;
+    result_cnt = pka_ring_results_addr(result_desc, &result1_addr,
+                                       &result2_addr);
+    if (result_cnt > 0)
+        index = pka_ring_copy_result(ring, queue_ptr, result1_offset,
+                        result1_addr, result1_size, queue_size);
+
+    if (result_cnt > 1)
+        index = pka_ring_copy_result(ring, queue_ptr, result2_offset,
+                        result2_addr, result2_size, queue_size);
+
+    pka_ring_free_operands(ring, result_desc);
 
     return index;
 }
 
+// Copy one result from window RAM to a user buffer. Unlike queues, the
+// buffer does not wrap.
+static __pka_inline void
+pka_ring_copy_result_buf(pka_ring_info_t *ring,
+                         uint8_t         *dst,
+                         uint32_t         src_addr,
+                         uint32_t         src_len)
+{
+    uint32_t  dst_size, idx;
+
+    idx      = 0;
+    dst_size = src_len;
+    src_addr = src_addr & ~ring->ring_desc.operands_base;
+
+    COPY_PTRS(src_addr, src_len);
+}
+
+// Copy output vector(s) associated with a result descriptor from ring memory
+// to user buffers.
+void pka_ring_get_result_bufs(pka_ring_info_t         *ring,
+                              pka_ring_hw_rslt_desc_t *result_desc,
+                              uint8_t                 *result1_ptr,
+                              uint8_t                 *result2_ptr,
+                              uint32_t                 result1_size,
+                              uint32_t                 result2_size)
+{
+    uint32_t result1_addr, result2_addr;
+    uint32_t result_cnt;
+
+    result_cnt = pka_ring_results_addr(result_desc, &result1_addr,
+                                       &result2_addr);
+    if (result_cnt > 0)
+        pka_ring_copy_result_buf(ring, result1_ptr, result1_addr,
+                                 result1_size);
+
+    if (result_cnt > 1)
+        pka_ring_copy_result_buf(ring, result2_ptr, result2_addr,
+                                 result2_size);
+
+    pka_ring_free_operands(ring, result_desc);
+}
+
+// Drop the output vector(s) associated with a result descriptor, freeing them
+// from ring memory.
+void pka_ring_drop_result(pka_ring_info_t         *ring,
+                          pka_ring_hw_rslt_desc_t *result_desc)
+{
+    pka_ring_free_operands(ring, result_desc);
+}
+
 // Set the size of result operands and return the number of results associated
 // with a given PK command.
 uint32_t pka_ring_results_len(pka_ring_hw_rslt_desc_t *result_desc,
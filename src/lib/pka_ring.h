@@ -63,6 +63,8 @@
 #include "pka_vectors.h"
 #endif
 
+#include "pka_config.h"
+
 #ifdef PKA_LIB_RING_DEBUG
 // A structure that stores the ring statistics.
 typedef struct
@@ -199,6 +201,10 @@ typedef struct  // 64 bytes long. 64 bytes aligned
 
 #define RESULT_DESC_SIZE  sizeof(pka_ring_hw_rslt_desc_t)  // Must be 64
 
+// Number of 64-bit words of the command descriptors bitmap, i.e. enough to
+// track the deepest ring supported by the HW.
+#define PKA_RING_DESC_MASK_WORDS  ((PKA_RING_NUM_CMD_DESC_MAX + 63) / 64)
+
 /// Describes a PKA command/result ring as used by the hardware.  A pair of
 /// command and result rings in PKA window memory, and the data memory used
 /// by the commands.
@@ -217,9 +223,14 @@ typedef struct
 
   uint32_t desc_size;      ///< size of each element in the ring.
 
-  uint64_t cmd_desc_mask;  ///< bitmask of free(0)/in_use(1) cmd descriptors.
+  uint64_t cmd_desc_mask[PKA_RING_DESC_MASK_WORDS]; ///< bitmap of free(0)/
+                                                   ///  in_use(1) descriptors.
   uint32_t cmd_desc_cnt;   ///< number of command descriptors currently in use.
   uint32_t rslt_desc_cnt;  ///< number of result descriptors currently ready.
+  uint32_t cmd_pending_cnt; ///< number of command descriptors appended but
+                            ///  not yet notified to the HW.
+  uint32_t rslt_ack_cnt;    ///< number of result descriptors read but not
+                            ///  yet acknowledged to the HW.
 } pka_ring_desc_t;
 
 /// This structure declares ring parameters which can be used by user interface.
@@ -250,6 +261,9 @@ typedef struct
 #endif
 
     uint8_t     big_endian;     ///< big endian byte order when enabled.
+
+    int         irq_fd;         ///< eventfd signalled by the ring result
+                                ///  interrupt, or -1 if not routed.
 } pka_ring_info_t;
 
 typedef struct
@@ -260,26 +274,40 @@ typedef struct
     pka_ring_info_t *ring;
 } pka_ring_alloc_t;
 
+/// Dispatch information of a command appended to a HW ring. It travels with
+/// the ring tag, so that it is found by whichever thread dequeues the result
+/// - see pka_dispatch_hw_complete().
+typedef struct
+{
+    uint64_t enqueue_time;  ///< cycle count when the cmd was appended.
+    uint64_t cost_units;    ///< cmd cost in work units.
+    uint64_t hw_cost;       ///< cmd estimated cost on the HW rings.
+} pka_ring_cost_t;
+
 // This sturcture encapsulates 'user data' information, it also includes
 // additional information useful for command processing and statistics.
 typedef struct
 {
     uint64_t valid; ///< if set to 'PKA_UDATA_INFO_VALID' then info is valid
     uint64_t user_data;     ///< opaque user address.
+    uint64_t rslt_bufs;     ///< user result buffers address, if any.
     uint64_t cmd_num;       ///< command request number.
-    uint8_t  cmd_desc_idx;  ///< index of the cmd descriptor in HW rings
+    uint32_t cmd_desc_idx;  ///< index of the cmd descriptor in HW rings
     uint8_t  ring_num;      ///< command request number.
     uint8_t  queue_num;     ///< queue number.
+    pka_ring_cost_t cost;   ///< dispatch information.
 } pka_udata_info_t;
 
 #define PKA_UDATA_INFO_VALID    0xDEADBEEF
 
 // This structure consists of a data base to store user data information.
-// Note that a data base should be associated with a hardware ring.
+// Note that a data base should be associated with a hardware ring, and holds
+// twice as many entries as the ring has descriptors.
 typedef struct
 {
-    pka_udata_info_t entries[32]; // user data information entries.
-    uint8_t          index   : 5; // entry index. Wrapping is permitted.
+    pka_udata_info_t *entries; // user data information entries.
+    uint32_t          size;    // number of entries.
+    uint32_t          index;   // entry index. Wrapping is permitted.
 } pka_udata_db_t;
 
 #ifndef __KERNEL__
@@ -307,20 +335,36 @@ uint32_t pka_ring_has_available_room(pka_ring_info_t *ring);
 /// the returned value may reflect the number of processed commands.
 uint32_t pka_ring_has_ready_rslt(pka_ring_info_t *ring);
 
+/// Route the result interrupt of a ring to a new eventfd - see 'irq_fd'. It
+/// returns 0 on success, a negative error code if the interrupt cannot be
+/// routed.
+int pka_ring_enable_irq(pka_ring_info_t *ring);
+
+/// Detach the result interrupt of a ring and close its eventfd.
+void pka_ring_disable_irq(pka_ring_info_t *ring);
+
+/// Clear the pending result interrupt of a ring, if routed. This must be
+/// done before reading the ring result count, so that no interrupt is lost.
+void pka_ring_clear_irq(pka_ring_info_t *ring);
+
 /// Return whether the returned pointer to use data info is valid or not.
 bool pka_ring_pop_tag(pka_ring_hw_rslt_desc_t *result_desc,
                       uint64_t                *user_data,
+                      uint64_t                *rslt_bufs,
                       uint64_t                *cmd_num,
                       uint8_t                 *queue_num,
-                      uint8_t                 *ring_num);
+                      uint8_t                 *ring_num,
+                      pka_ring_cost_t         *cost);
 
 /// Set ring command descriptor tag which is used to hold a pointer to user
 /// data info associated with a cmd.
 void pka_ring_push_tag(pka_ring_hw_cmd_desc_t *cmd,
                        uint64_t                user_data,
+                       uint64_t                rslt_bufs,
                        uint64_t                cmd_num,
                        uint8_t                 queue_num,
-                       uint8_t                 ring_num);
+                       uint8_t                 ring_num,
+                       pka_ring_cost_t        *cost);
 
 /// Write the command descriptor according to the PK command. This function
 /// should be called before enqueuing the descriptor on a ring.
@@ -337,12 +381,33 @@ int pka_ring_set_cmd_desc(pka_ring_hw_cmd_desc_t *cmd,
 int pka_ring_enqueue_cmd_desc(pka_ring_info_t        *ring,
                               pka_ring_hw_cmd_desc_t *cmd_desc);
 
+/// Append one command descriptor to a ring, without notifying the HW - i.e.
+/// the descriptor is processed once pka_ring_flush_cmd_descs() is called. It
+/// returns 0 on success, a negative error code on failure.
+int pka_ring_append_cmd_desc(pka_ring_info_t        *ring,
+                             pka_ring_hw_cmd_desc_t *cmd_desc);
+
+/// Notify the HW of the command descriptors appended to a ring, with a single
+/// increment of the ring command count register.
+void pka_ring_flush_cmd_descs(pka_ring_info_t *ring);
+
 /// Dequeue one result descriptor from a ring. This function verifies if there
 /// is a ready result in the queue for the command and read the descriptor. It
 /// returns 0 on success, a negative error code on failure.
 int pka_ring_dequeue_rslt_desc(pka_ring_info_t         *ring,
                                pka_ring_hw_rslt_desc_t *result_desc);
 
+/// Read the next result descriptor of a ring, without acknowledging it to the
+/// HW - i.e. the ring result count is decremented once by
+/// pka_ring_ack_rslt_descs(). The caller must know that the result is ready,
+/// see pka_ring_has_ready_rslt().
+void pka_ring_fetch_rslt_desc(pka_ring_info_t         *ring,
+                              pka_ring_hw_rslt_desc_t *result_desc);
+
+/// Acknowledge the result descriptors read from a ring, with a single
+/// decrement of the ring result count register.
+void pka_ring_ack_rslt_descs(pka_ring_info_t *ring);
+
 /// Get the output vector(s) associated with a result descriptor from ring
 /// memory and copy it to a queue. It returns the queue head address.
 uint32_t pka_ring_get_result(pka_ring_info_t         *ring,
@@ -354,6 +419,20 @@ uint32_t pka_ring_get_result(pka_ring_info_t         *ring,
                              uint32_t                 result1_size,
                              uint32_t                 result2_size);
 
+/// Get the output vector(s) associated with a result descriptor from ring
+/// memory and copy them directly to the given result buffers.
+void pka_ring_get_result_bufs(pka_ring_info_t         *ring,
+                              pka_ring_hw_rslt_desc_t *result_desc,
+                              uint8_t                 *result1_ptr,
+                              uint8_t                 *result2_ptr,
+                              uint32_t                 result1_size,
+                              uint32_t                 result2_size);
+
+/// Drop the output vector(s) associated with a result descriptor, freeing
+/// them from ring memory.
+void pka_ring_drop_result(pka_ring_info_t         *ring,
+                          pka_ring_hw_rslt_desc_t *result_desc);
+
 /// Set the size of result operands and return the number of results associated
 /// with a given PK command.
 uint32_t pka_ring_results_len(pka_ring_hw_rslt_desc_t *result_desc,
@@ -0,0 +1,964 @@
+//
+//   BSD LICENSE
+//
+//   Copyright(c) 2016 Mellanox Technologies, Ltd. All rights reserved.
+//   All rights reserved.
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions
+//   are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in
+//       the documentation and/or other materials provided with the
+//       distribution.
+//     * Neither the name of Mellanox Technologies nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+
+#include "pka_sim.h"
+#include "pka_soft.h"
+
+// Latency model of a PK command: 'base_ns + word_ns * len^degree'.
+typedef struct
+{
+    uint32_t base_ns;   ///< fixed cost of the command.
+    uint32_t word_ns;   ///< cost per (length in words)^degree.
+    uint8_t  degree;    ///< 1 - linear, 2 - quadratic, 3 - cubic.
+    uint8_t  valid;     ///< whether the opcode is known by the device.
+} pka_sim_latency_t;
+
+// Command fetched by the simulated device and waiting for completion.
+typedef struct
+{
+    uint64_t               finish_ns;  ///< time at which the result is posted.
+    pka_ring_hw_cmd_desc_t cmd_desc;   ///< copy of the command descriptor.
+} pka_sim_cmd_t;
+
+// Simulated ring.
+typedef struct
+{
+    bool                    busy;            ///< ring is opened.
+    bool                    mapped;          ///< ring resources are mapped.
+
+    uint8_t                *mem_ptr;         ///< emulated window RAM.
+    uint8_t                *reg_ptr;         ///< emulated count registers.
+    uint64_t                mem_size;        ///< window RAM size.
+    uint64_t                reg_size;        ///< count registers region size.
+
+    pka_dev_hw_ring_info_t  hw_ring_info;    ///< ring information words.
+    uint32_t                num_descs;       ///< number of descs in the ring.
+
+    uint64_t                cmd_cnt;         ///< CMMD_CTR_INC register.
+    uint64_t                rslt_cnt;        ///< RSLT_CTR_DEC register.
+
+    uint32_t                cmd_rd_idx;      ///< next command to fetch.
+    uint32_t                rslt_wr_idx;     ///< next result to post.
+    uint32_t                inflight_cnt;    ///< fetched, not posted cmds.
+    uint64_t                engine_free_ns;  ///< time the engine gets idle.
+    pka_sim_cmd_t          *inflight;        ///< fetched commands.
+
+    int                     irq_fd;          ///< eventfd signalled when
+                                             ///  results are posted, or -1.
+} pka_sim_ring_t;
+
+static pka_sim_ring_t   pka_sim_rings[PKA_MAX_NUM_RINGS];
+static pthread_mutex_t  pka_sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t        pka_sim_thread;
+static uint32_t         pka_sim_rings_cnt;
+static volatile bool    pka_sim_running;
+
+// Default latency model. These figures only aim to give the right order of
+// magnitude of the BlueField PK engines. Note that 'len' is length_b - i.e.
+// the modulus or prime length - when the command sets it, else length_a.
+static pka_sim_latency_t pka_sim_latency_tbl[256] =
+{
+    [CC_ADD]                   = {   300,    5, 1, 1 },
+    [CC_SUBTRACT]              = {   300,    5, 1, 1 },
+    [CC_ADD_SUBTRACT]          = {   400,    5, 1, 1 },
+    [CC_MULTIPLY]              = {   300,    2, 2, 1 },
+    [CC_DIVIDE]                = {   400,    3, 2, 1 },
+    [CC_MODULO]                = {   400,    3, 2, 1 },
+    [CC_SHIFT_LEFT]            = {   300,    5, 1, 1 },
+    [CC_SHIFT_RIGHT]           = {   300,    5, 1, 1 },
+    [CC_COMPARE]               = {   200,    2, 1, 1 },
+    [CC_COPY]                  = {   200,    2, 1, 1 },
+    [CC_MODULAR_EXP]           = {  2000,    4, 3, 1 },
+    [CC_MOD_EXP_CRT]           = {  3000,    8, 3, 1 },
+    [CC_MODULAR_INVERT]        = {  1000,   20, 2, 1 },
+    [CC_ECC_PT_ADD]            = {  1000,   20, 2, 1 },
+    [CC_ECC_PT_MULTIPLY]       = {  5000,  400, 3, 1 },
+    [CC_ECDSA_GENERATE]        = {  5000,  400, 3, 1 },
+    [CC_ECDSA_VERIFY]          = {  8000,  800, 3, 1 },
+    [CC_ECDSA_VERIFY_NO_WRITE] = {  8000,  800, 3, 1 },
+    [CC_DSA_GENERATE]          = {  3000,   32, 3, 1 },
+    [CC_DSA_VERIFY]            = {  5000,   64, 3, 1 },
+    [CC_DSA_VERIFY_NO_WRITE]   = {  5000,   64, 3, 1 },
+};
+
+// Return the current time in nanoseconds.
+static __pka_inline uint64_t pka_sim_time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec * NS_PER_S) + ts.tv_nsec;
+}
+
+// Returns offset of the given count register - same as what pka_ring.c does.
+static uint32_t pka_sim_reg_offset(pka_ring_info_t *ring_info, uint64_t addr)
+{
+    size_t page;
+
+    page = (size_t)sysconf(_SC_PAGESIZE);
+
+    return (ring_info->reg_addr + addr) & (page - 1);
+}
+
+// Parse the latency model given through the environment. Ignore malformed
+// items.
+static void pka_sim_parse_latency_env(void)
+{
+    char     *env, *str, *item, *save_ptr, *end;
+    uint32_t  opcode, base_ns, word_ns;
+
+    env = getenv(PKA_SIM_LATENCY_ENV);
+    if (!env)
+        return;
+
+    str = strdup(env);
+    if (!str)
+        return;
+
+    for (item = strtok_r(str, ",", &save_ptr); item;
+            item = strtok_r(NULL, ",", &save_ptr))
+    {
+        opcode = strtoul(item, &end, 0);
+        if (*end != ':')
+            goto bad_item;
+        base_ns = strtoul(end + 1, &end, 0);
+        word_ns = 0;
+        if (*end == ':')
+            word_ns = strtoul(end + 1, &end, 0);
+        if (*end != '\0' || pka_sim_set_latency(opcode, base_ns, word_ns))
+            goto bad_item;
+        continue;
+
+bad_item:
+        PKA_ERROR(PKA_DEV, "ignoring bad %s item '%s'\n",
+                    PKA_SIM_LATENCY_ENV, item);
+    }
+
+    free(str);
+}
+
+// Return the simulated processing time of a command.
+static uint64_t pka_sim_cmd_latency(pka_ring_hw_cmd_desc_t *cmd_desc)
+{
+    pka_sim_latency_t *latency;
+    uint64_t           len, work;
+    uint8_t            degree;
+
+    latency = &pka_sim_latency_tbl[cmd_desc->command];
+    len     = (cmd_desc->length_b) ? cmd_desc->length_b : cmd_desc->length_a;
+
+    work = 1;
+    for (degree = 0; degree < latency->degree; degree++)
+        work *= len;
+
+    return latency->base_ns + (latency->word_ns * work);
+}
+
+// Describe the operand of 'word_len' words at 'offset' in window RAM, and
+// return the offset of the operand that follows it when operands are
+// concatenated - see pka_ring_concat().
+static uint32_t pka_sim_operand(pka_sim_ring_t *ring,
+                                pka_operand_t  *operand,
+                                uint32_t        offset,
+                                uint32_t        word_len,
+                                uint32_t        odd_skip,
+                                uint32_t        even_skip)
+{
+    uint32_t skip_len;
+
+    offset             &= ring->mem_size - 1;
+    operand->buf_ptr    = ring->mem_ptr + offset;
+    operand->buf_len    = 4 * word_len;
+    operand->actual_len = 4 * word_len;
+    operand->big_endian = 0;
+
+    skip_len = ((word_len & 0x1) == 1) ? odd_skip : even_skip;
+    return PKA_ALIGN(offset + (4 * (word_len + skip_len)), 8);
+}
+
+// Read the operands of a command descriptor, as laid out by
+// pka_ring_set_cmd_desc(), in the order of the API. Returns the number of
+// operands.
+static uint32_t pka_sim_load_operands(pka_sim_ring_t         *ring,
+                                      pka_ring_hw_cmd_desc_t *cmd,
+                                      pka_operand_t           operands[])
+{
+    uint32_t lenA, lenB, ptr;
+
+    lenA = cmd->length_a;
+    lenB = cmd->length_b;
+
+    switch (cmd->command)
+    {
+    case CC_ADD:
+    case CC_SUBTRACT:
+    case CC_MULTIPLY:
+    case CC_DIVIDE:
+    case CC_MODULO:
+    case CC_MODULAR_INVERT:
+        pka_sim_operand(ring, &operands[0], cmd->pointer_a, lenA, 0, 0);
+        pka_sim_operand(ring, &operands[1], cmd->pointer_b, lenB, 0, 0);
+        return 2;
+
+    case CC_COMPARE:
+        pka_sim_operand(ring, &operands[0], cmd->pointer_a, lenA, 0, 0);
+        pka_sim_operand(ring, &operands[1], cmd->pointer_b, lenA, 0, 0);
+        return 2;
+
+    case CC_ADD_SUBTRACT:
+        pka_sim_operand(ring, &operands[0], cmd->pointer_a, lenA, 0, 0);
+        pka_sim_operand(ring, &operands[1], cmd->pointer_c, lenA, 0, 0);
+        pka_sim_operand(ring, &operands[2], cmd->pointer_b, lenA, 0, 0);
+        return 3;
+
+    case CC_SHIFT_LEFT:
+    case CC_SHIFT_RIGHT:
+        pka_sim_operand(ring, &operands[0], cmd->pointer_a, lenA, 0, 0);
+        return 1;
+
+    case CC_MODULAR_EXP:
+        pka_sim_operand(ring, &operands[0], cmd->pointer_a, lenA, 0, 0);
+        pka_sim_operand(ring, &operands[1], cmd->pointer_b, lenB, 0, 0);
+        pka_sim_operand(ring, &operands[2], cmd->pointer_c, lenB, 0, 0);
+        return 3;
+
+    case CC_MOD_EXP_CRT:
+        ptr = pka_sim_operand(ring, &operands[3], cmd->pointer_a, lenA, 1, 0);
+        pka_sim_operand(ring, &operands[4], ptr, lenA, 0, 0);
+        ptr = pka_sim_operand(ring, &operands[0], cmd->pointer_b, lenB, 1, 2);
+        pka_sim_operand(ring, &operands[1], ptr, lenB, 0, 0);
+        pka_sim_operand(ring, &operands[5], cmd->pointer_c, lenB, 0, 0);
+        pka_sim_operand(ring, &operands[2], cmd->pointer_e, 2 * lenB, 0, 0);
+        return 6;
+
+    case CC_ECC_PT_ADD:
+        ptr = pka_sim_operand(ring, &operands[0], cmd->pointer_a, lenB, 3, 2);
+        pka_sim_operand(ring, &operands[1], ptr, lenB, 0, 0);
+        ptr = pka_sim_operand(ring, &operands[4], cmd->pointer_b, lenB, 3, 2);
+        ptr = pka_sim_operand(ring, &operands[5], ptr, lenB, 3, 2);
+        pka_sim_operand(ring, &operands[6], ptr, lenB, 0, 0);
+        ptr = pka_sim_operand(ring, &operands[2], cmd->pointer_c, lenB, 3, 2);
+        pka_sim_operand(ring, &operands[3], ptr, lenB, 0, 0);
+        return 7;
+
+    case CC_ECC_PT_MULTIPLY:
+        pka_sim_operand(ring, &operands[0], cmd->pointer_a, lenA, 0, 0);
+        ptr = pka_sim_operand(ring, &operands[3], cmd->pointer_b, lenB, 3, 2);
+        ptr = pka_sim_operand(ring, &operands[4], ptr, lenB, 3, 2);
+        pka_sim_operand(ring, &operands[5], ptr, lenB, 0, 0);
+        ptr = pka_sim_operand(ring, &operands[1], cmd->pointer_c, lenB, 3, 2);
+        pka_sim_operand(ring, &operands[2], ptr, lenB, 0, 0);
+        return 6;
+
+    case CC_ECDSA_GENERATE:
+    case CC_ECDSA_VERIFY:
+    case CC_ECDSA_VERIFY_NO_WRITE:
+        // Curve p, a, b, n and base point x, y are concatenated.
+        ptr = pka_sim_operand(ring, &operands[5], cmd->pointer_b, lenB, 3, 2);
+        ptr = pka_sim_operand(ring, &operands[6], ptr, lenB, 3, 2);
+        ptr = pka_sim_operand(ring, &operands[7], ptr, lenB, 3, 2);
+        ptr = pka_sim_operand(ring, &operands[8], ptr, lenB, 3, 2);
+        ptr = pka_sim_operand(ring, &operands[0], ptr, lenB, 3, 2);
+        pka_sim_operand(ring, &operands[1], ptr, lenB, 0, 0);
+        pka_sim_operand(ring, &operands[4], cmd->pointer_c, lenB, 0, 0);
+        if (cmd->command == CC_ECDSA_GENERATE)
+        {
+            pka_sim_operand(ring, &operands[3], cmd->pointer_a, lenB, 0, 0);
+            pka_sim_operand(ring, &operands[2], cmd->pointer_e, lenB, 0, 0);
+            return 9;
+        }
+
+        ptr = pka_sim_operand(ring, &operands[2], cmd->pointer_a, lenB, 3, 2);
+        pka_sim_operand(ring, &operands[3], ptr, lenB, 0, 0);
+        ptr = pka_sim_operand(ring, &operands[9], cmd->pointer_e, lenB, 3, 2);
+        pka_sim_operand(ring, &operands[10], ptr, lenB, 0, 0);
+        return 11;
+
+    case CC_DSA_GENERATE:
+    case CC_DSA_VERIFY:
+    case CC_DSA_VERIFY_NO_WRITE:
+        // Prime p, generator g and sub-prime q are concatenated.
+        ptr = pka_sim_operand(ring, &operands[0], cmd->pointer_b, lenA, 3, 2);
+        ptr = pka_sim_operand(ring, &operands[1], ptr, lenA, 3, 2);
+        pka_sim_operand(ring, &operands[2], ptr, lenB, 0, 0);
+        pka_sim_operand(ring, &operands[3], cmd->pointer_c, lenB, 0, 0);
+        if (cmd->command == CC_DSA_GENERATE)
+        {
+            pka_sim_operand(ring, &operands[5], cmd->pointer_a, lenB, 0, 0);
+            pka_sim_operand(ring, &operands[4], cmd->pointer_e, lenB, 0, 0);
+            return 6;
+        }
+
+        pka_sim_operand(ring, &operands[4], cmd->pointer_a, lenA, 0, 0);
+        ptr = pka_sim_operand(ring, &operands[5], cmd->pointer_e, lenB, 3, 2);
+        pka_sim_operand(ring, &operands[6], ptr, lenB, 0, 0);
+        return 7;
+
+    default:
+        return 0;
+    }
+}
+
+// Write a result vector at 'offset' in window RAM, and return its length in
+// bits.
+static uint32_t pka_sim_write_result(pka_sim_ring_t *ring,
+                                     uint32_t        offset,
+                                     pka_operand_t  *result)
+{
+    uint32_t byte_idx;
+
+    offset &= ring->mem_size - 1;
+    memcpy(ring->mem_ptr + offset, result->buf_ptr, result->actual_len);
+
+    for (byte_idx = result->actual_len; byte_idx-- > 0; )
+        if (result->buf_ptr[byte_idx] != 0)
+            return (8 * byte_idx) + 32 -
+                        __builtin_clz(result->buf_ptr[byte_idx]);
+
+    return 0;
+}
+
+// Set the main result length of a result descriptor given its bit length.
+static void pka_sim_set_main_len(pka_ring_hw_rslt_desc_t *rslt_desc,
+                                 uint32_t                 bit_len)
+{
+    if (bit_len == 0)
+    {
+        rslt_desc->result_is_0 = 1;
+        return;
+    }
+
+    rslt_desc->result_is_0            = 0;
+    rslt_desc->main_result_msw_offset = (bit_len - 1) / 32;
+    rslt_desc->main_result_msb_offset = (bit_len - 1) % 32;
+}
+
+// Set the modulo (i.e. remainder) length of a result descriptor given its
+// bit length.
+static void pka_sim_set_modulo_len(pka_ring_hw_rslt_desc_t *rslt_desc,
+                                   uint32_t                 bit_len)
+{
+    if (bit_len == 0)
+    {
+        rslt_desc->modulo_is_0 = 1;
+        return;
+    }
+
+    rslt_desc->modulo_is_0       = 0;
+    rslt_desc->modulo_msw_offset = (bit_len - 1) / 32;
+}
+
+// Process a command with the software engine: read the operands from window
+// RAM, write the results where the library reads them - see
+// pka_ring_get_result() - and fill the result descriptor accordingly.
+static void pka_sim_process_cmd(pka_sim_ring_t          *ring,
+                                pka_ring_hw_rslt_desc_t *rslt_desc,
+                                pka_ring_hw_cmd_desc_t  *cmd_desc)
+{
+    pka_soft_rslt_t soft_rslt;
+    pka_operand_t   operands[MAX_OPERAND_CNT];
+    uint32_t        operand_cnt, lenB, y_offset, bit_len;
+
+    rslt_desc->result_is_0 = 1;
+    rslt_desc->modulo_is_0 = 1;
+
+    memset(operands, 0, sizeof(operands));
+    operand_cnt = pka_sim_load_operands(ring, cmd_desc, operands);
+    if (pka_soft_process_cmd(cmd_desc->command, operand_cnt,
+                             cmd_desc->odd_powers, operands, &soft_rslt))
+    {
+        rslt_desc->result_code = RC_INVALID_ARGUMENT;
+        return;
+    }
+
+    rslt_desc->result_code = soft_rslt.status;
+    rslt_desc->cmp_result  = soft_rslt.compare_result;
+    if (soft_rslt.status != RC_NO_ERROR)
+        return;
+
+    switch (cmd_desc->command)
+    {
+    case CC_ADD:
+    case CC_SUBTRACT:
+    case CC_MULTIPLY:
+    case CC_SHIFT_LEFT:
+    case CC_SHIFT_RIGHT:
+        bit_len = pka_sim_write_result(ring, cmd_desc->pointer_c,
+                                       &soft_rslt.results[0]);
+        pka_sim_set_main_len(rslt_desc, bit_len);
+        break;
+
+    case CC_DIVIDE:
+    case CC_MODULO:
+        bit_len = pka_sim_write_result(ring, cmd_desc->pointer_c,
+                                       &soft_rslt.results[0]);
+        pka_sim_set_modulo_len(rslt_desc, bit_len);
+        if (cmd_desc->command == CC_MODULO)
+            break;
+
+        bit_len = pka_sim_write_result(ring, cmd_desc->pointer_d,
+                                       &soft_rslt.results[1]);
+        pka_sim_set_main_len(rslt_desc, bit_len);
+        break;
+
+    case CC_ADD_SUBTRACT:
+    case CC_MODULAR_EXP:
+    case CC_MOD_EXP_CRT:
+    case CC_MODULAR_INVERT:
+    case CC_ECDSA_VERIFY:
+    case CC_DSA_VERIFY:
+        bit_len = pka_sim_write_result(ring, cmd_desc->pointer_d,
+                                       &soft_rslt.results[0]);
+        pka_sim_set_main_len(rslt_desc, bit_len);
+        break;
+
+    case CC_ECC_PT_ADD:
+    case CC_ECC_PT_MULTIPLY:
+    case CC_ECDSA_GENERATE:
+    case CC_DSA_GENERATE:
+        // Second result (y or s) follows the first one, with some skip words.
+        lenB     = cmd_desc->length_b;
+        y_offset = cmd_desc->pointer_d + (4 * lenB) +
+                        (4 * (((lenB & 1) == 0) ? 2 : 3));
+        bit_len  = pka_sim_write_result(ring, cmd_desc->pointer_d,
+                                        &soft_rslt.results[0]);
+        bit_len  = MAX(bit_len, pka_sim_write_result(ring, y_offset,
+                                        &soft_rslt.results[1]));
+        pka_sim_set_main_len(rslt_desc, bit_len);
+        break;
+
+    default:
+        // Comparisons and verifications without write return no vector.
+        break;
+    }
+}
+
+// Build the result descriptor associated with a completed command.
+static void pka_sim_set_rslt_desc(pka_sim_ring_t          *ring,
+                                  pka_ring_hw_rslt_desc_t *rslt_desc,
+                                  pka_ring_hw_cmd_desc_t  *cmd_desc)
+{
+    memset(rslt_desc, 0, sizeof(*rslt_desc));
+
+    rslt_desc->pointer_a      = cmd_desc->pointer_a;
+    rslt_desc->pointer_b      = cmd_desc->pointer_b;
+    rslt_desc->pointer_c      = cmd_desc->pointer_c;
+    rslt_desc->pointer_d      = cmd_desc->pointer_d;
+    rslt_desc->tag            = cmd_desc->tag;
+    rslt_desc->length_a       = cmd_desc->length_a;
+    rslt_desc->length_b       = cmd_desc->length_b;
+    rslt_desc->command        = cmd_desc->command;
+    rslt_desc->odd_powers     = cmd_desc->odd_powers;
+    rslt_desc->kdk            = cmd_desc->kdk;
+    rslt_desc->encrypted_mask = cmd_desc->encrypted_mask;
+    rslt_desc->linked         = cmd_desc->linked;
+
+    if (!pka_sim_latency_tbl[cmd_desc->command].valid)
+    {
+        rslt_desc->result_code = RC_UNKNOWN_COMMAND;
+        rslt_desc->result_is_0 = 1;
+        rslt_desc->modulo_is_0 = 1;
+        return;
+    }
+
+    pka_sim_process_cmd(ring, rslt_desc, cmd_desc);
+}
+
+// Fetch the command descriptors written by the host.
+static void pka_sim_fetch_cmds(pka_sim_ring_t *ring, uint64_t now_ns)
+{
+    pka_sim_cmd_t *cmd;
+    uint64_t       pending;
+    uint32_t       cmd_addr, slot;
+
+    pending = __atomic_load_n(&ring->cmd_cnt, __ATOMIC_ACQUIRE);
+    pending = MIN(pending, ring->num_descs) - ring->inflight_cnt;
+
+    while (pending-- > 0)
+    {
+        cmd_addr  = ring->hw_ring_info.cmmd_base & (ring->mem_size - 1);
+        cmd_addr += ring->cmd_rd_idx * CMD_DESC_SIZE;
+
+        slot = (ring->rslt_wr_idx + ring->inflight_cnt) % ring->num_descs;
+        cmd  = &ring->inflight[slot];
+        memcpy(&cmd->cmd_desc, ring->mem_ptr + cmd_addr, CMD_DESC_SIZE);
+
+        ring->engine_free_ns  = MAX(ring->engine_free_ns, now_ns);
+        ring->engine_free_ns += pka_sim_cmd_latency(&cmd->cmd_desc);
+        cmd->finish_ns        = ring->engine_free_ns;
+
+        ring->cmd_rd_idx    = (ring->cmd_rd_idx + 1) % ring->num_descs;
+        ring->inflight_cnt += 1;
+    }
+}
+
+// Post the results of the commands whose processing time elapsed.
+static void pka_sim_post_rslts(pka_sim_ring_t *ring, uint64_t now_ns)
+{
+    pka_ring_hw_rslt_desc_t  rslt_desc;
+    pka_sim_cmd_t           *cmd;
+    uint32_t                 rslt_addr, posted_cnt;
+
+    posted_cnt = 0;
+    while (ring->inflight_cnt > 0)
+    {
+        cmd = &ring->inflight[ring->rslt_wr_idx];
+        if (cmd->finish_ns > now_ns)
+            break;
+
+        pka_sim_set_rslt_desc(ring, &rslt_desc, &cmd->cmd_desc);
+
+        rslt_addr  = ring->hw_ring_info.rslt_base & (ring->mem_size - 1);
+        rslt_addr += ring->rslt_wr_idx * RESULT_DESC_SIZE;
+        memcpy(ring->mem_ptr + rslt_addr, &rslt_desc, RESULT_DESC_SIZE);
+
+        // Make the result descriptor visible before the count update.
+        __atomic_fetch_add(&ring->rslt_cnt, 1, __ATOMIC_RELEASE);
+        __atomic_fetch_sub(&ring->cmd_cnt, 1, __ATOMIC_RELAXED);
+
+        ring->rslt_wr_idx   = (ring->rslt_wr_idx + 1) % ring->num_descs;
+        ring->inflight_cnt -= 1;
+        posted_cnt         += 1;
+    }
+
+    // Raise the ring result interrupt, if routed.
+    if (posted_cnt && ring->irq_fd >= 0)
+        eventfd_write(ring->irq_fd, 1);
+}
+
+// Run the simulated device once, i.e. fetch new commands and post the ready
+// results of all rings. Called with the device lock held.
+static void pka_sim_run_device(void)
+{
+    pka_sim_ring_t *ring;
+    uint32_t        ring_id;
+    uint64_t        now_ns;
+
+    now_ns = pka_sim_time_ns();
+
+    for (ring_id = 0; ring_id < PKA_MAX_NUM_RINGS; ring_id++)
+    {
+        ring = &pka_sim_rings[ring_id];
+        if (!ring->mapped)
+            continue;
+
+        pka_sim_fetch_cmds(ring, now_ns);
+        pka_sim_post_rslts(ring, now_ns);
+    }
+}
+
+// Simulated device main loop.
+static void *pka_sim_device_main(void *arg)
+{
+    while (pka_sim_running)
+    {
+        pthread_mutex_lock(&pka_sim_lock);
+        pka_sim_run_device();
+        pthread_mutex_unlock(&pka_sim_lock);
+
+        // Give up the CPU to the application threads, in case they share it
+        // with the device thread.
+        sched_yield();
+    }
+
+    return NULL;
+}
+
+// Start the simulated device. Called with the device lock held.
+static int pka_sim_start_device(void)
+{
+    int ret;
+
+    pka_sim_parse_latency_env();
+
+    pka_sim_running = true;
+    ret = pthread_create(&pka_sim_thread, NULL, pka_sim_device_main, NULL);
+    if (ret)
+    {
+        PKA_ERROR(PKA_DEV, "failed to start simulated device\n");
+        pka_sim_running = false;
+        return -ret;
+    }
+
+    PKA_DEBUG(PKA_DEV, "simulated device started\n");
+    return 0;
+}
+
+// Stop the simulated device. Called without the device lock held since the
+// device thread takes it.
+static void pka_sim_stop_device(void)
+{
+    pka_sim_running = false;
+    pthread_join(pka_sim_thread, NULL);
+
+    PKA_DEBUG(PKA_DEV, "simulated device stopped\n");
+}
+
+int pka_sim_set_latency(uint32_t opcode, uint32_t base_ns, uint32_t word_ns)
+{
+    if (opcode >= PKA_DIM(pka_sim_latency_tbl) ||
+            !pka_sim_latency_tbl[opcode].valid)
+        return -EINVAL;
+
+    pka_sim_latency_tbl[opcode].base_ns = base_ns;
+    pka_sim_latency_tbl[opcode].word_ns = word_ns;
+
+    return 0;
+}
+
+int pka_sim_open_ring(pka_ring_info_t *ring_info)
+{
+    pka_sim_ring_t *ring;
+    int             ret = 0;
+
+    if (!ring_info || ring_info->ring_id >= PKA_MAX_NUM_RINGS)
+        return -EINVAL;
+
+    ring = &pka_sim_rings[ring_info->ring_id];
+
+    pthread_mutex_lock(&pka_sim_lock);
+    if (ring->busy)
+    {
+        pthread_mutex_unlock(&pka_sim_lock);
+        return -EBUSY;
+    }
+
+    if (pka_sim_rings_cnt == 0)
+        ret = pka_sim_start_device();
+
+    if (!ret)
+    {
+        ring->busy         = true;
+        ring->irq_fd       = -1;
+        pka_sim_rings_cnt += 1;
+    }
+    pthread_mutex_unlock(&pka_sim_lock);
+
+    // No VFIO resources behind a simulated ring.
+    ring_info->fd    = -1;
+    ring_info->group = -1;
+
+    return ret;
+}
+
+int pka_sim_close_ring(pka_ring_info_t *ring_info)
+{
+    pka_sim_ring_t *ring;
+    bool            stop_device;
+
+    if (!ring_info || ring_info->ring_id >= PKA_MAX_NUM_RINGS)
+        return -EINVAL;
+
+    ring        = &pka_sim_rings[ring_info->ring_id];
+    stop_device = false;
+
+    pthread_mutex_lock(&pka_sim_lock);
+    if (ring->busy)
+    {
+        ring->busy         = false;
+        pka_sim_rings_cnt -= 1;
+        stop_device        = (pka_sim_rings_cnt == 0);
+    }
+    pthread_mutex_unlock(&pka_sim_lock);
+
+    if (stop_device)
+        pka_sim_stop_device();
+
+    return 0;
+}
+
+// Return a ring setting given through the environment, or its default value
+// if not set or out of the [min, max] range.
+static uint32_t pka_sim_get_ring_env(const char *name, uint32_t def_val,
+                                     uint32_t min_val, uint32_t max_val)
+{
+    uint32_t  val;
+    char     *env, *end;
+
+    env = getenv(name);
+    if (!env)
+        return def_val;
+
+    val = strtoul(env, &end, 0);
+    if (*end != '\0' || val < min_val || val > max_val)
+    {
+        PKA_ERROR(PKA_DEV, "ignoring bad %s '%s' (range %u..%u)\n",
+                    name, env, min_val, max_val);
+        return def_val;
+    }
+
+    return val;
+}
+
+int pka_sim_mmap_ring(pka_ring_info_t *ring_info)
+{
+    pka_dev_hw_ring_info_t *hw_ring_info;
+    pka_sim_ring_t         *ring;
+    uint64_t                window_ram_base;
+    uint64_t                cmd_desc_ring_base;
+    uint64_t                rslt_desc_ring_base;
+    uint32_t                data_mem_size;
+    uint32_t                num_descs;
+    uint32_t                shim_ring_id;
+
+    if (!ring_info || ring_info->ring_id >= PKA_MAX_NUM_RINGS)
+        return -EINVAL;
+
+    ring = &pka_sim_rings[ring_info->ring_id];
+    if (!ring->busy)
+        return -EPERM;
+
+    // Partition the window RAM as the kernel driver does, i.e. data memory
+    // at the bottom, then command and result descriptor rings.
+    ring->reg_size  = (size_t)sysconf(_SC_PAGESIZE);
+    shim_ring_id    = ring_info->ring_id % PKA_MAX_NUM_IO_BLOCK_RINGS;
+    if (pka_sim_get_ring_env(PKA_SIM_SPLIT_ENV, PKA_SPLIT_WINDOW_RAM_MODE,
+                             SPLIT_WINDOW_RAM_MODE_DISABLED,
+                             SPLIT_WINDOW_RAM_MODE_ENABLED))
+    {
+        ring->mem_size  = PKA_RING_MEM_1_SIZE;
+        window_ram_base = PKA_RING_MEM_1_BASE +
+                            (shim_ring_id * PKA_RING_MEM_1_SPACING);
+    }
+    else
+    {
+        ring->mem_size  = PKA_RING_MEM_0_SIZE;
+        window_ram_base = PKA_RING_MEM_0_BASE +
+                            (shim_ring_id * PKA_RING_MEM_0_SPACING);
+    }
+
+    data_mem_size = pka_sim_get_ring_env(PKA_SIM_DATA_MEM_ENV,
+                                         PKA_WINDOW_RAM_DATA_MEM_SIZE,
+                                         PKA_WINDOW_RAM_DATA_MEM_MIN_SIZE,
+                                         ring->mem_size - 2 * CMD_DESC_SIZE);
+    data_mem_size &= ~(PKA_WINDOW_RAM_PARTITION_ALIGN - 1);
+    num_descs     = pka_sim_get_ring_env(PKA_SIM_RING_DESCS_ENV,
+                        MIN(PKA_RING_NUM_CMD_DESC,
+                            (ring->mem_size - data_mem_size) / 2 /
+                                CMD_DESC_SIZE),
+                        PKA_RING_NUM_CMD_DESC_MIN,
+                        (ring->mem_size - data_mem_size) / 2 / CMD_DESC_SIZE);
+
+    cmd_desc_ring_base  = window_ram_base + data_mem_size;
+    rslt_desc_ring_base = cmd_desc_ring_base + (num_descs * CMD_DESC_SIZE);
+
+    hw_ring_info = &ring->hw_ring_info;
+    memset(hw_ring_info, 0, sizeof(*hw_ring_info));
+    hw_ring_info->cmmd_base      =
+            PKA_RING_MEM_ADDR(cmd_desc_ring_base, ring->mem_size);
+    hw_ring_info->rslt_base      =
+            PKA_RING_MEM_ADDR(rslt_desc_ring_base, ring->mem_size);
+    hw_ring_info->size           = num_descs - 1;
+    hw_ring_info->host_desc_size = CMD_DESC_SIZE / BYTES_PER_WORD;
+    hw_ring_info->in_order       = PKA_RING_TYPE_IN_ORDER;
+
+    ring->inflight = calloc(num_descs, sizeof(pka_sim_cmd_t));
+    if (!ring->inflight)
+        return -ENOMEM;
+
+    ring->mem_ptr = mmap(NULL, ring->mem_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ring->reg_ptr = mmap(NULL, ring->reg_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring->mem_ptr == MAP_FAILED || ring->reg_ptr == MAP_FAILED)
+    {
+        PKA_ERROR(PKA_DEV, "ring %d failed to map simulated resources\n",
+                    ring_info->ring_id);
+        if (ring->mem_ptr != MAP_FAILED)
+            munmap(ring->mem_ptr, ring->mem_size);
+        if (ring->reg_ptr != MAP_FAILED)
+            munmap(ring->reg_ptr, ring->reg_size);
+        free(ring->inflight);
+        return -ENOMEM;
+    }
+
+    ring_info->mem_size = ring->mem_size;
+    ring_info->mem_off  = 0;
+    ring_info->mem_ptr  = ring->mem_ptr;
+    ring_info->reg_size = ring->reg_size;
+    ring_info->reg_off  = 0;
+    ring_info->reg_ptr  = ring->reg_ptr;
+
+    pthread_mutex_lock(&pka_sim_lock);
+    ring->num_descs      = num_descs;
+    ring->cmd_cnt        = 0;
+    ring->rslt_cnt       = 0;
+    ring->cmd_rd_idx     = 0;
+    ring->rslt_wr_idx    = 0;
+    ring->inflight_cnt   = 0;
+    ring->engine_free_ns = 0;
+    ring->mapped         = true;
+    pthread_mutex_unlock(&pka_sim_lock);
+
+    PKA_DEBUG(PKA_DEV, "ring %d - simulated resources mapped\n",
+                ring_info->ring_id);
+
+    return 0;
+}
+
+int pka_sim_munmap_ring(pka_ring_info_t *ring_info)
+{
+    pka_sim_ring_t *ring;
+
+    if (!ring_info || ring_info->ring_id >= PKA_MAX_NUM_RINGS)
+        return -EINVAL;
+
+    ring = &pka_sim_rings[ring_info->ring_id];
+
+    pthread_mutex_lock(&pka_sim_lock);
+    if (!ring->mapped)
+    {
+        pthread_mutex_unlock(&pka_sim_lock);
+        return 0;
+    }
+    ring->mapped = false;
+    pthread_mutex_unlock(&pka_sim_lock);
+
+    munmap(ring->mem_ptr, ring->mem_size);
+    munmap(ring->reg_ptr, ring->reg_size);
+    free(ring->inflight);
+
+    ring->mem_ptr  = NULL;
+    ring->reg_ptr  = NULL;
+    ring->inflight = NULL;
+
+    return 0;
+}
+
+int pka_sim_set_ring_irq(pka_ring_info_t *ring_info, int irq_fd)
+{
+    pka_sim_ring_t *ring;
+
+    if (!ring_info || ring_info->ring_id >= PKA_MAX_NUM_RINGS)
+        return -EINVAL;
+
+    ring = &pka_sim_rings[ring_info->ring_id];
+
+    pthread_mutex_lock(&pka_sim_lock);
+    if (!ring->busy)
+    {
+        pthread_mutex_unlock(&pka_sim_lock);
+        return -EPERM;
+    }
+    ring->irq_fd = irq_fd;
+    pthread_mutex_unlock(&pka_sim_lock);
+
+    return 0;
+}
+
+int pka_sim_get_ring_info(pka_ring_info_t        *ring_info,
+                          pka_dev_hw_ring_info_t *hw_ring_info)
+{
+    pka_sim_ring_t *ring;
+
+    if (!ring_info || ring_info->ring_id >= PKA_MAX_NUM_RINGS)
+        return -EINVAL;
+
+    ring = &pka_sim_rings[ring_info->ring_id];
+    if (!ring->mapped)
+        return -EPERM;
+
+    *hw_ring_info = ring->hw_ring_info;
+
+    return 0;
+}
+
+uint64_t pka_sim_reg_read(pka_ring_info_t *ring_info, uint32_t reg_offset)
+{
+    pka_sim_ring_t *ring;
+
+    ring = &pka_sim_rings[ring_info->ring_id];
+
+    if (reg_offset == pka_sim_reg_offset(ring_info, COMMAND_COUNT_0_ADDR))
+        return __atomic_load_n(&ring->cmd_cnt, __ATOMIC_ACQUIRE);
+
+    if (reg_offset == pka_sim_reg_offset(ring_info, RESULT_COUNT_0_ADDR))
+    {
+        // Let the polling thread run the device when it is idle. This keeps
+        // results flowing when the device thread does not get a CPU of its
+        // own, e.g. on hosts with few cores.
+        if (!pthread_mutex_trylock(&pka_sim_lock))
+        {
+            pka_sim_run_device();
+            pthread_mutex_unlock(&pka_sim_lock);
+        }
+
+        return __atomic_load_n(&ring->rslt_cnt, __ATOMIC_ACQUIRE);
+    }
+
+    return pka_mmio_read(ring->reg_ptr + reg_offset);
+}
+
+void pka_sim_reg_write(pka_ring_info_t *ring_info,
+                       uint32_t         reg_offset,
+                       uint64_t         val)
+{
+    pka_sim_ring_t *ring;
+    uint64_t        rslt_cnt;
+
+    ring = &pka_sim_rings[ring_info->ring_id];
+
+    if (reg_offset == pka_sim_reg_offset(ring_info, COMMAND_COUNT_0_ADDR))
+    {
+        // Make the command descriptors visible before the count update.
+        __atomic_fetch_add(&ring->cmd_cnt, val, __ATOMIC_RELEASE);
+        return;
+    }
+
+    if (reg_offset == pka_sim_reg_offset(ring_info, RESULT_COUNT_0_ADDR))
+    {
+        // The hardware does not let the count go below zero.
+        rslt_cnt = __atomic_load_n(&ring->rslt_cnt, __ATOMIC_RELAXED);
+        do
+        {
+            if (val > rslt_cnt)
+                val = rslt_cnt;
+        } while (!__atomic_compare_exchange_n(&ring->rslt_cnt, &rslt_cnt,
+                                              rslt_cnt - val, true,
+                                              __ATOMIC_RELAXED,
+                                              __ATOMIC_RELAXED));
+        return;
+    }
+
+    pka_mmio_write(ring->reg_ptr + reg_offset, val);
+}
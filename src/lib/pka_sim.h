@@ -0,0 +1,138 @@
+//
+//   BSD LICENSE
+//
+//   Copyright(c) 2016 Mellanox Technologies, Ltd. All rights reserved.
+//   All rights reserved.
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions
+//   are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in
+//       the documentation and/or other materials provided with the
+//       distribution.
+//     * Neither the name of Mellanox Technologies nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef __PKA_SIM_H__
+#define __PKA_SIM_H__
+
+///
+/// @file
+///
+/// Software emulation of the EIP-154 ring interface. When the library is
+/// built with PKA_LIB_SIM (configure --enable-sim), the ring device calls
+/// (open, mmap, get ring info, close and unmap) are served by an in-process
+/// simulated device instead of VFIO. This allows to run and profile the
+/// library - and tests - on hosts without BlueField hardware.
+///
+/// The simulated device emulates, per ring:
+///      - the 16KB window RAM (data memory, command and result rings),
+///      - the COMMAND_COUNT register: writes increment the count of pending
+///        commands, reads return the commands not yet completed,
+///      - the RESULT_COUNT register: writes decrement the count of ready
+///        results, reads return the results not yet acknowledged.
+///      - the ring result interrupt, delivered through an eventfd as VFIO
+///        does - see pka_sim_set_ring_irq().
+///
+/// A single device thread - started with the first ring and stopped with the
+/// last one - fetches command descriptors, charges each of them a latency
+/// derived from a per-opcode model and writes the result descriptors back,
+/// strictly in order, once that latency elapsed. Each ring is handled as one
+/// engine, i.e. commands of a given ring do not overlap in time. Threads that
+/// poll the RESULT_COUNT register also run the device when it is idle, so
+/// that results keep flowing on hosts with few cores.
+///
+/// The latency of a command is 'base_ns + word_ns * len^degree' where 'len'
+/// is the operand length in 32-bit words (length_b, or length_a when the
+/// opcode has no 'B' operand). Defaults can be changed at run time through
+/// pka_sim_set_latency(), or using the PKA_SIM_LATENCY environment variable,
+/// read when the device is started, as a list of 'opcode:base_ns:word_ns'
+/// items separated by commas, e.g. PKA_SIM_LATENCY="0x10:2000:4,0x1:100:0".
+///
+/// Rings hold PKA_RING_NUM_CMD_DESC descriptors and PKA_WINDOW_RAM_DATA_MEM_SIZE
+/// bytes of data memory, as set by default by the kernel driver. The
+/// PKA_SIM_RING_DESCS and PKA_SIM_DATA_MEM environment variables, read when a
+/// ring is mapped, change the ring depth and the window RAM partition, e.g.
+/// PKA_SIM_DATA_MEM=0x2000 PKA_SIM_RING_DESCS=64 for small operands. The
+/// descriptor rings get the window RAM left by the data memory. Likewise,
+/// PKA_SIM_SPLIT_WINDOW_RAM=0|1 overrides PKA_SPLIT_WINDOW_RAM_MODE, i.e.
+/// whether rings get their own window RAM region.
+///
+/// PK operations are computed by the software engine (see pka_soft.h): the
+/// device reads the operands from window RAM, writes the result vectors back
+/// at the result pointers and fills the result code, comparison result and
+/// result lengths of the result descriptor as the engine would. Note that
+/// the latency model only drives the timing; actual compute time adds up.
+///
+/// @note The device lives in the calling process; rings are not shared with
+/// other processes.
+///
+
+#ifdef PKA_LIB_SIM
+
+#include <stdint.h>
+
+#include "pka_ring.h"
+#include "pka_utils.h"
+
+#define PKA_SIM_LATENCY_ENV     "PKA_SIM_LATENCY"
+#define PKA_SIM_RING_DESCS_ENV  "PKA_SIM_RING_DESCS"
+#define PKA_SIM_DATA_MEM_ENV    "PKA_SIM_DATA_MEM"
+#define PKA_SIM_SPLIT_ENV       "PKA_SIM_SPLIT_WINDOW_RAM"
+
+/// Open a simulated ring. Returns 0 on success, -EBUSY if the ring is already
+/// in use and a negative error otherwise.
+int pka_sim_open_ring(pka_ring_info_t *ring_info);
+
+/// Close a simulated ring.
+int pka_sim_close_ring(pka_ring_info_t *ring_info);
+
+/// Map the simulated ring resources, i.e. count registers and window RAM.
+int pka_sim_mmap_ring(pka_ring_info_t *ring_info);
+
+/// Unmap the simulated ring resources.
+int pka_sim_munmap_ring(pka_ring_info_t *ring_info);
+
+/// Return the ring information words of a simulated ring - equivalent to the
+/// PKA_VFIO_GET_RING_INFO ioctl.
+int pka_sim_get_ring_info(pka_ring_info_t        *ring_info,
+                          pka_dev_hw_ring_info_t *hw_ring_info);
+
+/// Route the result interrupt of a simulated ring to an eventfd, or detach
+/// it if 'irq_fd' is negative. The device signals the eventfd whenever it
+/// posts results on the ring.
+int pka_sim_set_ring_irq(pka_ring_info_t *ring_info, int irq_fd);
+
+/// Read a simulated ring count register given its offset.
+uint64_t pka_sim_reg_read(pka_ring_info_t *ring_info, uint32_t reg_offset);
+
+/// Write a simulated ring count register given its offset.
+void pka_sim_reg_write(pka_ring_info_t *ring_info,
+                       uint32_t         reg_offset,
+                       uint64_t         val);
+
+/// Set the latency model of a given opcode. Returns 0 on success, -EINVAL
+/// if the opcode is unknown.
+int pka_sim_set_latency(uint32_t opcode, uint32_t base_ns, uint32_t word_ns);
+
+#endif // PKA_LIB_SIM
+
+#endif // __PKA_SIM_H__
@@ -0,0 +1,1824 @@
+//
+//   BSD LICENSE
+//
+//   Copyright(c) 2016 Mellanox Technologies, Ltd. All rights reserved.
+//   All rights reserved.
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions
+//   are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in
+//       the documentation and/or other materials provided with the
+//       distribution.
+//     * Neither the name of Mellanox Technologies nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+
+#include "pka_soft.h"
+#include "pka_utils.h"
+#include "pka_vectors.h"
+
+// Number of limbs of the largest operand.
+#define PKA_BN_MAX_OPERAND_LIMBS    (PKA_SOFT_MAX_OPERAND_LEN / 8)
+
+// Number of limbs of the largest big integer - i.e. the product of two
+// operands of maximal length, plus room for intermediate carries.
+#define PKA_BN_MAX_LIMBS            ((2 * PKA_BN_MAX_OPERAND_LIMBS) + 4)
+
+// Number of limbs of the largest ECC coordinate.
+#define PKA_BN_MAX_ECC_LIMBS        (MAX_ECC_VEC_SZ / 2)
+
+// Largest sliding window used by modular exponentiations, resp. by ECC
+// point multiplications.
+#define PKA_BN_MAX_EXP_WINDOW       6
+#define PKA_BN_MAX_ECC_WINDOW       4
+
+typedef unsigned __int128 pka_bn_dlimb_t;
+
+// Big integer. Limbs are stored least significant first and the limb count
+// 'len' never includes leading zero limbs. The value zero has a zero 'len'.
+typedef struct
+{
+    uint32_t len;
+    uint64_t limb[PKA_BN_MAX_LIMBS];
+} pka_bn_t;
+
+// Montgomery context of an odd modulus 'n', with R = 2^(64 * len).
+typedef struct
+{
+    uint32_t len;                              // modulus length in limbs.
+    uint64_t n0;                               // -n^-1 mod 2^64.
+    uint64_t n[PKA_BN_MAX_OPERAND_LIMBS];      // modulus.
+    uint64_t rr[PKA_BN_MAX_OPERAND_LIMBS];     // R^2 mod n.
+    uint64_t one[PKA_BN_MAX_OPERAND_LIMBS];    // R mod n - i.e. 1 in
+                                               // Montgomery form.
+} pka_bn_mont_t;
+
+// ECC point in Jacobian coordinates (X / Z^2, Y / Z^3), coordinates being
+// in Montgomery form. The point at infinity has a zero Z coordinate.
+typedef struct
+{
+    uint64_t x[PKA_BN_MAX_ECC_LIMBS];
+    uint64_t y[PKA_BN_MAX_ECC_LIMBS];
+    uint64_t z[PKA_BN_MAX_ECC_LIMBS];
+} pka_bn_ecc_pt_t;
+
+// ECC curve y^2 = x^3 + ax + b over the prime field p. 'b' is not needed by
+// the point arithmetic.
+typedef struct
+{
+    pka_bn_mont_t mont;                        // field modulus p.
+    uint64_t      a[PKA_BN_MAX_ECC_LIMBS];     // 'a' in Montgomery form.
+} pka_bn_curve_t;
+
+//
+// Limb array helpers.
+//
+
+static void pka_bn_limbs_copy(uint64_t *r, const uint64_t *a, uint32_t len)
+{
+    memcpy(r, a, len * sizeof(uint64_t));
+}
+
+static bool pka_bn_limbs_is_zero(const uint64_t *a, uint32_t len)
+{
+    uint32_t idx;
+
+    for (idx = 0; idx < len; idx++)
+        if (a[idx] != 0)
+            return false;
+
+    return true;
+}
+
+static int pka_bn_limbs_cmp(const uint64_t *a, const uint64_t *b, uint32_t len)
+{
+    uint32_t idx;
+
+    for (idx = len; idx-- > 0; )
+        if (a[idx] != b[idx])
+            return (a[idx] < b[idx]) ? -1 : 1;
+
+    return 0;
+}
+
+// Compute r = a + b over 'len' limbs and return the carry.
+static uint64_t pka_bn_limbs_add(uint64_t       *r,
+                                 const uint64_t *a,
+                                 const uint64_t *b,
+                                 uint32_t        len)
+{
+    pka_bn_dlimb_t sum;
+    uint64_t       carry;
+    uint32_t       idx;
+
+    carry = 0;
+    for (idx = 0; idx < len; idx++)
+    {
+        sum     = (pka_bn_dlimb_t) a[idx] + b[idx] + carry;
+        r[idx]  = (uint64_t) sum;
+        carry   = (uint64_t) (sum >> 64);
+    }
+
+    return carry;
+}
+
+// Compute r = a - b over 'len' limbs and return the borrow.
+static uint64_t pka_bn_limbs_sub(uint64_t       *r,
+                                 const uint64_t *a,
+                                 const uint64_t *b,
+                                 uint32_t        len)
+{
+    uint64_t borrow, diff, ai, bi;
+    uint32_t idx;
+
+    borrow = 0;
+    for (idx = 0; idx < len; idx++)
+    {
+        ai      = a[idx];
+        bi      = b[idx];
+        diff    = ai - bi;
+        r[idx]  = diff - borrow;
+        borrow  = (ai < bi) || (diff < borrow);
+    }
+
+    return borrow;
+}
+
+//
+// Big integer helpers.
+//
+
+static void pka_bn_norm(pka_bn_t *a)
+{
+    while ((a->len > 0) && (a->limb[a->len - 1] == 0))
+        a->len--;
+}
+
+static void pka_bn_set_u64(pka_bn_t *a, uint64_t val)
+{
+    a->limb[0] = val;
+    a->len     = (val != 0) ? 1 : 0;
+}
+
+static void pka_bn_copy(pka_bn_t *r, const pka_bn_t *a)
+{
+    if (r != a)
+    {
+        r->len = a->len;
+        pka_bn_limbs_copy(r->limb, a->limb, a->len);
+    }
+}
+
+static bool pka_bn_is_zero(const pka_bn_t *a)
+{
+    return a->len == 0;
+}
+
+static bool pka_bn_is_one(const pka_bn_t *a)
+{
+    return (a->len == 1) && (a->limb[0] == 1);
+}
+
+static bool pka_bn_is_odd(const pka_bn_t *a)
+{
+    return (a->len != 0) && (a->limb[0] & 1);
+}
+
+static uint32_t pka_bn_bit_len(const pka_bn_t *a)
+{
+    if (a->len == 0)
+        return 0;
+
+    return (a->len * 64) - __builtin_clzll(a->limb[a->len - 1]);
+}
+
+static uint32_t pka_bn_bit(const pka_bn_t *a, uint32_t bit)
+{
+    if ((bit / 64) >= a->len)
+        return 0;
+
+    return (a->limb[bit / 64] >> (bit % 64)) & 1;
+}
+
+static int pka_bn_cmp(const pka_bn_t *a, const pka_bn_t *b)
+{
+    if (a->len != b->len)
+        return (a->len < b->len) ? -1 : 1;
+
+    return pka_bn_limbs_cmp(a->limb, b->limb, a->len);
+}
+
+// Copy the 'len' limbs of 'a' (which must not be longer) into 'r'.
+static void pka_bn_to_limbs(uint64_t *r, const pka_bn_t *a, uint32_t len)
+{
+    pka_bn_limbs_copy(r, a->limb, a->len);
+    memset(&r[a->len], 0, (len - a->len) * sizeof(uint64_t));
+}
+
+static void pka_bn_from_limbs(pka_bn_t *r, const uint64_t *a, uint32_t len)
+{
+    pka_bn_limbs_copy(r->limb, a, len);
+    r->len = len;
+    pka_bn_norm(r);
+}
+
+// Load an operand, honoring its byte order. Leading zeros are allowed.
+static void pka_bn_from_operand(pka_bn_t *a, const pka_operand_t *operand)
+{
+    uint32_t byte_len, idx;
+    uint8_t  byte;
+
+    byte_len = operand->actual_len;
+    a->len   = (byte_len + 7) / 8;
+    memset(a->limb, 0, a->len * sizeof(uint64_t));
+
+    for (idx = 0; idx < byte_len; idx++)
+    {
+        if (operand->big_endian)
+            byte = operand->buf_ptr[byte_len - 1 - idx];
+        else
+            byte = operand->buf_ptr[idx];
+
+        a->limb[idx / 8] |= (uint64_t) byte << (8 * (idx % 8));
+    }
+
+    pka_bn_norm(a);
+}
+
+static void pka_bn_add(pka_bn_t *r, const pka_bn_t *a, const pka_bn_t *b)
+{
+    const pka_bn_t *tmp;
+    pka_bn_dlimb_t  sum;
+    uint64_t        carry;
+    uint32_t        idx, len;
+
+    if (a->len < b->len)
+    {
+        tmp = a;
+        a   = b;
+        b   = tmp;
+    }
+
+    len   = a->len;
+    carry = pka_bn_limbs_add(r->limb, a->limb, b->limb, b->len);
+    for (idx = b->len; idx < len; idx++)
+    {
+        sum          = (pka_bn_dlimb_t) a->limb[idx] + carry;
+        r->limb[idx] = (uint64_t) sum;
+        carry        = (uint64_t) (sum >> 64);
+    }
+
+    r->limb[len] = carry;
+    r->len       = len + 1;
+    pka_bn_norm(r);
+}
+
+// Compute r = a - b, 'a' being greater than or equal to 'b'.
+static void pka_bn_sub(pka_bn_t *r, const pka_bn_t *a, const pka_bn_t *b)
+{
+    uint64_t borrow, ai;
+    uint32_t idx;
+
+    borrow = pka_bn_limbs_sub(r->limb, a->limb, b->limb, b->len);
+    for (idx = b->len; idx < a->len; idx++)
+    {
+        ai           = a->limb[idx];
+        r->limb[idx] = ai - borrow;
+        borrow       = ai < borrow;
+    }
+
+    r->len = a->len;
+    pka_bn_norm(r);
+}
+
+static void pka_bn_mul(pka_bn_t *r, const pka_bn_t *a, const pka_bn_t *b)
+{
+    pka_bn_dlimb_t prod;
+    uint64_t       tmp[PKA_BN_MAX_LIMBS], carry;
+    uint32_t       len, i, j;
+
+    if (pka_bn_is_zero(a) || pka_bn_is_zero(b))
+    {
+        r->len = 0;
+        return;
+    }
+
+    len = a->len + b->len;
+    memset(tmp, 0, len * sizeof(uint64_t));
+    for (i = 0; i < a->len; i++)
+    {
+        carry = 0;
+        for (j = 0; j < b->len; j++)
+        {
+            prod       = ((pka_bn_dlimb_t) a->limb[i] * b->limb[j]) +
+                            tmp[i + j] + carry;
+            tmp[i + j] = (uint64_t) prod;
+            carry      = (uint64_t) (prod >> 64);
+        }
+
+        tmp[i + b->len] = carry;
+    }
+
+    pka_bn_from_limbs(r, tmp, len);
+}
+
+static void pka_bn_shl(pka_bn_t *r, const pka_bn_t *a, uint32_t bits)
+{
+    uint32_t limbs, shift, idx, len;
+    uint64_t top;
+
+    if (pka_bn_is_zero(a))
+    {
+        r->len = 0;
+        return;
+    }
+
+    limbs = bits / 64;
+    shift = bits % 64;
+    len   = a->len;
+    top   = (shift != 0) ? a->limb[len - 1] >> (64 - shift) : 0;
+
+    // Process the limbs from the top, so that 'r' may be 'a'.
+    r->limb[len + limbs] = top;
+    for (idx = len - 1; idx > 0; idx--)
+    {
+        r->limb[idx + limbs] = a->limb[idx] << shift;
+        if (shift != 0)
+            r->limb[idx + limbs] |= a->limb[idx - 1] >> (64 - shift);
+    }
+
+    r->limb[limbs] = a->limb[0] << shift;
+    memset(r->limb, 0, limbs * sizeof(uint64_t));
+    r->len = len + limbs + 1;
+    pka_bn_norm(r);
+}
+
+static void pka_bn_shr(pka_bn_t *r, const pka_bn_t *a, uint32_t bits)
+{
+    uint32_t limbs, shift, idx, len;
+    uint64_t val;
+
+    limbs = bits / 64;
+    shift = bits % 64;
+    if (limbs >= a->len)
+    {
+        r->len = 0;
+        return;
+    }
+
+    len = a->len - limbs;
+    for (idx = 0; idx < len; idx++)
+    {
+        val = a->limb[idx + limbs] >> shift;
+        if ((shift != 0) && ((idx + limbs + 1) < a->len))
+            val |= a->limb[idx + limbs + 1] << (64 - shift);
+
+        r->limb[idx] = val;
+    }
+
+    r->len = len;
+    pka_bn_norm(r);
+}
+
+// Compute the quotient 'q' and the remainder 'r' of a / b (Knuth, TAOCP vol.
+// 2, algorithm D). Either 'q' or 'r' may be NULL. Returns -EINVAL when 'b'
+// is zero.
+static int pka_bn_divmod(pka_bn_t       *q,
+                         pka_bn_t       *r,
+                         const pka_bn_t *a,
+                         const pka_bn_t *b)
+{
+    pka_bn_dlimb_t num, qhat, rhat, prod, sum;
+    uint64_t       u[PKA_BN_MAX_LIMBS + 1], v[PKA_BN_MAX_LIMBS];
+    uint64_t       qd[PKA_BN_MAX_LIMBS], rem, borrow, carry, uj;
+    uint32_t       n, m, shift, idx, j;
+
+    n = b->len;
+    if (n == 0)
+        return -EINVAL;
+
+    if (pka_bn_cmp(a, b) < 0)
+    {
+        if (r != NULL)
+            pka_bn_copy(r, a);
+        if (q != NULL)
+            q->len = 0;
+        return 0;
+    }
+
+    if (n == 1)
+    {
+        rem = 0;
+        for (idx = a->len; idx-- > 0; )
+        {
+            num     = ((pka_bn_dlimb_t) rem << 64) | a->limb[idx];
+            qd[idx] = (uint64_t) (num / b->limb[0]);
+            rem     = (uint64_t) (num % b->limb[0]);
+        }
+
+        if (q != NULL)
+            pka_bn_from_limbs(q, qd, a->len);
+        if (r != NULL)
+            pka_bn_set_u64(r, rem);
+        return 0;
+    }
+
+    // Normalize the divisor so that its most significant bit is set.
+    m     = a->len - n;
+    shift = __builtin_clzll(b->limb[n - 1]);
+    for (idx = n - 1; idx > 0; idx--)
+    {
+        v[idx] = b->limb[idx] << shift;
+        if (shift != 0)
+            v[idx] |= b->limb[idx - 1] >> (64 - shift);
+    }
+
+    v[0]      = b->limb[0] << shift;
+    u[a->len] = (shift != 0) ? a->limb[a->len - 1] >> (64 - shift) : 0;
+    for (idx = a->len - 1; idx > 0; idx--)
+    {
+        u[idx] = a->limb[idx] << shift;
+        if (shift != 0)
+            u[idx] |= a->limb[idx - 1] >> (64 - shift);
+    }
+
+    u[0] = a->limb[0] << shift;
+
+    for (j = m + 1; j-- > 0; )
+    {
+        // Estimate the quotient limb from the top two limbs.
+        num  = ((pka_bn_dlimb_t) u[j + n] << 64) | u[j + n - 1];
+        qhat = num / v[n - 1];
+        rhat = num % v[n - 1];
+        while (((qhat >> 64) != 0) ||
+               (((pka_bn_dlimb_t) (uint64_t) qhat * v[n - 2]) >
+                    ((rhat << 64) | u[j + n - 2])))
+        {
+            qhat--;
+            rhat += v[n - 1];
+            if ((rhat >> 64) != 0)
+                break;
+        }
+
+        // Multiply and subtract.
+        borrow = 0;
+        carry  = 0;
+        for (idx = 0; idx < n; idx++)
+        {
+            prod       = ((pka_bn_dlimb_t) (uint64_t) qhat * v[idx]) + carry;
+            carry      = (uint64_t) (prod >> 64);
+            uj         = u[idx + j];
+            u[idx + j] = uj - (uint64_t) prod - borrow;
+            borrow     = (uj < (uint64_t) prod) ||
+                            ((uj - (uint64_t) prod) < borrow);
+        }
+
+        uj         = u[j + n];
+        u[j + n]   = uj - carry - borrow;
+        qd[j]      = (uint64_t) qhat;
+
+        // The estimate was one too large - add back.
+        if ((pka_bn_dlimb_t) uj < ((pka_bn_dlimb_t) carry + borrow))
+        {
+            qd[j]--;
+            carry = 0;
+            for (idx = 0; idx < n; idx++)
+            {
+                sum        = (pka_bn_dlimb_t) u[idx + j] + v[idx] + carry;
+                u[idx + j] = (uint64_t) sum;
+                carry      = (uint64_t) (sum >> 64);
+            }
+
+            u[j + n] += carry;
+        }
+    }
+
+    if (q != NULL)
+        pka_bn_from_limbs(q, qd, m + 1);
+
+    if (r != NULL)
+    {
+        for (idx = 0; idx < n - 1; idx++)
+        {
+            r->limb[idx] = u[idx] >> shift;
+            if (shift != 0)
+                r->limb[idx] |= u[idx + 1] << (64 - shift);
+        }
+
+        r->limb[n - 1] = u[n - 1] >> shift;
+        r->len         = n;
+        pka_bn_norm(r);
+    }
+
+    return 0;
+}
+
+static int pka_bn_mod(pka_bn_t *r, const pka_bn_t *a, const pka_bn_t *n)
+{
+    return pka_bn_divmod(NULL, r, a, n);
+}
+
+// Compute r = (a * b) mod n.
+static void pka_bn_mod_mul(pka_bn_t       *r,
+                           const pka_bn_t *a,
+                           const pka_bn_t *b,
+                           const pka_bn_t *n)
+{
+    pka_bn_mul(r, a, b);
+    pka_bn_mod(r, r, n);
+}
+
+// Compute r = (a - b) mod n, 'a' and 'b' being lower than 'n'.
+static void pka_bn_mod_sub(pka_bn_t       *r,
+                           const pka_bn_t *a,
+                           const pka_bn_t *b,
+                           const pka_bn_t *n)
+{
+    pka_bn_t tmp;
+
+    if (pka_bn_cmp(a, b) >= 0)
+    {
+        pka_bn_sub(r, a, b);
+        return;
+    }
+
+    pka_bn_add(&tmp, a, n);
+    pka_bn_sub(r, &tmp, b);
+}
+
+// Compute a = a / 2 mod n, 'n' being odd.
+static void pka_bn_mod_half(pka_bn_t *a, const pka_bn_t *n)
+{
+    if (pka_bn_is_odd(a))
+        pka_bn_add(a, a, n);
+
+    pka_bn_shr(a, a, 1);
+}
+
+// Compute r = a^-1 mod n, 'n' being odd, using the binary extended Euclidean
+// algorithm. Returns -EINVAL when 'a' has no inverse.
+static int pka_bn_mod_inv(pka_bn_t *r, const pka_bn_t *a, const pka_bn_t *n)
+{
+    pka_bn_t u, v, x1, x2;
+
+    if (!pka_bn_is_odd(n))
+        return -EINVAL;
+
+    pka_bn_mod(&u, a, n);
+    pka_bn_copy(&v, n);
+    pka_bn_set_u64(&x1, 1);
+    pka_bn_set_u64(&x2, 0);
+    if (pka_bn_is_zero(&u))
+        return -EINVAL;
+
+    while (!pka_bn_is_one(&u) && !pka_bn_is_one(&v))
+    {
+        while (!pka_bn_is_odd(&u))
+        {
+            pka_bn_shr(&u, &u, 1);
+            pka_bn_mod_half(&x1, n);
+        }
+
+        while (!pka_bn_is_odd(&v))
+        {
+            pka_bn_shr(&v, &v, 1);
+            pka_bn_mod_half(&x2, n);
+        }
+
+        if (pka_bn_cmp(&u, &v) >= 0)
+        {
+            pka_bn_sub(&u, &u, &v);
+            pka_bn_mod_sub(&x1, &x1, &x2, n);
+        }
+        else
+        {
+            pka_bn_sub(&v, &v, &u);
+            pka_bn_mod_sub(&x2, &x2, &x1, n);
+        }
+
+        // gcd(a, n) is not 1.
+        if (pka_bn_is_zero(&u) || pka_bn_is_zero(&v))
+            return -EINVAL;
+    }
+
+    pka_bn_copy(r, pka_bn_is_one(&u) ? &x1 : &x2);
+    return 0;
+}
+
+//
+// Montgomery arithmetic.
+//
+
+// Initialize the Montgomery context of 'n'. Returns -EINVAL if 'n' is even
+// or too long.
+static int pka_bn_mont_init(pka_bn_mont_t *mont, const pka_bn_t *n)
+{
+    pka_bn_t tmp;
+    uint64_t inv;
+    uint32_t idx;
+
+    if (!pka_bn_is_odd(n) || (n->len > PKA_BN_MAX_OPERAND_LIMBS))
+        return -EINVAL;
+
+    mont->len = n->len;
+    pka_bn_limbs_copy(mont->n, n->limb, n->len);
+
+    // Newton iteration: each step doubles the number of correct low bits of
+    // n^-1, starting with 3 bits since n * n = 1 mod 8 for any odd n.
+    inv = n->limb[0];
+    for (idx = 0; idx < 5; idx++)
+        inv *= 2 - (n->limb[0] * inv);
+
+    mont->n0 = -inv;
+
+    // R mod n.
+    memset(tmp.limb, 0, n->len * sizeof(uint64_t));
+    tmp.limb[n->len] = 1;
+    tmp.len          = n->len + 1;
+    pka_bn_mod(&tmp, &tmp, n);
+    pka_bn_to_limbs(mont->one, &tmp, n->len);
+
+    // R^2 mod n.
+    memset(tmp.limb, 0, 2 * n->len * sizeof(uint64_t));
+    tmp.limb[2 * n->len] = 1;
+    tmp.len              = (2 * n->len) + 1;
+    pka_bn_mod(&tmp, &tmp, n);
+    pka_bn_to_limbs(mont->rr, &tmp, n->len);
+
+    return 0;
+}
+
+// Compute r = a * b * R^-1 mod n (coarsely integrated operand scanning). 'a'
+// and 'b' must be lower than 'n'; 'r' may be 'a' or 'b'.
+static void pka_bn_mont_mul(uint64_t            *r,
+                            const uint64_t      *a,
+                            const uint64_t      *b,
+                            const pka_bn_mont_t *mont)
+{
+    pka_bn_dlimb_t prod;
+    uint64_t       t[PKA_BN_MAX_OPERAND_LIMBS + 2], carry, m;
+    uint32_t       len, i, j;
+
+    len = mont->len;
+    memset(t, 0, (len + 2) * sizeof(uint64_t));
+    for (i = 0; i < len; i++)
+    {
+        carry = 0;
+        for (j = 0; j < len; j++)
+        {
+            prod  = ((pka_bn_dlimb_t) a[j] * b[i]) + t[j] + carry;
+            t[j]  = (uint64_t) prod;
+            carry = (uint64_t) (prod >> 64);
+        }
+
+        prod       = (pka_bn_dlimb_t) t[len] + carry;
+        t[len]     = (uint64_t) prod;
+        t[len + 1] = (uint64_t) (prod >> 64);
+
+        // Add m * n so that the lowest limb becomes zero, and drop it.
+        m     = t[0] * mont->n0;
+        prod  = ((pka_bn_dlimb_t) m * mont->n[0]) + t[0];
+        carry = (uint64_t) (prod >> 64);
+        for (j = 1; j < len; j++)
+        {
+            prod     = ((pka_bn_dlimb_t) m * mont->n[j]) + t[j] + carry;
+            t[j - 1] = (uint64_t) prod;
+            carry    = (uint64_t) (prod >> 64);
+        }
+
+        prod       = (pka_bn_dlimb_t) t[len] + carry;
+        t[len - 1] = (uint64_t) prod;
+        t[len]     = t[len + 1] + (uint64_t) (prod >> 64);
+    }
+
+    if ((t[len] != 0) || (pka_bn_limbs_cmp(t, mont->n, len) >= 0))
+        pka_bn_limbs_sub(t, t, mont->n, len);
+
+    pka_bn_limbs_copy(r, t, len);
+}
+
+// Convert 'a', which must be lower than the modulus, to Montgomery form.
+static void pka_bn_mont_to(uint64_t            *r,
+                           const pka_bn_t      *a,
+                           const pka_bn_mont_t *mont)
+{
+    uint64_t tmp[PKA_BN_MAX_OPERAND_LIMBS];
+
+    pka_bn_to_limbs(tmp, a, mont->len);
+    pka_bn_mont_mul(r, tmp, mont->rr, mont);
+}
+
+// Convert 'a' from Montgomery form.
+static void pka_bn_mont_from(pka_bn_t            *r,
+                             const uint64_t      *a,
+                             const pka_bn_mont_t *mont)
+{
+    uint64_t one[PKA_BN_MAX_OPERAND_LIMBS], tmp[PKA_BN_MAX_OPERAND_LIMBS];
+
+    memset(one, 0, mont->len * sizeof(uint64_t));
+    one[0] = 1;
+    pka_bn_mont_mul(tmp, a, one, mont);
+    pka_bn_from_limbs(r, tmp, mont->len);
+}
+
+// Compute r = (a + b) mod n, resp. r = (a - b) mod n, 'a' and 'b' being lower
+// than 'n'.
+static void pka_bn_mont_add(uint64_t            *r,
+                            const uint64_t      *a,
+                            const uint64_t      *b,
+                            const pka_bn_mont_t *mont)
+{
+    if (pka_bn_limbs_add(r, a, b, mont->len) ||
+        (pka_bn_limbs_cmp(r, mont->n, mont->len) >= 0))
+        pka_bn_limbs_sub(r, r, mont->n, mont->len);
+}
+
+static void pka_bn_mont_sub(uint64_t            *r,
+                            const uint64_t      *a,
+                            const uint64_t      *b,
+                            const pka_bn_mont_t *mont)
+{
+    if (pka_bn_limbs_sub(r, a, b, mont->len))
+        pka_bn_limbs_add(r, r, mont->n, mont->len);
+}
+
+// Return the sliding window size best suited to an exponent of 'bits' bits.
+static uint32_t pka_bn_window_size(uint32_t bits)
+{
+    if (bits > 671)
+        return 6;
+    else if (bits > 239)
+        return 5;
+    else if (bits > 79)
+        return 4;
+    else if (bits > 23)
+        return 3;
+    else
+        return 1;
+}
+
+// Find the next window of the exponent 'exp', whose most significant bit
+// 'bit' is set. Returns the window value (always odd) and sets 'low' to the
+// least significant bit of the window.
+static uint32_t pka_bn_window(const pka_bn_t *exp,
+                              uint32_t        bit,
+                              uint32_t        win,
+                              uint32_t       *low)
+{
+    uint32_t val, idx;
+
+    idx = ((bit + 1) >= win) ? (bit + 1) - win : 0;
+    while (!pka_bn_bit(exp, idx))
+        idx++;
+
+    val = 0;
+    for (*low = idx, idx = bit + 1; idx-- > *low; )
+        val = (val << 1) | pka_bn_bit(exp, idx);
+
+    return val;
+}
+
+// Compute r = base^exp mod n using a sliding window over the exponent bits.
+// 'base' must be lower than the modulus.
+static void pka_bn_mont_exp(pka_bn_t            *r,
+                            const pka_bn_t      *base,
+                            const pka_bn_t      *exp,
+                            const pka_bn_mont_t *mont)
+{
+    uint64_t table[1 << (PKA_BN_MAX_EXP_WINDOW - 1)][PKA_BN_MAX_OPERAND_LIMBS];
+    uint64_t acc[PKA_BN_MAX_OPERAND_LIMBS], sqr[PKA_BN_MAX_OPERAND_LIMBS];
+    uint32_t len, bits, win, bit, low, val, idx;
+    bool     started;
+
+    len  = mont->len;
+    bits = pka_bn_bit_len(exp);
+    win  = pka_bn_window_size(bits);
+
+    // Odd powers of the base: table[i] = base^(2i + 1).
+    pka_bn_mont_to(table[0], base, mont);
+    if (win > 1)
+    {
+        pka_bn_mont_mul(sqr, table[0], table[0], mont);
+        for (idx = 1; idx < (1U << (win - 1)); idx++)
+            pka_bn_mont_mul(table[idx], table[idx - 1], sqr, mont);
+    }
+
+    pka_bn_limbs_copy(acc, mont->one, len);
+    started = false;
+    bit     = bits;
+    while (bit-- > 0)
+    {
+        if (!pka_bn_bit(exp, bit))
+        {
+            if (started)
+                pka_bn_mont_mul(acc, acc, acc, mont);
+            continue;
+        }
+
+        val = pka_bn_window(exp, bit, win, &low);
+        if (started)
+        {
+            for (idx = low; idx <= bit; idx++)
+                pka_bn_mont_mul(acc, acc, acc, mont);
+            pka_bn_mont_mul(acc, acc, table[val >> 1], mont);
+        }
+        else
+        {
+            pka_bn_limbs_copy(acc, table[val >> 1], len);
+            started = true;
+        }
+
+        bit = low;
+    }
+
+    pka_bn_mont_from(r, acc, mont);
+}
+
+//
+// ECC point arithmetic.
+//
+
+static void pka_bn_ecc_set_infinity(pka_bn_ecc_pt_t      *r,
+                                    const pka_bn_curve_t *curve)
+{
+    uint32_t len;
+
+    len = curve->mont.len;
+    pka_bn_limbs_copy(r->x, curve->mont.one, len);
+    pka_bn_limbs_copy(r->y, curve->mont.one, len);
+    memset(r->z, 0, len * sizeof(uint64_t));
+}
+
+static bool pka_bn_ecc_is_infinity(const pka_bn_ecc_pt_t *p,
+                                   const pka_bn_curve_t  *curve)
+{
+    return pka_bn_limbs_is_zero(p->z, curve->mont.len);
+}
+
+// Compute r = 2p, with M = 3X^2 + aZ^4, S = 4XY^2:
+// X3 = M^2 - 2S, Y3 = M(S - X3) - 8Y^4, Z3 = 2YZ.
+static void pka_bn_ecc_double(pka_bn_ecc_pt_t       *r,
+                              const pka_bn_ecc_pt_t *p,
+                              const pka_bn_curve_t  *curve)
+{
+    const pka_bn_mont_t *mont = &curve->mont;
+    uint64_t             xx[PKA_BN_MAX_ECC_LIMBS], yy[PKA_BN_MAX_ECC_LIMBS];
+    uint64_t             m[PKA_BN_MAX_ECC_LIMBS], s[PKA_BN_MAX_ECC_LIMBS];
+    uint64_t             t[PKA_BN_MAX_ECC_LIMBS], z3[PKA_BN_MAX_ECC_LIMBS];
+
+    if (pka_bn_ecc_is_infinity(p, curve) ||
+        pka_bn_limbs_is_zero(p->y, mont->len))
+    {
+        pka_bn_ecc_set_infinity(r, curve);
+        return;
+    }
+
+    pka_bn_mont_mul(xx, p->x, p->x, mont);
+    pka_bn_mont_mul(yy, p->y, p->y, mont);
+
+    // Z3 = 2YZ
+    pka_bn_mont_mul(z3, p->y, p->z, mont);
+    pka_bn_mont_add(z3, z3, z3, mont);
+
+    // S = 4XY^2
+    pka_bn_mont_mul(s, p->x, yy, mont);
+    pka_bn_mont_add(s, s, s, mont);
+    pka_bn_mont_add(s, s, s, mont);
+
+    // M = 3X^2 + aZ^4
+    pka_bn_mont_mul(t, p->z, p->z, mont);
+    pka_bn_mont_mul(t, t, t, mont);
+    pka_bn_mont_mul(t, t, curve->a, mont);
+    pka_bn_mont_add(m, xx, xx, mont);
+    pka_bn_mont_add(m, m, xx, mont);
+    pka_bn_mont_add(m, m, t, mont);
+
+    // X3 = M^2 - 2S
+    pka_bn_mont_mul(r->x, m, m, mont);
+    pka_bn_mont_sub(r->x, r->x, s, mont);
+    pka_bn_mont_sub(r->x, r->x, s, mont);
+
+    // Y3 = M(S - X3) - 8Y^4
+    pka_bn_mont_mul(yy, yy, yy, mont);
+    pka_bn_mont_add(yy, yy, yy, mont);
+    pka_bn_mont_add(yy, yy, yy, mont);
+    pka_bn_mont_add(yy, yy, yy, mont);
+    pka_bn_mont_sub(t, s, r->x, mont);
+    pka_bn_mont_mul(t, m, t, mont);
+    pka_bn_mont_sub(r->y, t, yy, mont);
+
+    pka_bn_limbs_copy(r->z, z3, mont->len);
+}
+
+// Compute r = p + q, with U1 = X1Z2^2, U2 = X2Z1^2, S1 = Y1Z2^3, S2 = Y2Z1^3,
+// H = U2 - U1, R = S2 - S1:
+// X3 = R^2 - H^3 - 2U1H^2, Y3 = R(U1H^2 - X3) - S1H^3, Z3 = Z1Z2H.
+static void pka_bn_ecc_add(pka_bn_ecc_pt_t       *r,
+                           const pka_bn_ecc_pt_t *p,
+                           const pka_bn_ecc_pt_t *q,
+                           const pka_bn_curve_t  *curve)
+{
+    const pka_bn_mont_t *mont = &curve->mont;
+    uint64_t             u1[PKA_BN_MAX_ECC_LIMBS], u2[PKA_BN_MAX_ECC_LIMBS];
+    uint64_t             s1[PKA_BN_MAX_ECC_LIMBS], s2[PKA_BN_MAX_ECC_LIMBS];
+    uint64_t             h[PKA_BN_MAX_ECC_LIMBS], rr[PKA_BN_MAX_ECC_LIMBS];
+    uint64_t             t[PKA_BN_MAX_ECC_LIMBS], z3[PKA_BN_MAX_ECC_LIMBS];
+    uint32_t             len;
+
+    len = mont->len;
+    if (pka_bn_ecc_is_infinity(p, curve))
+    {
+        *r = *q;
+        return;
+    }
+
+    if (pka_bn_ecc_is_infinity(q, curve))
+    {
+        *r = *p;
+        return;
+    }
+
+    // U1, S1
+    pka_bn_mont_mul(t, q->z, q->z, mont);
+    pka_bn_mont_mul(u1, p->x, t, mont);
+    pka_bn_mont_mul(t, t, q->z, mont);
+    pka_bn_mont_mul(s1, p->y, t, mont);
+
+    // U2, S2
+    pka_bn_mont_mul(t, p->z, p->z, mont);
+    pka_bn_mont_mul(u2, q->x, t, mont);
+    pka_bn_mont_mul(t, t, p->z, mont);
+    pka_bn_mont_mul(s2, q->y, t, mont);
+
+    pka_bn_mont_sub(h, u2, u1, mont);
+    pka_bn_mont_sub(rr, s2, s1, mont);
+    if (pka_bn_limbs_is_zero(h, len))
+    {
+        if (pka_bn_limbs_is_zero(rr, len))
+            pka_bn_ecc_double(r, p, curve);
+        else
+            pka_bn_ecc_set_infinity(r, curve);
+        return;
+    }
+
+    // Z3 = Z1Z2H
+    pka_bn_mont_mul(z3, p->z, q->z, mont);
+    pka_bn_mont_mul(z3, z3, h, mont);
+
+    // u2 = H^2, s2 = H^3, u1 = U1H^2
+    pka_bn_mont_mul(u2, h, h, mont);
+    pka_bn_mont_mul(s2, u2, h, mont);
+    pka_bn_mont_mul(u1, u1, u2, mont);
+
+    // X3 = R^2 - H^3 - 2U1H^2
+    pka_bn_mont_mul(r->x, rr, rr, mont);
+    pka_bn_mont_sub(r->x, r->x, s2, mont);
+    pka_bn_mont_sub(r->x, r->x, u1, mont);
+    pka_bn_mont_sub(r->x, r->x, u1, mont);
+
+    // Y3 = R(U1H^2 - X3) - S1H^3
+    pka_bn_mont_sub(t, u1, r->x, mont);
+    pka_bn_mont_mul(t, rr, t, mont);
+    pka_bn_mont_mul(s1, s1, s2, mont);
+    pka_bn_mont_sub(r->y, t, s1, mont);
+
+    pka_bn_limbs_copy(r->z, z3, len);
+}
+
+// Compute r = k * p using a sliding window over the bits of 'k'.
+static void pka_bn_ecc_mult(pka_bn_ecc_pt_t       *r,
+                            const pka_bn_ecc_pt_t *p,
+                            const pka_bn_t        *k,
+                            const pka_bn_curve_t  *curve)
+{
+    pka_bn_ecc_pt_t table[1 << (PKA_BN_MAX_ECC_WINDOW - 1)], dbl, acc;
+    uint32_t        bits, win, bit, low, val, idx;
+    bool            started;
+
+    bits = pka_bn_bit_len(k);
+    win  = MIN(pka_bn_window_size(bits), PKA_BN_MAX_ECC_WINDOW);
+
+    // Odd multiples of the point: table[i] = (2i + 1) * p.
+    table[0] = *p;
+    if (win > 1)
+    {
+        pka_bn_ecc_double(&dbl, p, curve);
+        for (idx = 1; idx < (1U << (win - 1)); idx++)
+            pka_bn_ecc_add(&table[idx], &table[idx - 1], &dbl, curve);
+    }
+
+    pka_bn_ecc_set_infinity(&acc, curve);
+    started = false;
+    bit     = bits;
+    while (bit-- > 0)
+    {
+        if (!pka_bn_bit(k, bit))
+        {
+            if (started)
+                pka_bn_ecc_double(&acc, &acc, curve);
+            continue;
+        }
+
+        val = pka_bn_window(k, bit, win, &low);
+        if (started)
+        {
+            for (idx = low; idx <= bit; idx++)
+                pka_bn_ecc_double(&acc, &acc, curve);
+            pka_bn_ecc_add(&acc, &acc, &table[val >> 1], curve);
+        }
+        else
+        {
+            acc     = table[val >> 1];
+            started = true;
+        }
+
+        bit = low;
+    }
+
+    *r = acc;
+}
+
+// Initialize a curve from its field modulus 'p' and parameter 'a'. Returns
+// -EINVAL if 'p' is even or too long.
+static int pka_bn_ecc_init(pka_bn_curve_t *curve,
+                           const pka_bn_t *p,
+                           const pka_bn_t *a)
+{
+    pka_bn_t tmp;
+
+    if ((p->len > PKA_BN_MAX_ECC_LIMBS) ||
+        (pka_bn_mont_init(&curve->mont, p) != 0))
+        return -EINVAL;
+
+    pka_bn_mod(&tmp, a, p);
+    pka_bn_mont_to(curve->a, &tmp, &curve->mont);
+    return 0;
+}
+
+static void pka_bn_ecc_from_affine(pka_bn_ecc_pt_t      *r,
+                                   const pka_bn_t       *x,
+                                   const pka_bn_t       *y,
+                                   const pka_bn_curve_t *curve)
+{
+    const pka_bn_mont_t *mont = &curve->mont;
+    pka_bn_t             p, tmp;
+
+    pka_bn_from_limbs(&p, mont->n, mont->len);
+    pka_bn_mod(&tmp, x, &p);
+    pka_bn_mont_to(r->x, &tmp, mont);
+    pka_bn_mod(&tmp, y, &p);
+    pka_bn_mont_to(r->y, &tmp, mont);
+    pka_bn_limbs_copy(r->z, mont->one, mont->len);
+}
+
+// Convert a point to affine coordinates. Returns -EINVAL if the point is the
+// point at infinity.
+static int pka_bn_ecc_to_affine(pka_bn_t              *x,
+                                pka_bn_t              *y,
+                                const pka_bn_ecc_pt_t *pt,
+                                const pka_bn_curve_t  *curve)
+{
+    const pka_bn_mont_t *mont = &curve->mont;
+    pka_bn_t             p, z;
+    uint64_t             zinv[PKA_BN_MAX_ECC_LIMBS], t[PKA_BN_MAX_ECC_LIMBS];
+
+    if (pka_bn_ecc_is_infinity(pt, curve))
+        return -EINVAL;
+
+    pka_bn_from_limbs(&p, mont->n, mont->len);
+    pka_bn_mont_from(&z, pt->z, mont);
+    pka_bn_mod_inv(&z, &z, &p);
+    pka_bn_mont_to(zinv, &z, mont);
+
+    pka_bn_mont_mul(t, zinv, zinv, mont);
+    pka_bn_mont_mul(zinv, t, zinv, mont);
+    pka_bn_mont_mul(t, pt->x, t, mont);
+    pka_bn_mont_from(x, t, mont);
+    pka_bn_mont_mul(t, pt->y, zinv, mont);
+    pka_bn_mont_from(y, t, mont);
+    return 0;
+}
+
+//
+// PK commands.
+//
+
+// Number of operands of each command, zero for unknown commands.
+static uint8_t pka_soft_operand_cnt(pka_opcode_t opcode)
+{
+    switch (opcode)
+    {
+    case CC_SHIFT_LEFT:
+    case CC_SHIFT_RIGHT:
+        return 1;
+    case CC_ADD:
+    case CC_SUBTRACT:
+    case CC_MULTIPLY:
+    case CC_DIVIDE:
+    case CC_MODULO:
+    case CC_COMPARE:
+    case CC_MODULAR_INVERT:
+        return 2;
+    case CC_ADD_SUBTRACT:
+    case CC_MODULAR_EXP:
+        return 3;
+    case CC_MOD_EXP_CRT:
+    case CC_ECC_PT_MULTIPLY:
+    case CC_DSA_GENERATE:
+        return 6;
+    case CC_ECC_PT_ADD:
+    case CC_DSA_VERIFY:
+    case CC_DSA_VERIFY_NO_WRITE:
+        return 7;
+    case CC_ECDSA_GENERATE:
+        return 9;
+    case CC_ECDSA_VERIFY:
+    case CC_ECDSA_VERIFY_NO_WRITE:
+        return 11;
+    default:
+        return 0;
+    }
+}
+
+// Length, in bytes, of an operand rounded up to a whole number of words -
+// i.e. the length of the vector the HW would process.
+static uint32_t pka_soft_operand_len(const pka_operand_t *operand)
+{
+    return 4 * ((operand->actual_len + 3) / 4);
+}
+
+// Length, in bytes, the HW reports for a main result - i.e. at least one
+// byte, even for a zero result.
+static uint32_t pka_soft_main_len(const pka_bn_t *val)
+{
+    return MAX((pka_bn_bit_len(val) + 7) / 8, 1);
+}
+
+// Length, in bytes, the HW reports for a remainder - i.e. a whole number of
+// words, and no byte at all for a zero remainder.
+static uint32_t pka_soft_mod_len(const pka_bn_t *val)
+{
+    return 4 * ((pka_bn_bit_len(val) + 31) / 32);
+}
+
+// Set result 'idx' to 'val', on 'byte_len' bytes padded to a multiple of 8
+// bytes. Big endian values are right-aligned, as the HW results once
+// converted by the result queues.
+static void pka_soft_set_result(pka_soft_rslt_t *rslt,
+                                uint32_t         idx,
+                                const pka_bn_t  *val,
+                                uint32_t         byte_len,
+                                uint8_t          big_endian)
+{
+    pka_operand_t *result;
+    uint32_t       len, byte_idx;
+    uint8_t       *buf, byte;
+
+    result = &rslt->results[idx];
+    buf    = rslt->buf[idx];
+    len    = MIN(PKA_ALIGN(byte_len, 8), PKA_SOFT_RESULT_BUF_SIZE);
+    for (byte_idx = 0; byte_idx < len; byte_idx++)
+    {
+        byte = 0;
+        if ((byte_idx / 8) < val->len)
+            byte = val->limb[byte_idx / 8] >> (8 * (byte_idx % 8));
+
+        if (big_endian)
+            buf[len - 1 - byte_idx] = byte;
+        else
+            buf[byte_idx] = byte;
+    }
+
+    result->buf_ptr    = buf;
+    result->buf_len    = PKA_SOFT_RESULT_BUF_SIZE;
+    result->actual_len = len;
+    result->big_endian = big_endian;
+    rslt->result_cnt   = MAX(rslt->result_cnt, idx + 1);
+}
+
+// Compute r = 2^bits + a - b, i.e. the two's complement wrap-around of a
+// negative difference on 'bits' bits.
+static void pka_soft_wrap_sub(pka_bn_t       *r,
+                              const pka_bn_t *a,
+                              const pka_bn_t *b,
+                              uint32_t        bits)
+{
+    pka_bn_t tmp;
+
+    pka_bn_set_u64(&tmp, 1);
+    pka_bn_shl(&tmp, &tmp, bits);
+    pka_bn_add(&tmp, &tmp, a);
+    pka_bn_sub(r, &tmp, b);
+}
+
+static void pka_soft_basic(pka_opcode_t     opcode,
+                           uint32_t         shift_cnt,
+                           pka_operand_t    operands[],
+                           pka_soft_rslt_t *rslt,
+                           uint8_t          big_endian)
+{
+    pka_bn_t a, b, c, r, q;
+    uint32_t bits;
+
+    pka_bn_from_operand(&a, &operands[0]);
+    if ((opcode != CC_SHIFT_LEFT) && (opcode != CC_SHIFT_RIGHT))
+        pka_bn_from_operand(&b, &operands[1]);
+
+    switch (opcode)
+    {
+    case CC_ADD:
+        pka_bn_add(&r, &a, &b);
+        break;
+    case CC_SUBTRACT:
+        if (pka_bn_cmp(&a, &b) >= 0)
+        {
+            pka_bn_sub(&r, &a, &b);
+            break;
+        }
+
+        bits = 8 * MAX(pka_soft_operand_len(&operands[0]),
+                       pka_soft_operand_len(&operands[1]));
+        pka_soft_wrap_sub(&r, &a, &b, bits);
+        break;
+    case CC_ADD_SUBTRACT:
+        // Operands are the value, the addend and the subtrahend.
+        pka_bn_from_operand(&c, &operands[2]);
+        pka_bn_add(&a, &a, &b);
+        if (pka_bn_cmp(&a, &c) >= 0)
+        {
+            pka_bn_sub(&r, &a, &c);
+            break;
+        }
+
+        bits = 8 * (pka_soft_operand_len(&operands[0]) + 4);
+        pka_soft_wrap_sub(&r, &a, &c, bits);
+        break;
+    case CC_MULTIPLY:
+        pka_bn_mul(&r, &a, &b);
+        break;
+    case CC_DIVIDE:
+    case CC_MODULO:
+        if (pka_bn_divmod(&q, &r, &a, &b) != 0)
+        {
+            rslt->status = RC_OPERAND_VALUE_ERR;
+            return;
+        }
+
+        pka_soft_set_result(rslt, 0, &r, pka_soft_mod_len(&r), big_endian);
+        if (opcode == CC_DIVIDE)
+            pka_soft_set_result(rslt, 1, &q, pka_soft_main_len(&q),
+                                big_endian);
+        return;
+    case CC_SHIFT_LEFT:
+        pka_bn_shl(&r, &a, shift_cnt);
+        break;
+    case CC_SHIFT_RIGHT:
+        pka_bn_shr(&r, &a, shift_cnt);
+        break;
+    case CC_COMPARE:
+        switch (pka_bn_cmp(&a, &b))
+        {
+        case 0:
+            rslt->compare_result = RC_COMPARE_EQUAL;
+            break;
+        case -1:
+            rslt->compare_result = RC_LEFT_IS_SMALLER;
+            break;
+        default:
+            rslt->compare_result = RC_RIGHT_IS_SMALLER;
+            break;
+        }
+        return;
+    default:
+        rslt->status = RC_UNKNOWN_COMMAND;
+        return;
+    }
+
+    pka_soft_set_result(rslt, 0, &r, pka_soft_main_len(&r), big_endian);
+}
+
+static void pka_soft_mod_exp(pka_operand_t    operands[],
+                             pka_soft_rslt_t *rslt,
+                             uint8_t          big_endian)
+{
+    pka_bn_mont_t mont;
+    pka_bn_t      exp, mod, val, r;
+
+    // Operands are the exponent, the modulus and the value.
+    pka_bn_from_operand(&exp, &operands[0]);
+    pka_bn_from_operand(&mod, &operands[1]);
+    pka_bn_from_operand(&val, &operands[2]);
+    if (pka_bn_mont_init(&mont, &mod) != 0)
+    {
+        rslt->status = RC_EVEN_MODULUS;
+        return;
+    }
+
+    pka_bn_mod(&val, &val, &mod);
+    pka_bn_mont_exp(&r, &val, &exp, &mont);
+    pka_soft_set_result(rslt, 0, &r, pka_soft_main_len(&r), big_endian);
+}
+
+static void pka_soft_mod_exp_crt(pka_operand_t    operands[],
+                                 pka_soft_rslt_t *rslt,
+                                 uint8_t          big_endian)
+{
+    pka_bn_mont_t mont_p, mont_q;
+    pka_bn_t      p, q, c, dp, dq, qinv, m1, m2, h;
+
+    // Operands are p, q, the value, d mod (p-1), d mod (q-1) and q^-1 mod p.
+    pka_bn_from_operand(&p,    &operands[0]);
+    pka_bn_from_operand(&q,    &operands[1]);
+    pka_bn_from_operand(&c,    &operands[2]);
+    pka_bn_from_operand(&dp,   &operands[3]);
+    pka_bn_from_operand(&dq,   &operands[4]);
+    pka_bn_from_operand(&qinv, &operands[5]);
+    if ((pka_bn_mont_init(&mont_p, &p) != 0) ||
+        (pka_bn_mont_init(&mont_q, &q) != 0))
+    {
+        rslt->status = RC_EVEN_MODULUS;
+        return;
+    }
+
+    // m1 = c^dp mod p, m2 = c^dq mod q
+    pka_bn_mod(&h, &c, &p);
+    pka_bn_mont_exp(&m1, &h, &dp, &mont_p);
+    pka_bn_mod(&h, &c, &q);
+    pka_bn_mont_exp(&m2, &h, &dq, &mont_q);
+
+    // h = qinv * (m1 - m2) mod p, m = m2 + h * q
+    pka_bn_mod(&h, &m2, &p);
+    pka_bn_mod_sub(&h, &m1, &h, &p);
+    pka_bn_mod(&qinv, &qinv, &p);
+    pka_bn_mod_mul(&h, &qinv, &h, &p);
+    pka_bn_mul(&h, &h, &q);
+    pka_bn_add(&h, &h, &m2);
+    pka_soft_set_result(rslt, 0, &h, pka_soft_main_len(&h), big_endian);
+}
+
+static void pka_soft_mod_inv(pka_operand_t    operands[],
+                             pka_soft_rslt_t *rslt,
+                             uint8_t          big_endian)
+{
+    pka_bn_t val, mod, r;
+
+    pka_bn_from_operand(&val, &operands[0]);
+    pka_bn_from_operand(&mod, &operands[1]);
+    if (!pka_bn_is_odd(&mod))
+    {
+        rslt->status = RC_EVEN_MODULUS;
+        return;
+    }
+
+    if (pka_bn_mod_inv(&r, &val, &mod) != 0)
+    {
+        rslt->status = RC_NO_MODULAR_INVERSE;
+        return;
+    }
+
+    pka_soft_set_result(rslt, 0, &r, pka_soft_main_len(&r), big_endian);
+}
+
+// Load the curve whose p, a and b parameters are operands[idx .. idx + 2].
+static int pka_soft_ecc_curve(pka_bn_curve_t  *curve,
+                              pka_operand_t    operands[],
+                              uint32_t         idx,
+                              pka_soft_rslt_t *rslt)
+{
+    pka_bn_t p, a;
+
+    pka_bn_from_operand(&p, &operands[idx]);
+    pka_bn_from_operand(&a, &operands[idx + 1]);
+    if (pka_bn_ecc_init(curve, &p, &a) != 0)
+    {
+        rslt->status = pka_bn_is_odd(&p) ? RC_OPERAND_LENGTH_ERR :
+                                           RC_EVEN_MODULUS;
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+// Load the point whose x and y coordinates are operands[idx .. idx + 1].
+static void pka_soft_ecc_point(pka_bn_ecc_pt_t      *pt,
+                               pka_operand_t         operands[],
+                               uint32_t              idx,
+                               const pka_bn_curve_t *curve)
+{
+    pka_bn_t x, y;
+
+    pka_bn_from_operand(&x, &operands[idx]);
+    pka_bn_from_operand(&y, &operands[idx + 1]);
+    pka_bn_ecc_from_affine(pt, &x, &y, curve);
+}
+
+// Set the results of an ECC point command. Both coordinates are reported
+// with the same length, as the HW does.
+static void pka_soft_ecc_result(pka_soft_rslt_t       *rslt,
+                                const pka_bn_ecc_pt_t *pt,
+                                const pka_bn_curve_t  *curve,
+                                uint8_t                big_endian)
+{
+    pka_bn_t x, y;
+    uint32_t len;
+
+    if (pka_bn_ecc_to_affine(&x, &y, pt, curve) != 0)
+    {
+        rslt->status = RC_RESULT_IS_PAI;
+        return;
+    }
+
+    len = MAX(pka_soft_main_len(&x), pka_soft_main_len(&y));
+    pka_soft_set_result(rslt, 0, &x, len, big_endian);
+    pka_soft_set_result(rslt, 1, &y, len, big_endian);
+}
+
+static void pka_soft_ecc_pt_add(pka_operand_t    operands[],
+                                pka_soft_rslt_t *rslt,
+                                uint8_t          big_endian)
+{
+    pka_bn_ecc_pt_t p1, p2;
+    pka_bn_curve_t  curve;
+
+    // Operands are x1, y1, x2, y2, p, a and b.
+    if (pka_soft_ecc_curve(&curve, operands, 4, rslt) != 0)
+        return;
+
+    pka_soft_ecc_point(&p1, operands, 0, &curve);
+    pka_soft_ecc_point(&p2, operands, 2, &curve);
+    pka_bn_ecc_add(&p1, &p1, &p2, &curve);
+    pka_soft_ecc_result(rslt, &p1, &curve, big_endian);
+}
+
+static void pka_soft_ecc_pt_mult(pka_operand_t    operands[],
+                                 pka_soft_rslt_t *rslt,
+                                 uint8_t          big_endian)
+{
+    pka_bn_ecc_pt_t pt;
+    pka_bn_curve_t  curve;
+    pka_bn_t        k;
+
+    // Operands are k, x, y, p, a and b.
+    if (pka_soft_ecc_curve(&curve, operands, 3, rslt) != 0)
+        return;
+
+    pka_bn_from_operand(&k, &operands[0]);
+    pka_soft_ecc_point(&pt, operands, 1, &curve);
+    pka_bn_ecc_mult(&pt, &pt, &k, &curve);
+    pka_soft_ecc_result(rslt, &pt, &curve, big_endian);
+}
+
+// Set the comparison result of a signature verification, and the computed
+// value if the command writes it.
+static void pka_soft_verify_result(pka_opcode_t     opcode,
+                                   pka_soft_rslt_t *rslt,
+                                   const pka_bn_t  *r,
+                                   const pka_bn_t  *v,
+                                   uint32_t         byte_len,
+                                   uint8_t          big_endian)
+{
+    switch (pka_bn_cmp(r, v))
+    {
+    case 0:
+        rslt->compare_result = RC_COMPARE_EQUAL;
+        break;
+    case -1:
+        rslt->compare_result = RC_LEFT_IS_SMALLER;
+        break;
+    default:
+        rslt->compare_result = RC_RIGHT_IS_SMALLER;
+        break;
+    }
+
+    if ((opcode == CC_ECDSA_VERIFY) || (opcode == CC_DSA_VERIFY))
+        pka_soft_set_result(rslt, 0, v, byte_len, big_endian);
+}
+
+// Compute s = k^-1 * (hash + priv * r) mod n, the second half of an (EC)DSA
+// signature. Returns -EINVAL if 'k' has no inverse.
+static int pka_soft_sign(pka_bn_t       *s,
+                         const pka_bn_t *k,
+                         const pka_bn_t *priv,
+                         const pka_bn_t *hash,
+                         const pka_bn_t *r,
+                         const pka_bn_t *n)
+{
+    pka_bn_t kinv, tmp;
+
+    if (pka_bn_mod_inv(&kinv, k, n) != 0)
+        return -EINVAL;
+
+    pka_bn_mod_mul(&tmp, priv, r, n);
+    pka_bn_add(&tmp, &tmp, hash);
+    pka_bn_mod(&tmp, &tmp, n);
+    pka_bn_mod_mul(s, &kinv, &tmp, n);
+    return 0;
+}
+
+// Compute u1 = hash * s^-1 mod n and u2 = r * s^-1 mod n, the multipliers
+// of an (EC)DSA verification. Returns -EINVAL if the signature is out of
+// range.
+static int pka_soft_verify_init(pka_bn_t       *u1,
+                                pka_bn_t       *u2,
+                                const pka_bn_t *hash,
+                                const pka_bn_t *r,
+                                const pka_bn_t *s,
+                                const pka_bn_t *n)
+{
+    pka_bn_t w;
+
+    if (pka_bn_is_zero(r) || pka_bn_is_zero(s) ||
+        (pka_bn_cmp(r, n) >= 0) || (pka_bn_cmp(s, n) >= 0) ||
+        (pka_bn_mod_inv(&w, s, n) != 0))
+        return -EINVAL;
+
+    pka_bn_mod_mul(u1, hash, &w, n);
+    pka_bn_mod_mul(u2, r, &w, n);
+    return 0;
+}
+
+static void pka_soft_ecdsa_gen(pka_operand_t    operands[],
+                               pka_soft_rslt_t *rslt,
+                               uint8_t          big_endian)
+{
+    pka_bn_ecc_pt_t pt;
+    pka_bn_curve_t  curve;
+    pka_bn_t        k, priv, hash, n, r, s, y;
+    uint32_t        len;
+
+    // Operands are Gx, Gy, k, the private key, the hash, p, a, b and n.
+    if (pka_soft_ecc_curve(&curve, operands, 5, rslt) != 0)
+        return;
+
+    pka_bn_from_operand(&k,    &operands[2]);
+    pka_bn_from_operand(&priv, &operands[3]);
+    pka_bn_from_operand(&hash, &operands[4]);
+    pka_bn_from_operand(&n,    &operands[8]);
+    if (!pka_bn_is_odd(&n))
+    {
+        rslt->status = RC_EVEN_MODULUS;
+        return;
+    }
+
+    // r = (kG).x mod n
+    pka_soft_ecc_point(&pt, operands, 0, &curve);
+    pka_bn_ecc_mult(&pt, &pt, &k, &curve);
+    if (pka_bn_ecc_to_affine(&r, &y, &pt, &curve) != 0)
+    {
+        rslt->status = RC_RESULT_IS_PAI;
+        return;
+    }
+
+    pka_bn_mod(&r, &r, &n);
+    if (pka_bn_is_zero(&r))
+    {
+        rslt->status = RC_OPERAND_VALUE_ERR;
+        return;
+    }
+
+    if (pka_soft_sign(&s, &k, &priv, &hash, &r, &n) != 0)
+    {
+        rslt->status = RC_NO_MODULAR_INVERSE;
+        return;
+    }
+
+    if (pka_bn_is_zero(&s))
+    {
+        rslt->status = RC_OPERAND_VALUE_ERR;
+        return;
+    }
+
+    len = pka_soft_operand_len(&operands[5]);
+    pka_soft_set_result(rslt, 0, &r, len, big_endian);
+    pka_soft_set_result(rslt, 1, &s, len, big_endian);
+}
+
+static void pka_soft_ecdsa_verify(pka_opcode_t     opcode,
+                                  pka_operand_t    operands[],
+                                  pka_soft_rslt_t *rslt,
+                                  uint8_t          big_endian)
+{
+    pka_bn_ecc_pt_t g, q;
+    pka_bn_curve_t  curve;
+    pka_bn_t        hash, n, r, s, u1, u2, v, y;
+
+    // Operands are Gx, Gy, Qx, Qy, the hash, p, a, b, n, r and s.
+    if (pka_soft_ecc_curve(&curve, operands, 5, rslt) != 0)
+        return;
+
+    pka_bn_from_operand(&hash, &operands[4]);
+    pka_bn_from_operand(&n,    &operands[8]);
+    pka_bn_from_operand(&r,    &operands[9]);
+    pka_bn_from_operand(&s,    &operands[10]);
+    if (!pka_bn_is_odd(&n))
+    {
+        rslt->status = RC_EVEN_MODULUS;
+        return;
+    }
+
+    // v = (u1G + u2Q).x mod n, or zero if the signature is not valid.
+    pka_bn_set_u64(&v, 0);
+    if (pka_soft_verify_init(&u1, &u2, &hash, &r, &s, &n) == 0)
+    {
+        pka_soft_ecc_point(&g, operands, 0, &curve);
+        pka_soft_ecc_point(&q, operands, 2, &curve);
+        pka_bn_ecc_mult(&g, &g, &u1, &curve);
+        pka_bn_ecc_mult(&q, &q, &u2, &curve);
+        pka_bn_ecc_add(&g, &g, &q, &curve);
+        if (pka_bn_ecc_to_affine(&v, &y, &g, &curve) == 0)
+            pka_bn_mod(&v, &v, &n);
+    }
+
+    pka_soft_verify_result(opcode, rslt, &r, &v,
+                           pka_soft_operand_len(&operands[5]), big_endian);
+}
+
+static void pka_soft_dsa_gen(pka_operand_t    operands[],
+                             pka_soft_rslt_t *rslt,
+                             uint8_t          big_endian)
+{
+    pka_bn_mont_t mont;
+    pka_bn_t      p, g, q, hash, k, priv, r, s;
+    uint32_t      len;
+
+    // Operands are p, g, q, the hash, k and the private key.
+    pka_bn_from_operand(&p,    &operands[0]);
+    pka_bn_from_operand(&g,    &operands[1]);
+    pka_bn_from_operand(&q,    &operands[2]);
+    pka_bn_from_operand(&hash, &operands[3]);
+    pka_bn_from_operand(&k,    &operands[4]);
+    pka_bn_from_operand(&priv, &operands[5]);
+    if ((pka_bn_mont_init(&mont, &p) != 0) || !pka_bn_is_odd(&q))
+    {
+        rslt->status = RC_EVEN_MODULUS;
+        return;
+    }
+
+    // r = (g^k mod p) mod q
+    pka_bn_mod(&g, &g, &p);
+    pka_bn_mont_exp(&r, &g, &k, &mont);
+    pka_bn_mod(&r, &r, &q);
+    if (pka_bn_is_zero(&r))
+    {
+        rslt->status = RC_OPERAND_VALUE_ERR;
+        return;
+    }
+
+    if (pka_soft_sign(&s, &k, &priv, &hash, &r, &q) != 0)
+    {
+        rslt->status = RC_NO_MODULAR_INVERSE;
+        return;
+    }
+
+    if (pka_bn_is_zero(&s))
+    {
+        rslt->status = RC_OPERAND_VALUE_ERR;
+        return;
+    }
+
+    len = MIN(pka_soft_operand_len(&operands[2]),
+              pka_soft_operand_len(&operands[0]) - 4);
+    pka_soft_set_result(rslt, 0, &r, len, big_endian);
+    pka_soft_set_result(rslt, 1, &s, len, big_endian);
+}
+
+static void pka_soft_dsa_verify(pka_opcode_t     opcode,
+                                pka_operand_t    operands[],
+                                pka_soft_rslt_t *rslt,
+                                uint8_t          big_endian)
+{
+    pka_bn_mont_t mont;
+    pka_bn_t      p, g, q, hash, pub, r, s, u1, u2, v;
+    uint32_t      len;
+
+    // Operands are p, g, q, the hash, the public key, r and s.
+    pka_bn_from_operand(&p,    &operands[0]);
+    pka_bn_from_operand(&g,    &operands[1]);
+    pka_bn_from_operand(&q,    &operands[2]);
+    pka_bn_from_operand(&hash, &operands[3]);
+    pka_bn_from_operand(&pub,  &operands[4]);
+    pka_bn_from_operand(&r,    &operands[5]);
+    pka_bn_from_operand(&s,    &operands[6]);
+    if ((pka_bn_mont_init(&mont, &p) != 0) || !pka_bn_is_odd(&q))
+    {
+        rslt->status = RC_EVEN_MODULUS;
+        return;
+    }
+
+    // v = ((g^u1 * y^u2) mod p) mod q, or zero if the signature is not valid.
+    pka_bn_set_u64(&v, 0);
+    if (pka_soft_verify_init(&u1, &u2, &hash, &r, &s, &q) == 0)
+    {
+        pka_bn_mod(&g, &g, &p);
+        pka_bn_mod(&pub, &pub, &p);
+        pka_bn_mont_exp(&u1, &g, &u1, &mont);
+        pka_bn_mont_exp(&u2, &pub, &u2, &mont);
+        pka_bn_mod_mul(&v, &u1, &u2, &p);
+        pka_bn_mod(&v, &v, &q);
+    }
+
+    len = MIN(pka_soft_operand_len(&operands[2]),
+              pka_soft_operand_len(&operands[0]) - 4);
+    pka_soft_verify_result(opcode, rslt, &r, &v, len, big_endian);
+}
+
+int pka_soft_process_cmd(pka_opcode_t     opcode,
+                         uint32_t         operand_cnt,
+                         uint32_t         shift_cnt,
+                         pka_operand_t    operands[],
+                         pka_soft_rslt_t *rslt)
+{
+    uint32_t idx;
+    uint8_t  big_endian;
+
+    memset(rslt, 0, offsetof(pka_soft_rslt_t, buf));
+    rslt->status = RC_NO_ERROR;
+
+    if (pka_soft_operand_cnt(opcode) == 0)
+    {
+        rslt->status = RC_UNKNOWN_COMMAND;
+        return 0;
+    }
+
+    if ((operand_cnt != pka_soft_operand_cnt(opcode)) || (operands == NULL))
+        return -EINVAL;
+
+    for (idx = 0; idx < operand_cnt; idx++)
+    {
+        if (operands[idx].buf_ptr == NULL)
+            return -EINVAL;
+
+        if (operands[idx].actual_len > PKA_SOFT_MAX_OPERAND_LEN)
+        {
+            rslt->status = RC_OPERAND_LENGTH_ERR;
+            return 0;
+        }
+    }
+
+    big_endian = operands[0].big_endian;
+    switch (opcode)
+    {
+    case CC_MODULAR_EXP:
+        pka_soft_mod_exp(operands, rslt, big_endian);
+        break;
+    case CC_MOD_EXP_CRT:
+        pka_soft_mod_exp_crt(operands, rslt, big_endian);
+        break;
+    case CC_MODULAR_INVERT:
+        pka_soft_mod_inv(operands, rslt, big_endian);
+        break;
+    case CC_ECC_PT_ADD:
+        pka_soft_ecc_pt_add(operands, rslt, big_endian);
+        break;
+    case CC_ECC_PT_MULTIPLY:
+        pka_soft_ecc_pt_mult(operands, rslt, big_endian);
+        break;
+    case CC_ECDSA_GENERATE:
+        pka_soft_ecdsa_gen(operands, rslt, big_endian);
+        break;
+    case CC_ECDSA_VERIFY:
+    case CC_ECDSA_VERIFY_NO_WRITE:
+        pka_soft_ecdsa_verify(opcode, operands, rslt, big_endian);
+        break;
+    case CC_DSA_GENERATE:
+        pka_soft_dsa_gen(operands, rslt, big_endian);
+        break;
+    case CC_DSA_VERIFY:
+    case CC_DSA_VERIFY_NO_WRITE:
+        pka_soft_dsa_verify(opcode, operands, rslt, big_endian);
+        break;
+    default:
+        pka_soft_basic(opcode, shift_cnt, operands, rslt, big_endian);
+        break;
+    }
+
+    // Results are only meaningful when the command succeeded.
+    if (rslt->status != RC_NO_ERROR)
+        rslt->result_cnt = 0;
+
+    return 0;
+}
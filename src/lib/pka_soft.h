@@ -0,0 +1,109 @@
+//
+//   BSD LICENSE
+//
+//   Copyright(c) 2016 Mellanox Technologies, Ltd. All rights reserved.
+//   All rights reserved.
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions
+//   are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in
+//       the documentation and/or other materials provided with the
+//       distribution.
+//     * Neither the name of Mellanox Technologies nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#ifndef __PKA_SOFT_H__
+#define __PKA_SOFT_H__
+
+///
+/// @file
+///
+/// Software implementation of the PK commands. It allows the library to
+/// process commands on the host CPU when no HW ring can accept them - e.g.
+/// the rings are full under overload, or the host has no rings at all - and
+/// it provides the arithmetic of the simulated device.
+///
+/// Big integers are held as arrays of 64-bit limbs. Modular multiplications
+/// use the Montgomery representation, and modular exponentiations as well as
+/// ECC point multiplications scan the exponent (resp. multiplier) using a
+/// sliding window. ECC points are processed in Jacobian coordinates.
+///
+/// Results are returned as the HW rings would return them - i.e. same result
+/// count, same result order and lengths padded to a multiple of 8 bytes - so
+/// that they can flow through the same result queues.
+///
+/// @note The implementation is not constant time; it aims at throughput,
+/// like the rest of the library, and shall not be used where timing side
+/// channels are a concern.
+///
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+#endif
+
+#include "pka.h"
+
+/// Largest operand, in bytes, the software engine accepts. It covers the
+/// largest vector the API can send to the HW - i.e. MAX_BYTE_LEN bytes, and
+/// the double length input of a modular exponentiation with CRT.
+#define PKA_SOFT_MAX_OPERAND_LEN    (68 * 8)
+
+/// Size of a result buffer, large enough to hold the product of two
+/// operands of maximal length.
+#define PKA_SOFT_RESULT_BUF_SIZE    (2 * PKA_SOFT_MAX_OPERAND_LEN)
+
+/// Result of a PK command processed in software.
+typedef struct
+{
+    pka_result_code_t status;          ///< same as the HW result code.
+    pka_cmp_code_t    compare_result;  ///< result of a comparison.
+    uint8_t           result_cnt;      ///< result cnt must be 0, 1 or 2.
+    pka_operand_t     results[MAX_RESULT_CNT]; ///< result operands, pointing
+                                               ///  to the buffers below.
+    uint8_t           buf[MAX_RESULT_CNT][PKA_SOFT_RESULT_BUF_SIZE];
+} pka_soft_rslt_t;
+
+/// Process a PK command in software. Operands are given in the same order
+/// as the one used to build HW command descriptors (see pka_ring.c) and may
+/// have leading zeros. Results are written in the byte order of the first
+/// operand, their 'actual_len' being the length the HW would report, padded
+/// to a multiple of 8 bytes.
+///
+/// @param opcode       PK command code.
+/// @param operand_cnt  Number of operands.
+/// @param shift_cnt    Shift amount of shift commands.
+/// @param operands     Table of operands.
+/// @param rslt         Result of the command.
+///
+/// @return             0 on success (the status of the command is given by
+///                     'rslt->status'), -EINVAL if the operands do not match
+///                     the command.
+int pka_soft_process_cmd(pka_opcode_t     opcode,
+                         uint32_t         operand_cnt,
+                         uint32_t         shift_cnt,
+                         pka_operand_t    operands[],
+                         pka_soft_rslt_t *rslt);
+
+#endif // __PKA_SOFT_H__
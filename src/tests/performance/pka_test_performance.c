@@ -31,6 +31,8 @@ typedef struct
 
     test_stats_t    thread_stats;
     uint64_t        thread_cycles;
+    uint32_t        outstanding_cmds; // updated by the threads sharing the
+                                      // handle of the thread, see '-H'.
 } thread_state_t;
 
 typedef struct
@@ -72,6 +74,7 @@ static const uint32_t DEFAULT_BIT_LEN[] =
 static pka_instance_t pka_test_instance;
 
 static uint32_t        num_of_threads;
+static uint32_t        num_of_handles;
 static uint32_t        cmds_outstanding;
 static uint32_t        submits_per_test;
 static uint8_t         num_of_rings;
@@ -88,6 +91,11 @@ static thread_state_t thread_states[MAX_THREADS];
 static pthread_t      threads[MAX_THREADS];
 static thread_arg_t   thread_args[MAX_THREADS];
 
+// Handles shared by the threads, and the commands completed on each of them
+// - see '-H'.
+static pka_handle_t   shared_handles[MAX_THREADS];
+static uint32_t       handle_cmds_done[MAX_THREADS];
+
 static uint32_t overall_cmds_done   = 0;
 static uint32_t overall_bad_results = 0;
 static uint64_t overall_start_time;
@@ -200,7 +208,11 @@ static __pka_inline void pm_disable()
 //
 // SY       Full system ISB operation. This is the default, and can be omitted.
 //
+#ifdef __aarch64__
 #define isb(opt)     ({ asm volatile("isb " #opt : : : "memory"); })
+#else
+#define isb(opt)     __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
 static __pka_inline void pka_mf(void)
 {
     isb(sy);
@@ -1078,18 +1090,43 @@ static void join_threads(uint32_t num_threads)
         pthread_join(threads[thread_idx], NULL);
 }
 
+// Return the number of threads using a given handle - see '-H'.
+static uint32_t handle_threads_cnt(uint32_t handle_idx)
+{
+    if (!num_of_handles)
+        return 1;
+
+    return (num_of_threads / num_of_handles) +
+                ((handle_idx < num_of_threads % num_of_handles) ? 1 : 0);
+}
+
+// Each thread has a handle of its own, unless the threads share handles -
+// see '-H'. The result of a command submitted through a shared handle is
+// retrieved by any of the threads using it, which records its statistics.
+// The threads of a handle then stop once all their commands are done.
 static void execute_tests_by_thread(uint32_t        thread_idx,
                                     thread_state_t *thread_state)
 {
-    pka_handle_t   handle;
-    pka_results_t *results;
-    user_data_t   *user_data_ptr, user_data[256];
-    uint64_t       thread_start_time, thread_end_time, test_end_time;
-    uint32_t       outstanding_cmds, failure_cnt;
-    uint32_t       total_cmds_done, num_cmds, test_idx, test_desc_idx;
-    uint32_t       total_cmds_submitted, user_data_idx, cmds_left_to_submit;
+    pka_handle_t    handle;
+    pka_results_t  *results;
+    thread_state_t *submitter_state;
+    user_data_t    *user_data_ptr, user_data[256];
+    uint64_t        thread_start_time, thread_end_time, test_end_time;
+    uint32_t        failure_cnt, handle_idx, handle_cmds;
+    uint32_t        total_cmds_done, num_cmds, test_idx, test_desc_idx;
+    uint32_t        total_cmds_submitted, user_data_idx, cmds_left_to_submit;
+
+    if (num_of_handles)
+    {
+        handle_idx = thread_idx % num_of_handles;
+        handle     = shared_handles[handle_idx];
+    }
+    else
+    {
+        handle_idx = thread_idx;
+        handle     = pka_init_local(pka_test_instance);
+    }
 
-    handle = pka_init_local(pka_test_instance);
     if (handle == PKA_HANDLE_INVALID)
     {
         printf("Failed to init local on thread_idx=%u\n",
@@ -1104,13 +1141,13 @@ static void execute_tests_by_thread(uint32_t        thread_idx,
         user_data[user_data_idx].thread_idx    = thread_idx;
     }
 
-    outstanding_cmds     = 0;
     total_cmds_submitted = 0;
     total_cmds_done      = 0;
     failure_cnt          = 0;
     thread_start_time    = pka_get_cycle_cnt();
     test_desc_idx        = 0;
     num_cmds             = num_tests * submits_per_test;
+    handle_cmds          = num_cmds * handle_threads_cnt(handle_idx);
     user_data_idx        = 0;
     results              = malloc_results(2, MAX_BYTE_LEN + 8);
 
@@ -1120,7 +1157,9 @@ static void execute_tests_by_thread(uint32_t        thread_idx,
     while(true)
     {
         cmds_left_to_submit = num_cmds - total_cmds_submitted;
-        while ((cmds_left_to_submit != 0) && (outstanding_cmds < cmds_outstanding))
+        while ((cmds_left_to_submit != 0) &&
+               (__atomic_load_n(&thread_state->outstanding_cmds,
+                                __ATOMIC_ACQUIRE) < cmds_outstanding))
         {
             // Need to get the next user_data structure to use and the next
             // test_desc idx to run.
@@ -1136,14 +1175,20 @@ static void execute_tests_by_thread(uint32_t        thread_idx,
             user_data_ptr->test_desc = test_descs[test_idx];
             user_data_ptr->test_desc_stats =
                                     &thread_state->test_desc_stats[test_idx];
+            __atomic_fetch_add(&thread_state->outstanding_cmds, 1,
+                               __ATOMIC_RELAXED);
             if (SUCCESS == submit_pka_test(handle, user_data_ptr, true))
             {
-                outstanding_cmds++;
                 total_cmds_submitted++;
                 cmds_left_to_submit = num_cmds - total_cmds_submitted;
             }
-            else if (failure_cnt++ > 10)
-                break;
+            else
+            {
+                __atomic_fetch_sub(&thread_state->outstanding_cmds, 1,
+                                   __ATOMIC_RELAXED);
+                if (failure_cnt++ > 10)
+                    break;
+            }
         }
 
         //printf("[%d] cmds_left_to_submit:%u - outstanding_cmds:%u\n",
@@ -1151,14 +1196,21 @@ static void execute_tests_by_thread(uint32_t        thread_idx,
 
         if (SUCCESS == pka_get_result(handle, results))
         {
-            test_end_time = pka_get_cycle_cnt();
+            test_end_time   = pka_get_cycle_cnt();
+            user_data_ptr   = (user_data_t *) results->user_data;
+            submitter_state = &thread_states[user_data_ptr->thread_idx];
+            user_data_ptr->test_desc_stats =
+                        &thread_state->test_desc_stats[user_data_ptr->test_idx];
             if (process_pka_test_results(handle, results, test_end_time))
             {
-                outstanding_cmds--;
-                total_cmds_done++;
-                //printf("[%d] outstanding_cmds:%u - total_cmds_done=%u\n",
-                //       thread_idx, outstanding_cmds, total_cmds_done);
-                if (num_cmds <= total_cmds_done)
+                __atomic_fetch_sub(&submitter_state->outstanding_cmds, 1,
+                                   __ATOMIC_RELEASE);
+                total_cmds_done = __atomic_add_fetch(
+                                        &handle_cmds_done[handle_idx], 1,
+                                        __ATOMIC_RELAXED);
+                //printf("[%d] total_cmds_done=%u\n",
+                //       thread_idx, total_cmds_done);
+                if (handle_cmds <= total_cmds_done)
                     break;
             }
             else
@@ -1171,13 +1223,16 @@ static void execute_tests_by_thread(uint32_t        thread_idx,
         if (failure_cnt > 10)
             break;
 
-        if ((cmds_left_to_submit == 0) && (num_cmds == total_cmds_done))
+        if ((cmds_left_to_submit == 0) &&
+            (handle_cmds <= __atomic_load_n(&handle_cmds_done[handle_idx],
+                                            __ATOMIC_RELAXED)))
             break;
     }
 
     thread_end_time             = pka_get_cycle_cnt();
     thread_state->thread_cycles = thread_end_time - thread_start_time;
-    pka_term_local(handle);
+    if (!num_of_handles)
+        pka_term_local(handle);
 }
 
 static void *pka_test_thread(void *arg)
@@ -1255,7 +1310,7 @@ static int run_test(pka_handle_t handle)
 {
     pthread_attr_t attr;
     cpu_set_t cpu_set;
-    uint32_t  thread_idx;
+    uint32_t  thread_idx, handle_idx;
     int64_t   worker_cpu;
     int       rc;
 
@@ -1272,6 +1327,17 @@ static int run_test(pka_handle_t handle)
     if (MAX_THREADS < num_of_threads)
         return -3;
 
+    // Open the handles the threads share, if any.
+    for (handle_idx = 0; handle_idx < num_of_handles; handle_idx++)
+    {
+        shared_handles[handle_idx] = pka_init_local(pka_test_instance);
+        if (shared_handles[handle_idx] == PKA_HANDLE_INVALID)
+        {
+            printf("Failed to init shared handle %u\n", handle_idx);
+            return -3;
+        }
+    }
+
     for (thread_idx = 0; thread_idx < num_of_threads; thread_idx++)
     {
         worker_cpu = thread_idx % num_of_threads;
@@ -1299,6 +1365,10 @@ static int run_test(pka_handle_t handle)
     // Wait for each thread to complete their running of the test.
     join_threads(num_of_threads);
     overall_end_time = pka_get_cycle_cnt();
+
+    for (handle_idx = 0; handle_idx < num_of_handles; handle_idx++)
+        pka_term_local(shared_handles[handle_idx]);
+
     return 0;
 }
 
@@ -1471,6 +1541,8 @@ static void print_usage(char *progname)
     printf("  -b <bit_len>         primary bit_len to use\n");
     printf("  -e ( big | little )  endianness of the interface\n");
     printf("  -h                   print this message and exit\n");
+    printf("  -H <num_handles>     num of handles shared by the threads, 0 for\n");
+    printf("                       one handle per thread\n");
     printf("  -k <num_keys>        num of different key subsystems to make\n");
     printf("  -m <runs_per_test>   num of runs of each test per thread\n");
     printf("  -n <num_tests>       num of tests (per key subsystem) to make\n");
@@ -1502,11 +1574,11 @@ static void print_usage(char *progname)
 static pka_status_t process_options(int argc, char *argv[])
 {
     pka_test_name_t test_name;
-    uint32_t        num_tests, thread_cnt, ring_cnt;
+    uint32_t        num_tests, thread_cnt, ring_cnt, handle_cnt;
     uint32_t        num_outstanding, bit_len, test_runs, key_systems;
     int             optionChar;
 
-    while ((optionChar = getopt(argc, argv, "b:c:e:hk:m:n:q:rs:t:o:v:y:")) != -1)
+    while ((optionChar = getopt(argc, argv, "b:c:e:hH:k:m:n:q:rs:t:o:v:y:")) != -1)
     {
         switch (optionChar)
         {
@@ -1555,6 +1627,18 @@ static pka_status_t process_options(int argc, char *argv[])
             help = true;
             break;
 
+        case 'H':
+            handle_cnt = atoi(optarg);
+            if (MAX_THREADS < handle_cnt)
+            {
+                printf("number of shared handles must be <= %u\n",
+                       MAX_THREADS);
+                return FAILURE;
+            }
+            else
+                num_of_handles = handle_cnt;
+            break;
+
         case 'k':
             key_systems = atoi(optarg);
             if (key_systems != 1)
@@ -1695,12 +1779,13 @@ static pka_status_t process_options(int argc, char *argv[])
 int main (int argc, char *argv[])
 {
     pka_handle_t  handle;
-    uint32_t      cmd_queue_sz, rslt_queue_sz;
-    uint8_t       flags;
+    uint32_t      cmd_queue_sz, rslt_queue_sz, queue_cnt;
+    uint32_t      flags;
     int           return_code = 0;
 
     // Set argument defaults:
     num_of_threads      = 1;
+    num_of_handles      = 0;
     num_of_rings        = 1;
     cmds_outstanding    = 10;
     submits_per_test    = 100;
@@ -1771,18 +1856,29 @@ int main (int argc, char *argv[])
            big_endian ? "BIG_ENDIAN" : "LITTLE_ENDIAN",
            test_name_to_string(test_kind.test_name), test_kind.bit_len,
            test_kind.second_bit_len);
+    // More handles than threads would be left unused.
+    num_of_handles = MIN(num_of_handles, num_of_threads);
+
     printf("Running each test %u times with %u cmds outstanding on %u "
            "threads\n", submits_per_test, cmds_outstanding, num_of_threads);
+    if (num_of_handles)
+        printf("The threads share %u handles\n", num_of_handles);
     printf("Tests %s be checked and thread stats %s be reported. "
            "Verbosity=%u\n", check_results ? "will" : " will not",
            report_thread_stats ? "will" : "will not", verbosity);
 
     // Init PKA before calling anything else
     flags         = PKA_F_PROCESS_MODE_MULTI | PKA_F_SYNC_MODE_ENABLE;
+    queue_cnt     = num_of_threads;
+    if (num_of_handles)
+    {
+        flags     |= PKA_F_SHARED_HANDLES;
+        queue_cnt  = num_of_handles;
+    }
     cmd_queue_sz  = PKA_MAX_OBJS * PKA_CMD_DESC_MAX_DATA_SIZE;
     rslt_queue_sz = PKA_MAX_OBJS * PKA_RSLT_DESC_MAX_DATA_SIZE;
     pka_test_instance = pka_init_global(NO_PATH(argv[0]), flags, num_of_rings,
-                            num_of_threads, cmd_queue_sz,
+                            queue_cnt, cmd_queue_sz,
                             rslt_queue_sz);
     if (pka_test_instance == PKA_INSTANCE_INVALID)
     {
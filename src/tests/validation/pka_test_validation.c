@@ -6,6 +6,9 @@
 #include <string.h>
 #include <getopt.h>
 #include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
 #include <inttypes.h>
 #include <sys/types.h>
 #include <ctype.h>
@@ -23,6 +26,37 @@
 #define PKA_CMD_DESC_MAX_DATA_SIZE  (1 << 14) // 16K bytes.
 #define PKA_RSLT_DESC_MAX_DATA_SIZE (1 << 12) //  4K bytes.
 
+// Time after which a result that did not come back is reported as a failure.
+#define RESULT_TIMEOUT_SEC          10
+
+// Largest number of commands submitted to fill the HW rings.
+#define FILL_CMDS_MAX               256
+
+// Largest number of batches submitted to fill the window RAM of the HW rings
+// in the bypass test.
+#define BYPASS_BATCHES_MAX          16
+
+// Largest number of times the bypass test fills the HW rings.
+#define BYPASS_ATTEMPTS             4
+
+// Largest number of commands submitted by each run of the handoff test.
+#define HANDOFF_CMDS                4096
+
+// Threads sharing the handle in the shared handle test, and commands each of
+// them submits.
+#define SHARED_THREADS              4
+#define SHARED_CMDS                 16
+
+// Handles an instance may have at most - see pka_init_global() - and
+// commands in flight when a handle is terminated in the slot test.
+#define SLOT_HANDLES_MAX            55
+#define SLOT_CMDS                   8
+
+// Additions submitted over each window RAM layout of the simulated rings, and
+// additions in flight at once.
+#define LAYOUT_CMDS                 1024
+#define LAYOUT_BURST                64
+
 // Macro to print the current application mode
 #define PRINT_APPL_MODE(x) printf("%s(bit %i)\n", #x, (x))
 
@@ -38,6 +72,12 @@ typedef struct
     uint8_t        ring_count;     ///< Number of Rings to use
     uint8_t        mode;           ///< Application mode
     uint8_t        sync;           ///< Synchronization mode
+    uint32_t       policy;         ///< Ring selection policy
+    uint32_t       priority;       ///< Priority ring flag
+    uint32_t       budget;         ///< Commands per lock acquisition
+    uint32_t       lane;           ///< Lane mode flag
+    uint32_t       fallback;       ///< Software fallback flag
+    uint32_t       shared;         ///< Shared handles flag
     uint8_t        time;           ///< Time to run app
 } app_args_t;
 
@@ -73,8 +113,13 @@ volatile bool global_quit;
 volatile uint32_t print_thread_idx;
 
 static pka_barrier_t startup_barrier;
+static pka_barrier_t lane_barrier;
+static pka_barrier_t api_barrier;
 static pka_barrier_t ending_barrier;
 
+static uint32_t      threads_cnt;
+static volatile bool lane_test_done;
+
 static uint32_t validation_tests_passed;
 static uint32_t validation_tests_failed;
 static uint32_t validation_tests_total;
@@ -89,6 +134,8 @@ typedef pka_result_code_t (* shift_fcn_t) (pka_handle_t   hdl,
                                            pka_operand_t *operand,
                                            uint32_t       shift_cnt);
 
+typedef void (* api_test_fcn_t) (thread_args_t *args);
+
 #define PKA_ADD            (basic_fcn_t) pka_add
 #define PKA_SUBTRACT       (basic_fcn_t) pka_subtract
 #define PKA_MULTIPLY       (basic_fcn_t) pka_multiply
@@ -231,6 +278,12 @@ static void InitTestOperands(void)
     CreateTestOperand(21, 0xCCCC999A, 0, 0, 0);
     CreateTestOperand(22, 0xC0000001, 0, 0, 0);
 
+    // A modulus large enough for a modular exponentiation to make a long
+    // large command, and an operand small enough for an addition to make a
+    // small one, see TestPkaBypass().
+    CreateTestOperand(23, 0xFFFFFFFE,     0xFFFE, 256, 0x01);
+    CreateTestOperand(24, 0xFFFFFFFE,     0xFFFE, 150, 0);
+
     SetTestOperand(30, MakeOperand(RESULT0, sizeof(RESULT0)));
     SetTestOperand(31, MakeOperand(RESULT1, sizeof(RESULT1)));
     SetTestOperand(32, MakeOperand(RESULT2, sizeof(RESULT2)));
@@ -666,6 +719,181 @@ static void TestFailed(thread_args_t     *args,
     args->tests_failed++;
 }
 
+static void ApiTestFailed(thread_args_t *args,
+                          const char    *test_fcn_name,
+                          const char    *what,
+                          int            rc)
+{
+    printf("%s error: %s rc=%d\n", test_fcn_name, what, rc);
+    args->tests_failed++;
+}
+
+// Retrieve a result of the handle, giving up after RESULT_TIMEOUT_SEC seconds
+// rather than getting stuck when the test fails.
+static int GetResult(pka_handle_t handle, pka_results_t *results)
+{
+    time_t start;
+
+    start = time(NULL);
+    while (FAILURE == pka_get_result(handle, results))
+    {
+        if (time(NULL) - start > RESULT_TIMEOUT_SEC)
+            return FAILURE;
+    }
+
+    return SUCCESS;
+}
+
+// Add 1 to 1 with the handle, and check that the only result it gets is that
+// one - e.g. rather than a result left by the previous handle of its index.
+static bool SingleAdd(pka_handle_t handle, void *user_data)
+{
+    pka_results_t results;
+    uint8_t       res_buf[MAX_BUF];
+
+    if (pka_add(handle, user_data, test_operands[1], test_operands[1]))
+        return false;
+
+    memset(&results, 0, sizeof(pka_results_t));
+    init_operand(&results.results[0], &res_buf[0], MAX_BUF, 0);
+    if (GetResult(handle, &results) != SUCCESS ||
+            results.user_data != user_data ||
+            results.status != RC_NO_ERROR ||
+            pki_compare(&results.results[0], test_operands[2]) !=
+                RC_COMPARE_EQUAL)
+        return false;
+
+    return pka_get_result(handle, &results) == FAILURE &&
+                !pka_request_count(handle);
+}
+
+// Submit modular exponentiations until at least 'queued_cnt' commands wait
+// in the SW command queues - i.e. until the HW rings are full. The user data
+// of each command is its index. Returns the number of commands submitted in
+// 'cmd_cnt', and whether enough commands were queued. Note that without
+// synchronization, a command is refused rather than queued when the rings
+// have descriptors left but not enough window RAM.
+static bool FillRings(thread_args_t *args,
+                      pka_operand_t *exponent,
+                      pka_operand_t *modulus,
+                      uint32_t       queued_cnt,
+                      uint32_t      *cmd_cnt)
+{
+    pka_load_t load;
+
+    *cmd_cnt = 0;
+    while (*cmd_cnt < FILL_CMDS_MAX)
+    {
+        if (MOD_EXP(args->handle, (void *) (uintptr_t) *cmd_cnt, exponent,
+                    modulus, test_operands[16]) != RC_NO_ERROR)
+            return false;
+
+        *cmd_cnt += 1;
+        if (!pka_get_load(args->instance, &load) &&
+                load.queued_cmds >= queued_cnt)
+            return true;
+    }
+
+    return false;
+}
+
+// Retrieve and drop the results of the outstanding commands of the handle -
+// e.g. those left by a test which failed - so that the next test only gets
+// the results of its own commands.
+static void DrainResults(thread_args_t *args)
+{
+    pka_results_t results;
+    uint8_t       res_buf[2][MAX_BUF];
+
+    while (pka_request_count(args->handle))
+    {
+        memset(&results, 0, sizeof(pka_results_t));
+        init_operand(&results.results[0], &res_buf[0][0], MAX_BUF, 0);
+        init_operand(&results.results[1], &res_buf[1][0], MAX_BUF, 0);
+        if (GetResult(args->handle, &results) != SUCCESS)
+            return;
+    }
+}
+
+// Check that the handle has neither outstanding commands nor results left
+// before a test starts. Whatever is left is dropped.
+static bool HandleIdle(thread_args_t *args, const char *test_fcn_name)
+{
+    pka_results_t results;
+    uint8_t       res_buf[2][MAX_BUF];
+
+    memset(&results, 0, sizeof(pka_results_t));
+    init_operand(&results.results[0], &res_buf[0][0], MAX_BUF, 0);
+    init_operand(&results.results[1], &res_buf[1][0], MAX_BUF, 0);
+    if (!pka_request_count(args->handle) &&
+            pka_get_result(args->handle, &results) == FAILURE)
+        return true;
+
+    ApiTestFailed(args, test_fcn_name, "results left",
+                  pka_request_count(args->handle));
+    DrainResults(args);
+    return false;
+}
+
+// Run an API test on an idle handle, and drop whatever it leaves - e.g. the
+// results of a test which failed - so that the next test only gets the
+// results of its own commands.
+static void ApiTestRun(thread_args_t  *args,
+                       api_test_fcn_t  test_fcn,
+                       const char     *test_fcn_name)
+{
+    if (!HandleIdle(args, test_fcn_name))
+        return;
+
+    test_fcn(args);
+    DrainResults(args);
+}
+
+#define RUN_API_TEST(args, test_fcn) ApiTestRun((args), (test_fcn), #test_fcn)
+
+// Retrieve the results of the commands submitted by FillRings(), and check
+// those which completed. The status of each command is returned in 'status'.
+static bool GetFillResults(thread_args_t     *args,
+                           const char        *test_fcn_name,
+                           uint32_t           cmd_cnt,
+                           pka_result_code_t  status[])
+{
+    pka_results_t results;
+    uint32_t      idx, cmd_idx;
+    uint8_t       res_buf[MAX_BUF];
+    bool          done[FILL_CMDS_MAX];
+
+    memset(done, 0, sizeof(done));
+
+    for (idx = 0; idx < cmd_cnt; idx++)
+    {
+        memset(&results, 0, sizeof(pka_results_t));
+        init_operand(&results.results[0], &res_buf[0], MAX_BUF, 0);
+        if (GetResult(args->handle, &results) != SUCCESS)
+        {
+            ApiTestFailed(args, test_fcn_name, "missing result", idx);
+            return false;
+        }
+
+        // Dropped commands have no result operand.
+        cmd_idx = (uintptr_t) results.user_data;
+        if (cmd_idx >= cmd_cnt || done[cmd_idx] ||
+                (results.status == RC_NO_ERROR &&
+                    pki_compare(&results.results[0], test_operands[34]) !=
+                        RC_COMPARE_EQUAL) ||
+                (results.status != RC_NO_ERROR && results.result_cnt))
+        {
+            ApiTestFailed(args, test_fcn_name, "wrong result", cmd_idx);
+            return false;
+        }
+
+        status[cmd_idx] = results.status;
+        done[cmd_idx]   = true;
+    }
+
+    return true;
+}
+
 static void ModExpWithCrtTestFailed(thread_args_t     *args,
                                     const char        *test_fcn_name,
                                     rsa_system_t      *rsa,
@@ -870,7 +1098,7 @@ static void ShiftTest(thread_args_t *args,
     rc = fcn(args->handle, args->user_data, operand, shift_cnt);
     if (rc != RC_NO_ERROR)
     {
-        CmdFailed(args, __func__, pki_fcn_name, &operand, 2, rc);
+        CmdFailed(args, __func__, pki_fcn_name, &operand, 1, rc);
         return;
     }
 
@@ -1410,6 +1638,102 @@ void TestDsa(thread_args_t *args)
     DsaTest(args, DSS_3072_256, 90, 91, 92, 93, 90);
 }
 
+// Submit a batch of commands and check their results. A batch with a command
+// which is not valid must be refused as a whole.
+void TestPkaSubmitBatch(thread_args_t *args)
+{
+    pka_batch_cmd_t  cmds[4];
+    pka_operand_t   *correct[4];
+    pka_results_t    results;
+    uint32_t         idx, cmd_idx, done_mask;
+    uint8_t          res_buf[MAX_BUF];
+    int              rc;
+
+    memset(cmds, 0, sizeof(cmds));
+    cmds[0].opcode    = CC_ADD;
+    cmds[0].args[0]   = test_operands[1];
+    cmds[0].args[1]   = test_operands[1];
+    correct[0]        = test_operands[2];
+    cmds[1].opcode    = CC_SUBTRACT;
+    cmds[1].args[0]   = test_operands[6];
+    cmds[1].args[1]   = test_operands[2];
+    correct[1]        = test_operands[4];
+    cmds[2].opcode    = CC_SHIFT_LEFT;
+    cmds[2].args[0]   = test_operands[1];
+    cmds[2].shift_cnt = 16;
+    correct[2]        = test_operands[9];
+    cmds[3].opcode    = CC_MODULAR_EXP;
+    cmds[3].args[0]   = test_operands[15];
+    cmds[3].args[1]   = test_operands[19];
+    cmds[3].args[2]   = test_operands[16];
+    correct[3]        = test_operands[34];
+    for (idx = 0; idx < 4; idx++)
+        cmds[idx].user_data = (void *) (uintptr_t) idx;
+
+    // Batches belong to a single thread.
+    if (gbl_args->app.shared)
+    {
+        rc = pka_submit_batch(args->handle, cmds, 4);
+        if (rc != -EPERM)
+        {
+            ApiTestFailed(args, __func__, "shared handle accepted", rc);
+            return;
+        }
+
+        args->tests_passed++;
+        return;
+    }
+
+    rc = pka_submit_batch(args->handle, cmds, 4);
+    if (rc != 4)
+    {
+        ApiTestFailed(args, __func__, "pka_submit_batch failed", rc);
+        return;
+    }
+
+    done_mask = 0;
+    for (idx = 0; idx < 4; idx++)
+    {
+        memset(&results, 0, sizeof(pka_results_t));
+        init_operand(&results.results[0], &res_buf[0], MAX_BUF, 0);
+        if (GetResult(args->handle, &results) != SUCCESS)
+        {
+            ApiTestFailed(args, __func__, "missing result", idx);
+            return;
+        }
+
+        cmd_idx = (uintptr_t) results.user_data;
+        if (cmd_idx >= 4 || (done_mask & (1 << cmd_idx)) ||
+                results.status != RC_NO_ERROR ||
+                pki_compare(&results.results[0], correct[cmd_idx]) !=
+                    RC_COMPARE_EQUAL)
+        {
+            ApiTestFailed(args, __func__, "wrong result", cmd_idx);
+            return;
+        }
+
+        done_mask |= 1 << cmd_idx;
+    }
+
+    // No command is submitted when one of them is not valid.
+    cmds[3].opcode = CC_COMPARE;
+    rc = pka_submit_batch(args->handle, cmds, 4);
+    if (rc != -EINVAL || pka_request_count(args->handle))
+    {
+        ApiTestFailed(args, __func__, "invalid batch submitted", rc);
+        return;
+    }
+
+    rc = pka_submit_batch(args->handle, cmds, PKA_MAX_BATCH_CNT + 1);
+    if (rc != -EINVAL)
+    {
+        ApiTestFailed(args, __func__, "oversized batch submitted", rc);
+        return;
+    }
+
+    args->tests_passed++;
+}
+
 // When application run multiple threads, this test will fail if it is called
 // by every thread. Issues regarding queueing and re-ordering should be fixed.
 void SingleThreadTestAll(thread_args_t *args)
@@ -1438,154 +1762,2191 @@ void SingleThreadTestAll(thread_args_t *args)
     TestDsa(args);
 }
 
-static void *thread_start_routine(void *arg)
+// Retrieve the results of several commands at once with pka_get_results().
+void TestPkaGetResults(thread_args_t *args)
 {
-    pka_handle_t   pka_hdl;
-    thread_args_t *thread_args;
-    uint32_t       thread_idx, cpu_num;
-
-    thread_args = (thread_args_t *) arg;
-    thread_idx  =  thread_args->id;
-    cpu_num     =  thread_args->cpu_num;
-
-    thread_args->user_data = arg;
+    pka_results_t  results[4];
+    pka_operand_t *correct[4];
+    uint32_t       left_idx[4] = { 1, 3, 4, 7 };
+    uint32_t       correct_idx[4] = { 2, 4, 5, 8 };
+    uint32_t       idx, cmd_idx, rslt_cnt, done_mask;
+    uint8_t        res_bufs[4][MAX_BUF];
+    time_t         start;
+    int            rc;
+
+    memset(results, 0, sizeof(results));
+    for (idx = 0; idx < 4; idx++)
+    {
+        init_operand(&results[idx].results[0], &res_bufs[idx][0], MAX_BUF,
+                     0);
+        correct[idx] = test_operands[correct_idx[idx]];
+        rc = pka_add(args->handle, (void *) (uintptr_t) idx,
+                     test_operands[left_idx[idx]], test_operands[1]);
+        if (rc != RC_NO_ERROR)
+        {
+            ApiTestFailed(args, __func__, "pka_add failed", rc);
+            return;
+        }
+    }
 
-    thread_args->ticks = 50;
-    thread_args->seed  = 1000 * thread_idx + 10 * cpu_num + 1;
+    rslt_cnt = 0;
+    start    = time(NULL);
+    while (rslt_cnt < 4)
+    {
+        rc = pka_get_results(args->handle, &results[rslt_cnt], 4 - rslt_cnt);
+        if (rc < 0 || rc > (int) (4 - rslt_cnt))
+        {
+            ApiTestFailed(args, __func__, "pka_get_results failed", rc);
+            return;
+        }
 
-    thread_args->tests_failed = 0;
-    thread_args->tests_passed = 0;
+        rslt_cnt += rc;
+        if (time(NULL) - start > RESULT_TIMEOUT_SEC)
+        {
+            ApiTestFailed(args, __func__, "missing results", rslt_cnt);
+            return;
+        }
+    }
 
-    printf("Starting thread_idx=%u on cpu_num=%u\n", thread_idx, cpu_num);
-    fflush(NULL);
+    done_mask = 0;
+    for (idx = 0; idx < 4; idx++)
+    {
+        cmd_idx = (uintptr_t) results[idx].user_data;
+        if (cmd_idx >= 4 || (done_mask & (1 << cmd_idx)) ||
+                results[idx].status != RC_NO_ERROR ||
+                pki_compare(&results[idx].results[0], correct[cmd_idx]) !=
+                    RC_COMPARE_EQUAL)
+        {
+            ApiTestFailed(args, __func__, "wrong result", cmd_idx);
+            return;
+        }
 
-    pka_barrier_wait(&startup_barrier);
+        done_mask |= 1 << cmd_idx;
+    }
 
-    // Init PK local execution context.
-    pka_hdl = pka_init_local(thread_args->instance);
-    if (pka_hdl == PKA_HANDLE_INVALID)
+    // Every result was acknowledged, none is left.
+    rc = pka_get_results(args->handle, results, 4);
+    if (rc != 0 || pka_request_count(args->handle))
     {
-        printf("failed to init local\n");
-        return NULL;
+        ApiTestFailed(args, __func__, "results left", rc);
+        return;
     }
 
-    // Set thread handle
-    thread_args->handle = pka_hdl;
+    rc = pka_get_results(args->handle, NULL, 4);
+    if (rc != -EINVAL)
+    {
+        ApiTestFailed(args, __func__, "NULL results accepted", rc);
+        return;
+    }
 
-    // Do some stuff here
-    //while (gbl_args->exit_threads)
-        SingleThreadTestAll(thread_args);
+    args->tests_passed++;
+}
 
-    pka_barrier_wait(&ending_barrier);
+// Submit an addition with the given result buffers attached, and check that
+// its result is returned in 'rslt_buf_ptr'.
+static bool ResultBufsTest(thread_args_t *args,
+                           pka_results_t *rslt_bufs,
+                           uint8_t       *rslt_buf_ptr)
+{
+    pka_results_t results;
+    uint8_t       res_buf[MAX_BUF];
+    int           rc;
 
-    pka_term_local(thread_args->handle);
-    //printf("thread %d - term local\n", thread_idx);
+    rc = pka_set_result_bufs(args->handle, rslt_bufs);
+    if (rc)
+    {
+        ApiTestFailed(args, __func__, "pka_set_result_bufs failed", rc);
+        return false;
+    }
 
-    // wait for print_thread_idx to be equal to my thread_idx + 1.
-    while (print_thread_idx != (thread_idx + 1))
-            pka_wait();
+    rc = pka_add(args->handle, args->user_data, test_operands[194],
+                 test_operands[195]);
+    if (rc != RC_NO_ERROR)
+    {
+        ApiTestFailed(args, __func__, "pka_add failed", rc);
+        return false;
+    }
 
-    // Summary;
-    printf("%s thread_idx=%u cpu_num=%u done\n\t", __func__,
-               thread_idx, cpu_num);
-    printf("tests_passed=%u \n\t"
-           "tests_failed=%u \n\t"
-           "total_tests=%u  \n",
-           thread_args->tests_passed,
-           thread_args->tests_failed,
-           thread_args->tests_passed + thread_args->tests_failed);
-    fflush(NULL);
+    memset(&results, 0, sizeof(pka_results_t));
+    init_operand(&results.results[0], &res_buf[0], MAX_BUF, 0);
+    if (GetResult(args->handle, &results) != SUCCESS)
+    {
+        ApiTestFailed(args, __func__, "missing result", 0);
+        return false;
+    }
 
-    validation_tests_passed = thread_args->tests_passed;
-    validation_tests_failed = thread_args->tests_failed;
-    validation_tests_total  =
-            validation_tests_passed + validation_tests_failed;
+    if (rslt_buf_ptr == NULL)
+        rslt_buf_ptr = &res_buf[0];
 
-    // Signal the next thread to print its counters.
-    print_thread_idx += 1;
-    pka_mb_full();
+    if (results.status != RC_NO_ERROR ||
+            results.results[0].buf_ptr != rslt_buf_ptr ||
+            pki_compare(&results.results[0], test_operands[196]) !=
+                RC_COMPARE_EQUAL)
+    {
+        ApiTestFailed(args, __func__, "wrong result", results.status);
+        return false;
+    }
 
-    return NULL;
+    return true;
 }
 
-int main(int argc, char *argv[])
+// Attach result buffers to commands. A buffer too small for the result is
+// ignored, and the result is returned in the buffer passed to
+// pka_get_result() as usual.
+void TestPkaSetResultBufs(thread_args_t *args)
 {
-    app_args_t      *app_args;
-    static pthread_t thread_tbl[MAX_THREADS];
-    thread_args_t   *thread_args;
-    pthread_attr_t   attr;
-    cpu_set_t        cpu_set;
-    pka_instance_t   pka_instance;
-    uint32_t         cpu_num, worker_idx, cmd_queue_sz, rslt_queue_sz;
-    uint8_t          flags, rings_num, workers_num;
+    pka_results_t rslt_bufs;
+    uint8_t       rslt_buf[MAX_BUF], small_buf[8];
+    int           rc;
 
-    int ret = 0;
+    memset(&rslt_bufs, 0, sizeof(pka_results_t));
+    init_operand(&rslt_bufs.results[0], &rslt_buf[0], MAX_BUF, 0);
 
-    gbl_args = calloc(1, sizeof(args_t));
-    if (gbl_args == NULL) {
-        printf("gbl_args mem alloc failed.\n");
-        exit(EXIT_FAILURE);
+    // The result might be written by another process, or retrieved by
+    // another thread of the handle.
+    if (gbl_args->app.mode == PKA_F_PROCESS_MODE_MULTI ||
+            gbl_args->app.shared)
+    {
+        rc = pka_set_result_bufs(args->handle, &rslt_bufs);
+        if (rc != -EPERM)
+        {
+            ApiTestFailed(args, __func__, "result buffers attached", rc);
+            return;
+        }
+
+        args->tests_passed++;
+        return;
     }
 
-    // Parse and store the instance arguments
-    ParseArgs(argc, argv, &gbl_args->app);
+    if (!ResultBufsTest(args, &rslt_bufs, &rslt_buf[0]))
+        return;
 
-    // Default to system CPU count unless user specified
-    workers_num = MAX_THREADS;
-    if (gbl_args->app.cpu_count <= MAX_THREADS)
-        workers_num = gbl_args->app.cpu_count;
+    init_operand(&rslt_bufs.results[0], &small_buf[0], sizeof(small_buf),
+                 0);
+    if (!ResultBufsTest(args, &rslt_bufs, NULL))
+        return;
 
-    // Init PKA before calling anything else
-    app_args      = &gbl_args->app;
-    flags         = app_args->mode | app_args->sync;
-    rings_num     = app_args->ring_count;
-    cmd_queue_sz  = PKA_MAX_OBJS * PKA_CMD_DESC_MAX_DATA_SIZE;
-    rslt_queue_sz = PKA_MAX_OBJS * PKA_RSLT_DESC_MAX_DATA_SIZE;
-    pka_instance = pka_init_global(NO_PATH(argv[0]), flags, rings_num,
-                            workers_num, cmd_queue_sz,
-                            rslt_queue_sz);
-    if (pka_instance == PKA_INSTANCE_INVALID)
+    // Detached buffers are not used anymore.
+    init_operand(&rslt_bufs.results[0], &rslt_buf[0], MAX_BUF, 0);
+    rc = pka_set_result_bufs(args->handle, &rslt_bufs);
+    if (rc)
     {
-        printf("failed to init global\n");
-        return ret;
+        ApiTestFailed(args, __func__, "pka_set_result_bufs failed", rc);
+        return;
     }
 
-    gbl_args->app.instance = pka_instance;
+    if (!ResultBufsTest(args, NULL, NULL))
+        return;
 
-    // Print both system and instance information
-    PrintInfo(NO_PATH(argv[0]), &gbl_args->app);
+    args->tests_passed++;
+}
 
-    // Init test parameters
-    TestInit();
+// Register the exponent and the modulus of modular exponentiations, some of
+// which wait in the SW command queue holding references to them.
+void TestPkaRegisterOperand(thread_args_t *args)
+{
+    pka_result_code_t  status[FILL_CMDS_MAX];
+    pka_operand_t     *exponent, *modulus;
+    uint32_t           cmd_cnt, idx;
+    int                rc;
 
-    printf("num worker threads: %i\n", workers_num);
+    exponent = dup_operand(test_operands[15]);
+    modulus  = dup_operand(test_operands[19]);
 
-    // Create and init worker threads
-    pka_barrier_init(&startup_barrier, workers_num);
-    memset(thread_tbl, 0, sizeof(thread_tbl));
-    for (worker_idx = 0; worker_idx < workers_num; worker_idx++)
+    rc = pka_register_operand(args->handle, exponent);
+    if (gbl_args->app.mode == PKA_F_PROCESS_MODE_MULTI)
     {
-        thread_args  = &gbl_args->thread[worker_idx];
-        cpu_num      = worker_idx % app_args->cpu_count;
-        CPU_ZERO(&cpu_set);
-        CPU_SET(cpu_num, &cpu_set);
-        pthread_attr_init(&attr);
-        pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpu_set);
+        // Another process might copy the operands to the HW rings.
+        if (rc != -EPERM)
+            ApiTestFailed(args, __func__, "multi process mode accepted", rc);
+        else
+            args->tests_passed++;
+        goto free_operands;
+    }
 
-        // Create threads one-by-one instead of all-at-once,
-        // because each thread might get different arguments.
-        // Calls pthread_create() for each thread
-        thread_args->cpu_num  = cpu_num;
-        thread_args->id       = worker_idx;
-        thread_args->instance = pka_instance;
-        pthread_create(&thread_tbl[worker_idx], &attr,
-                               thread_start_routine, (void *) thread_args);
+    if (rc || (rc = pka_register_operand(args->handle, modulus)))
+    {
+        ApiTestFailed(args, __func__, "pka_register_operand failed", rc);
+        goto free_operands;
     }
 
-    // Sleep during test and then signal threads to quit.
-    pka_barrier_init(&ending_barrier, workers_num);
-    //sleep(inst->time);
-    //global_quit = TRUE;
+    rc = pka_register_operand(args->handle, NULL);
+    if (rc != -EINVAL)
+    {
+        ApiTestFailed(args, __func__, "NULL operand registered", rc);
+        goto free_operands;
+    }
+
+    FillRings(args, exponent, modulus, 2, &cmd_cnt);
+    if (!GetFillResults(args, __func__, cmd_cnt, status))
+        goto free_operands;
+
+    for (idx = 0; idx < cmd_cnt; idx++)
+    {
+        if (status[idx] != RC_NO_ERROR)
+        {
+            ApiTestFailed(args, __func__, "command failed", status[idx]);
+            goto free_operands;
+        }
+    }
+
+    if ((rc = pka_unregister_operand(args->handle, exponent)) ||
+            (rc = pka_unregister_operand(args->handle, modulus)))
+    {
+        ApiTestFailed(args, __func__, "pka_unregister_operand failed", rc);
+        goto free_operands;
+    }
+
+    args->tests_passed++;
+
+free_operands:
+    free_operand(exponent);
+    free_operand(modulus);
+}
+
+// Wait for the result of a modular exponentiation on the completion fd of the
+// handle. Each wake up must come before the timeout, though it might not
+// yield the result.
+void TestPkaGetResultFd(thread_args_t *args)
+{
+    pka_results_t results;
+    struct pollfd pfd;
+    uint8_t       res_buf[MAX_BUF];
+    time_t        start;
+    int           rc;
+
+    pfd.fd     = pka_get_result_fd(args->handle);
+    pfd.events = POLLIN;
+
+    // Results might be moved by another process.
+    if (gbl_args->app.mode == PKA_F_PROCESS_MODE_MULTI)
+    {
+        if (pfd.fd != -EPERM)
+            ApiTestFailed(args, __func__, "multi process mode accepted",
+                          pfd.fd);
+        else
+            args->tests_passed++;
+        return;
+    }
+
+    if (pfd.fd < 0 || pka_get_result_fd(args->handle) != pfd.fd)
+    {
+        ApiTestFailed(args, __func__, "pka_get_result_fd failed", pfd.fd);
+        return;
+    }
+
+    rc = MOD_EXP(args->handle, args->user_data, test_operands[15],
+                 test_operands[19], test_operands[16]);
+    if (rc != RC_NO_ERROR)
+    {
+        ApiTestFailed(args, __func__, "pka_modular_exp failed", rc);
+        return;
+    }
+
+    memset(&results, 0, sizeof(pka_results_t));
+    init_operand(&results.results[0], &res_buf[0], MAX_BUF, 0);
+    start = time(NULL);
+    while (FAILURE == pka_get_result(args->handle, &results))
+    {
+        rc = poll(&pfd, 1, RESULT_TIMEOUT_SEC * 1000);
+        if (rc != 1 || time(NULL) - start > RESULT_TIMEOUT_SEC)
+        {
+            ApiTestFailed(args, __func__, "completion fd not signalled", rc);
+            return;
+        }
+    }
+
+    if (results.status != RC_NO_ERROR ||
+            pki_compare(&results.results[0], test_operands[34]) !=
+                RC_COMPARE_EQUAL)
+    {
+        ApiTestFailed(args, __func__, "wrong result", results.status);
+        return;
+    }
+
+    args->tests_passed++;
+}
+
+// Wait for the result of a modular exponentiation with pka_wait_result().
+void TestPkaWaitResult(thread_args_t *args)
+{
+    pka_wait_stats_t stats;
+    pka_results_t    results;
+    uint8_t          res_buf[MAX_BUF];
+    int              rc;
+
+    memset(&results, 0, sizeof(pka_results_t));
+    init_operand(&results.results[0], &res_buf[0], MAX_BUF, 0);
+
+    rc = pka_wait_result(args->handle, &results, PKA_WAIT_FOREVER, NULL);
+    if (rc != -ENOENT)
+    {
+        ApiTestFailed(args, __func__, "no outstanding command", rc);
+        return;
+    }
+
+    rc = MOD_EXP(args->handle, args->user_data, test_operands[15],
+                 test_operands[19], test_operands[16]);
+    if (rc != RC_NO_ERROR)
+    {
+        ApiTestFailed(args, __func__, "pka_modular_exp failed", rc);
+        return;
+    }
+
+    // The exponentiation takes far longer than a single poll.
+    rc = pka_wait_result(args->handle, &results, 0, NULL);
+    if (rc != -ETIMEDOUT)
+    {
+        ApiTestFailed(args, __func__, "no timeout", rc);
+        return;
+    }
+
+    memset(&stats, 0, sizeof(pka_wait_stats_t));
+    rc = pka_wait_result(args->handle, &results,
+                         RESULT_TIMEOUT_SEC * 1000000, &stats);
+    if (rc || results.status != RC_NO_ERROR ||
+            pki_compare(&results.results[0], test_operands[34]) !=
+                RC_COMPARE_EQUAL)
+    {
+        ApiTestFailed(args, __func__, "wrong result", rc);
+        return;
+    }
+
+    if (stats.spin_ns + stats.yield_ns + stats.sleep_ns == 0)
+    {
+        ApiTestFailed(args, __func__, "no wait accounted", rc);
+        return;
+    }
+
+    rc = pka_wait_result(args->handle, NULL, 0, NULL);
+    if (rc != -EINVAL)
+    {
+        ApiTestFailed(args, __func__, "NULL results accepted", rc);
+        return;
+    }
+
+    args->tests_passed++;
+}
+
+// Fill the HW rings, then submit a command with a deadline behind the queued
+// ones and cancel the last command queued before it. The former must expire
+// and the latter must be withdrawn, while the other commands complete.
+void TestPkaDeadlineCancel(thread_args_t *args)
+{
+    pka_result_code_t status[FILL_CMDS_MAX], correct;
+    pka_result_code_t canceled_status;
+    uint32_t          cmd_cnt, canceled_idx, deadline_idx, idx;
+    bool              filled;
+    int               rc;
+
+    filled = FillRings(args, test_operands[15], test_operands[19], 2,
+                       &cmd_cnt);
+    if (!filled || cmd_cnt == FILL_CMDS_MAX)
+    {
+        // The rings might not fill up without synchronization, see
+        // FillRings(). Commands which completed cannot be canceled.
+        if (!GetFillResults(args, __func__, cmd_cnt, status))
+            return;
+
+        rc = pka_cancel(args->handle, (void *) (uintptr_t) 0);
+        if (rc != -ENOENT)
+        {
+            ApiTestFailed(args, __func__, "completed command canceled", rc);
+            return;
+        }
+
+        args->tests_passed++;
+        return;
+    }
+
+    canceled_idx = cmd_cnt - 1;
+    deadline_idx = cmd_cnt;
+
+    rc = pka_set_timeout(args->handle, 1);
+    if (rc)
+    {
+        ApiTestFailed(args, __func__, "pka_set_timeout failed", rc);
+        return;
+    }
+
+    rc = MOD_EXP(args->handle, (void *) (uintptr_t) deadline_idx,
+                 test_operands[15], test_operands[19], test_operands[16]);
+    pka_set_timeout(args->handle, PKA_WAIT_FOREVER);
+    if (rc != RC_NO_ERROR)
+    {
+        ApiTestFailed(args, __func__, "pka_modular_exp failed", rc);
+        return;
+    }
+
+    cmd_cnt += 1;
+
+    // The progress thread might have appended the command to a ring
+    // meanwhile.
+    canceled_status = RC_CANCELED;
+    rc = pka_cancel(args->handle, (void *) (uintptr_t) canceled_idx);
+    if (rc == -ENOENT && (gbl_args->app.sync & PKA_F_PROGRESS_THREAD))
+        canceled_status = RC_NO_ERROR;
+    else if (rc != 1)
+    {
+        ApiTestFailed(args, __func__, "pka_cancel failed", rc);
+        return;
+    }
+
+    if (!GetFillResults(args, __func__, cmd_cnt, status))
+        return;
+
+    for (idx = 0; idx < cmd_cnt; idx++)
+    {
+        correct = RC_NO_ERROR;
+        if (idx == deadline_idx)
+            correct = RC_TIMEOUT;
+        else if (idx == canceled_idx)
+            correct = canceled_status;
+
+        if (status[idx] != correct)
+        {
+            ApiTestFailed(args, __func__, "wrong status", status[idx]);
+            return;
+        }
+    }
+
+    rc = pka_cancel(args->handle, (void *) (uintptr_t) canceled_idx);
+    if (rc != -ENOENT)
+    {
+        ApiTestFailed(args, __func__, "completed command canceled", rc);
+        return;
+    }
+
+    args->tests_passed++;
+}
+
+// Check the load snapshot of a filled instance, then acquire all credits of
+// the instance and check that they are accounted for, refused once exhausted
+// and given back either explicitly or once the result of the command which
+// consumed them is returned.
+void TestPkaLoadCredits(thread_args_t *args)
+{
+    pka_results_t results;
+    pka_load_t    load;
+    uint32_t      cmd_cnt, credits;
+    uint8_t       res_buf[MAX_BUF];
+    bool          filled;
+    int           rc;
+
+    rc = pka_get_load(args->instance, NULL);
+    if (rc != -EINVAL)
+    {
+        ApiTestFailed(args, __func__, "NULL load accepted", rc);
+        return;
+    }
+
+    filled = FillRings(args, test_operands[15], test_operands[19], 2,
+                       &cmd_cnt);
+    rc     = pka_get_load(args->instance, &load);
+    if (rc)
+    {
+        ApiTestFailed(args, __func__, "pka_get_load failed", rc);
+        return;
+    }
+
+    if (load.rings_cnt != pka_get_rings_count(args->instance))
+    {
+        ApiTestFailed(args, __func__, "wrong rings count", load.rings_cnt);
+        return;
+    }
+
+    if (filled && (!load.queued_cmds || !load.queued_bytes ||
+                       load.queued_bytes > load.queues_size || !load.drain_ns))
+    {
+        ApiTestFailed(args, __func__, "wrong load", load.queued_cmds);
+        return;
+    }
+
+    // Only the snapshot matters here, not the results of the commands.
+    DrainResults(args);
+    if (pka_request_count(args->handle))
+    {
+        ApiTestFailed(args, __func__, "missing result",
+                      pka_request_count(args->handle));
+        return;
+    }
+
+    // Credits belong to a single thread.
+    if (gbl_args->app.shared)
+    {
+        rc = pka_acquire_credits(args->handle, 1);
+        if (rc != -EPERM)
+        {
+            ApiTestFailed(args, __func__, "shared handle accepted", rc);
+            if (!rc)
+                pka_release_credits(args->handle, 1);
+            return;
+        }
+
+        args->tests_passed++;
+        return;
+    }
+
+    // All credits are granted to an instance without rings.
+    credits = load.credits;
+    if (!credits)
+    {
+        if (load.rings_cnt)
+            ApiTestFailed(args, __func__, "no credits", 0);
+        else
+            args->tests_passed++;
+        return;
+    }
+
+    rc = pka_acquire_credits(args->handle, credits);
+    if (rc)
+    {
+        ApiTestFailed(args, __func__, "pka_acquire_credits failed", rc);
+        return;
+    }
+
+    rc = pka_acquire_credits(args->handle, 1);
+    if (rc != -EAGAIN)
+    {
+        ApiTestFailed(args, __func__, "credits overcommitted", rc);
+        pka_release_credits(args->handle, credits);
+        return;
+    }
+
+    pka_get_load(args->instance, &load);
+    if (load.credits)
+    {
+        ApiTestFailed(args, __func__, "credits left", load.credits);
+        pka_release_credits(args->handle, credits);
+        return;
+    }
+
+    rc = pka_release_credits(args->handle, credits + 1);
+    if (rc != -EINVAL)
+    {
+        ApiTestFailed(args, __func__, "credits not held released", rc);
+        pka_release_credits(args->handle, credits);
+        return;
+    }
+
+    // Keep a single credit, for the next command.
+    rc = pka_release_credits(args->handle, credits - 1);
+    if (rc)
+    {
+        ApiTestFailed(args, __func__, "pka_release_credits failed", rc);
+        pka_release_credits(args->handle, credits);
+        return;
+    }
+
+    rc = pka_add(args->handle, NULL, test_operands[1], test_operands[1]);
+    if (rc)
+    {
+        ApiTestFailed(args, __func__, "pka_add failed", rc);
+        pka_release_credits(args->handle, 1);
+        return;
+    }
+
+    memset(&results, 0, sizeof(pka_results_t));
+    init_operand(&results.results[0], &res_buf[0], MAX_BUF, 0);
+    if (GetResult(args->handle, &results) != SUCCESS ||
+            results.status != RC_NO_ERROR ||
+            pki_compare(&results.results[0], test_operands[2]) !=
+                RC_COMPARE_EQUAL)
+    {
+        ApiTestFailed(args, __func__, "wrong result", results.status);
+        return;
+    }
+
+    // The command consumed the credit, which went back to the instance
+    // with its result.
+    pka_get_load(args->instance, &load);
+    if (load.credits != credits)
+    {
+        ApiTestFailed(args, __func__, "credit not returned", load.credits);
+        return;
+    }
+
+    rc = pka_release_credits(args->handle, 1);
+    if (rc != -EINVAL)
+    {
+        ApiTestFailed(args, __func__, "consumed credit released", rc);
+        return;
+    }
+
+    args->tests_passed++;
+}
+
+// Return the commands of the instance served to the HW rings: those of the
+// worker of the handle, plus those other workers stole from the SW queues in
+// lane mode.
+static uint64_t ServedCmds(thread_args_t *args, uint32_t worker_id)
+{
+    pka_worker_stats_t stats;
+    uint64_t           served_cmds;
+    uint32_t           idx;
+
+    pka_get_worker_stats(args->instance, worker_id, &stats);
+    served_cmds = stats.served_cmds;
+    if (!(gbl_args->app.lane & PKA_F_LANE_MODE))
+        return served_cmds;
+
+    for (idx = 0; !pka_get_worker_stats(args->instance, idx, &stats); idx++)
+        served_cmds += stats.stolen_cmds;
+
+    return served_cmds;
+}
+
+// Check the weights the handle accepts, find the worker of the handle from
+// its weight, then submit commands until some wait in the SW queues and check
+// that the commands served from the SW queues are accounted to the worker.
+void TestPkaWeight(thread_args_t *args)
+{
+    pka_worker_stats_t stats;
+    pka_load_t         load;
+    uint64_t           served_cmds;
+    uint32_t           cmd_cnt, worker_id;
+    bool               queued;
+    int                rc;
+
+    rc = pka_set_weight(args->handle, 0);
+    if (rc != -EINVAL)
+    {
+        ApiTestFailed(args, __func__, "null weight accepted", rc);
+        return;
+    }
+
+    rc = pka_set_weight(args->handle, PKA_WEIGHT_MAX + 1);
+    if (rc != -EINVAL)
+    {
+        ApiTestFailed(args, __func__, "weight too large accepted", rc);
+        return;
+    }
+
+    rc = pka_set_weight(args->handle, PKA_WEIGHT_MAX);
+    if (rc)
+    {
+        ApiTestFailed(args, __func__, "pka_set_weight failed", rc);
+        return;
+    }
+
+    // The other handles keep the default weight.
+    for (worker_id = 0; ; worker_id++)
+    {
+        rc = pka_get_worker_stats(args->instance, worker_id, &stats);
+        if (rc || stats.weight == PKA_WEIGHT_MAX)
+            break;
+    }
+
+    if (rc)
+    {
+        ApiTestFailed(args, __func__, "weight not reported", rc);
+        pka_set_weight(args->handle, 1);
+        return;
+    }
+
+    rc = pka_get_worker_stats(args->instance, UINT32_MAX, &stats);
+    if (rc != -EINVAL)
+    {
+        ApiTestFailed(args, __func__, "unknown worker accepted", rc);
+        pka_set_weight(args->handle, 1);
+        return;
+    }
+
+    rc = pka_get_worker_stats(args->instance, worker_id, NULL);
+    if (rc != -EINVAL)
+    {
+        ApiTestFailed(args, __func__, "NULL stats accepted", rc);
+        pka_set_weight(args->handle, 1);
+        return;
+    }
+
+    // The commands only wait in the SW queues once the HW rings are full.
+    // Without synchronization, a command might be refused instead.
+    served_cmds = ServedCmds(args, worker_id);
+    queued      = false;
+    for (cmd_cnt = 0; cmd_cnt < FILL_CMDS_MAX && !queued; cmd_cnt++)
+    {
+        if (MOD_EXP(args->handle, NULL, test_operands[15], test_operands[19],
+                    test_operands[16]) != RC_NO_ERROR)
+            break;
+
+        queued = !pka_get_load(args->instance, &load) && load.queued_cmds;
+    }
+
+    // Serve the SW queues until every command completed.
+    DrainResults(args);
+    if (pka_request_count(args->handle))
+    {
+        ApiTestFailed(args, __func__, "missing result",
+                      pka_request_count(args->handle));
+        pka_set_weight(args->handle, 1);
+        return;
+    }
+
+    if (queued && ServedCmds(args, worker_id) <= served_cmds)
+    {
+        ApiTestFailed(args, __func__, "queued commands not served",
+                      served_cmds);
+        pka_set_weight(args->handle, 1);
+        return;
+    }
+
+    if (ServedCmds(args, worker_id) - served_cmds > cmd_cnt)
+    {
+        ApiTestFailed(args, __func__, "commands served twice", cmd_cnt);
+        pka_set_weight(args->handle, 1);
+        return;
+    }
+
+    pka_get_worker_stats(args->instance, worker_id, &stats);
+    if (queued && stats.served_cmds && !stats.max_delay_ns)
+    {
+        ApiTestFailed(args, __func__, "no delay accounted", 0);
+        pka_set_weight(args->handle, 1);
+        return;
+    }
+
+    pka_set_weight(args->handle, 1);
+    args->tests_passed++;
+}
+
+// Write the data of 'src' at the buffer of the reserved operand 'dst', in
+// the byte order of the rings.
+static void WriteReservedOperand(pka_operand_t *dst,
+                                 pka_operand_t *src,
+                                 uint8_t        big_endian)
+{
+    uint32_t idx;
+
+    if (src->big_endian == big_endian)
+    {
+        memcpy(dst->buf_ptr, src->buf_ptr, src->actual_len);
+        return;
+    }
+
+    for (idx = 0; idx < src->actual_len; idx++)
+        dst->buf_ptr[idx] = src->buf_ptr[src->actual_len - 1 - idx];
+}
+
+// Reserve an addition, check that the handle submits nothing else while the
+// command is reserved and that the command is not issued before its commit,
+// then commit it and check its result. Aborted commands and commands with a
+// leading zero byte must be dropped.
+void TestPkaReserveCommit(thread_args_t *args)
+{
+    pka_batch_cmd_t  cmd;
+    pka_operand_t    operands[2];
+    pka_results_t    results;
+    uint8_t          res_buf[MAX_BUF];
+    uint8_t          big_endian;
+    int              rc;
+
+    big_endian  = pka_get_rings_byte_order(args->handle);
+    operands[0] = *test_operands[16];
+    operands[1] = *test_operands[1];
+    rc          = pka_reserve_cmd(args->handle, (void *) 1, CC_ADD, operands,
+                                  2, 0);
+
+    // Reserved commands belong to a single thread.
+    if (gbl_args->app.shared)
+    {
+        if (rc != -EPERM)
+        {
+            ApiTestFailed(args, __func__, "shared handle accepted", rc);
+            if (!rc)
+                pka_abort_cmd(args->handle);
+            return;
+        }
+
+        args->tests_passed++;
+        return;
+    }
+    if (rc == -ENODEV && !pka_get_rings_count(args->instance))
+    {
+        // Reserved commands are only processed by the HW rings.
+        args->tests_passed++;
+        return;
+    }
+
+    if (rc)
+    {
+        ApiTestFailed(args, __func__, "pka_reserve_cmd failed", rc);
+        return;
+    }
+
+    rc = pka_reserve_cmd(args->handle, (void *) 2, CC_ADD, operands, 2, 0);
+    if (rc != -EBUSY)
+    {
+        ApiTestFailed(args, __func__, "second command reserved", rc);
+        pka_abort_cmd(args->handle);
+        return;
+    }
+
+    rc = pka_add(args->handle, (void *) 3, test_operands[1],
+                 test_operands[1]);
+    if (!rc)
+    {
+        ApiTestFailed(args, __func__, "command submitted while reserved",
+                      rc);
+        pka_abort_cmd(args->handle);
+        return;
+    }
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.opcode  = CC_ADD;
+    cmd.args[0] = test_operands[1];
+    cmd.args[1] = test_operands[1];
+    rc = pka_submit_batch(args->handle, &cmd, 1);
+    if (rc != -EBUSY)
+    {
+        ApiTestFailed(args, __func__, "batch submitted while reserved", rc);
+        pka_abort_cmd(args->handle);
+        return;
+    }
+
+    WriteReservedOperand(&operands[0], test_operands[16], big_endian);
+    WriteReservedOperand(&operands[1], test_operands[1], big_endian);
+
+    // The command is not issued before its commit.
+    memset(&results, 0, sizeof(pka_results_t));
+    init_operand(&results.results[0], &res_buf[0], MAX_BUF, 0);
+    if (pka_request_count(args->handle) ||
+            pka_get_result(args->handle, &results) == SUCCESS)
+    {
+        ApiTestFailed(args, __func__, "reserved command issued", 0);
+        pka_abort_cmd(args->handle);
+        return;
+    }
+
+    rc = pka_commit_cmd(args->handle);
+    if (rc)
+    {
+        ApiTestFailed(args, __func__, "pka_commit_cmd failed", rc);
+        return;
+    }
+
+    if (GetResult(args->handle, &results) != SUCCESS ||
+            results.user_data != (void *) 1 ||
+            results.status != RC_NO_ERROR ||
+            pki_compare(&results.results[0], test_operands[30]) !=
+                RC_COMPARE_EQUAL)
+    {
+        ApiTestFailed(args, __func__, "wrong result", results.status);
+        return;
+    }
+
+    rc = pka_commit_cmd(args->handle);
+    if (rc != -ENOENT)
+    {
+        ApiTestFailed(args, __func__, "command committed twice", rc);
+        return;
+    }
+
+    // An aborted command is never issued.
+    operands[0] = *test_operands[16];
+    operands[1] = *test_operands[1];
+    rc          = pka_reserve_cmd(args->handle, (void *) 4, CC_ADD, operands,
+                                  2, 0);
+    if (rc)
+    {
+        ApiTestFailed(args, __func__, "pka_reserve_cmd failed", rc);
+        return;
+    }
+
+    rc = pka_abort_cmd(args->handle);
+    if (rc || pka_request_count(args->handle))
+    {
+        ApiTestFailed(args, __func__, "pka_abort_cmd failed", rc);
+        return;
+    }
+
+    rc = pka_abort_cmd(args->handle);
+    if (rc != -ENOENT)
+    {
+        ApiTestFailed(args, __func__, "command aborted twice", rc);
+        return;
+    }
+
+    // A command with a leading zero byte is dropped on commit.
+    operands[0] = *test_operands[16];
+    operands[1] = *test_operands[1];
+    rc          = pka_reserve_cmd(args->handle, (void *) 5, CC_ADD, operands,
+                                  2, 0);
+    if (rc)
+    {
+        ApiTestFailed(args, __func__, "pka_reserve_cmd failed", rc);
+        return;
+    }
+
+    WriteReservedOperand(&operands[0], test_operands[16], big_endian);
+    WriteReservedOperand(&operands[1], test_operands[1], big_endian);
+    operands[0].buf_ptr[big_endian ? 0 : operands[0].actual_len - 1] = 0;
+    rc = pka_commit_cmd(args->handle);
+    if (rc != -EINVAL || pka_request_count(args->handle))
+    {
+        ApiTestFailed(args, __func__, "leading zero byte accepted", rc);
+        return;
+    }
+
+    rc = pka_commit_cmd(args->handle);
+    if (rc != -ENOENT)
+    {
+        ApiTestFailed(args, __func__, "dropped command committed", rc);
+        return;
+    }
+
+    args->tests_passed++;
+}
+
+// State of the threads of the shared handle test.
+typedef struct
+{
+    thread_args_t   *args;
+    pthread_mutex_t  lock;
+    bool             done[SHARED_THREADS * SHARED_CMDS];
+    const char      *failure;
+    int              rc;
+} shared_test_t;
+
+typedef struct
+{
+    shared_test_t *test;
+    uint32_t       thread_idx;
+} shared_thread_t;
+
+static void SharedTestFailed(shared_test_t *test, const char *what, int rc)
+{
+    pthread_mutex_lock(&test->lock);
+    if (!test->failure)
+    {
+        test->failure = what;
+        test->rc      = rc;
+    }
+    pthread_mutex_unlock(&test->lock);
+}
+
+// Submit additions with the shared handle, then retrieve as many results -
+// of any thread - and check them against their user data.
+static void *SharedHandleThread(void *arg)
+{
+    shared_thread_t *thread = (shared_thread_t *) arg;
+    shared_test_t   *test   = thread->test;
+    pka_handle_t     handle = test->args->handle;
+    pka_operand_t   *value, *correct;
+    pka_results_t    results;
+    uint32_t         idx, cmd_idx;
+    uint8_t          res_buf[MAX_BUF];
+    bool             dup;
+    int              rc;
+
+    // Odd commands add 1 to 3, even ones 1 to 1.
+    for (idx = 0; idx < SHARED_CMDS; idx++)
+    {
+        cmd_idx = thread->thread_idx * SHARED_CMDS + idx;
+        value   = (cmd_idx & 1) ? test_operands[3] : test_operands[1];
+        rc      = pka_add(handle, (void *) (uintptr_t) cmd_idx, value,
+                          test_operands[1]);
+        if (rc)
+        {
+            SharedTestFailed(test, "pka_add failed", rc);
+            return NULL;
+        }
+    }
+
+    for (idx = 0; idx < SHARED_CMDS; idx++)
+    {
+        memset(&results, 0, sizeof(pka_results_t));
+        init_operand(&results.results[0], &res_buf[0], MAX_BUF, 0);
+        if (GetResult(handle, &results) != SUCCESS)
+        {
+            SharedTestFailed(test, "missing result", idx);
+            return NULL;
+        }
+
+        cmd_idx = (uintptr_t) results.user_data;
+        if (cmd_idx >= SHARED_THREADS * SHARED_CMDS)
+        {
+            SharedTestFailed(test, "unknown user data", cmd_idx);
+            return NULL;
+        }
+
+        correct = (cmd_idx & 1) ? test_operands[4] : test_operands[2];
+        if (results.status != RC_NO_ERROR ||
+                pki_compare(&results.results[0], correct) !=
+                    RC_COMPARE_EQUAL)
+        {
+            SharedTestFailed(test, "wrong result", results.status);
+            return NULL;
+        }
+
+        pthread_mutex_lock(&test->lock);
+        dup                 = test->done[cmd_idx];
+        test->done[cmd_idx] = true;
+        pthread_mutex_unlock(&test->lock);
+        if (dup)
+        {
+            SharedTestFailed(test, "duplicate result", cmd_idx);
+            return NULL;
+        }
+    }
+
+    return NULL;
+}
+
+// Have several threads submit commands with the same handle at once and
+// retrieve the results of each other. Each command must complete exactly
+// once, with the result matching its user data.
+void TestPkaSharedHandle(thread_args_t *args)
+{
+    shared_thread_t threads[SHARED_THREADS];
+    pthread_t       thread_tbl[SHARED_THREADS];
+    shared_test_t   test;
+    uint32_t        idx, started;
+
+    memset(&test, 0, sizeof(shared_test_t));
+    test.args = args;
+    pthread_mutex_init(&test.lock, NULL);
+
+    for (started = 0; started < SHARED_THREADS; started++)
+    {
+        threads[started].test       = &test;
+        threads[started].thread_idx = started;
+        if (pthread_create(&thread_tbl[started], NULL, SharedHandleThread,
+                           &threads[started]))
+            break;
+    }
+
+    for (idx = 0; idx < started; idx++)
+        pthread_join(thread_tbl[idx], NULL);
+
+    pthread_mutex_destroy(&test.lock);
+
+    if (started < SHARED_THREADS)
+    {
+        ApiTestFailed(args, __func__, "pthread_create failed", started);
+        return;
+    }
+
+    if (test.failure)
+    {
+        ApiTestFailed(args, __func__, test.failure, test.rc);
+        return;
+    }
+
+    if (pka_request_count(args->handle))
+    {
+        ApiTestFailed(args, __func__, "requests left",
+                      pka_request_count(args->handle));
+        return;
+    }
+
+    args->tests_passed++;
+}
+
+// Check that the dispatch cost model sends the commands down the path its
+// parameters select, as counted by the dispatch statistics: the HW rings
+// when the CPU path is disabled, the CPU when it costs nothing - unless the
+// instance may not use it, or the operands are secret - and the CPU as well
+// when the instance has no ring.
+void TestPkaDispatch(thread_args_t *args)
+{
+    pka_dispatch_params_t saved, params;
+    pka_dispatch_stats_t  before, after;
+    bool                  cpu;
+    int                   rc;
+
+    rc = pka_set_dispatch_params(args->instance, NULL);
+    if (rc != -EINVAL)
+    {
+        ApiTestFailed(args, __func__, "NULL params accepted", rc);
+        return;
+    }
+
+    rc = pka_get_dispatch_params(args->instance, &saved);
+    if (rc)
+    {
+        ApiTestFailed(args, __func__, "pka_get_dispatch_params failed", rc);
+        return;
+    }
+
+    // Without rings, every command is processed on the CPU.
+    if (!pka_get_rings_count(args->instance))
+    {
+        pka_get_dispatch_stats(args->instance, &before);
+        if (!SingleAdd(args->handle, NULL))
+        {
+            ApiTestFailed(args, __func__, "wrong result", 0);
+            return;
+        }
+
+        pka_get_dispatch_stats(args->instance, &after);
+        if (after.spilled_cmds != before.spilled_cmds + 1)
+            ApiTestFailed(args, __func__, "command not spilled",
+                          after.spilled_cmds - before.spilled_cmds);
+        else
+            args->tests_passed++;
+        return;
+    }
+
+    params               = saved;
+    params.max_cpu_units = 0;
+    pka_set_dispatch_params(args->instance, &params);
+    pka_get_dispatch_stats(args->instance, &before);
+    if (!SingleAdd(args->handle, NULL))
+    {
+        ApiTestFailed(args, __func__, "wrong result", 0);
+        goto exit;
+    }
+
+    pka_get_dispatch_stats(args->instance, &after);
+    if (after.hw_cmds != before.hw_cmds + 1 ||
+            after.cpu_cmds != before.cpu_cmds)
+    {
+        ApiTestFailed(args, __func__, "CPU path not disabled",
+                      after.cpu_cmds - before.cpu_cmds);
+        goto exit;
+    }
+
+    // The HW rings now seem to take a second per command.
+    params.hw_base_ns     = 1000000000;
+    params.hw_unit_ps     = 0;
+    params.cpu_base_ns    = 0;
+    params.cpu_unit_ps    = 0;
+    params.max_cpu_units  = UINT32_MAX;
+    params.hw_autotune    = 0;
+    params.cpu_secret_ops = 0;
+    pka_set_dispatch_params(args->instance, &params);
+    pka_get_dispatch_stats(args->instance, &before);
+    if (!SingleAdd(args->handle, NULL))
+    {
+        ApiTestFailed(args, __func__, "wrong result", 0);
+        goto exit;
+    }
+
+    pka_get_dispatch_stats(args->instance, &after);
+    cpu = gbl_args->app.fallback;
+    if (after.cpu_cmds != before.cpu_cmds + cpu ||
+            after.hw_cmds != before.hw_cmds + !cpu)
+    {
+        ApiTestFailed(args, __func__, "CPU path not taken",
+                      after.cpu_cmds - before.cpu_cmds);
+        goto exit;
+    }
+
+    // The exponent of a modular exponentiation of more than 32 bits is
+    // deemed secret.
+    pka_get_dispatch_stats(args->instance, &before);
+    rc = MOD_EXP(args->handle, args->user_data, test_operands[15],
+                 test_operands[19], test_operands[16]);
+    if (rc != RC_NO_ERROR)
+    {
+        ApiTestFailed(args, __func__, "pka_modular_exp failed", rc);
+        goto exit;
+    }
+
+    DrainResults(args);
+    pka_get_dispatch_stats(args->instance, &after);
+    if (after.hw_cmds != before.hw_cmds + 1 ||
+            after.cpu_cmds != before.cpu_cmds)
+    {
+        ApiTestFailed(args, __func__, "secret operands on the CPU",
+                      after.cpu_cmds - before.cpu_cmds);
+        goto exit;
+    }
+
+    args->tests_passed++;
+
+exit:
+    pka_set_dispatch_params(args->instance, &saved);
+}
+
+// Submit batches of modular exponentiations, whose operands take more window
+// RAM than a small command may, until some wait in the SW command queues -
+// i.e. until the window RAM of the rings is full - then a batch of additions
+// which are small commands. As the rings drain, an addition fits the window
+// RAM freed by an exponentiation before another exponentiation does, and
+// goes past the exponentiations. Check the blocked and bypass counters of
+// the dispatch statistics. With many rings, an exponentiation may find the
+// window RAM it needs on another ring as soon as one drains, so that nothing
+// is blocked - the rings are filled again a few times before failing.
+void TestPkaBypass(thread_args_t *args)
+{
+    pka_dispatch_stats_t before, after;
+    pka_batch_cmd_t      cmds[PKA_MAX_BATCH_CNT];
+    pka_results_t        results;
+    pka_load_t           load;
+    uint32_t             idx, batch_cnt, attempt;
+    uint8_t              res_buf[2][MAX_BUF];
+    int                  rc;
+
+    // Without synchronization, a command no ring has window RAM for is
+    // refused rather than queued, and a progress thread or a lane serves the
+    // SW command queues on its own. Without rings, nothing is queued, and
+    // batches are neither for shared handles nor kept from the CPU with a
+    // fallback.
+    if (gbl_args->app.sync != PKA_F_SYNC_MODE_ENABLE ||
+            gbl_args->app.shared || gbl_args->app.fallback ||
+            gbl_args->app.lane || !pka_get_rings_count(args->instance))
+    {
+        args->tests_passed++;
+        return;
+    }
+
+    // High priority commands have a SW queue of their own, whatever their
+    // size. The largest weight keeps the deficit round robin from holding
+    // back the exponentiations - see pka_set_weight().
+    pka_set_priority(args->handle, PKA_PRIORITY_NORMAL);
+    pka_set_weight(args->handle, PKA_WEIGHT_MAX);
+    pka_get_dispatch_stats(args->instance, &before);
+
+    memset(cmds, 0, sizeof(cmds));
+    for (attempt = 0; attempt < BYPASS_ATTEMPTS; attempt++)
+    {
+        for (idx = 0; idx < PKA_MAX_BATCH_CNT; idx++)
+        {
+            cmds[idx].opcode  = CC_MODULAR_EXP;
+            cmds[idx].args[0] = test_operands[24];
+            cmds[idx].args[1] = test_operands[23];
+            cmds[idx].args[2] = test_operands[24];
+        }
+
+        // The results are retrieved between the batches, so that they do
+        // not overflow the SW result queue while the rings are filled.
+        for (batch_cnt = 0; batch_cnt < BYPASS_BATCHES_MAX; batch_cnt++)
+        {
+            rc = pka_submit_batch(args->handle, cmds, PKA_MAX_BATCH_CNT);
+            pka_get_load(args->instance, &load);
+            if (rc <= 0 || load.queued_cmds)
+                break;
+
+            do
+            {
+                memset(&results, 0, sizeof(pka_results_t));
+                init_operand(&results.results[0], &res_buf[0][0], MAX_BUF, 0);
+                init_operand(&results.results[1], &res_buf[1][0], MAX_BUF, 0);
+            } while (pka_get_result(args->handle, &results) == SUCCESS);
+        }
+
+        if (rc > 0 && load.queued_cmds)
+        {
+            for (idx = 0; idx < PKA_MAX_BATCH_CNT; idx++)
+            {
+                cmds[idx].opcode  = CC_ADD;
+                cmds[idx].args[0] = test_operands[24];
+                cmds[idx].args[1] = test_operands[24];
+            }
+
+            rc = pka_submit_batch(args->handle, cmds, PKA_MAX_BATCH_CNT);
+        }
+
+        DrainResults(args);
+        pka_get_dispatch_stats(args->instance, &after);
+        if (rc <= 0 || !load.queued_cmds || pka_request_count(args->handle))
+            break;
+
+        if (after.blocked_cmds != before.blocked_cmds &&
+                after.bypass_cmds != before.bypass_cmds)
+            break;
+    }
+
+    pka_set_weight(args->handle, 1);
+    if (gbl_args->app.priority)
+        pka_set_priority(args->handle, PKA_PRIORITY_HIGH);
+
+    if (rc <= 0 || !load.queued_cmds)
+    {
+        ApiTestFailed(args, __func__, "rings not filled", rc);
+        return;
+    }
+
+    if (pka_request_count(args->handle))
+    {
+        ApiTestFailed(args, __func__, "missing result",
+                      pka_request_count(args->handle));
+        return;
+    }
+
+    if (after.blocked_cmds == before.blocked_cmds ||
+            after.bypass_cmds == before.bypass_cmds)
+    {
+        ApiTestFailed(args, __func__, "no command went past",
+                      after.bypass_cmds - before.bypass_cmds);
+        return;
+    }
+
+    args->tests_passed++;
+}
+
+// State of the thread contending for the lock in the handoff test.
+typedef struct
+{
+    thread_args_t *args;
+    volatile bool  stop;
+    const char    *failure;
+    int            rc;
+} handoff_test_t;
+
+// Submit additions with a handle of our own, one at a time, until told to
+// stop. The handle has a completion fd, so that an owner of the lock whose
+// budget is spent hands our requests off rather than keeping them.
+static void *HandoffThread(void *arg)
+{
+    handoff_test_t *test = (handoff_test_t *) arg;
+    pka_handle_t    handle;
+    int             rc;
+
+    handle = pka_init_local(test->args->instance);
+    if (handle == PKA_HANDLE_INVALID)
+    {
+        test->failure = "pka_init_local failed";
+        return NULL;
+    }
+
+    rc = pka_get_result_fd(handle);
+    if (rc < 0)
+    {
+        test->failure = "pka_get_result_fd failed";
+        test->rc      = rc;
+    }
+
+    while (!test->failure && !test->stop)
+    {
+        if (!SingleAdd(handle, test))
+            test->failure = "missing result";
+    }
+
+    pka_term_local(handle);
+    return NULL;
+}
+
+// Submit additions while another thread does as well, with the owner budget
+// 'max_cmds', until an owner of the lock hands requests off or HANDOFF_CMDS
+// additions are done. Returns the number of handoffs, or -1 on failure.
+static int64_t HandoffRun(thread_args_t *args, uint32_t max_cmds)
+{
+    pka_lock_stats_t before, after;
+    handoff_test_t   test;
+    pthread_t        thread;
+    uint32_t         cmd_cnt;
+    bool             added;
+
+    memset(&test, 0, sizeof(handoff_test_t));
+    test.args = args;
+
+    pka_set_owner_budget(args->instance, max_cmds, 0);
+    pka_get_lock_stats(args->instance, &before);
+    if (pthread_create(&thread, NULL, HandoffThread, &test))
+    {
+        pka_set_owner_budget(args->instance, gbl_args->app.budget, 0);
+        ApiTestFailed(args, __func__, "pthread_create failed", 0);
+        return -1;
+    }
+
+    after = before;
+    added = true;
+    for (cmd_cnt = 0; cmd_cnt < HANDOFF_CMDS && added; cmd_cnt++)
+    {
+        added = SingleAdd(args->handle, args->user_data);
+        pka_get_lock_stats(args->instance, &after);
+        if (after.handoffs != before.handoffs)
+            break;
+    }
+
+    test.stop = true;
+    pthread_join(thread, NULL);
+    pka_set_owner_budget(args->instance, gbl_args->app.budget, 0);
+
+    if (!added || test.failure)
+    {
+        ApiTestFailed(args, __func__, added ? test.failure : "missing result",
+                      test.rc);
+        return -1;
+    }
+
+    return after.handoffs - before.handoffs;
+}
+
+// Have another handle contend for the lock while we submit commands. With a
+// budget of a command per acquisition, an owner which appends a command of
+// the other handle from the SW queues must hand its request off, as counted
+// by the lock statistics. Without a budget, no owner ever does. The test
+// runs on an instance of its own, see SlotTestRun().
+void TestPkaHandoff(thread_args_t *args)
+{
+    pka_dispatch_params_t params;
+    int64_t               handoffs;
+
+    // Without synchronization, with a progress thread or with lanes, no
+    // owner appends the commands of the other handles. Without rings,
+    // nothing is appended, and the completion fd is for single processes.
+    if (gbl_args->app.sync != PKA_F_SYNC_MODE_ENABLE ||
+            gbl_args->app.lane ||
+            gbl_args->app.mode == PKA_F_PROCESS_MODE_MULTI ||
+            !pka_get_rings_count(args->instance))
+    {
+        args->tests_passed++;
+        return;
+    }
+
+    // The additions must go to the rings, rather than to the CPU.
+    pka_get_dispatch_params(args->instance, &params);
+    params.max_cpu_units = 0;
+    pka_set_dispatch_params(args->instance, &params);
+
+    handoffs = HandoffRun(args, 1);
+    if (handoffs < 0)
+        return;
+
+    if (!handoffs)
+    {
+        ApiTestFailed(args, __func__, "no handoff", HANDOFF_CMDS);
+        return;
+    }
+
+    handoffs = HandoffRun(args, 0);
+    if (handoffs < 0)
+        return;
+
+    if (handoffs)
+    {
+        ApiTestFailed(args, __func__, "handoff without budget", handoffs);
+        return;
+    }
+
+    args->tests_passed++;
+}
+
+// The API tests check state shared by the handles of the instance - e.g. the
+// credits - and are run by a single thread.
+void ApiTestAll(thread_args_t *args)
+{
+    RUN_API_TEST(args, TestPkaSubmitBatch);
+    RUN_API_TEST(args, TestPkaGetResults);
+    RUN_API_TEST(args, TestPkaSetResultBufs);
+    RUN_API_TEST(args, TestPkaRegisterOperand);
+    RUN_API_TEST(args, TestPkaGetResultFd);
+    RUN_API_TEST(args, TestPkaWaitResult);
+    RUN_API_TEST(args, TestPkaDeadlineCancel);
+    RUN_API_TEST(args, TestPkaLoadCredits);
+    RUN_API_TEST(args, TestPkaWeight);
+    RUN_API_TEST(args, TestPkaReserveCommit);
+    RUN_API_TEST(args, TestPkaDispatch);
+    RUN_API_TEST(args, TestPkaBypass);
+    if (gbl_args->app.shared)
+        RUN_API_TEST(args, TestPkaSharedHandle);
+}
+
+// Return the weight of the handle of the given index, 0 if it is not valid.
+// A handle taking an index starts with a weight of 1.
+static uint32_t SlotWeight(pka_instance_t instance, uint32_t worker_id)
+{
+    pka_worker_stats_t stats;
+
+    if (pka_get_worker_stats(instance, worker_id, &stats))
+        return 0;
+
+    return stats.weight;
+}
+
+// Open a handle taking the index of the handle terminated with commands in
+// flight, index 0. The index is only given back once the results of those
+// commands are dropped, so 'driver' retrieves results meanwhile to have them
+// arrive.
+static pka_handle_t SlotReuse(thread_args_t *args, pka_handle_t driver)
+{
+    pka_results_t results;
+    pka_handle_t  handle;
+    uint8_t       res_buf[MAX_BUF];
+    time_t        start;
+
+    start = time(NULL);
+    while (time(NULL) - start <= RESULT_TIMEOUT_SEC)
+    {
+        handle = pka_init_local(args->instance);
+        if (handle == PKA_HANDLE_INVALID ||
+                SlotWeight(args->instance, 0) == 1)
+            return handle;
+
+        pka_term_local(handle);
+        memset(&results, 0, sizeof(pka_results_t));
+        init_operand(&results.results[0], &res_buf[0], MAX_BUF, 0);
+        pka_get_result(driver, &results);
+    }
+
+    return PKA_HANDLE_INVALID;
+}
+
+// Terminate a handle with commands in flight, and check that the handle
+// which takes its index gets neither their results nor wake ups of its
+// completion fd. Then open handles until the instance has none left, and
+// check that it has as many as it may have. The instance is the one of the
+// test, with SLOT_HANDLES_MAX queues and no other handle.
+void TestPkaSlots(thread_args_t *args)
+{
+    pka_handle_t  handles[SLOT_HANDLES_MAX + 1];
+    pka_handle_t  orphan;
+    pka_results_t results;
+    struct pollfd pfd;
+    uint32_t      handles_cnt, idx;
+    uint8_t       res_buf[MAX_BUF];
+    int           rc;
+
+    orphan = pka_init_local(args->instance);
+    if (orphan == PKA_HANDLE_INVALID)
+    {
+        ApiTestFailed(args, __func__, "pka_init_local failed", 0);
+        return;
+    }
+
+    // The weight tells whether a handle took the index of this one. The
+    // completion fd of the handle is closed when the handle is terminated,
+    // the results of its commands must not signal it anymore.
+    pka_set_weight(orphan, PKA_WEIGHT_MAX);
+    pka_get_result_fd(orphan);
+    for (idx = 0; idx < SLOT_CMDS; idx++)
+    {
+        rc = MOD_EXP(orphan, (void *) (uintptr_t) idx, test_operands[15],
+                     test_operands[19], test_operands[16]);
+        if (rc != RC_NO_ERROR)
+            break;
+    }
+
+    pka_term_local(orphan);
+    if (rc != RC_NO_ERROR)
+    {
+        ApiTestFailed(args, __func__, "pka_modular_exp failed", rc);
+        return;
+    }
+
+    handles_cnt = 0;
+    handles[handles_cnt] = pka_init_local(args->instance);
+    if (handles[handles_cnt] == PKA_HANDLE_INVALID)
+    {
+        ApiTestFailed(args, __func__, "pka_init_local failed", 0);
+        return;
+    }
+
+    handles_cnt++;
+    if (SlotWeight(args->instance, 0) != 1)
+    {
+        handles[handles_cnt] = SlotReuse(args, handles[0]);
+        if (handles[handles_cnt] == PKA_HANDLE_INVALID)
+        {
+            ApiTestFailed(args, __func__, "index not reused", 0);
+            goto exit;
+        }
+
+        handles_cnt++;
+    }
+
+    // The handle of index 0 is the last one opened. Retrieving a result
+    // moves those of the rings and clears their interrupts, which would
+    // otherwise signal the completion fd as well. Nothing is in flight then,
+    // so nothing may signal it.
+    memset(&results, 0, sizeof(pka_results_t));
+    init_operand(&results.results[0], &res_buf[0], MAX_BUF, 0);
+    if (pka_get_result(handles[handles_cnt - 1], &results) != FAILURE)
+    {
+        ApiTestFailed(args, __func__, "stale result", 0);
+        goto exit;
+    }
+
+    pfd.fd     = pka_get_result_fd(handles[handles_cnt - 1]);
+    pfd.events = POLLIN;
+    if (pfd.fd >= 0 && poll(&pfd, 1, 0))
+    {
+        ApiTestFailed(args, __func__, "completion fd signalled", pfd.fd);
+        goto exit;
+    }
+
+    if (!SingleAdd(handles[handles_cnt - 1], (void *) (uintptr_t) SLOT_CMDS))
+    {
+        ApiTestFailed(args, __func__, "stale result", 0);
+        goto exit;
+    }
+
+    if (pfd.fd >= 0 && poll(&pfd, 1, 0))
+    {
+        ApiTestFailed(args, __func__, "completion fd left signalled", pfd.fd);
+        goto exit;
+    }
+
+    while (handles_cnt <= SLOT_HANDLES_MAX)
+    {
+        handles[handles_cnt] = pka_init_local(args->instance);
+        if (handles[handles_cnt] == PKA_HANDLE_INVALID)
+            break;
+
+        handles_cnt++;
+    }
+
+    if (handles_cnt != SLOT_HANDLES_MAX)
+    {
+        ApiTestFailed(args, __func__, "wrong handle limit", handles_cnt);
+        goto exit;
+    }
+
+    // The last index is a valid one.
+    if (!SingleAdd(handles[handles_cnt - 1],
+                   (void *) (uintptr_t) SLOT_HANDLES_MAX))
+    {
+        ApiTestFailed(args, __func__, "last handle failed", 0);
+        goto exit;
+    }
+
+    args->tests_passed++;
+
+exit:
+    for (idx = 0; idx < handles_cnt; idx++)
+    {
+        args->handle = handles[idx];
+        DrainResults(args);
+        pka_term_local(handles[idx]);
+    }
+}
+
+// Run the slot and handoff tests on an instance of their own: the instance
+// of the other tests has a handle per thread. The instance is created with
+// the arguments of the other one - the rings of which are free by now.
+static void SlotTestRun(const char *name,
+                        uint32_t    flags,
+                        uint8_t     rings_num,
+                        uint32_t    cmd_queue_sz,
+                        uint32_t    rslt_queue_sz)
+{
+    thread_args_t args;
+
+    memset(&args, 0, sizeof(thread_args_t));
+    args.instance = pka_init_global(name, flags, rings_num, SLOT_HANDLES_MAX,
+                                    cmd_queue_sz, rslt_queue_sz);
+    if (args.instance == PKA_INSTANCE_INVALID)
+    {
+        ApiTestFailed(&args, "TestPkaSlots", "failed to init global", 0);
+    }
+    else
+    {
+        TestPkaSlots(&args);
+
+        args.handle = pka_init_local(args.instance);
+        if (args.handle == PKA_HANDLE_INVALID)
+        {
+            ApiTestFailed(&args, "TestPkaHandoff", "pka_init_local failed",
+                          0);
+        }
+        else
+        {
+            TestPkaHandoff(&args);
+            pka_term_local(args.handle);
+        }
+
+        pka_term_global(args.instance);
+    }
+
+    printf("%s done\n\t"
+           "tests_passed=%u \n\t"
+           "tests_failed=%u \n", __func__, args.tests_passed,
+           args.tests_failed);
+
+    validation_tests_passed += args.tests_passed;
+    validation_tests_failed += args.tests_failed;
+    validation_tests_total   =
+            validation_tests_passed + validation_tests_failed;
+}
+
+#ifdef PKA_LIB_SIM
+// Window RAM layout of the simulated rings - see the PKA_SIM_* environment
+// variables in README.
+typedef struct
+{
+    const char *split;      ///< PKA_SIM_SPLIT_WINDOW_RAM.
+    const char *data_mem;   ///< PKA_SIM_DATA_MEM.
+    const char *descs;      ///< PKA_SIM_RING_DESCS.
+    uint32_t    mem_size;   ///< window RAM bytes for the operands.
+    uint32_t    descs_cnt;  ///< descriptors of each ring.
+} ring_layout_t;
+
+// Layouts the tests run over besides the default one: rings deeper than 64
+// descriptors next to the smallest data memory, a partition of the window
+// RAM in between, and split window RAM mode.
+static const ring_layout_t ring_layouts[] =
+{
+    { "0", "4096", "96",  4096, 96 },
+    { "0", "8192", "32",  8192, 32 },
+    { "1", NULL,   NULL, 14336, 16 },
+};
+
+// Set an environment variable, or unset it if 'value' is NULL.
+static void SetEnv(const char *name, const char *value)
+{
+    if (value)
+        setenv(name, value, 1);
+    else
+        unsetenv(name);
+}
+
+// Check that every ring of the instance is idle, with the descriptors and
+// window RAM of the layout.
+static bool RingsIdle(thread_args_t       *args,
+                      const char          *test_fcn_name,
+                      const ring_layout_t *layout)
+{
+    pka_load_t load;
+    uint32_t   idx;
+
+    pka_get_load(args->instance, &load);
+    for (idx = 0; idx < load.rings_cnt; idx++)
+    {
+        if (load.rings[idx].free_descs != layout->descs_cnt ||
+                load.rings[idx].free_mem != layout->mem_size ||
+                load.rings[idx].pending_cmds)
+        {
+            ApiTestFailed(args, test_fcn_name, "ring not idle",
+                          load.rings[idx].ring_id);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Run commands over a window RAM layout of the simulated rings: bursts of
+// additions, which go through the descriptors of the rings several times,
+// then modular exponentiations until the window RAM is full. Every result
+// must be right, and the rings must give back all of their descriptors and
+// window RAM.
+static void TestPkaRingLayout(thread_args_t *args, const ring_layout_t *layout)
+{
+    pka_dispatch_params_t params;
+    pka_result_code_t     status[FILL_CMDS_MAX];
+    pka_results_t         results;
+    uint32_t              cmd_cnt, idx, cmd_idx;
+    uint8_t               res_buf[MAX_BUF];
+    bool                  done[LAYOUT_BURST];
+
+    if (!pka_get_rings_count(args->instance))
+    {
+        args->tests_passed++;
+        return;
+    }
+
+    if (!RingsIdle(args, __func__, layout))
+        return;
+
+    // The commands must go to the rings, rather than to the CPU.
+    pka_get_dispatch_params(args->instance, &params);
+    params.max_cpu_units = 0;
+    pka_set_dispatch_params(args->instance, &params);
+
+    for (cmd_cnt = 0; cmd_cnt < LAYOUT_CMDS; cmd_cnt += LAYOUT_BURST)
+    {
+        for (idx = 0; idx < LAYOUT_BURST; idx++)
+        {
+            if (pka_add(args->handle, (void *) (uintptr_t) idx,
+                        test_operands[1], test_operands[1]))
+                break;
+        }
+
+        memset(done, 0, sizeof(done));
+        for (cmd_idx = idx; cmd_idx; cmd_idx--)
+        {
+            memset(&results, 0, sizeof(pka_results_t));
+            init_operand(&results.results[0], &res_buf[0], MAX_BUF, 0);
+            if (GetResult(args->handle, &results) != SUCCESS)
+            {
+                ApiTestFailed(args, __func__, "missing result", cmd_cnt);
+                return;
+            }
+
+            if ((uintptr_t) results.user_data >= idx ||
+                    done[(uintptr_t) results.user_data] ||
+                    results.status != RC_NO_ERROR ||
+                    pki_compare(&results.results[0], test_operands[2]) !=
+                        RC_COMPARE_EQUAL)
+            {
+                ApiTestFailed(args, __func__, "wrong result", cmd_cnt);
+                return;
+            }
+
+            done[(uintptr_t) results.user_data] = true;
+        }
+    }
+
+    FillRings(args, test_operands[15], test_operands[19], 2, &cmd_cnt);
+    if (!GetFillResults(args, __func__, cmd_cnt, status))
+        return;
+
+    for (idx = 0; idx < cmd_cnt; idx++)
+    {
+        if (status[idx] != RC_NO_ERROR)
+        {
+            ApiTestFailed(args, __func__, "command failed", status[idx]);
+            return;
+        }
+    }
+
+    if (RingsIdle(args, __func__, layout))
+        args->tests_passed++;
+}
+
+// Run the ring layout test over each layout, on an instance of its own,
+// created with the arguments of the instance of the other tests. The layout
+// is read from the environment when the instance maps its rings.
+static void LayoutTestRun(const char *name,
+                          uint32_t    flags,
+                          uint8_t     rings_num,
+                          uint32_t    cmd_queue_sz,
+                          uint32_t    rslt_queue_sz)
+{
+    const ring_layout_t *layout;
+    thread_args_t        args;
+    uint32_t             idx;
+
+    memset(&args, 0, sizeof(thread_args_t));
+    for (idx = 0; idx < PKA_DIM(ring_layouts); idx++)
+    {
+        layout = &ring_layouts[idx];
+        SetEnv("PKA_SIM_SPLIT_WINDOW_RAM", layout->split);
+        SetEnv("PKA_SIM_DATA_MEM", layout->data_mem);
+        SetEnv("PKA_SIM_RING_DESCS", layout->descs);
+
+        args.instance = pka_init_global(name, flags, rings_num, 1,
+                                        cmd_queue_sz, rslt_queue_sz);
+        if (args.instance == PKA_INSTANCE_INVALID)
+        {
+            ApiTestFailed(&args, "TestPkaRingLayout",
+                          "failed to init global", idx);
+            continue;
+        }
+
+        args.handle = pka_init_local(args.instance);
+        if (args.handle == PKA_HANDLE_INVALID)
+        {
+            ApiTestFailed(&args, "TestPkaRingLayout",
+                          "pka_init_local failed", idx);
+        }
+        else
+        {
+            TestPkaRingLayout(&args, layout);
+            DrainResults(&args);
+            pka_term_local(args.handle);
+        }
+
+        pka_term_global(args.instance);
+    }
+
+    SetEnv("PKA_SIM_SPLIT_WINDOW_RAM", NULL);
+    SetEnv("PKA_SIM_DATA_MEM", NULL);
+    SetEnv("PKA_SIM_RING_DESCS", NULL);
+
+    printf("%s done\n\t"
+           "tests_passed=%u \n\t"
+           "tests_failed=%u \n", __func__, args.tests_passed,
+           args.tests_failed);
+
+    validation_tests_passed += args.tests_passed;
+    validation_tests_failed += args.tests_failed;
+    validation_tests_total   =
+            validation_tests_passed + validation_tests_failed;
+}
+#endif
+
+// Return the commands the workers of the instance stole from the SW queues
+// of other workers - see PKA_F_LANE_MODE.
+static uint64_t StolenCmds(thread_args_t *args)
+{
+    pka_worker_stats_t stats;
+    uint64_t           stolen_cmds;
+    uint32_t           idx;
+
+    stolen_cmds = 0;
+    for (idx = 0; !pka_get_worker_stats(args->instance, idx, &stats); idx++)
+        stolen_cmds += stats.stolen_cmds;
+
+    return stolen_cmds;
+}
+
+// Return whether each thread has a lane of rings, and may steal the commands
+// of the other ones.
+static bool LaneStealEnabled(thread_args_t *args)
+{
+    return gbl_args->app.lane && gbl_args->app.sync == PKA_F_SYNC_MODE_ENABLE &&
+                !gbl_args->app.shared && threads_cnt > 1 &&
+                pka_get_rings_count(args->instance) >= threads_cnt;
+}
+
+// Run by all threads at once. Thread 0 submits commands until they overflow
+// its lane to its SW queues and the other threads - whose SW queues are empty
+// - steal some of them, then collects its results. The other threads
+// meanwhile poll their handle, which steals the commands and moves their
+// results, while thread 0 moves the results of the stolen commands from the
+// lanes of the other threads as well.
+void LaneStealTest(thread_args_t *args)
+{
+    pka_results_t results;
+    uint64_t      stolen_cmds;
+    uint32_t      cmd_cnt, idx, cmd_idx;
+    uint8_t       res_buf[MAX_BUF];
+    time_t        start;
+    bool          done[FILL_CMDS_MAX];
+
+    lane_test_done = false;
+    pka_barrier_wait(&lane_barrier);
+
+    if (args->id)
+    {
+        // Our commands are all completed, any result is another one's.
+        memset(&results, 0, sizeof(pka_results_t));
+        init_operand(&results.results[0], &res_buf[0], MAX_BUF, 0);
+        while (!lane_test_done)
+        {
+            if (pka_get_result(args->handle, &results) == SUCCESS)
+            {
+                ApiTestFailed(args, __func__, "unexpected result",
+                              results.status);
+                break;
+            }
+        }
+
+        pka_barrier_wait(&lane_barrier);
+        if (!pka_request_count(args->handle))
+            args->tests_passed++;
+        else
+            ApiTestFailed(args, __func__, "requests left",
+                          pka_request_count(args->handle));
+        return;
+    }
+
+    stolen_cmds = StolenCmds(args);
+    for (cmd_cnt = 0; cmd_cnt < FILL_CMDS_MAX; cmd_cnt++)
+    {
+        if (StolenCmds(args) != stolen_cmds ||
+                MOD_EXP(args->handle, (void *) (uintptr_t) cmd_cnt,
+                        test_operands[15], test_operands[19],
+                        test_operands[16]) != RC_NO_ERROR)
+            break;
+    }
+
+    // Stay away from the handle, only the other threads may serve the
+    // commands left in the SW queues.
+    start = time(NULL);
+    while (StolenCmds(args) == stolen_cmds &&
+                time(NULL) - start <= RESULT_TIMEOUT_SEC)
+        sched_yield();
+
+    // Each command must complete once, stolen or not.
+    memset(done, 0, sizeof(done));
+    for (idx = 0; idx < cmd_cnt; idx++)
+    {
+        memset(&results, 0, sizeof(pka_results_t));
+        init_operand(&results.results[0], &res_buf[0], MAX_BUF, 0);
+        if (GetResult(args->handle, &results) != SUCCESS)
+        {
+            ApiTestFailed(args, __func__, "missing result", idx);
+            break;
+        }
+
+        cmd_idx = (uintptr_t) results.user_data;
+        if (cmd_idx >= cmd_cnt || done[cmd_idx] ||
+                results.status != RC_NO_ERROR ||
+                pki_compare(&results.results[0], test_operands[34]) !=
+                    RC_COMPARE_EQUAL)
+        {
+            ApiTestFailed(args, __func__, "wrong result", cmd_idx);
+            break;
+        }
+
+        done[cmd_idx] = true;
+    }
+
+    if (idx == cmd_cnt)
+    {
+        if (StolenCmds(args) == stolen_cmds)
+            ApiTestFailed(args, __func__, "no command stolen", cmd_cnt);
+        else
+            args->tests_passed++;
+    }
+
+    DrainResults(args);
+    lane_test_done = true;
+    pka_mb_full();
+    pka_barrier_wait(&lane_barrier);
+}
+
+static void *thread_start_routine(void *arg)
+{
+    pka_handle_t   pka_hdl;
+    thread_args_t *thread_args;
+    uint32_t       thread_idx, cpu_num;
+
+    thread_args = (thread_args_t *) arg;
+    thread_idx  =  thread_args->id;
+    cpu_num     =  thread_args->cpu_num;
+
+    thread_args->user_data = arg;
+
+    thread_args->ticks = 50;
+    thread_args->seed  = 1000 * thread_idx + 10 * cpu_num + 1;
+
+    thread_args->tests_failed = 0;
+    thread_args->tests_passed = 0;
+
+    printf("Starting thread_idx=%u on cpu_num=%u\n", thread_idx, cpu_num);
+    fflush(NULL);
+
+    pka_barrier_wait(&startup_barrier);
+
+    // Init PK local execution context.
+    pka_hdl = pka_init_local(thread_args->instance);
+    if (pka_hdl == PKA_HANDLE_INVALID)
+    {
+        printf("failed to init local\n");
+        return NULL;
+    }
+
+    // Even threads submit high priority commands when a ring is reserved
+    // for them.
+    if (gbl_args->app.priority && !(thread_idx & 1))
+        pka_set_priority(pka_hdl, PKA_PRIORITY_HIGH);
+
+    // Set thread handle
+    thread_args->handle = pka_hdl;
+
+    // Do some stuff here
+    //while (gbl_args->exit_threads)
+        SingleThreadTestAll(thread_args);
+
+    if (LaneStealEnabled(thread_args))
+        LaneStealTest(thread_args);
+
+    // The API tests fill the rings and withdraw queued commands, which the
+    // commands of the other threads would disturb.
+    pka_barrier_wait(&api_barrier);
+    if (thread_idx == 0)
+        ApiTestAll(thread_args);
+
+    pka_barrier_wait(&ending_barrier);
+
+    pka_term_local(thread_args->handle);
+    //printf("thread %d - term local\n", thread_idx);
+
+    // wait for print_thread_idx to be equal to my thread_idx + 1.
+    while (print_thread_idx != (thread_idx + 1))
+            pka_wait();
+
+    // Summary;
+    printf("%s thread_idx=%u cpu_num=%u done\n\t", __func__,
+               thread_idx, cpu_num);
+    printf("tests_passed=%u \n\t"
+           "tests_failed=%u \n\t"
+           "total_tests=%u  \n",
+           thread_args->tests_passed,
+           thread_args->tests_failed,
+           thread_args->tests_passed + thread_args->tests_failed);
+    fflush(NULL);
+
+    // The threads print in turn, so the totals are updated by one thread
+    // at a time.
+    validation_tests_passed += thread_args->tests_passed;
+    validation_tests_failed += thread_args->tests_failed;
+    validation_tests_total   =
+            validation_tests_passed + validation_tests_failed;
+
+    // Signal the next thread to print its counters.
+    print_thread_idx += 1;
+    pka_mb_full();
+
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    app_args_t      *app_args;
+    static pthread_t thread_tbl[MAX_THREADS];
+    thread_args_t   *thread_args;
+    pthread_attr_t   attr;
+    cpu_set_t        cpu_set;
+    pka_instance_t   pka_instance;
+    uint32_t         cpu_num, worker_idx, cmd_queue_sz, rslt_queue_sz;
+    uint32_t         flags, cpus_num;
+    uint8_t          rings_num, workers_num;
+
+    int ret = 0;
+
+    gbl_args = calloc(1, sizeof(args_t));
+    if (gbl_args == NULL) {
+        printf("gbl_args mem alloc failed.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Parse and store the instance arguments
+    ParseArgs(argc, argv, &gbl_args->app);
+
+    // Default to system CPU count unless user specified
+    workers_num = MAX_THREADS;
+    if (gbl_args->app.cpu_count <= MAX_THREADS)
+        workers_num = gbl_args->app.cpu_count;
+
+    threads_cnt = workers_num;
+
+    // Threads beyond the CPUs online share them, rather than fail to start.
+    cpus_num = MIN(gbl_args->app.cpu_count, sysconf(_SC_NPROCESSORS_ONLN));
+
+    // Init PKA before calling anything else
+    app_args      = &gbl_args->app;
+    flags         = app_args->mode | app_args->sync | app_args->policy |
+                        app_args->priority | app_args->lane |
+                        app_args->fallback | app_args->shared;
+    rings_num     = app_args->ring_count;
+    cmd_queue_sz  = PKA_MAX_OBJS * PKA_CMD_DESC_MAX_DATA_SIZE;
+    rslt_queue_sz = PKA_MAX_OBJS * PKA_RSLT_DESC_MAX_DATA_SIZE;
+    pka_instance = pka_init_global(NO_PATH(argv[0]), flags, rings_num,
+                            workers_num, cmd_queue_sz,
+                            rslt_queue_sz);
+    if (pka_instance == PKA_INSTANCE_INVALID)
+    {
+        printf("failed to init global\n");
+        return ret;
+    }
+
+    gbl_args->app.instance = pka_instance;
+    pka_set_owner_budget(pka_instance, app_args->budget, 0);
+
+    // Print both system and instance information
+    PrintInfo(NO_PATH(argv[0]), &gbl_args->app);
+
+    // Init test parameters
+    TestInit();
+
+    printf("num worker threads: %i\n", workers_num);
+
+    // Create and init worker threads
+    pka_barrier_init(&startup_barrier, workers_num);
+    pka_barrier_init(&lane_barrier, workers_num);
+    pka_barrier_init(&api_barrier, workers_num);
+    memset(thread_tbl, 0, sizeof(thread_tbl));
+    for (worker_idx = 0; worker_idx < workers_num; worker_idx++)
+    {
+        thread_args  = &gbl_args->thread[worker_idx];
+        cpu_num      = worker_idx % cpus_num;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(cpu_num, &cpu_set);
+        pthread_attr_init(&attr);
+        pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpu_set);
+
+        // Create threads one-by-one instead of all-at-once,
+        // because each thread might get different arguments.
+        // Calls pthread_create() for each thread
+        thread_args->cpu_num  = cpu_num;
+        thread_args->id       = worker_idx;
+        thread_args->instance = pka_instance;
+        pthread_create(&thread_tbl[worker_idx], &attr,
+                               thread_start_routine, (void *) thread_args);
+    }
+
+    // Sleep during test and then signal threads to quit.
+    pka_barrier_init(&ending_barrier, workers_num);
+    //sleep(inst->time);
+    //global_quit = TRUE;
 
     // Now command each thread in turn to dump its stats.
     print_thread_idx = 1;
@@ -1596,6 +3957,16 @@ int main(int argc, char *argv[])
 
     sleep(1);
 
+    // Remove PK global
+    pka_term_global(app_args->instance);
+
+    SlotTestRun(NO_PATH(argv[0]), flags, rings_num, cmd_queue_sz,
+                rslt_queue_sz);
+#ifdef PKA_LIB_SIM
+    LayoutTestRun(NO_PATH(argv[0]), flags, rings_num, cmd_queue_sz,
+                  rslt_queue_sz);
+#endif
+
     if (validation_tests_total &&
             (validation_tests_total == validation_tests_passed))
         printf("validation tests passed!\n");
@@ -1608,9 +3979,6 @@ int main(int argc, char *argv[])
                validation_tests_passed,
                validation_tests_total);
 
-    // Remove PK global
-    pka_term_global(app_args->instance);
-
     return 0;
 }
 
@@ -1626,15 +3994,22 @@ static void ParseArgs(int argc, char *argv[], app_args_t *app_args)
         {"time",  required_argument, NULL, 't'},
         {"mode",  required_argument, NULL, 'm'},  // return 'm'
         {"sync", required_argument, NULL, 's'},   // return 's'
+        {"policy", required_argument, NULL, 'p'}, // return 'p'
+        {"priority", required_argument, NULL, 'P'}, // return 'P'
+        {"budget", required_argument, NULL, 'b'}, // return 'b'
+        {"lane", required_argument, NULL, 'l'},   // return 'l'
+        {"fallback", required_argument, NULL, 'f'}, // return 'f'
+        {"shared", required_argument, NULL, 'H'}, // return 'H'
         {"help",  no_argument,       NULL, 'h'},  // return 'h'
         {NULL, 0, NULL, 0}
     };
 
-    static const char *shortopts = "c:r:t:m:s:h";
+    static const char *shortopts = "c:r:t:m:s:p:P:b:l:f:H:h";
 
-    app_args->mode = PKA_F_PROCESS_MODE_SINGLE;
-    app_args->sync = PKA_F_SYNC_MODE_ENABLE;
-    app_args->time = 5; ///< 0: loop forever
+    app_args->mode   = PKA_F_PROCESS_MODE_SINGLE;
+    app_args->sync   = PKA_F_SYNC_MODE_ENABLE;
+    app_args->policy = PKA_F_RING_POLICY_MOST_FREE;
+    app_args->time   = 5; ///< 0: loop forever
 
     opterr = 0; // do not issue errors on helper options
 
@@ -1681,6 +4056,82 @@ static void ParseArgs(int argc, char *argv[], app_args_t *app_args)
             case 1:
                 app_args->sync = PKA_F_SYNC_MODE_ENABLE;
                 break;
+            case 2:
+                app_args->sync = PKA_F_SYNC_MODE_ENABLE |
+                                    PKA_F_PROGRESS_THREAD;
+                break;
+            default:
+                Usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'p':
+            i = atoi(optarg);
+            if (i < 0 || (i << 8) > PKA_F_RING_POLICY_SHIM_LOCAL)
+            {
+                Usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            app_args->policy = i << 8;
+            break;
+        case 'P':
+            i = atoi(optarg);
+            switch (i)
+            {
+            case 0:
+                app_args->priority = 0;
+                break;
+            case 1:
+                app_args->priority = PKA_F_PRIORITY_RING;
+                break;
+            default:
+                Usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'b':
+            app_args->budget = atoi(optarg);
+            break;
+        case 'l':
+            i = atoi(optarg);
+            switch (i)
+            {
+            case 0:
+                app_args->lane = 0;
+                break;
+            case 1:
+                app_args->lane = PKA_F_LANE_MODE;
+                break;
+            default:
+                Usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'f':
+            i = atoi(optarg);
+            switch (i)
+            {
+            case 0:
+                app_args->fallback = 0;
+                break;
+            case 1:
+                app_args->fallback = PKA_F_SOFT_FALLBACK;
+                break;
+            default:
+                Usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'H':
+            i = atoi(optarg);
+            switch (i)
+            {
+            case 0:
+                app_args->shared = 0;
+                break;
+            case 1:
+                app_args->shared = PKA_F_SHARED_HANDLES;
+                break;
             default:
                 Usage(argv[0]);
                 exit(EXIT_FAILURE);
@@ -1746,6 +4197,9 @@ static void PrintInfo(char *progname, app_args_t *app_args)
     case PKA_F_SYNC_MODE_ENABLE:
         PRINT_APPL_MODE(PKA_F_SYNC_MODE_ENABLE);
         break;
+    case PKA_F_SYNC_MODE_ENABLE | PKA_F_PROGRESS_THREAD:
+        PRINT_APPL_MODE(PKA_F_PROGRESS_THREAD);
+        break;
     }
     printf("\n\n");
     fflush(NULL);
@@ -1773,6 +4227,30 @@ static void Usage(char *progname)
                                    "operations\n"
            "                        0: none of operations are lock-free\n"
            "                        1: all operations are lock-free (default)\n"
+           "                        2: a progress thread owns the rings\n"
+           "  -p, --policy <digit> Ring selection policy\n"
+           "                        0: most free descriptors (default)\n"
+           "                        1: least outstanding work\n"
+           "                        2: window RAM best fit\n"
+           "                        3: round robin with opcode affinity\n"
+           "                        4: shim local\n"
+           "  -P, --priority <digit> Command priorities\n"
+           "                        0: normal priority only (default)\n"
+           "                        1: even threads use high priority and a\n"
+           "                           reserved ring\n"
+           "  -b, --budget <number> Commands appended by the lock owner per\n"
+           "                        acquisition, 0: unbounded (default)\n"
+           "  -l, --lane <digit>   Lanes of rings per thread\n"
+           "                        0: all rings are shared (default)\n"
+           "                        1: each thread owns a lane of rings\n"
+           "  -f, --fallback <digit> Software fallback\n"
+           "                        0: commands only run on HW rings "
+                                   "(default)\n"
+           "                        1: commands may run on the CPU\n"
+           "  -H, --shared <digit> Shared handles\n"
+           "                        0: each handle has a single thread "
+                                   "(default)\n"
+           "                        1: threads may share a handle\n"
            "  -h, --help           Display help and exit.\n"
            "\n", NO_PATH(progname), NO_PATH(progname)
         );